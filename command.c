@@ -1066,6 +1066,28 @@ bool command_get_status(command_t *cmd, const char* arg)
    return true;
 }
 
+#ifdef HAVE_NETWORKING
+bool command_get_netplay_stats(command_t *cmd, const char* arg)
+{
+   size_t _len;
+   char reply[4096];
+   netplay_telemetry_report_t report;
+
+   _len        = strlcpy(reply, "GET_NETPLAY_STATS ", sizeof(reply));
+   report.s    = reply + _len;
+   report.len  = sizeof(reply) - _len - 1;
+   if (netplay_driver_ctl(RARCH_NETPLAY_CTL_GET_TELEMETRY, &report))
+      _len    += strlen(report.s);
+   else
+      _len    += strlcpy(reply + _len, "NONE", sizeof(reply) - _len);
+   reply[  _len] = '\n';
+   reply[++_len] = '\0';
+
+   cmd->replier(cmd, reply, _len);
+   return true;
+}
+#endif
+
 bool command_read_memory(command_t *cmd, const char *arg)
 {
    unsigned i;
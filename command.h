@@ -434,6 +434,9 @@ bool command_write_ram(command_t *cmd, const char *arg);
 bool command_read_memory(command_t *cmd, const char *arg);
 bool command_write_memory(command_t *cmd, const char *arg);
 bool command_load_core(command_t *cmd, const char* arg);
+#ifdef HAVE_NETWORKING
+bool command_get_netplay_stats(command_t *cmd, const char* arg);
+#endif
 
 static const struct cmd_action_map action_map[] = {
 #if defined(HAVE_CG) || defined(HAVE_GLSL) || defined(HAVE_SLANG) || defined(HAVE_HLSL)
@@ -460,6 +463,9 @@ static const struct cmd_action_map action_map[] = {
    { "LOAD_FILES", command_load_savefiles, "No argument"},
 
    { "LOAD_CORE", command_load_core, "<core path>"},
+#ifdef HAVE_NETWORKING
+   { "GET_NETPLAY_STATS", command_get_netplay_stats, "No argument"},
+#endif
 };
 
 static const struct cmd_map map[] = {
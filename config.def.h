@@ -1282,6 +1282,16 @@
  * depending on the save state buffer. */
 #define DEFAULT_REWIND_ENABLE false
 
+/* Store rewind states as deduplicated blocks instead of a ring of
+ * deltas. Holds far more states for cores whose memory changes
+ * sparsely. */
+#define DEFAULT_REWIND_DEDUP false
+
+/* Run each rewind delta through zstd, at a level that follows the
+ * time compression takes. Several times the rewind depth for cores
+ * whose state changes a lot each frame. */
+#define DEFAULT_REWIND_COMPRESS false
+
 /* When set, any time a cheat is toggled it is immediately applied. */
 #define DEFAULT_APPLY_CHEATS_AFTER_TOGGLE false
 
@@ -1306,6 +1316,16 @@
 #define DEFAULT_REWIND_GRANULARITY 1
 #endif
 
+/* Size of the scratch file that rewind history evicted from the
+ * rewind buffer moves to, 0 to drop it instead. The file lives in
+ * the cache directory and is only paged in when rewinding that far. */
+#define DEFAULT_REWIND_SPILL_SIZE 0
+
+/* Seconds of history to keep within the rewind buffer size, thinning
+ * out older captures as needed; 0 keeps every capture until the
+ * buffer is full. */
+#define DEFAULT_REWIND_SECONDS 0
+
 /* Pause gameplay when window loses focus. */
 #define DEFAULT_PAUSE_NONACTIVE true
 
@@ -1343,12 +1363,63 @@
 /* Allow players to pause */
 #define DEFAULT_NETPLAY_ALLOW_PAUSING false
 
-/* Default GekkoNet rollback parameters */
-#define DEFAULT_NETPLAY_LOCAL_DELAY 2
+/* Default GekkoNet rollback parameters. No local delay unless asked
+ * for; auto mode starts from it and raises it as the link requires. */
+#define DEFAULT_NETPLAY_LOCAL_DELAY 0
+/* Frames spectators are held behind the players, to ride out jitter */
+#define DEFAULT_NETPLAY_SPECTATOR_DELAY 2
 #define DEFAULT_NETPLAY_SPECTATOR_LIMIT 8
 #define DEFAULT_NETPLAY_PREDICTION_WINDOW 8
 #define DEFAULT_NETPLAY_DESYNC_HANDLING "auto"
 
+/* Receive packets on a dedicated thread */
+#define DEFAULT_NETPLAY_IO_THREAD false
+
+/* Pick the local delay from measured round trip time and jitter
+ * instead of using netplay_local_delay as-is */
+#define DEFAULT_NETPLAY_LOCAL_DELAY_AUTO false
+/* Rollback depth, in frames, the automatic delay aims to stay under */
+#define DEFAULT_NETPLAY_ROLLBACK_TARGET 2
+/* Frames between two automatic delay evaluations */
+#define DEFAULT_NETPLAY_DELAY_INTERVAL 60
+
+/* Local controller ports each peer sends as one player; player N
+ * then drives core ports N*ports to N*ports+ports-1 */
+#define DEFAULT_NETPLAY_INPUT_PORTS 1
+
+/* Write per-second netplay telemetry to a CSV file when the session
+ * ends, in the log directory */
+#define DEFAULT_NETPLAY_TELEMETRY_CSV false
+
+/* Saved frames whose per-block hashes are kept, so a desync can be
+ * narrowed down to the parts of the state that differ (0 = off).
+ * Every save is hashed in full while it is on, so it is a debugging
+ * aid rather than a default. */
+#define DEFAULT_NETPLAY_DESYNC_HISTORY 0
+
+/* Record every confirmed netplay frame into a replay next to the
+ * regular replays, playable without netplay */
+#define DEFAULT_NETPLAY_RECORD_REPLAY false
+
+/* Stream the host's state to peers joining a running session */
+#define DEFAULT_NETPLAY_LATE_JOIN true
+
+/* Watch through the relay in netplay_relay_server instead of joining
+ * the host's session */
+#define DEFAULT_NETPLAY_RELAY_SPECTATE false
+
+/* State checksum used for GekkoNet desync detection:
+ * "crc32", "xxh3", "crc32c" or "none". All peers must agree. */
+#define DEFAULT_NETPLAY_CHECKSUM_MODE "crc32"
+/* Hash every Nth frame only (1 = every frame) */
+#define DEFAULT_NETPLAY_CHECKSUM_INTERVAL 1
+/* Hash only a 256-byte sample of every N bytes of state (0 = all) */
+#define DEFAULT_NETPLAY_CHECKSUM_STRIDE 0
+/* Hash these core memory areas instead of the whole state, comma
+ * separated: "system_ram", "save_ram", "video_ram", "rtc". Empty,
+ * or none the core exposes, hashes the state. */
+#define DEFAULT_NETPLAY_CHECKSUM_REGIONS ""
+
 /* When being client over netplay, use keybinds for
  * user 1 rather than user 2. */
 #define DEFAULT_NETPLAY_CLIENT_SWAP_INPUT true
@@ -1456,6 +1527,13 @@
 /* When using the Run Ahead feature, use a secondary instance of the core. */
 #define DEFAULT_RUN_AHEAD_SECONDARY_INSTANCE true
 
+/* Run the secondary instance on its own thread while the real frame runs. */
+#define DEFAULT_RUN_AHEAD_SECONDARY_THREAD false
+
+/* Pick the Run Ahead / Preemptive Frames count from measured core timings,
+ * up to the configured count. */
+#define DEFAULT_RUN_AHEAD_AUTO false
+
 /* Hide warning messages when using the Run Ahead feature. */
 #define DEFAULT_RUN_AHEAD_HIDE_WARNINGS false
 
@@ -1608,6 +1608,8 @@ static struct config_array_setting *populate_settings_array(
 
 #ifdef HAVE_NETWORKING
    SETTING_ARRAY("netplay_desync_handling",      settings->arrays.netplay_desync_handling, true, DEFAULT_NETPLAY_DESYNC_HANDLING, true);
+   SETTING_ARRAY("netplay_checksum_mode",        settings->arrays.netplay_checksum_mode, true, DEFAULT_NETPLAY_CHECKSUM_MODE, true);
+   SETTING_ARRAY("netplay_checksum_regions",     settings->arrays.netplay_checksum_regions, true, DEFAULT_NETPLAY_CHECKSUM_REGIONS, true);
    SETTING_ARRAY("webdav_url",                   settings->arrays.webdav_url, false, NULL, true);
    SETTING_ARRAY("webdav_username",              settings->arrays.webdav_username, false, NULL, true);
    SETTING_ARRAY("webdav_password",              settings->arrays.webdav_password, false, NULL, true);
@@ -1712,6 +1714,7 @@ static struct config_path_setting *populate_settings_path(
 
 #ifdef HAVE_NETWORKING
    SETTING_PATH("netplay_ip_address",            settings->paths.netplay_server, false, NULL, true);
+   SETTING_PATH("netplay_relay_server",          settings->paths.netplay_relay_server, false, NULL, true);
    SETTING_PATH("netplay_nickname",              settings->paths.username, false, NULL, true);
    SETTING_PATH("netplay_password",              settings->paths.netplay_password, false, NULL, true);
    SETTING_PATH("netplay_spectate_password",     settings->paths.netplay_spectate_password, false, NULL, true);
@@ -1780,11 +1783,15 @@ static struct config_bool_setting *populate_settings_bool(
    SETTING_BOOL("apply_cheats_after_toggle",     &settings->bools.apply_cheats_after_toggle, true, DEFAULT_APPLY_CHEATS_AFTER_TOGGLE, false);
    SETTING_BOOL("apply_cheats_after_load",       &settings->bools.apply_cheats_after_load, true, DEFAULT_APPLY_CHEATS_AFTER_LOAD, false);
    SETTING_BOOL("rewind_enable",                 &settings->bools.rewind_enable, true, DEFAULT_REWIND_ENABLE, false);
+   SETTING_BOOL("rewind_dedup",                  &settings->bools.rewind_dedup, true, DEFAULT_REWIND_DEDUP, false);
+   SETTING_BOOL("rewind_compress",               &settings->bools.rewind_compress, true, DEFAULT_REWIND_COMPRESS, false);
    SETTING_BOOL("fastforward_frameskip",         &settings->bools.fastforward_frameskip, true, DEFAULT_FASTFORWARD_FRAMESKIP, false);
    SETTING_BOOL("vrr_runloop_enable",            &settings->bools.vrr_runloop_enable, true, DEFAULT_VRR_RUNLOOP_ENABLE, false);
    SETTING_BOOL("menu_throttle_framerate",       &settings->bools.menu_throttle_framerate, true, true, false);
    SETTING_BOOL("run_ahead_enabled",             &settings->bools.run_ahead_enabled, true, false, false);
    SETTING_BOOL("run_ahead_secondary_instance",  &settings->bools.run_ahead_secondary_instance, true, DEFAULT_RUN_AHEAD_SECONDARY_INSTANCE, false);
+   SETTING_BOOL("run_ahead_secondary_thread",    &settings->bools.run_ahead_secondary_thread, true, DEFAULT_RUN_AHEAD_SECONDARY_THREAD, false);
+   SETTING_BOOL("run_ahead_auto",                &settings->bools.run_ahead_auto, true, DEFAULT_RUN_AHEAD_AUTO, false);
    SETTING_BOOL("run_ahead_hide_warnings",       &settings->bools.run_ahead_hide_warnings, true, DEFAULT_RUN_AHEAD_HIDE_WARNINGS, false);
    SETTING_BOOL("preemptive_frames_enable",      &settings->bools.preemptive_frames_enable, true, false, false);
 #if HAVE_MENU
@@ -2233,6 +2240,12 @@ static struct config_bool_setting *populate_settings_bool(
    SETTING_BOOL("netplay_nat_traversal",         &settings->bools.netplay_nat_traversal, true, true, false);
    SETTING_BOOL("netplay_fade_chat",             &settings->bools.netplay_fade_chat, true, DEFAULT_NETPLAY_FADE_CHAT, false);
    SETTING_BOOL("netplay_allow_pausing",         &settings->bools.netplay_allow_pausing, true, DEFAULT_NETPLAY_ALLOW_PAUSING, false);
+   SETTING_BOOL("netplay_io_thread",             &settings->bools.netplay_io_thread, true, DEFAULT_NETPLAY_IO_THREAD, false);
+   SETTING_BOOL("netplay_telemetry_csv",         &settings->bools.netplay_telemetry_csv, true, DEFAULT_NETPLAY_TELEMETRY_CSV, false);
+   SETTING_BOOL("netplay_record_replay",         &settings->bools.netplay_record_replay, true, DEFAULT_NETPLAY_RECORD_REPLAY, false);
+   SETTING_BOOL("netplay_late_join",             &settings->bools.netplay_late_join, true, DEFAULT_NETPLAY_LATE_JOIN, false);
+   SETTING_BOOL("netplay_relay_spectate",        &settings->bools.netplay_relay_spectate, true, DEFAULT_NETPLAY_RELAY_SPECTATE, false);
+   SETTING_BOOL("netplay_local_delay_auto",      &settings->bools.netplay_local_delay_auto, true, DEFAULT_NETPLAY_LOCAL_DELAY_AUTO, false);
    SETTING_BOOL("netplay_request_device_p1",     &settings->bools.netplay_request_devices[0], true, false, false);
    SETTING_BOOL("netplay_request_device_p2",     &settings->bools.netplay_request_devices[1], true, false, false);
    SETTING_BOOL("netplay_request_device_p3",     &settings->bools.netplay_request_devices[2], true, false, false);
@@ -2407,6 +2420,7 @@ static struct config_uint_setting *populate_settings_uint(
    SETTING_UINT("core_updater_auto_backup_history_size", &settings->uints.core_updater_auto_backup_history_size, true, DEFAULT_CORE_UPDATER_AUTO_BACKUP_HISTORY_SIZE, false);
    SETTING_UINT("autosave_interval",             &settings->uints.autosave_interval,  true, DEFAULT_AUTOSAVE_INTERVAL, false);
    SETTING_UINT("rewind_granularity",            &settings->uints.rewind_granularity, true, DEFAULT_REWIND_GRANULARITY, false);
+   SETTING_UINT("rewind_seconds",                &settings->uints.rewind_seconds, true, DEFAULT_REWIND_SECONDS, false);
    SETTING_UINT("rewind_buffer_size_step",       &settings->uints.rewind_buffer_size_step, true, DEFAULT_REWIND_BUFFER_SIZE_STEP, false);
    SETTING_UINT("run_ahead_frames",              &settings->uints.run_ahead_frames, true, 1,  false);
    SETTING_UINT("replay_max_keep",               &settings->uints.replay_max_keep, true, DEFAULT_REPLAY_MAX_KEEP, false);
@@ -2605,8 +2619,15 @@ static struct config_uint_setting *populate_settings_uint(
    SETTING_UINT("netplay_chat_color_name",            &settings->uints.netplay_chat_color_name, true, DEFAULT_NETPLAY_CHAT_COLOR_NAME, false);
    SETTING_UINT("netplay_chat_color_msg",             &settings->uints.netplay_chat_color_msg, true, DEFAULT_NETPLAY_CHAT_COLOR_MSG, false);
    SETTING_UINT("netplay_local_delay",                &settings->uints.netplay_local_delay, true, DEFAULT_NETPLAY_LOCAL_DELAY, false);
+   SETTING_UINT("netplay_spectator_delay",            &settings->uints.netplay_spectator_delay, true, DEFAULT_NETPLAY_SPECTATOR_DELAY, false);
    SETTING_UINT("netplay_spectator_limit",            &settings->uints.netplay_spectator_limit, true, DEFAULT_NETPLAY_SPECTATOR_LIMIT, false);
    SETTING_UINT("netplay_prediction_window",          &settings->uints.netplay_prediction_window, true, DEFAULT_NETPLAY_PREDICTION_WINDOW, false);
+   SETTING_UINT("netplay_rollback_target",            &settings->uints.netplay_rollback_target, true, DEFAULT_NETPLAY_ROLLBACK_TARGET, false);
+   SETTING_UINT("netplay_delay_interval",             &settings->uints.netplay_delay_interval, true, DEFAULT_NETPLAY_DELAY_INTERVAL, false);
+   SETTING_UINT("netplay_input_ports",                &settings->uints.netplay_input_ports, true, DEFAULT_NETPLAY_INPUT_PORTS, false);
+   SETTING_UINT("netplay_desync_history",             &settings->uints.netplay_desync_history, true, DEFAULT_NETPLAY_DESYNC_HISTORY, false);
+   SETTING_UINT("netplay_checksum_interval",          &settings->uints.netplay_checksum_interval, true, DEFAULT_NETPLAY_CHECKSUM_INTERVAL, false);
+   SETTING_UINT("netplay_checksum_stride",            &settings->uints.netplay_checksum_stride, true, DEFAULT_NETPLAY_CHECKSUM_STRIDE, false);
    SETTING_UINT("netplay_share_digital",              &settings->uints.netplay_share_digital, true, DEFAULT_NETPLAY_SHARE_DIGITAL, false);
    SETTING_UINT("netplay_share_analog",               &settings->uints.netplay_share_analog,  true, DEFAULT_NETPLAY_SHARE_ANALOG, false);
 #endif
@@ -2685,6 +2706,7 @@ static struct config_size_setting *populate_settings_size(
       return NULL;
 
    SETTING_SIZE("rewind_buffer_size",            &settings->sizes.rewind_buffer_size, true, DEFAULT_REWIND_BUFFER_SIZE, false);
+   SETTING_SIZE("rewind_spill_size",             &settings->sizes.rewind_spill_size, true, DEFAULT_REWIND_SPILL_SIZE, false);
 
    *size = count;
 
@@ -2834,6 +2856,8 @@ void config_set_defaults(void *data)
    const char *def_record           = config_get_default_record();
    const char *def_midi             = config_get_default_midi();
    const char *def_desync           = DEFAULT_NETPLAY_DESYNC_HANDLING;
+   const char *def_checksum         = DEFAULT_NETPLAY_CHECKSUM_MODE;
+   const char *def_checksum_regions = DEFAULT_NETPLAY_CHECKSUM_REGIONS;
    struct video_viewport *custom_vp = &settings->video_vp_custom;
    struct config_float_setting      *float_settings = populate_settings_float (settings, &float_settings_size);
    struct config_bool_setting       *bool_settings  = populate_settings_bool  (settings, &bool_settings_size);
@@ -2962,6 +2986,14 @@ void config_set_defaults(void *data)
       configuration_set_string(settings,
             settings->arrays.netplay_desync_handling,
             def_desync);
+   if (def_checksum)
+      configuration_set_string(settings,
+            settings->arrays.netplay_checksum_mode,
+            def_checksum);
+   if (def_checksum_regions)
+      configuration_set_string(settings,
+            settings->arrays.netplay_checksum_regions,
+            def_checksum_regions);
 #ifdef HAVE_MENU
    if (def_menu)
       configuration_set_string(settings,
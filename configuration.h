@@ -101,6 +101,7 @@ typedef struct settings
    {
       size_t placeholder;
       size_t rewind_buffer_size;
+      size_t rewind_spill_size;
    } sizes;
 
    video_viewport_t video_vp_custom; /* int alignment */
@@ -221,8 +222,15 @@ typedef struct settings
       unsigned netplay_chat_color_name;
       unsigned netplay_chat_color_msg;
       unsigned netplay_local_delay;
+      unsigned netplay_spectator_delay;
       unsigned netplay_spectator_limit;
       unsigned netplay_prediction_window;
+      unsigned netplay_rollback_target;
+      unsigned netplay_delay_interval;
+      unsigned netplay_input_ports;
+      unsigned netplay_desync_history;
+      unsigned netplay_checksum_interval;
+      unsigned netplay_checksum_stride;
       unsigned netplay_share_digital;
       unsigned netplay_share_analog;
       unsigned bundle_assets_extract_version_current;
@@ -231,6 +239,7 @@ typedef struct settings
       unsigned frontend_log_level;
       unsigned libretro_log_level;
       unsigned rewind_granularity;
+      unsigned rewind_seconds;
       unsigned rewind_buffer_size_step;
       unsigned autosave_interval;
       unsigned replay_checkpoint_interval;
@@ -520,6 +529,8 @@ typedef struct settings
       char audio_device[NAME_MAX_LENGTH];
       char camera_device[NAME_MAX_LENGTH];
       char netplay_desync_handling[64];
+      char netplay_checksum_mode[16];
+      char netplay_checksum_regions[64];
       char webdav_url[NAME_MAX_LENGTH];
       char webdav_username[NAME_MAX_LENGTH];
       char webdav_password[NAME_MAX_LENGTH];
@@ -548,6 +559,7 @@ typedef struct settings
       char streaming_title[512]; /* TODO/FIXME - check size */
 
       char netplay_server[NAME_MAX_LENGTH];
+      char netplay_relay_server[NAME_MAX_LENGTH];
       char network_buildbot_url[NAME_MAX_LENGTH];
       char network_buildbot_assets_url[NAME_MAX_LENGTH];
       char menu_content_show_settings_password[NAME_MAX_LENGTH];
@@ -922,6 +934,12 @@ typedef struct settings
       bool netplay_start_as_spectator;
       bool netplay_fade_chat;
       bool netplay_allow_pausing;
+      bool netplay_local_delay_auto;
+      bool netplay_io_thread;
+      bool netplay_telemetry_csv;
+      bool netplay_record_replay;
+      bool netplay_late_join;
+      bool netplay_relay_spectate;
       bool netplay_nat_traversal;
       bool netplay_request_devices[MAX_USERS];
       bool netplay_ping_show;
@@ -1006,6 +1024,8 @@ typedef struct settings
       bool history_list_enable;
       bool playlist_entry_rename;
       bool rewind_enable;
+      bool rewind_dedup;
+      bool rewind_compress;
       bool fastforward_frameskip;
       bool vrr_runloop_enable;
       bool menu_throttle_framerate;
@@ -1013,6 +1033,8 @@ typedef struct settings
       bool apply_cheats_after_load;
       bool run_ahead_enabled;
       bool run_ahead_secondary_instance;
+      bool run_ahead_secondary_thread;
+      bool run_ahead_auto;
       bool run_ahead_hide_warnings;
       bool preemptive_frames_enable;
       bool pause_nonactive;
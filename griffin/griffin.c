@@ -1114,6 +1114,7 @@ STATE MANAGER
 ============================================================ */
 #ifdef HAVE_REWIND
 #include "../state_manager.c"
+#include "../state_manager_raw.c"
 #endif
 
 /*============================================================
@@ -1262,6 +1263,17 @@ NETPLAY
 #ifdef HAVE_NETWORKING
 #include "../network/natt.c"
 #include "../network/netplay/netplay_frontend.c"
+#include "../network/netplay/netplay_checksum.c"
+#include "../network/netplay/netplay_input.c"
+#include "../network/netplay/netplay_events.c"
+#include "../network/netplay/netplay_telemetry.c"
+#include "../network/netplay/netplay_forensics.c"
+#include "../network/netplay/netplay_replay.c"
+#include "../network/netplay/netplay_join.c"
+#include "../network/netplay/netplay_relay.c"
+#include "../network/netplay/netplay_timesync.c"
+#include "../network/netplay/netplay_autodelay.c"
+#include "../network/netplay/netplay_adapter.c"
 #include "../network/netplay/netplay_room_parse.c"
 #include "../libretro-common/net/net_compat.c"
 #include "../libretro-common/net/net_socket.c"
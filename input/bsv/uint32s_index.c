@@ -22,6 +22,7 @@ uint32s_index_t *uint32s_index_new(size_t object_size, uint8_t commit_interval,
    index->counts = NULL;
    index->hashes = NULL;
    index->additions = NULL;
+   index->free_slots = NULL;
    index->commit_interval = commit_interval;
    index->commit_threshold = commit_threshold;
    /* transfers ownership of zero buffer */
@@ -108,6 +109,27 @@ bool uint32s_bucket_remove(struct uint32s_bucket *bucket, uint32_t idx)
    return false;
 }
 
+/* copies object into a released slot if there is one, else onto the end */
+static uint32_t uint32s_index_store(uint32s_index_t *index, uint32_t *object, size_t size_bytes, uint32_t hash)
+{
+   uint32_t idx;
+   uint32_t *copy = malloc(size_bytes);
+   memcpy(copy, object, size_bytes);
+   if (RBUF_LEN(index->free_slots) > 0)
+   {
+      idx = RBUF_POP(index->free_slots);
+      index->objects[idx] = copy;
+      index->counts[idx] = 1;
+      index->hashes[idx] = hash;
+      return idx;
+   }
+   idx = RBUF_LEN(index->objects);
+   RBUF_PUSH(index->objects, copy);
+   RBUF_PUSH(index->counts, 1);
+   RBUF_PUSH(index->hashes, hash);
+   return idx;
+}
+
 uint32s_insert_result_t uint32s_index_insert(uint32s_index_t *index, uint32_t *object, uint64_t frame)
 {
    struct uint32s_bucket *bucket;
@@ -115,7 +137,6 @@ uint32s_insert_result_t uint32s_index_insert(uint32s_index_t *index, uint32_t *o
    size_t size_bytes = index->object_size * sizeof(uint32_t);
    uint32_t hash = uint32s_hash_bytes((uint8_t *)object, size_bytes);
    uint32_t idx;
-   uint32_t *copy;
    uint32_t additions_len = RBUF_LEN(index->additions);
    result.index = 0;
    result.is_new = false;
@@ -135,12 +156,7 @@ uint32s_insert_result_t uint32s_index_insert(uint32s_index_t *index, uint32_t *o
             return result;
          }
       }
-      idx = RBUF_LEN(index->objects);
-      copy = malloc(size_bytes);
-      memcpy(copy, object, size_bytes);
-      RBUF_PUSH(index->objects, copy);
-      RBUF_PUSH(index->counts, 1);
-      RBUF_PUSH(index->hashes, hash);
+      idx = uint32s_index_store(index, object, size_bytes, hash);
       result.index = idx;
       result.is_new = true;
       uint32s_bucket_expand(bucket, idx);
@@ -148,12 +164,7 @@ uint32s_insert_result_t uint32s_index_insert(uint32s_index_t *index, uint32_t *o
    else
    {
       struct uint32s_bucket new_bucket;
-      idx = RBUF_LEN(index->objects);
-      copy = malloc(size_bytes);
-      memcpy(copy, object, size_bytes);
-      RBUF_PUSH(index->objects, copy);
-      RBUF_PUSH(index->counts, 1);
-      RBUF_PUSH(index->hashes, hash);
+      idx = uint32s_index_store(index, object, size_bytes, hash);
       new_bucket.len = 1;
       new_bucket.contents.idxs[0] = idx;
       new_bucket.contents.idxs[1] = 0;
@@ -239,6 +250,29 @@ void uint32s_index_commit(uint32s_index_t *index)
    }
 }
 
+bool uint32s_index_release(uint32s_index_t *index, uint32_t which)
+{
+   struct uint32s_bucket *bucket;
+   if (which >= RBUF_LEN(index->counts) || !index->objects[which])
+      return false;
+   if (index->counts[which] > 0)
+      index->counts[which]--;
+   if (which == 0 || index->counts[which] > 0) /* never free 0s pattern */
+      return false;
+   free(index->objects[which]);
+   index->objects[which] = NULL;
+   bucket = RHMAP_PTR(index->index, index->hashes[which]);
+   uint32s_bucket_remove(bucket, which);
+   if (bucket->len == 0)
+   {
+      uint32s_bucket_free(bucket);
+      if (!RHMAP_DEL(index->index, index->hashes[which]))
+         RARCH_ERR("[STATESTREAM] Trying to remove absent hash %x\n",index->hashes[which]);
+   }
+   RBUF_PUSH(index->free_slots, which);
+   return true;
+}
+
 void uint32s_index_bump_count(uint32s_index_t *index, uint32_t which)
 {
    if (which >= RBUF_LEN(index->counts))
@@ -315,6 +349,7 @@ void uint32s_index_clear(uint32s_index_t *index)
    RBUF_CLEAR(index->objects);
    RBUF_CLEAR(index->counts);
    RBUF_CLEAR(index->hashes);
+   RBUF_CLEAR(index->free_slots);
    uint32s_index_insert_exact(index, 0, zeros, 0);
    /* wipe additions */
    RBUF_CLEAR(index->additions);
@@ -335,6 +370,7 @@ void uint32s_index_free(uint32s_index_t *index)
    RBUF_FREE(index->counts);
    RBUF_FREE(index->hashes);
    RBUF_FREE(index->additions);
+   RBUF_FREE(index->free_slots);
    free(index);
 }
 
@@ -31,6 +31,7 @@ struct uint32s_index
    uint32_t *counts;   /* an rbuf of the times each object was used */
    uint32_t *hashes;   /* an rbuf of each object's hash code */
    struct uint32s_frame_addition *additions; /* an rbuf of addition info */
+   uint32_t *free_slots; /* an rbuf of released indices, reused by insert */
    uint8_t commit_interval, commit_threshold;
 };
 typedef struct uint32s_index uint32s_index_t;
@@ -55,6 +56,9 @@ uint32_t *uint32s_index_get(uint32s_index_t *index, uint32_t which);
 void uint32s_index_bump_count(uint32s_index_t *index, uint32_t which);
 /* Call once the superblocks and blocks are all identified; transient blocks that have not been used this frame will be dropped. */
 void uint32s_index_commit(uint32s_index_t *index);
+/* Drop one use of an object and free it once it has none left; returns true if it was freed.
+ * Its index is reused by later inserts, so don't mix with commit or remove_after. */
+bool uint32s_index_release(uint32s_index_t *index, uint32_t which);
 void uint32s_index_free(uint32s_index_t *index);
 
 /* goes backwards from end of additions */
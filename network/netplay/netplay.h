@@ -169,8 +169,25 @@ typedef struct netplay_session_status_info
    char message[128];
    unsigned session_sync_current;
    unsigned session_sync_total;
+   /* Time synchronisation against the remote peer */
+   float frames_ahead;
+   float frames_ahead_smoothed;
+   int frame_adjust_usec;
+   unsigned frames_held;
+   unsigned frames_skipped;
+   /* Input delay currently applied to the local player */
+   unsigned local_delay;
+   bool local_delay_auto;
 } netplay_session_status_info_t;
 
+/* Buffer filled by RARCH_NETPLAY_CTL_GET_TELEMETRY with space
+ * separated key=value pairs */
+typedef struct netplay_telemetry_report
+{
+   char *s;
+   size_t len;
+} netplay_telemetry_report_t;
+
 net_driver_state_t *networking_state_get_ptr(void);
 
 bool netplay_compatible_version(const char *version);
@@ -0,0 +1,837 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2021 - Daniel De Matteis
+ *  Copyright (C) 2024-2025 - Jamie Meyer
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libretro.h>
+#include <net/net_compat.h>
+#include <net/net_socket.h>
+#include <compat/strl.h>
+#include <string/stdstring.h>
+#include <features/features_cpu.h>
+#include <retro_timers.h>
+
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
+/* recvmmsg()/sendmmsg() need the GNU extensions, which the Linux
+ * builds enable globally */
+#if defined(__linux__) && defined(_GNU_SOURCE)
+#include <sys/socket.h>
+#define NETPLAY_ADAPTER_MMSG 1
+#endif
+
+/* The receive ring is single-producer/single-consumer and only needs
+ * acquire/release ordering on its two indices. */
+#if defined(HAVE_THREADS) && (defined(__GNUC__) || defined(__clang__))
+#define NETPLAY_ADAPTER_THREADED 1
+#define NETPLAY_ATOMIC_LOAD(p)     __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define NETPLAY_ATOMIC_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#elif defined(HAVE_THREADS) && defined(_MSC_VER)
+#include <intrin.h>
+#define NETPLAY_ADAPTER_THREADED 1
+#define NETPLAY_ATOMIC_LOAD(p)     ((unsigned)_InterlockedCompareExchange((volatile long*)(p), 0, 0))
+#define NETPLAY_ATOMIC_STORE(p, v) _InterlockedExchange((volatile long*)(p), (long)(v))
+#endif
+
+/* Longest the receive thread sleeps before checking for shutdown */
+#define NETPLAY_ADAPTER_THREAD_WAIT_MS 4
+
+#if defined(_WIN32) && !defined(GEKKONET_STATIC)
+#define GEKKONET_STATIC
+#endif
+
+#if defined(_WIN32)
+#include "../../gekkonet/windows/include/gekkonet.h"
+#elif defined(__APPLE__)
+#include "../../gekkonet/mac/include/gekkonet.h"
+#else
+#include "../../gekkonet/linux/include/gekkonet.h"
+#endif
+
+#include "../../verbosity.h"
+
+#include "netplay_adapter.h"
+
+/* One received datagram. Everything GekkoNet is handed by
+ * receive_data() points into one of these, so no packet ever
+ * touches the heap. */
+typedef struct netplay_adapter_slot
+{
+   GekkoNetResult          result;
+   struct sockaddr_storage addr;
+   socklen_t               addr_len;
+   unsigned                len;
+   /* When the receive thread picked it up */
+   retro_time_t            arrival;
+   /* One byte spare, so that a longer datagram shows by its size
+    * even where truncation is not reported */
+   char                    data[NETPLAY_ADAPTER_PACKET_MAX + 1];
+} netplay_adapter_slot_t;
+
+typedef struct netplay_adapter_packet
+{
+   struct sockaddr_storage addr;
+   socklen_t               addr_len;
+   size_t                  len;
+   size_t                  peer;
+   char                    data[NETPLAY_ADAPTER_PACKET_MAX];
+} netplay_adapter_packet_t;
+
+typedef struct netplay_adapter_peer
+{
+   struct sockaddr_storage addr;
+   socklen_t               addr_len;
+   netplay_adapter_peer_stats_t stats;
+} netplay_adapter_peer_t;
+
+typedef struct netplay_adapter
+{
+   GekkoNetAdapter           iface;
+   int                       fd;
+   netplay_adapter_slot_t   *slots;
+   GekkoNetResult          **results;
+   netplay_adapter_packet_t *queue;
+   size_t                    queued;
+   netplay_adapter_peer_t    peers[NETPLAY_ADAPTER_MAX_PEERS];
+   size_t                    peer_count;
+   netplay_adapter_stats_t   stats;
+   netplay_adapter_oob_t     oob_handler;
+#if defined(NETPLAY_ADAPTER_THREADED)
+   sthread_t                *thread;
+   /* Guards stats while the network thread runs */
+   slock_t                  *stats_lock;
+   netplay_adapter_slot_t   *ring;
+   /* Written by the receive thread only */
+   unsigned                  ring_head;
+   /* Written by the main thread only */
+   unsigned                  ring_tail;
+   /* Slots consumed by the last receive_data(), out-of-band
+    * datagrams included */
+   unsigned                  ring_handed;
+   unsigned                  thread_quit;
+#endif
+} netplay_adapter_t;
+
+static netplay_adapter_t *netplay_adapter_st;
+
+static void netplay_adapter_stats_lock(netplay_adapter_t *adapter)
+{
+#if defined(NETPLAY_ADAPTER_THREADED)
+   if (adapter->stats_lock)
+      slock_lock(adapter->stats_lock);
+#endif
+}
+
+static void netplay_adapter_stats_unlock(netplay_adapter_t *adapter)
+{
+#if defined(NETPLAY_ADAPTER_THREADED)
+   if (adapter->stats_lock)
+      slock_unlock(adapter->stats_lock);
+#endif
+}
+
+static void netplay_adapter_describe(const struct sockaddr *addr,
+      socklen_t addr_len, char *s, size_t len)
+{
+   char host[48];
+   char serv[8];
+
+   if (getnameinfo_retro(addr, addr_len, host, sizeof(host),
+            serv, sizeof(serv), NI_NUMERICHOST | NI_NUMERICSERV))
+      strlcpy(s, "unknown", len);
+   else
+      snprintf(s, len, "%s:%s", host, serv);
+}
+
+/* Find the counters for @addr, creating an entry on first contact.
+ * Once the table is full, unknown peers share the last entry. */
+static size_t netplay_adapter_peer_index(netplay_adapter_t *adapter,
+      const struct sockaddr *addr, socklen_t addr_len)
+{
+   size_t i;
+   netplay_adapter_peer_t *peer;
+
+   for (i = 0; i < adapter->peer_count; i++)
+   {
+      peer = &adapter->peers[i];
+      if (     peer->addr_len == addr_len
+            && !memcmp(&peer->addr, addr, addr_len))
+         return i;
+   }
+
+   if (adapter->peer_count >= NETPLAY_ADAPTER_MAX_PEERS)
+      return NETPLAY_ADAPTER_MAX_PEERS - 1;
+
+   peer = &adapter->peers[adapter->peer_count];
+   memset(peer, 0, sizeof(*peer));
+   if (addr_len <= sizeof(peer->addr))
+   {
+      memcpy(&peer->addr, addr, addr_len);
+      peer->addr_len = addr_len;
+   }
+   netplay_adapter_describe(addr, addr_len,
+         peer->stats.address, sizeof(peer->stats.address));
+
+   return adapter->peer_count++;
+}
+
+static void netplay_adapter_send_data(GekkoNetAddress *addr,
+      const char *data, int length)
+{
+   netplay_adapter_t        *adapter = netplay_adapter_st;
+   netplay_adapter_packet_t *packet;
+
+   if (     !adapter
+         || !addr
+         || !addr->data
+         || !data
+         || length <= 0
+         || addr->size > sizeof(struct sockaddr_storage))
+      return;
+
+   if (length > NETPLAY_ADAPTER_PACKET_MAX)
+   {
+      /* The peer's adapter would drop it */
+      size_t idx = netplay_adapter_peer_index(adapter,
+            (const struct sockaddr*)addr->data, (socklen_t)addr->size);
+      if (!adapter->stats.send_oversize++)
+         RARCH_WARN("[Netplay] Dropping a %d byte packet to %s, over the %d byte limit.\n",
+               length, adapter->peers[idx].stats.address,
+               NETPLAY_ADAPTER_PACKET_MAX);
+      adapter->peers[idx].stats.send_errors++;
+      return;
+   }
+
+   if (adapter->queued >= NETPLAY_ADAPTER_SEND_SLOTS)
+      netplay_adapter_flush();
+
+   packet           = &adapter->queue[adapter->queued++];
+   memcpy(&packet->addr, addr->data, addr->size);
+   packet->addr_len = (socklen_t)addr->size;
+   packet->len      = (size_t)length;
+   packet->peer     = netplay_adapter_peer_index(adapter,
+         (const struct sockaddr*)&packet->addr, packet->addr_len);
+   memcpy(packet->data, data, (size_t)length);
+}
+
+/**
+ * netplay_adapter_read
+ *
+ * Read up to @max pending datagrams into the consecutive @slots
+ * without blocking. Truncated datagrams are dropped.
+ *
+ * Returns the number of slots filled.
+ */
+static int netplay_adapter_read(netplay_adapter_t *adapter,
+      netplay_adapter_slot_t *slots, int max)
+{
+   int count         = 0;
+   unsigned oversize = 0;
+#if defined(NETPLAY_ADAPTER_MMSG)
+   int i, got;
+   struct mmsghdr msgs[NETPLAY_ADAPTER_RECV_SLOTS];
+   struct iovec   iovs[NETPLAY_ADAPTER_RECV_SLOTS];
+
+   if (max > NETPLAY_ADAPTER_RECV_SLOTS)
+      max = NETPLAY_ADAPTER_RECV_SLOTS;
+
+   for (i = 0; i < max; i++)
+   {
+      iovs[i].iov_base            = slots[i].data;
+      iovs[i].iov_len             = sizeof(slots[i].data);
+      memset(&msgs[i], 0, sizeof(msgs[i]));
+      msgs[i].msg_hdr.msg_name    = &slots[i].addr;
+      msgs[i].msg_hdr.msg_namelen = sizeof(slots[i].addr);
+      msgs[i].msg_hdr.msg_iov     = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen  = 1;
+   }
+
+   got = recvmmsg(adapter->fd, msgs, (unsigned)max, MSG_DONTWAIT, NULL);
+   if (got <= 0)
+      return 0;
+
+   /* Compact accepted datagrams towards the front */
+   for (i = 0; i < got; i++)
+   {
+      netplay_adapter_slot_t *dst = &slots[count];
+
+      if (     (msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+            || msgs[i].msg_len > NETPLAY_ADAPTER_PACKET_MAX)
+      {
+         oversize++;
+         continue;
+      }
+
+      if (dst != &slots[i])
+      {
+         memcpy(&dst->addr, &slots[i].addr, sizeof(dst->addr));
+         memcpy(dst->data, slots[i].data, msgs[i].msg_len);
+      }
+      dst->addr_len = msgs[i].msg_hdr.msg_namelen;
+      dst->len      = msgs[i].msg_len;
+      count++;
+   }
+#else
+   while (count < max)
+   {
+      netplay_adapter_slot_t *slot = &slots[count];
+      socklen_t addr_len           = sizeof(slot->addr);
+      int ret                      = (int)recvfrom(adapter->fd,
+            slot->data, sizeof(slot->data), 0,
+            (struct sockaddr*)&slot->addr, &addr_len);
+
+      if (ret < 0)
+      {
+#if defined(_WIN32)
+         if (WSAGetLastError() == WSAEMSGSIZE)
+         {
+            oversize++;
+            continue;
+         }
+#endif
+         break;
+      }
+
+      if (ret > NETPLAY_ADAPTER_PACKET_MAX)
+      {
+         oversize++;
+         continue;
+      }
+
+      slot->addr_len = addr_len;
+      slot->len      = (unsigned)ret;
+      count++;
+   }
+
+   if (!count && !oversize)
+      return 0;
+#endif
+
+   /* Runs on the network thread, if there is one */
+   netplay_adapter_stats_lock(adapter);
+   adapter->stats.recv_batches++;
+   adapter->stats.dropped_oversize += oversize;
+   netplay_adapter_stats_unlock(adapter);
+
+   return count;
+}
+
+static void netplay_adapter_accept(netplay_adapter_t *adapter,
+      netplay_adapter_slot_t *slot, int *count)
+{
+   size_t idx = netplay_adapter_peer_index(adapter,
+         (const struct sockaddr*)&slot->addr, slot->addr_len);
+
+   adapter->peers[idx].stats.packets_received++;
+   adapter->peers[idx].stats.bytes_received += slot->len;
+
+   if (     slot->len >= NETPLAY_ADAPTER_OOB_MAGIC_SIZE
+         && !memcmp(slot->data, NETPLAY_ADAPTER_OOB_MAGIC,
+            NETPLAY_ADAPTER_OOB_MAGIC_SIZE))
+   {
+      if (adapter->oob_handler)
+         adapter->oob_handler(adapter->peers[idx].stats.address,
+               (const uint8_t*)slot->data + NETPLAY_ADAPTER_OOB_MAGIC_SIZE,
+               slot->len - NETPLAY_ADAPTER_OOB_MAGIC_SIZE);
+      return;
+   }
+
+   slot->result.addr.data  = &slot->addr;
+   slot->result.addr.size  = (unsigned)slot->addr_len;
+   slot->result.data_len   = slot->len;
+   slot->result.data       = slot->data;
+   adapter->results[(*count)++] = &slot->result;
+}
+
+#if defined(NETPLAY_ADAPTER_THREADED)
+/* Receive thread: the only producer of the ring. It sleeps in
+ * poll()/select() and stamps every datagram as it lands. */
+static void netplay_adapter_thread(void *data)
+{
+   netplay_adapter_t *adapter = (netplay_adapter_t*)data;
+
+   while (!NETPLAY_ATOMIC_LOAD(&adapter->thread_quit))
+   {
+      int i, got;
+      unsigned contiguous;
+      bool rd        = true;
+      unsigned head  = adapter->ring_head;
+      unsigned avail = NETPLAY_ADAPTER_RING_SLOTS
+         - (head - NETPLAY_ATOMIC_LOAD(&adapter->ring_tail));
+
+      if (!avail)
+      {
+         /* The session is not polling (paused, loading); leave the
+          * rest in the socket buffer until it catches up. */
+         netplay_adapter_stats_lock(adapter);
+         adapter->stats.ring_full++;
+         netplay_adapter_stats_unlock(adapter);
+         retro_sleep(1);
+         continue;
+      }
+
+      if (     !socket_wait(adapter->fd, &rd, NULL,
+               NETPLAY_ADAPTER_THREAD_WAIT_MS)
+            || !rd)
+         continue;
+
+      contiguous = NETPLAY_ADAPTER_RING_SLOTS
+         - (head & (NETPLAY_ADAPTER_RING_SLOTS - 1));
+      if (contiguous > avail)
+         contiguous = avail;
+
+      got = netplay_adapter_read(adapter,
+            &adapter->ring[head & (NETPLAY_ADAPTER_RING_SLOTS - 1)],
+            (int)contiguous);
+      if (got <= 0)
+         continue;
+
+      {
+         retro_time_t now = cpu_features_get_time_usec();
+         for (i = 0; i < got; i++)
+            adapter->ring[(head + i) & (NETPLAY_ADAPTER_RING_SLOTS - 1)]
+               .arrival = now;
+      }
+
+      NETPLAY_ATOMIC_STORE(&adapter->ring_head, head + (unsigned)got);
+   }
+}
+
+/* Consumer side: hand out ring slots in place. They are returned to
+ * the producer on the next call, once GekkoNet is done with them. */
+static int netplay_adapter_drain_ring(netplay_adapter_t *adapter)
+{
+   unsigned i, head, tail;
+   int count         = 0;
+   retro_time_t now  = cpu_features_get_time_usec();
+
+   tail  = adapter->ring_tail + adapter->ring_handed;
+   NETPLAY_ATOMIC_STORE(&adapter->ring_tail, tail);
+   adapter->ring_handed = 0;
+
+   head  = NETPLAY_ATOMIC_LOAD(&adapter->ring_head);
+
+   /* Out-of-band datagrams are consumed without reaching GekkoNet,
+    * so slots handed out and results returned can differ */
+   for (i = tail; i != head && count < NETPLAY_ADAPTER_RECV_SLOTS; i++)
+   {
+      netplay_adapter_slot_t *slot =
+         &adapter->ring[i & (NETPLAY_ADAPTER_RING_SLOTS - 1)];
+      retro_time_t waited          = now - slot->arrival;
+
+      adapter->stats.queued_packets++;
+      adapter->stats.queue_delay_total_usec += waited;
+      if ((uint64_t)waited > adapter->stats.queue_delay_max_usec)
+         adapter->stats.queue_delay_max_usec = (uint64_t)waited;
+
+      netplay_adapter_accept(adapter, slot, &count);
+   }
+
+   adapter->ring_handed = i - tail;
+   return count;
+}
+#endif
+
+/* Every slot handed out by the previous call has been consumed by
+ * GekkoNet by now, so the whole arena is reused from the start. */
+static GekkoNetResult **netplay_adapter_receive_data(int *length)
+{
+   int i, got;
+   int count                  = 0;
+   netplay_adapter_t *adapter = netplay_adapter_st;
+
+   if (length)
+      *length = 0;
+   if (!adapter || !length)
+      return NULL;
+
+   /* Replies to what was queued this frame should not wait */
+   netplay_adapter_flush();
+
+#if defined(NETPLAY_ADAPTER_THREADED)
+   if (adapter->thread)
+   {
+      *length = netplay_adapter_drain_ring(adapter);
+      return *length ? adapter->results : NULL;
+   }
+#endif
+
+   while (count < NETPLAY_ADAPTER_RECV_SLOTS)
+   {
+      got = netplay_adapter_read(adapter, &adapter->slots[count],
+            NETPLAY_ADAPTER_RECV_SLOTS - count);
+      if (got <= 0)
+         break;
+      count += got;
+   }
+
+   if (count >= NETPLAY_ADAPTER_RECV_SLOTS)
+      adapter->stats.arena_full++;
+
+   got   = count;
+   count = 0;
+   for (i = 0; i < got; i++)
+      netplay_adapter_accept(adapter, &adapter->slots[i], &count);
+
+   *length = count;
+   return count ? adapter->results : NULL;
+}
+
+/* Results, addresses and payloads all live in the arena */
+static void netplay_adapter_free_data(void *data_ptr)
+{
+   (void)data_ptr;
+}
+
+void netplay_adapter_flush(void)
+{
+   size_t i;
+   netplay_adapter_t *adapter = netplay_adapter_st;
+
+   if (!adapter || !adapter->queued)
+      return;
+
+   adapter->stats.send_batches++;
+
+#if defined(NETPLAY_ADAPTER_MMSG)
+   {
+      struct mmsghdr msgs[NETPLAY_ADAPTER_SEND_SLOTS];
+      struct iovec   iovs[NETPLAY_ADAPTER_SEND_SLOTS];
+      size_t         sent = 0;
+
+      for (i = 0; i < adapter->queued; i++)
+      {
+         netplay_adapter_packet_t *packet = &adapter->queue[i];
+         iovs[i].iov_base                 = packet->data;
+         iovs[i].iov_len                  = packet->len;
+         memset(&msgs[i], 0, sizeof(msgs[i]));
+         msgs[i].msg_hdr.msg_name         = &packet->addr;
+         msgs[i].msg_hdr.msg_namelen      = packet->addr_len;
+         msgs[i].msg_hdr.msg_iov          = &iovs[i];
+         msgs[i].msg_hdr.msg_iovlen       = 1;
+      }
+
+      while (sent < adapter->queued)
+      {
+         int ret = sendmmsg(adapter->fd, &msgs[sent],
+               (unsigned)(adapter->queued - sent), MSG_DONTWAIT);
+
+         if (ret <= 0)
+         {
+            /* Skip the datagram that failed and carry on with
+             * the rest; UDP gives no guarantees anyway. */
+            adapter->peers[adapter->queue[sent].peer].stats.send_errors++;
+            sent++;
+            continue;
+         }
+
+         for (i = sent; i < sent + (size_t)ret; i++)
+         {
+            netplay_adapter_packet_t *packet = &adapter->queue[i];
+            adapter->peers[packet->peer].stats.packets_sent++;
+            adapter->peers[packet->peer].stats.bytes_sent += packet->len;
+         }
+         sent += (size_t)ret;
+      }
+   }
+#else
+   for (i = 0; i < adapter->queued; i++)
+   {
+      netplay_adapter_packet_t *packet = &adapter->queue[i];
+      netplay_adapter_peer_stats_t *st = &adapter->peers[packet->peer].stats;
+
+      if (sendto(adapter->fd, packet->data, (int)packet->len, 0,
+               (const struct sockaddr*)&packet->addr,
+               packet->addr_len) == (int)packet->len)
+      {
+         st->packets_sent++;
+         st->bytes_sent += packet->len;
+      }
+      else
+         st->send_errors++;
+   }
+#endif
+
+   adapter->queued = 0;
+}
+
+GekkoNetAdapter *netplay_adapter_create(unsigned short port,
+      bool threaded)
+{
+   size_t i;
+   struct addrinfo *addr      = NULL;
+   netplay_adapter_t *adapter = NULL;
+   int fd;
+
+   netplay_adapter_destroy();
+
+   fd = socket_init((void**)&addr, port, NULL, SOCKET_TYPE_DATAGRAM, AF_INET);
+   if (fd < 0 || !addr)
+      goto error;
+
+   if (!socket_bind(fd, addr))
+   {
+      RARCH_ERR("[Netplay] Unable to bind UDP port %u.\n", (unsigned)port);
+      goto error;
+   }
+
+   if (!socket_set_block(fd, false))
+   {
+      RARCH_ERR("[Netplay] Unable to make the UDP socket non-blocking.\n");
+      goto error;
+   }
+
+   freeaddrinfo_retro(addr);
+   addr = NULL;
+
+   adapter = (netplay_adapter_t*)calloc(1, sizeof(*adapter));
+   if (!adapter)
+      goto error;
+
+   adapter->fd      = fd;
+   adapter->slots   = (netplay_adapter_slot_t*)calloc(
+         NETPLAY_ADAPTER_RECV_SLOTS, sizeof(*adapter->slots));
+   adapter->results = (GekkoNetResult**)calloc(
+         NETPLAY_ADAPTER_RECV_SLOTS, sizeof(*adapter->results));
+   adapter->queue   = (netplay_adapter_packet_t*)calloc(
+         NETPLAY_ADAPTER_SEND_SLOTS, sizeof(*adapter->queue));
+   if (!adapter->slots || !adapter->results || !adapter->queue)
+      goto error;
+
+   for (i = 0; i < NETPLAY_ADAPTER_RECV_SLOTS; i++)
+      adapter->results[i] = &adapter->slots[i].result;
+
+   if (threaded)
+   {
+#if defined(NETPLAY_ADAPTER_THREADED)
+      adapter->ring       = (netplay_adapter_slot_t*)calloc(
+            NETPLAY_ADAPTER_RING_SLOTS, sizeof(*adapter->ring));
+      adapter->stats_lock = slock_new();
+      if (adapter->ring && adapter->stats_lock)
+         adapter->thread  = sthread_create(netplay_adapter_thread, adapter);
+      if (!adapter->thread)
+      {
+         RARCH_WARN("[Netplay] Unable to start the network thread, polling on the main thread.\n");
+         free(adapter->ring);
+         adapter->ring       = NULL;
+         if (adapter->stats_lock)
+            slock_free(adapter->stats_lock);
+         adapter->stats_lock = NULL;
+      }
+#else
+      RARCH_WARN("[Netplay] Network thread not supported on this build, polling on the main thread.\n");
+#endif
+   }
+
+   adapter->iface.send_data    = netplay_adapter_send_data;
+   adapter->iface.receive_data = netplay_adapter_receive_data;
+   adapter->iface.free_data    = netplay_adapter_free_data;
+
+   netplay_adapter_st = adapter;
+
+   RARCH_LOG("[Netplay] Native UDP transport listening on port %u%s%s.\n",
+         (unsigned)port,
+#if defined(NETPLAY_ADAPTER_MMSG)
+         ", batched",
+#else
+         "",
+#endif
+#if defined(NETPLAY_ADAPTER_THREADED)
+         adapter->thread ? ", network thread" : ""
+#else
+         ""
+#endif
+         );
+
+   return &adapter->iface;
+
+error:
+   if (adapter)
+   {
+      free(adapter->slots);
+      free(adapter->results);
+      free(adapter->queue);
+      free(adapter);
+   }
+   if (addr)
+      freeaddrinfo_retro(addr);
+   if (fd >= 0)
+      socket_close(fd);
+   return NULL;
+}
+
+void netplay_adapter_destroy(void)
+{
+   size_t i;
+   netplay_adapter_t *adapter = netplay_adapter_st;
+
+   if (!adapter)
+      return;
+
+   netplay_adapter_flush();
+
+   for (i = 0; i < adapter->peer_count; i++)
+   {
+      const netplay_adapter_peer_stats_t *st = &adapter->peers[i].stats;
+      RARCH_LOG("[Netplay] Peer %s: sent %llu packets (%llu bytes, %llu errors), "
+            "received %llu packets (%llu bytes).\n",
+            st->address,
+            (unsigned long long)st->packets_sent,
+            (unsigned long long)st->bytes_sent,
+            (unsigned long long)st->send_errors,
+            (unsigned long long)st->packets_received,
+            (unsigned long long)st->bytes_received);
+   }
+
+   netplay_adapter_st = NULL;
+
+#if defined(NETPLAY_ADAPTER_THREADED)
+   if (adapter->thread)
+   {
+      NETPLAY_ATOMIC_STORE(&adapter->thread_quit, 1);
+      sthread_join(adapter->thread);
+      adapter->thread = NULL;
+
+      if (adapter->stats.queued_packets)
+         RARCH_LOG("[Netplay] Network thread: %llu packets, average wait %llu usec, worst %llu usec.\n",
+               (unsigned long long)adapter->stats.queued_packets,
+               (unsigned long long)(adapter->stats.queue_delay_total_usec
+                  / adapter->stats.queued_packets),
+               (unsigned long long)adapter->stats.queue_delay_max_usec);
+   }
+   if (adapter->stats_lock)
+      slock_free(adapter->stats_lock);
+   free(adapter->ring);
+#endif
+
+   socket_close(adapter->fd);
+   free(adapter->slots);
+   free(adapter->results);
+   free(adapter->queue);
+   free(adapter);
+}
+
+bool netplay_adapter_threaded(void)
+{
+#if defined(NETPLAY_ADAPTER_THREADED)
+   return netplay_adapter_st && netplay_adapter_st->thread;
+#else
+   return false;
+#endif
+}
+
+size_t netplay_adapter_peer_count(void)
+{
+   return netplay_adapter_st ? netplay_adapter_st->peer_count : 0;
+}
+
+bool netplay_adapter_get_peer_stats(size_t idx,
+      netplay_adapter_peer_stats_t *stats)
+{
+   netplay_adapter_t *adapter = netplay_adapter_st;
+
+   if (!adapter || !stats || idx >= adapter->peer_count)
+      return false;
+
+   *stats = adapter->peers[idx].stats;
+   return true;
+}
+
+void netplay_adapter_get_stats(netplay_adapter_stats_t *stats)
+{
+   if (!stats)
+      return;
+   if (netplay_adapter_st)
+   {
+      netplay_adapter_stats_lock(netplay_adapter_st);
+      *stats = netplay_adapter_st->stats;
+      netplay_adapter_stats_unlock(netplay_adapter_st);
+   }
+   else
+      memset(stats, 0, sizeof(*stats));
+}
+
+void netplay_adapter_set_oob_handler(netplay_adapter_oob_t handler)
+{
+   if (netplay_adapter_st)
+      netplay_adapter_st->oob_handler = handler;
+}
+
+static void netplay_adapter_queue_oob(netplay_adapter_t *adapter,
+      size_t peer, const void *data, size_t len)
+{
+   netplay_adapter_packet_t *packet;
+
+   if (adapter->queued >= NETPLAY_ADAPTER_SEND_SLOTS)
+      netplay_adapter_flush();
+
+   packet           = &adapter->queue[adapter->queued++];
+   memcpy(&packet->addr, &adapter->peers[peer].addr,
+         sizeof(packet->addr));
+   packet->addr_len = adapter->peers[peer].addr_len;
+   packet->len      = NETPLAY_ADAPTER_OOB_MAGIC_SIZE + len;
+   packet->peer     = peer;
+   memcpy(packet->data, NETPLAY_ADAPTER_OOB_MAGIC,
+         NETPLAY_ADAPTER_OOB_MAGIC_SIZE);
+   memcpy(packet->data + NETPLAY_ADAPTER_OOB_MAGIC_SIZE, data, len);
+}
+
+size_t netplay_adapter_send_oob(const void *data, size_t len)
+{
+   size_t i;
+   netplay_adapter_t *adapter = netplay_adapter_st;
+
+   if (     !adapter
+         || !data
+         || !len
+         || len > NETPLAY_ADAPTER_PACKET_MAX - NETPLAY_ADAPTER_OOB_MAGIC_SIZE)
+      return 0;
+
+   for (i = 0; i < adapter->peer_count; i++)
+      netplay_adapter_queue_oob(adapter, i, data, len);
+
+   return adapter->peer_count;
+}
+
+bool netplay_adapter_send_oob_to(const char *address,
+      const void *data, size_t len)
+{
+   size_t i;
+   netplay_adapter_t *adapter = netplay_adapter_st;
+
+   if (     !adapter
+         || !address
+         || !data
+         || !len
+         || len > NETPLAY_ADAPTER_PACKET_MAX - NETPLAY_ADAPTER_OOB_MAGIC_SIZE)
+      return false;
+
+   for (i = 0; i < adapter->peer_count; i++)
+   {
+      if (string_is_equal(adapter->peers[i].stats.address, address))
+      {
+         netplay_adapter_queue_oob(adapter, i, data, len);
+         return true;
+      }
+   }
+
+   return false;
+}
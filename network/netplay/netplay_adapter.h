@@ -0,0 +1,155 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2021 - Daniel De Matteis
+ *  Copyright (C) 2024-2025 - Jamie Meyer
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RARCH_NETPLAY_ADAPTER_H
+#define __RARCH_NETPLAY_ADAPTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <boolean.h>
+#include <retro_common_api.h>
+
+#ifndef GEKKONET_ADAPTER_TYPE_DEFINED
+typedef struct GekkoNetAdapter GekkoNetAdapter;
+#define GEKKONET_ADAPTER_TYPE_DEFINED
+#endif
+
+RETRO_BEGIN_DECLS
+
+/* Largest datagram sent or accepted; longer ones are dropped and
+ * counted */
+#define NETPLAY_ADAPTER_PACKET_MAX 1472
+/* Packets held by the receive arena and the send queue */
+#define NETPLAY_ADAPTER_RECV_SLOTS 128
+#define NETPLAY_ADAPTER_SEND_SLOTS 64
+/* Packets buffered between the network thread and the session;
+ * must be a power of two */
+#define NETPLAY_ADAPTER_RING_SLOTS 256
+/* Peers with their own counters; others share the last entry */
+#define NETPLAY_ADAPTER_MAX_PEERS  16
+/* Prefix of datagrams exchanged by the frontend itself, which are
+ * kept away from GekkoNet */
+#define NETPLAY_ADAPTER_OOB_MAGIC  "\xffRAo"
+#define NETPLAY_ADAPTER_OOB_MAGIC_SIZE 4
+
+typedef struct netplay_adapter_peer_stats
+{
+   char     address[64];
+   uint64_t packets_sent;
+   uint64_t packets_received;
+   uint64_t bytes_sent;
+   uint64_t bytes_received;
+   uint64_t send_errors;
+} netplay_adapter_peer_stats_t;
+
+/**
+ * netplay_adapter_oob_t
+ * @from                 : printable address of the sender
+ *
+ * Receives out-of-band messages, without their prefix, on the
+ * thread that polls the session.
+ */
+typedef void (*netplay_adapter_oob_t)(const char *from,
+      const uint8_t *data, size_t len);
+
+typedef struct netplay_adapter_stats
+{
+   uint64_t recv_batches;
+   uint64_t send_batches;
+   /* Datagrams longer than NETPLAY_ADAPTER_PACKET_MAX received, and
+    * sends over it, both dropped */
+   uint64_t dropped_oversize;
+   uint64_t send_oversize;
+   /* Datagrams left in the socket because the arena was full */
+   uint64_t arena_full;
+   /* Network thread only: times the ring was full, and how long
+    * packets waited in it before the session saw them */
+   uint64_t ring_full;
+   uint64_t queued_packets;
+   uint64_t queue_delay_total_usec;
+   uint64_t queue_delay_max_usec;
+} netplay_adapter_stats_t;
+
+/**
+ * netplay_adapter_create
+ * @port                 : local UDP port to bind
+ * @threaded             : receive on a dedicated thread
+ *
+ * Open the frontend's own UDP transport for GekkoNet. The adapter
+ * callbacks carry no context, so there is a single instance per
+ * process; creating it again replaces the previous one.
+ *
+ * In threaded mode a background thread waits on the socket and
+ * queues datagrams, with their arrival time, in a lock-free ring
+ * that receive_data() drains. Sends stay on the calling thread.
+ *
+ * Returns the adapter to hand to gekko_net_adapter_set(), or NULL.
+ */
+GekkoNetAdapter *netplay_adapter_create(unsigned short port,
+      bool threaded);
+
+void netplay_adapter_destroy(void);
+
+/**
+ * netplay_adapter_flush
+ *
+ * Send every packet GekkoNet queued since the last flush.
+ * Call after each gekko_update_session()/gekko_network_poll().
+ */
+void netplay_adapter_flush(void);
+
+/**
+ * netplay_adapter_threaded
+ *
+ * Returns true if datagrams are received on the network thread.
+ */
+bool netplay_adapter_threaded(void);
+
+size_t netplay_adapter_peer_count(void);
+
+bool netplay_adapter_get_peer_stats(size_t idx,
+      netplay_adapter_peer_stats_t *stats);
+
+void netplay_adapter_get_stats(netplay_adapter_stats_t *stats);
+
+void netplay_adapter_set_oob_handler(netplay_adapter_oob_t handler);
+
+/**
+ * netplay_adapter_send_oob
+ *
+ * Queue an out-of-band message to every peer seen so far. Like
+ * GekkoNet's own traffic it is plain UDP and may be lost.
+ *
+ * Returns the number of peers it was queued for.
+ */
+size_t netplay_adapter_send_oob(const void *data, size_t len);
+
+/**
+ * netplay_adapter_send_oob_to
+ * @address              : a peer's address as in its statistics
+ *
+ * Queue an out-of-band message to one peer.
+ *
+ * Returns false if no such peer was seen.
+ */
+bool netplay_adapter_send_oob_to(const char *address,
+      const void *data, size_t len);
+
+RETRO_END_DECLS
+
+#endif
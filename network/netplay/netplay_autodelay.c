@@ -0,0 +1,111 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2021 - Daniel De Matteis
+ *  Copyright (C) 2024-2025 - Jamie Meyer
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "netplay_autodelay.h"
+
+void netplay_autodelay_init(netplay_autodelay_t *ad, unsigned delay,
+      unsigned target_rollback, unsigned max_delay, unsigned interval)
+{
+   if (!ad)
+      return;
+
+   memset(ad, 0, sizeof(*ad));
+
+   if (delay > max_delay)
+      delay = max_delay;
+
+   ad->delay           = delay;
+   ad->target_rollback = target_rollback;
+   ad->max_delay       = max_delay;
+   ad->interval        = interval ? interval : 1;
+   ad->countdown       = ad->interval;
+}
+
+unsigned netplay_autodelay_wanted(const netplay_autodelay_t *ad,
+      float rtt_ms, float jitter_ms, float frame_ms, float headroom)
+{
+   float latency;
+   int   wanted;
+
+   if (!ad || frame_ms <= 0.0f)
+      return 0;
+
+   if (rtt_ms < 0.0f)
+      rtt_ms = 0.0f;
+   if (jitter_ms < 0.0f)
+      jitter_ms = 0.0f;
+
+   /* Remote inputs arrive half a round trip late, give or take the
+    * jitter; every frame of that not covered by delay is predicted
+    * and may have to be rolled back. */
+   latency = (rtt_ms * 0.5f + jitter_ms) / frame_ms + headroom;
+   wanted  = (int)ceilf(latency) - (int)ad->target_rollback;
+
+   if (wanted < 0)
+      return 0;
+   if ((unsigned)wanted > ad->max_delay)
+      return ad->max_delay;
+   return (unsigned)wanted;
+}
+
+bool netplay_autodelay_tick(netplay_autodelay_t *ad)
+{
+   if (!ad)
+      return false;
+   if (ad->countdown > 1)
+   {
+      ad->countdown--;
+      return false;
+   }
+   ad->countdown = ad->interval;
+   return true;
+}
+
+bool netplay_autodelay_evaluate(netplay_autodelay_t *ad,
+      float rtt_ms, float jitter_ms, float frame_ms)
+{
+   unsigned up;
+   unsigned down;
+
+   if (!ad)
+      return false;
+
+   up = netplay_autodelay_wanted(ad, rtt_ms, jitter_ms, frame_ms, 0.0f);
+   if (up > ad->delay)
+   {
+      ad->delay       = up;
+      ad->lower_votes = 0;
+      return true;
+   }
+
+   down = netplay_autodelay_wanted(ad, rtt_ms, jitter_ms, frame_ms, 0.5f);
+   if (down >= ad->delay)
+   {
+      ad->lower_votes = 0;
+      return false;
+   }
+
+   if (++ad->lower_votes < NETPLAY_AUTODELAY_LOWER_VOTES)
+      return false;
+
+   ad->delay--;
+   ad->lower_votes = 0;
+   return true;
+}
@@ -0,0 +1,83 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2021 - Daniel De Matteis
+ *  Copyright (C) 2024-2025 - Jamie Meyer
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RARCH_NETPLAY_AUTODELAY_H
+#define __RARCH_NETPLAY_AUTODELAY_H
+
+#include <boolean.h>
+#include <retro_common_api.h>
+
+RETRO_BEGIN_DECLS
+
+/* Upper bound for the automatic local delay, in frames */
+#define NETPLAY_AUTODELAY_MAX          10
+/* Consecutive evaluations that must agree before lowering the delay */
+#define NETPLAY_AUTODELAY_LOWER_VOTES  3
+
+/* Picks the local input delay that keeps the expected rollback depth
+ * at or below a target, from the round trip time and jitter reported
+ * by GekkoNet. Raising the delay happens at once; lowering it goes one
+ * frame at a time, only after several evaluations agree and with half
+ * a frame of headroom, so the value does not oscillate on a noisy link. */
+typedef struct netplay_autodelay
+{
+   /* Delay currently applied to the local player */
+   unsigned delay;
+   /* Rollback depth, in frames, we are willing to live with */
+   unsigned target_rollback;
+   unsigned max_delay;
+   /* Frames between two evaluations */
+   unsigned interval;
+   unsigned countdown;
+   unsigned lower_votes;
+} netplay_autodelay_t;
+
+void netplay_autodelay_init(netplay_autodelay_t *ad, unsigned delay,
+      unsigned target_rollback, unsigned max_delay, unsigned interval);
+
+/**
+ * netplay_autodelay_wanted
+ * @rtt_ms               : average round trip time to the peer
+ * @jitter_ms            : round trip time jitter
+ * @frame_ms             : duration of one frame
+ * @headroom             : extra frames of latency to assume
+ *
+ * Returns the delay keeping the expected rollback depth at or below
+ * the target, clamped to [0, max_delay].
+ */
+unsigned netplay_autodelay_wanted(const netplay_autodelay_t *ad,
+      float rtt_ms, float jitter_ms, float frame_ms, float headroom);
+
+/**
+ * netplay_autodelay_tick
+ *
+ * Count down one frame. Returns true when a new evaluation is due.
+ */
+bool netplay_autodelay_tick(netplay_autodelay_t *ad);
+
+/**
+ * netplay_autodelay_evaluate
+ *
+ * Feed the latest link statistics. Returns true if ad->delay changed
+ * and has to be handed to GekkoNet.
+ */
+bool netplay_autodelay_evaluate(netplay_autodelay_t *ad,
+      float rtt_ms, float jitter_ms, float frame_ms);
+
+RETRO_END_DECLS
+
+#endif
@@ -0,0 +1,461 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2021 - Daniel De Matteis
+ *  Copyright (C) 2024-2025 - Jamie Meyer
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <libretro.h>
+#include <encodings/crc32.h>
+#include <features/features_cpu.h>
+#include <string/stdstring.h>
+
+#define XXH_INLINE_ALL
+#include "../../deps/xxHash/xxhash.h"
+
+#include "netplay_checksum.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <nmmintrin.h>
+#define NETPLAY_CRC32C_SSE42 1
+#define NETPLAY_CRC32C_TARGET __attribute__((target("sse4.2")))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <nmmintrin.h>
+#define NETPLAY_CRC32C_SSE42 1
+#define NETPLAY_CRC32C_TARGET
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define NETPLAY_CRC32C_ARM 1
+#endif
+
+enum netplay_crc32c_impl
+{
+   NETPLAY_CRC32C_IMPL_UNKNOWN = 0,
+   NETPLAY_CRC32C_IMPL_SOFTWARE,
+   NETPLAY_CRC32C_IMPL_HARDWARE
+};
+
+static enum netplay_crc32c_impl netplay_crc32c_impl;
+static uint32_t netplay_crc32c_table[256];
+
+static void netplay_crc32c_init(void)
+{
+   unsigned i, j;
+
+   if (netplay_crc32c_impl != NETPLAY_CRC32C_IMPL_UNKNOWN)
+      return;
+
+   for (i = 0; i < 256; i++)
+   {
+      uint32_t crc = i;
+      for (j = 0; j < 8; j++)
+         crc = (crc >> 1) ^ (0x82F63B78U & (0U - (crc & 1)));
+      netplay_crc32c_table[i] = crc;
+   }
+
+   netplay_crc32c_impl = NETPLAY_CRC32C_IMPL_SOFTWARE;
+
+#if defined(NETPLAY_CRC32C_SSE42)
+   if (cpu_features_get() & RETRO_SIMD_SSE42)
+      netplay_crc32c_impl = NETPLAY_CRC32C_IMPL_HARDWARE;
+#elif defined(NETPLAY_CRC32C_ARM)
+   netplay_crc32c_impl = NETPLAY_CRC32C_IMPL_HARDWARE;
+#endif
+}
+
+static uint32_t netplay_crc32c_software(uint32_t crc,
+      const uint8_t *data, size_t len)
+{
+   while (len--)
+      crc = netplay_crc32c_table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+   return crc;
+}
+
+#if defined(NETPLAY_CRC32C_SSE42)
+NETPLAY_CRC32C_TARGET
+static uint32_t netplay_crc32c_hardware(uint32_t crc,
+      const uint8_t *data, size_t len)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+   uint64_t crc64 = crc;
+   while (len >= 8)
+   {
+      uint64_t word;
+      memcpy(&word, data, sizeof(word));
+      crc64 = _mm_crc32_u64(crc64, word);
+      data += 8;
+      len  -= 8;
+   }
+   crc = (uint32_t)crc64;
+#endif
+   while (len >= 4)
+   {
+      uint32_t word;
+      memcpy(&word, data, sizeof(word));
+      crc   = _mm_crc32_u32(crc, word);
+      data += 4;
+      len  -= 4;
+   }
+   while (len--)
+      crc = _mm_crc32_u8(crc, *data++);
+   return crc;
+}
+#elif defined(NETPLAY_CRC32C_ARM)
+static uint32_t netplay_crc32c_hardware(uint32_t crc,
+      const uint8_t *data, size_t len)
+{
+   while (len >= 8)
+   {
+      uint64_t word;
+      memcpy(&word, data, sizeof(word));
+      crc   = __crc32cd(crc, word);
+      data += 8;
+      len  -= 8;
+   }
+   while (len--)
+      crc = __crc32cb(crc, *data++);
+   return crc;
+}
+#endif
+
+static uint32_t netplay_crc32c_update(uint32_t crc,
+      const uint8_t *data, size_t len)
+{
+#if defined(NETPLAY_CRC32C_SSE42) || defined(NETPLAY_CRC32C_ARM)
+   if (netplay_crc32c_impl == NETPLAY_CRC32C_IMPL_HARDWARE)
+      return netplay_crc32c_hardware(crc, data, len);
+#endif
+   return netplay_crc32c_software(crc, data, len);
+}
+
+bool netplay_checksum_hw_accelerated(void)
+{
+   netplay_crc32c_init();
+   return netplay_crc32c_impl == NETPLAY_CRC32C_IMPL_HARDWARE;
+}
+
+enum netplay_checksum_mode netplay_checksum_mode_from_string(
+      const char *str)
+{
+   if (string_is_equal_noncase(str, "xxh3"))
+      return NETPLAY_CHECKSUM_XXH3;
+   if (string_is_equal_noncase(str, "crc32c"))
+      return NETPLAY_CHECKSUM_CRC32C;
+   if (string_is_equal_noncase(str, "none"))
+      return NETPLAY_CHECKSUM_NONE;
+   return NETPLAY_CHECKSUM_CRC32;
+}
+
+const char *netplay_checksum_mode_to_string(
+      enum netplay_checksum_mode mode)
+{
+   switch (mode)
+   {
+      case NETPLAY_CHECKSUM_XXH3:
+         return "xxh3";
+      case NETPLAY_CHECKSUM_CRC32C:
+         return "crc32c";
+      case NETPLAY_CHECKSUM_NONE:
+         return "none";
+      case NETPLAY_CHECKSUM_CRC32:
+      default:
+         break;
+   }
+   return "crc32";
+}
+
+bool netplay_checksum_wants_frame(const netplay_checksum_t *cs,
+      int frame)
+{
+   if (!cs || cs->mode == NETPLAY_CHECKSUM_NONE)
+      return false;
+   if (cs->interval <= 1)
+      return true;
+   return frame >= 0 && ((unsigned)frame % cs->interval) == 0;
+}
+
+/* Running hash over one or more buffers */
+typedef struct netplay_checksum_ctx
+{
+   XXH3_state_t xxh3;
+   enum netplay_checksum_mode mode;
+   size_t   stride;
+   uint32_t crc;
+} netplay_checksum_ctx_t;
+
+static void netplay_checksum_begin(netplay_checksum_ctx_t *ctx,
+      const netplay_checksum_t *cs)
+{
+   ctx->mode   = cs->mode;
+   ctx->stride = cs->stride > NETPLAY_CHECKSUM_SAMPLE_SIZE
+      ? cs->stride : 0;
+   ctx->crc    = 0;
+
+   switch (ctx->mode)
+   {
+      case NETPLAY_CHECKSUM_XXH3:
+         XXH3_INITSTATE(&ctx->xxh3);
+         XXH3_64bits_reset(&ctx->xxh3);
+         break;
+      case NETPLAY_CHECKSUM_CRC32C:
+         netplay_crc32c_init();
+         ctx->crc = 0xFFFFFFFFU;
+         break;
+      default:
+         break;
+   }
+}
+
+static void netplay_checksum_chunk(netplay_checksum_ctx_t *ctx,
+      const uint8_t *buf, size_t len)
+{
+   switch (ctx->mode)
+   {
+      case NETPLAY_CHECKSUM_XXH3:
+         XXH3_64bits_update(&ctx->xxh3, buf, len);
+         break;
+      case NETPLAY_CHECKSUM_CRC32C:
+         ctx->crc = netplay_crc32c_update(ctx->crc, buf, len);
+         break;
+      case NETPLAY_CHECKSUM_CRC32:
+         ctx->crc = encoding_crc32(ctx->crc, buf, len);
+         break;
+      case NETPLAY_CHECKSUM_NONE:
+      default:
+         break;
+   }
+}
+
+/* Hashes @buf whole, or a sample of every stride bytes of it */
+static void netplay_checksum_update(netplay_checksum_ctx_t *ctx,
+      const uint8_t *buf, size_t len)
+{
+   size_t offset;
+
+   if (!ctx->stride)
+   {
+      netplay_checksum_chunk(ctx, buf, len);
+      return;
+   }
+
+   for (offset = 0; offset < len; offset += ctx->stride)
+   {
+      size_t chunk = len - offset;
+      if (chunk > NETPLAY_CHECKSUM_SAMPLE_SIZE)
+         chunk = NETPLAY_CHECKSUM_SAMPLE_SIZE;
+      netplay_checksum_chunk(ctx, buf + offset, chunk);
+   }
+}
+
+static uint32_t netplay_checksum_end(netplay_checksum_ctx_t *ctx)
+{
+   switch (ctx->mode)
+   {
+      case NETPLAY_CHECKSUM_XXH3:
+         {
+            XXH64_hash_t hash = XXH3_64bits_digest(&ctx->xxh3);
+            return (uint32_t)(hash ^ (hash >> 32));
+         }
+      case NETPLAY_CHECKSUM_CRC32C:
+         return ~ctx->crc;
+      case NETPLAY_CHECKSUM_CRC32:
+         return ctx->crc;
+      case NETPLAY_CHECKSUM_NONE:
+      default:
+         break;
+   }
+   return 0;
+}
+
+uint32_t netplay_checksum_compute(const netplay_checksum_t *cs,
+      const void *data, size_t len)
+{
+   netplay_checksum_ctx_t ctx;
+
+   if (!cs || !data || !len || cs->mode == NETPLAY_CHECKSUM_NONE)
+      return 0;
+
+   /* One pass over a whole buffer needs no hash state */
+   if (cs->stride <= NETPLAY_CHECKSUM_SAMPLE_SIZE)
+   {
+      if (cs->mode == NETPLAY_CHECKSUM_XXH3)
+      {
+         XXH64_hash_t hash = XXH3_64bits(data, len);
+         return (uint32_t)(hash ^ (hash >> 32));
+      }
+      if (cs->mode == NETPLAY_CHECKSUM_CRC32)
+         return encoding_crc32(0, (const uint8_t*)data, len);
+   }
+
+   netplay_checksum_begin(&ctx, cs);
+   netplay_checksum_update(&ctx, (const uint8_t*)data, len);
+   return netplay_checksum_end(&ctx);
+}
+
+uint32_t netplay_checksum_compute_regions(const netplay_checksum_t *cs,
+      const netplay_checksum_region_t *regions, unsigned count)
+{
+   unsigned i;
+   netplay_checksum_ctx_t ctx;
+
+   if (!cs || !regions || cs->mode == NETPLAY_CHECKSUM_NONE)
+      return 0;
+
+   netplay_checksum_begin(&ctx, cs);
+   for (i = 0; i < count; i++)
+      if (regions[i].data && regions[i].len)
+         netplay_checksum_update(&ctx,
+               (const uint8_t*)regions[i].data, regions[i].len);
+   return netplay_checksum_end(&ctx);
+}
+
+unsigned netplay_checksum_regions_from_string(const char *str,
+      unsigned *ids, unsigned max)
+{
+   static const struct
+   {
+      unsigned    id;
+      const char *name;
+   } names[] = {
+      { RETRO_MEMORY_SYSTEM_RAM, "system_ram" },
+      { RETRO_MEMORY_SAVE_RAM,   "save_ram"   },
+      { RETRO_MEMORY_VIDEO_RAM,  "video_ram"  },
+      { RETRO_MEMORY_RTC,        "rtc"        }
+   };
+   unsigned count = 0;
+
+   while (str && *str && count < max)
+   {
+      unsigned i;
+      size_t len;
+
+      while (*str == ',' || *str == ' ')
+         str++;
+      for (len = 0; str[len] && str[len] != ',' && str[len] != ' '; len++);
+      if (!len)
+         break;
+
+      for (i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+      {
+         if (     strlen(names[i].name) == len
+               && !strncmp(str, names[i].name, len))
+         {
+            ids[count++] = names[i].id;
+            break;
+         }
+      }
+      str += len;
+   }
+
+   return count;
+}
+
+size_t netplay_checksum_config_pack(const netplay_checksum_t *cs,
+      uint8_t *buf, size_t len)
+{
+   unsigned i;
+   uint32_t interval;
+   uint32_t stride;
+
+   if (!cs || !buf || len < NETPLAY_CHECKSUM_CONFIG_SIZE)
+      return 0;
+
+   /* 0 and 1 both hash every frame */
+   interval = cs->interval > 1 ? (uint32_t)cs->interval : 1;
+   stride   = (uint32_t)cs->stride;
+
+   buf[0] = (uint8_t)cs->mode;
+   buf[1] = (uint8_t)(interval >> 24);
+   buf[2] = (uint8_t)(interval >> 16);
+   buf[3] = (uint8_t)(interval >>  8);
+   buf[4] = (uint8_t)interval;
+   buf[5] = (uint8_t)(stride   >> 24);
+   buf[6] = (uint8_t)(stride   >> 16);
+   buf[7] = (uint8_t)(stride   >>  8);
+   buf[8] = (uint8_t)stride;
+   buf[9] = (uint8_t)cs->region_count;
+   for (i = 0; i < NETPLAY_CHECKSUM_MAX_REGIONS; i++)
+      buf[10 + i] = i < cs->region_count ? (uint8_t)cs->region_ids[i] : 0;
+   return NETPLAY_CHECKSUM_CONFIG_SIZE;
+}
+
+bool netplay_checksum_config_unpack(const uint8_t *buf, size_t len,
+      netplay_checksum_t *cs)
+{
+   unsigned i;
+
+   if (     !buf || !cs
+         || len < NETPLAY_CHECKSUM_CONFIG_SIZE
+         || buf[0] > NETPLAY_CHECKSUM_NONE
+         || buf[9] > NETPLAY_CHECKSUM_MAX_REGIONS)
+      return false;
+
+   cs->mode         = (enum netplay_checksum_mode)buf[0];
+   cs->interval     = ((unsigned)buf[1] << 24) | ((unsigned)buf[2] << 16)
+                    | ((unsigned)buf[3] <<  8) |  (unsigned)buf[4];
+   cs->stride       = ((size_t)buf[5]   << 24) | ((size_t)buf[6]   << 16)
+                    | ((size_t)buf[7]   <<  8) |  (size_t)buf[8];
+   cs->region_count = buf[9];
+   for (i = 0; i < NETPLAY_CHECKSUM_MAX_REGIONS; i++)
+      cs->region_ids[i] = buf[10 + i];
+   return true;
+}
+
+bool netplay_checksum_config_equal(const netplay_checksum_t *a,
+      const netplay_checksum_t *b)
+{
+   unsigned i;
+
+   if (     a->mode         != b->mode
+         || a->region_count != b->region_count)
+      return false;
+   /* Without a hash the rest never matters */
+   if (a->mode == NETPLAY_CHECKSUM_NONE)
+      return true;
+   if (     (a->interval > 1 ? a->interval : 1)
+         != (b->interval > 1 ? b->interval : 1)
+         || a->stride != b->stride)
+      return false;
+   /* Regions are hashed in order */
+   for (i = 0; i < a->region_count; i++)
+      if (a->region_ids[i] != b->region_ids[i])
+         return false;
+   return true;
+}
+
+size_t netplay_checksum_config_describe(const netplay_checksum_t *cs,
+      char *s, size_t len)
+{
+   int written;
+
+   if (!cs || !s || !len)
+      return 0;
+
+   written = snprintf(s, len, "%s, interval %u, stride %u, %u region(s)",
+         netplay_checksum_mode_to_string(cs->mode),
+         cs->interval > 1 ? cs->interval : 1,
+         (unsigned)cs->stride, cs->region_count);
+   return written > 0 ? (size_t)written : 0;
+}
+
+uint32_t netplay_checksum_frame(const netplay_checksum_t *cs,
+      int frame, const void *data, size_t len)
+{
+   if (!netplay_checksum_wants_frame(cs, frame))
+      return 0;
+   return netplay_checksum_compute(cs, data, len);
+}
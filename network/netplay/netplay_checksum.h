@@ -0,0 +1,174 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2021 - Daniel De Matteis
+ *  Copyright (C) 2024-2025 - Jamie Meyer
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RARCH_NETPLAY_CHECKSUM_H
+#define __RARCH_NETPLAY_CHECKSUM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <boolean.h>
+#include <retro_common_api.h>
+
+RETRO_BEGIN_DECLS
+
+#define NETPLAY_CHECKSUM_SAMPLE_SIZE 256
+#define NETPLAY_CHECKSUM_MAX_REGIONS 4
+/* Bytes written by netplay_checksum_config_pack */
+#define NETPLAY_CHECKSUM_CONFIG_SIZE (10 + NETPLAY_CHECKSUM_MAX_REGIONS)
+
+/* Hash used to fill GekkoNet's SaveEvent checksum. Every peer of a
+ * session must use the same mode, interval and stride, otherwise the
+ * session reports desyncs on every checked frame. */
+enum netplay_checksum_mode
+{
+   /* zlib-compatible software CRC-32 (legacy behaviour) */
+   NETPLAY_CHECKSUM_CRC32 = 0,
+   /* XXH3-64, folded to 32 bits */
+   NETPLAY_CHECKSUM_XXH3,
+   /* CRC-32C (Castagnoli); SSE4.2 or ARMv8 CRC when available */
+   NETPLAY_CHECKSUM_CRC32C,
+   /* Never hash; desync detection is effectively disabled */
+   NETPLAY_CHECKSUM_NONE
+};
+
+typedef struct netplay_checksum
+{
+   enum netplay_checksum_mode mode;
+   /* Only frames that are a multiple of this are hashed; others
+    * report a checksum of 0. 0 and 1 both mean every frame. */
+   unsigned interval;
+   /* When non-zero, only the first NETPLAY_CHECKSUM_SAMPLE_SIZE bytes
+    * of every 'stride' bytes are hashed. */
+   size_t   stride;
+   /* Core memory (RETRO_MEMORY_*) hashed instead of the serialized
+    * state, when the core exposes any of it */
+   unsigned region_ids[NETPLAY_CHECKSUM_MAX_REGIONS];
+   unsigned region_count;
+} netplay_checksum_t;
+
+/* A piece of core memory hashed in place of the state */
+typedef struct netplay_checksum_region
+{
+   const void *data;
+   size_t      len;
+} netplay_checksum_region_t;
+
+/**
+ * netplay_checksum_mode_from_string
+ * @str                  : "crc32", "xxh3", "crc32c" or "none"
+ *
+ * Returns the matching mode, NETPLAY_CHECKSUM_CRC32 if unknown.
+ */
+enum netplay_checksum_mode netplay_checksum_mode_from_string(
+      const char *str);
+
+const char *netplay_checksum_mode_to_string(
+      enum netplay_checksum_mode mode);
+
+/**
+ * netplay_checksum_hw_accelerated
+ *
+ * Returns true if CRC-32C is computed with CPU instructions
+ * on this machine.
+ */
+bool netplay_checksum_hw_accelerated(void);
+
+/**
+ * netplay_checksum_wants_frame
+ *
+ * Returns true if @frame is to be hashed under @cs.
+ */
+bool netplay_checksum_wants_frame(const netplay_checksum_t *cs,
+      int frame);
+
+/**
+ * netplay_checksum_compute
+ *
+ * Hash @len bytes of @data according to @cs, ignoring the
+ * frame interval.
+ */
+uint32_t netplay_checksum_compute(const netplay_checksum_t *cs,
+      const void *data, size_t len);
+
+/**
+ * netplay_checksum_compute_regions
+ *
+ * Hash @count pieces of core memory one after the other, as
+ * netplay_checksum_compute() hashes a state, stride included.
+ */
+uint32_t netplay_checksum_compute_regions(const netplay_checksum_t *cs,
+      const netplay_checksum_region_t *regions, unsigned count);
+
+/**
+ * netplay_checksum_regions_from_string
+ * @str                  : comma separated "system_ram", "save_ram",
+ *                         "video_ram" and "rtc"
+ * @ids                  : receives up to @max RETRO_MEMORY_* ids
+ *
+ * Returns the number of ids written; unknown names are skipped.
+ */
+unsigned netplay_checksum_regions_from_string(const char *str,
+      unsigned *ids, unsigned max);
+
+/**
+ * netplay_checksum_config_pack
+ *
+ * Writes mode, interval, stride and regions of @cs for a peer to
+ * compare with its own. Returns the number of bytes written, 0 if
+ * @len is short of NETPLAY_CHECKSUM_CONFIG_SIZE.
+ */
+size_t netplay_checksum_config_pack(const netplay_checksum_t *cs,
+      uint8_t *buf, size_t len);
+
+/**
+ * netplay_checksum_config_unpack
+ *
+ * Reads a peer's configuration written by
+ * netplay_checksum_config_pack(). Returns false if it is malformed.
+ */
+bool netplay_checksum_config_unpack(const uint8_t *buf, size_t len,
+      netplay_checksum_t *cs);
+
+/**
+ * netplay_checksum_config_equal
+ *
+ * Returns true if @a and @b hash every state the same way.
+ */
+bool netplay_checksum_config_equal(const netplay_checksum_t *a,
+      const netplay_checksum_t *b);
+
+/**
+ * netplay_checksum_config_describe
+ *
+ * Writes a short human readable summary of @cs to @s.
+ */
+size_t netplay_checksum_config_describe(const netplay_checksum_t *cs,
+      char *s, size_t len);
+
+/**
+ * netplay_checksum_frame
+ *
+ * Hash the state of @frame, or return 0 if the frame is skipped
+ * by the configured interval.
+ */
+uint32_t netplay_checksum_frame(const netplay_checksum_t *cs,
+      int frame, const void *data, size_t len);
+
+RETRO_END_DECLS
+
+#endif
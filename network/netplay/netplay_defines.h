@@ -77,7 +77,9 @@ enum rarch_netplay_ctl_state
    RARCH_NETPLAY_CTL_SET_CORE_PACKET_INTERFACE,
    RARCH_NETPLAY_CTL_USE_CORE_PACKET_INTERFACE,
    RARCH_NETPLAY_CTL_GET_SESSION_STATUS,
-   RARCH_NETPLAY_CTL_ALLOW_TIMESKIP
+   RARCH_NETPLAY_CTL_ALLOW_TIMESKIP,
+   RARCH_NETPLAY_CTL_TIMESYNC_ADJUST,
+   RARCH_NETPLAY_CTL_GET_TELEMETRY
 };
 
 /* The current status of a connection */
@@ -0,0 +1,109 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2021 - Daniel De Matteis
+ *  Copyright (C) 2024-2025 - Jamie Meyer
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "netplay_events.h"
+
+netplay_event_plan_t *netplay_events_begin(netplay_events_t *ev, int count)
+{
+   ev->count     = 0;
+   ev->presented = -1;
+
+   if (count <= 0)
+      return NULL;
+
+   if (count > ev->capacity)
+   {
+      netplay_event_plan_t *plan = (netplay_event_plan_t*)realloc(
+            ev->plan, count * sizeof(*plan));
+      if (!plan)
+         return NULL;
+      ev->plan     = plan;
+      ev->capacity = count;
+   }
+
+   memset(ev->plan, 0, count * sizeof(*ev->plan));
+   ev->count = count;
+   return ev->plan;
+}
+
+int netplay_events_plan(netplay_events_t *ev, bool present)
+{
+   int i;
+   int last_advance = -1;
+
+   ev->presented = -1;
+
+   for (i = 0; i < ev->count; i++)
+      if (ev->plan[i].type == NETPLAY_EVENT_ADVANCE)
+         last_advance = i;
+
+   /* A rollback's frames are never shown, and a load after the last
+    * advance would undo it before core_run() got to it */
+   if (     present
+         && last_advance >= 0
+         && !ev->plan[last_advance].rolling_back)
+   {
+      ev->presented = last_advance;
+      for (i = last_advance + 1; i < ev->count; i++)
+      {
+         if (ev->plan[i].type == NETPLAY_EVENT_LOAD)
+         {
+            ev->presented = -1;
+            break;
+         }
+      }
+   }
+
+   for (i = 0; i < ev->count; i++)
+   {
+      netplay_event_plan_t *plan = &ev->plan[i];
+
+      switch (plan->type)
+      {
+         case NETPLAY_EVENT_ADVANCE:
+            plan->action = (i == ev->presented)
+               ? NETPLAY_EVENT_PRESENT : NETPLAY_EVENT_RESIMULATE;
+            break;
+         case NETPLAY_EVENT_SAVE:
+            /* A save after the presented advance holds the frame
+             * after it, so it waits for core_run() */
+            plan->action = (ev->presented >= 0 && i > ev->presented)
+               ? NETPLAY_EVENT_SAVE_AFTER : NETPLAY_EVENT_SAVE_NOW;
+            break;
+         case NETPLAY_EVENT_LOAD:
+            plan->action = NETPLAY_EVENT_LOAD_NOW;
+            break;
+         default:
+            plan->action = NETPLAY_EVENT_SKIP;
+            break;
+      }
+   }
+
+   return ev->presented;
+}
+
+void netplay_events_free(netplay_events_t *ev)
+{
+   free(ev->plan);
+   ev->plan      = NULL;
+   ev->capacity  = 0;
+   ev->count     = 0;
+   ev->presented = -1;
+}
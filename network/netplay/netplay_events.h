@@ -0,0 +1,92 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2021 - Daniel De Matteis
+ *  Copyright (C) 2024-2025 - Jamie Meyer
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RARCH_NETPLAY_EVENTS_H
+#define __RARCH_NETPLAY_EVENTS_H
+
+#include <boolean.h>
+#include <retro_common_api.h>
+
+RETRO_BEGIN_DECLS
+
+/* The game events of a GekkoNet update, as far as their order goes */
+enum netplay_event_type
+{
+   NETPLAY_EVENT_OTHER = 0,
+   NETPLAY_EVENT_ADVANCE,
+   NETPLAY_EVENT_SAVE,
+   NETPLAY_EVENT_LOAD
+};
+
+enum netplay_event_action
+{
+   NETPLAY_EVENT_SKIP = 0,
+   /* Run the frame here, unpresented */
+   NETPLAY_EVENT_RESIMULATE,
+   /* Leave the frame to core_run(), which presents it */
+   NETPLAY_EVENT_PRESENT,
+   NETPLAY_EVENT_SAVE_NOW,
+   /* Save once the presented frame has run, before the next update */
+   NETPLAY_EVENT_SAVE_AFTER,
+   NETPLAY_EVENT_LOAD_NOW
+};
+
+typedef struct netplay_event_plan
+{
+   enum netplay_event_type   type;
+   enum netplay_event_action action;
+   bool                      rolling_back;
+} netplay_event_plan_t;
+
+/* Decides what is done with every event of an update. Only the last
+ * advance of an update made right before core_run() is left to it, so
+ * that it is the one frame shown; saves after it wait until it ran.
+ * The plan of the latest update is kept for those saves. */
+typedef struct netplay_events
+{
+   netplay_event_plan_t *plan;
+   int                   capacity;
+   int                   count;
+   /* Index of the advance left for core_run(), -1 if none */
+   int                   presented;
+} netplay_events_t;
+
+/**
+ * netplay_events_begin
+ * @count                : number of events in the update
+ *
+ * Returns @count entries for the caller to fill in with the type of
+ * every event and whether advances roll back, or NULL on failure.
+ * The previous plan is gone afterwards.
+ */
+netplay_event_plan_t *netplay_events_begin(netplay_events_t *ev, int count);
+
+/**
+ * netplay_events_plan
+ * @present              : core_run() follows the update and presents
+ *                         its last advance
+ *
+ * Fill in the action of every event. Returns the index of the advance
+ * left for core_run(), -1 if every advance runs here.
+ */
+int netplay_events_plan(netplay_events_t *ev, bool present);
+
+void netplay_events_free(netplay_events_t *ev);
+
+RETRO_END_DECLS
+
+#endif
@@ -0,0 +1,595 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2021 - Daniel De Matteis
+ *  Copyright (C) 2024-2025 - Jamie Meyer
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <compat/strl.h>
+#include <string/stdstring.h>
+#include <streams/file_stream.h>
+
+#include "netplay_checksum.h"
+#include "netplay_forensics.h"
+
+#define NETPLAY_FORENSICS_MSG_HASHES  1
+#define NETPLAY_FORENSICS_MSG_VERSION 1
+#define NETPLAY_FORENSICS_HEADER_SIZE 20
+
+/* Section tags looked for in a state, see netplay_forensics_sections */
+#define NETPLAY_FORENSICS_MAX_SECTIONS 512
+/* Bytes compared to place a region in a state */
+#define NETPLAY_FORENSICS_PROBE_SIZE   64
+
+typedef struct netplay_forensics_section
+{
+   size_t offset;
+   char   name[32];
+} netplay_forensics_section_t;
+
+/* Block hashes never go into a session checksum, so they use the
+ * fastest portable hash regardless of the session's mode */
+static const netplay_checksum_t netplay_forensics_hash = {
+   NETPLAY_CHECKSUM_XXH3, 1, 0
+};
+
+static void netplay_forensics_put32(uint8_t *p, uint32_t v)
+{
+   p[0] = (uint8_t)(v);
+   p[1] = (uint8_t)(v >> 8);
+   p[2] = (uint8_t)(v >> 16);
+   p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t netplay_forensics_get32(const uint8_t *p)
+{
+   return (uint32_t)p[0]
+        | ((uint32_t)p[1] << 8)
+        | ((uint32_t)p[2] << 16)
+        | ((uint32_t)p[3] << 24);
+}
+
+bool netplay_forensics_init(netplay_forensics_t *f, unsigned history)
+{
+   unsigned i;
+
+   if (!f)
+      return false;
+
+   netplay_forensics_free(f);
+   f->desync_frame = -1;
+
+   if (!history)
+      return true;
+   if (history > NETPLAY_FORENSICS_MAX_HISTORY)
+      history = NETPLAY_FORENSICS_MAX_HISTORY;
+
+   f->entries = (netplay_forensics_entry_t*)calloc(history,
+         sizeof(*f->entries));
+   if (!f->entries)
+      return false;
+
+   f->history = history;
+   for (i = 0; i < history; i++)
+      f->entries[i].frame = -1;
+   return true;
+}
+
+void netplay_forensics_free(netplay_forensics_t *f)
+{
+   unsigned i;
+
+   if (!f)
+      return;
+
+   for (i = 0; i < f->history; i++)
+      free(f->entries[i].hashes);
+   for (i = 0; i < f->remote_count; i++)
+   {
+      free(f->remotes[i].hashes);
+      free(f->remotes[i].have);
+   }
+   free(f->entries);
+   free(f->pinned.hashes);
+   memset(f, 0, sizeof(*f));
+   f->desync_frame = -1;
+   f->sent_frame   = -1;
+}
+
+void netplay_forensics_record(netplay_forensics_t *f, int frame,
+      const void *state, size_t len)
+{
+   unsigned i, blocks;
+   netplay_forensics_entry_t *entry;
+   const uint8_t *data = (const uint8_t*)state;
+
+   if (!f || !f->history || !state || !len || frame < 0)
+      return;
+
+   entry  = &f->entries[(unsigned)frame % f->history];
+   blocks = (unsigned)((len + NETPLAY_FORENSICS_BLOCK_SIZE - 1)
+         / NETPLAY_FORENSICS_BLOCK_SIZE);
+
+   if (blocks > entry->block_capacity)
+   {
+      uint32_t *hashes = (uint32_t*)realloc(entry->hashes,
+            blocks * sizeof(*hashes));
+      if (!hashes)
+      {
+         entry->frame = -1;
+         return;
+      }
+      entry->hashes         = hashes;
+      entry->block_capacity = blocks;
+   }
+
+   for (i = 0; i < blocks; i++)
+   {
+      size_t off   = (size_t)i * NETPLAY_FORENSICS_BLOCK_SIZE;
+      size_t chunk = len - off < NETPLAY_FORENSICS_BLOCK_SIZE
+         ? len - off : NETPLAY_FORENSICS_BLOCK_SIZE;
+      entry->hashes[i] = netplay_checksum_compute(&netplay_forensics_hash,
+            data + off, chunk);
+   }
+
+   entry->block_count = blocks;
+   entry->state_len   = (uint32_t)len;
+   entry->frame       = frame;
+}
+
+const netplay_forensics_entry_t *netplay_forensics_find(
+      const netplay_forensics_t *f, int frame)
+{
+   const netplay_forensics_entry_t *entry;
+
+   if (!f || frame < 0)
+      return NULL;
+   if (f->pinned.hashes && f->pinned.frame == frame)
+      return &f->pinned;
+   if (!f->history)
+      return NULL;
+
+   entry = &f->entries[(unsigned)frame % f->history];
+   return entry->frame == frame ? entry : NULL;
+}
+
+const netplay_forensics_entry_t *netplay_forensics_pin(
+      netplay_forensics_t *f, int frame)
+{
+   const netplay_forensics_entry_t *entry;
+
+   if (!f || f->desync_frame >= 0)
+      return NULL;
+
+   f->desync_frame = frame;
+   if (!(entry = netplay_forensics_find(f, frame)))
+      return NULL;
+
+   f->pinned.hashes = (uint32_t*)malloc(
+         entry->block_count * sizeof(*entry->hashes));
+   if (!f->pinned.hashes)
+      return NULL;
+
+   memcpy(f->pinned.hashes, entry->hashes,
+         entry->block_count * sizeof(*entry->hashes));
+   f->pinned.block_capacity = entry->block_count;
+   f->pinned.block_count    = entry->block_count;
+   f->pinned.state_len      = entry->state_len;
+   f->pinned.frame          = frame;
+   return &f->pinned;
+}
+
+size_t netplay_forensics_message(const netplay_forensics_entry_t *entry,
+      unsigned chunk, uint8_t *buf, size_t len)
+{
+   unsigned i, first, count;
+
+   if (!entry || !buf || len < NETPLAY_FORENSICS_MESSAGE_MAX)
+      return 0;
+
+   first = chunk * NETPLAY_FORENSICS_CHUNK_HASHES;
+   if (first >= entry->block_count)
+      return 0;
+
+   count = entry->block_count - first;
+   if (count > NETPLAY_FORENSICS_CHUNK_HASHES)
+      count = NETPLAY_FORENSICS_CHUNK_HASHES;
+
+   buf[0] = NETPLAY_FORENSICS_MSG_HASHES;
+   buf[1] = NETPLAY_FORENSICS_MSG_VERSION;
+   buf[2] = (uint8_t)(count);
+   buf[3] = (uint8_t)(count >> 8);
+   netplay_forensics_put32(buf + 4,  (uint32_t)entry->frame);
+   netplay_forensics_put32(buf + 8,  entry->state_len);
+   netplay_forensics_put32(buf + 12, entry->block_count);
+   netplay_forensics_put32(buf + 16, first);
+
+   for (i = 0; i < count; i++)
+      netplay_forensics_put32(buf + NETPLAY_FORENSICS_HEADER_SIZE + i * 4,
+            entry->hashes[first + i]);
+
+   return NETPLAY_FORENSICS_HEADER_SIZE + (size_t)count * 4;
+}
+
+netplay_forensics_remote_t *netplay_forensics_receive(netplay_forensics_t *f,
+      const char *from, const uint8_t *data, size_t len)
+{
+   unsigned i, count, blocks, first;
+   uint32_t state_len;
+   int frame;
+   netplay_forensics_remote_t *remote = NULL;
+
+   if (!f || !from || !data || len < NETPLAY_FORENSICS_HEADER_SIZE)
+      return NULL;
+   if (     data[0] != NETPLAY_FORENSICS_MSG_HASHES
+         || data[1] != NETPLAY_FORENSICS_MSG_VERSION)
+      return NULL;
+
+   count     = (unsigned)data[2] | ((unsigned)data[3] << 8);
+   frame     = (int)netplay_forensics_get32(data + 4);
+   state_len = netplay_forensics_get32(data + 8);
+   blocks    = netplay_forensics_get32(data + 12);
+   first     = netplay_forensics_get32(data + 16);
+
+   if (     len < NETPLAY_FORENSICS_HEADER_SIZE + (size_t)count * 4
+         || !blocks
+         || (uint64_t)blocks * NETPLAY_FORENSICS_BLOCK_SIZE
+            < state_len
+         || blocks > state_len / NETPLAY_FORENSICS_BLOCK_SIZE + 1
+         || first >= blocks
+         || count > blocks - first)
+      return NULL;
+
+   for (i = 0; i < f->remote_count; i++)
+   {
+      if (string_is_equal(f->remotes[i].name, from))
+      {
+         remote = &f->remotes[i];
+         break;
+      }
+   }
+
+   if (!remote)
+   {
+      if (f->remote_count >= NETPLAY_FORENSICS_MAX_REMOTES)
+         return NULL;
+      remote = &f->remotes[f->remote_count++];
+      memset(remote, 0, sizeof(*remote));
+      strlcpy(remote->name, from, sizeof(remote->name));
+      remote->frame = -1;
+   }
+
+   /* A different frame starts over */
+   if (     remote->frame != frame
+         || remote->block_count != blocks
+         || remote->state_len != state_len)
+   {
+      free(remote->hashes);
+      free(remote->have);
+      remote->hashes = (uint32_t*)calloc(blocks, sizeof(*remote->hashes));
+      remote->have   = (uint8_t*)calloc(blocks, 1);
+      if (!remote->hashes || !remote->have)
+      {
+         free(remote->hashes);
+         free(remote->have);
+         remote->hashes      = NULL;
+         remote->have        = NULL;
+         remote->block_count = 0;
+         remote->frame       = -1;
+         return NULL;
+      }
+      remote->frame       = frame;
+      remote->block_count = blocks;
+      remote->state_len   = state_len;
+      remote->received    = 0;
+      remote->reported    = false;
+   }
+
+   for (i = 0; i < count; i++)
+   {
+      unsigned block = first + i;
+      remote->hashes[block] = netplay_forensics_get32(
+            data + NETPLAY_FORENSICS_HEADER_SIZE + i * 4);
+      if (!remote->have[block])
+      {
+         remote->have[block] = 1;
+         remote->received++;
+      }
+   }
+
+   if (remote->received == remote->block_count && !remote->reported)
+      return remote;
+   return NULL;
+}
+
+/* Where @region's current contents sit in @state, or -1. */
+static int64_t netplay_forensics_locate(
+      const netplay_forensics_region_t *region,
+      const uint8_t *state, size_t len)
+{
+   size_t probe, i;
+   size_t verify;
+
+   if (!region->ptr || region->len < NETPLAY_FORENSICS_PROBE_SIZE
+         || region->len > len)
+      return -1;
+
+   /* Use the first window that is not a single repeated byte, so a
+    * zeroed prefix does not match every padding area of the state */
+   for (probe = 0; probe + NETPLAY_FORENSICS_PROBE_SIZE <= region->len;
+         probe += NETPLAY_FORENSICS_PROBE_SIZE)
+   {
+      const uint8_t *w = region->ptr + probe;
+      for (i = 1; i < NETPLAY_FORENSICS_PROBE_SIZE; i++)
+         if (w[i] != w[0])
+            break;
+      if (i < NETPLAY_FORENSICS_PROBE_SIZE)
+         break;
+   }
+   if (probe + NETPLAY_FORENSICS_PROBE_SIZE > region->len)
+      return -1;
+
+   verify = region->len < NETPLAY_FORENSICS_BLOCK_SIZE
+      ? region->len : NETPLAY_FORENSICS_BLOCK_SIZE;
+
+   for (i = probe; i + region->len - probe <= len; i++)
+   {
+      const uint8_t *base;
+
+      if (     state[i] != region->ptr[probe]
+            || memcmp(state + i, region->ptr + probe,
+               NETPLAY_FORENSICS_PROBE_SIZE))
+         continue;
+
+      base = state + i - probe;
+      if (!memcmp(base, region->ptr, verify))
+         return (int64_t)(i - probe);
+   }
+
+   return -1;
+}
+
+static bool netplay_forensics_tag_char(uint8_t c)
+{
+   return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')
+      || (c >= '0' && c <= '9') || c == '_' || c == '.' || c == ' ';
+}
+
+/* Look for the chunk headers cores commonly put in their states:
+ * "TAG:000123:" length-prefixed blocks, and section names padded
+ * with NULs to 32 bytes. */
+static unsigned netplay_forensics_sections(const uint8_t *state, size_t len,
+      netplay_forensics_section_t *sections, unsigned max)
+{
+   size_t i;
+   unsigned count = 0;
+
+   for (i = 0; i + 11 <= len && count < max; i++)
+   {
+      unsigned n, k;
+      uint8_t c = state[i];
+
+      if (!((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')))
+         continue;
+      if (i && netplay_forensics_tag_char(state[i - 1]))
+         continue;
+
+      for (n = 1; n < 31 && i + n < len
+            && netplay_forensics_tag_char(state[i + n]); n++);
+
+      if (i + n < len && state[i + n] == ':' && n >= 3
+            && i + n + 8 <= len && state[i + n + 7] == ':')
+      {
+         for (k = 1; k <= 6; k++)
+            if (state[i + n + k] < '0' || state[i + n + k] > '9')
+               break;
+         if (k <= 6)
+            continue;
+      }
+      else if (n >= 3 && (i & 3) == 0 && i + 32 <= len)
+      {
+         for (k = n; k < 32; k++)
+            if (state[i + k])
+               break;
+         if (k < 32)
+            continue;
+      }
+      else
+         continue;
+
+      sections[count].offset = i;
+      memcpy(sections[count].name, state + i, n);
+      sections[count].name[n] = '\0';
+      count++;
+      i += n;
+   }
+
+   return count;
+}
+
+static void netplay_forensics_describe_range(size_t start, size_t end,
+      const netplay_forensics_region_t *regions, const int64_t *offsets,
+      unsigned region_count, const netplay_forensics_section_t *sections,
+      unsigned section_count, char *s, size_t len)
+{
+   unsigned i;
+   size_t _len = 0;
+   const char *section = NULL;
+
+   s[0] = '\0';
+
+   for (i = 0; i < section_count && sections[i].offset < end; i++)
+      section = sections[i].name;
+   if (section)
+      _len += snprintf(s + _len, len - _len, " section=%s", section);
+
+   for (i = 0; i < region_count && _len < len; i++)
+   {
+      size_t lo, hi;
+      if (offsets[i] < 0)
+         continue;
+      lo = (size_t)offsets[i];
+      hi = lo + regions[i].len;
+      if (hi <= start || lo >= end)
+         continue;
+      _len += snprintf(s + _len, len - _len,
+            " region=%s address=0x%llx-0x%llx", regions[i].name,
+            (unsigned long long)(regions[i].start
+               + (start > lo ? start - lo : 0)),
+            (unsigned long long)(regions[i].start
+               + (end < hi ? end : hi) - lo - 1));
+   }
+}
+
+bool netplay_forensics_write_report(const netplay_forensics_t *f,
+      int frame, const netplay_forensics_remote_t *remote,
+      const netplay_forensics_region_t *regions, unsigned region_count,
+      const uint8_t *live_state, size_t live_len,
+      const char *header, const char *path)
+{
+   unsigned i;
+   unsigned diff_blocks    = 0;
+   unsigned ranges         = 0;
+   unsigned section_count  = 0;
+   unsigned located        = 0;
+   int64_t *offsets        = NULL;
+   netplay_forensics_section_t *sections = NULL;
+   const netplay_forensics_entry_t *entry = netplay_forensics_find(f, frame);
+   RFILE *file;
+
+   if (!entry || !path || !*path)
+      return false;
+
+   if (!(file = filestream_open(path, RETRO_VFS_FILE_ACCESS_WRITE,
+         RETRO_VFS_FILE_ACCESS_HINT_NONE)))
+      return false;
+
+   if (region_count)
+      offsets = (int64_t*)malloc(region_count * sizeof(*offsets));
+   if (live_state && live_len)
+      sections = (netplay_forensics_section_t*)malloc(
+            NETPLAY_FORENSICS_MAX_SECTIONS * sizeof(*sections));
+
+   for (i = 0; offsets && i < region_count; i++)
+   {
+      offsets[i] = live_state
+         ? netplay_forensics_locate(&regions[i], live_state, live_len) : -1;
+      if (offsets[i] >= 0)
+         located++;
+   }
+   if (sections)
+      section_count = netplay_forensics_sections(live_state, live_len,
+            sections, NETPLAY_FORENSICS_MAX_SECTIONS);
+
+   filestream_printf(file, "# RetroArch netplay desync report\n");
+   if (header && *header)
+      filestream_printf(file, "%s", header);
+   filestream_printf(file, "frame: %d\n", frame);
+   filestream_printf(file, "local state: %u bytes, %u blocks of %u bytes\n",
+         (unsigned)entry->state_len, entry->block_count,
+         (unsigned)NETPLAY_FORENSICS_BLOCK_SIZE);
+
+   if (remote)
+   {
+      filestream_printf(file, "remote peer: %s\n", remote->name);
+      filestream_printf(file, "remote state: %u bytes, %u blocks\n",
+            (unsigned)remote->state_len, remote->block_count);
+      if (remote->state_len != entry->state_len)
+         filestream_printf(file, "warning: the states differ in size\n");
+   }
+   else
+      filestream_printf(file, "remote peer: none, local hashes only\n");
+
+   filestream_printf(file, "memory regions located in the state: %u of %u\n",
+         located, region_count);
+   for (i = 0; offsets && i < region_count; i++)
+   {
+      if (offsets[i] >= 0)
+         filestream_printf(file, "  %s: %u bytes at state offset 0x%llx\n",
+               regions[i].name, (unsigned)regions[i].len,
+               (unsigned long long)offsets[i]);
+      else
+         filestream_printf(file, "  %s: %u bytes, not found\n",
+               regions[i].name, (unsigned)regions[i].len);
+   }
+   filestream_printf(file, "section tags found in the state: %u\n",
+         section_count);
+
+   if (remote)
+   {
+      unsigned blocks = entry->block_count > remote->block_count
+         ? entry->block_count : remote->block_count;
+
+      filestream_printf(file, "\n# Divergent ranges\n");
+      filestream_printf(file, "# offset end blocks where\n");
+
+      i = 0;
+      while (i < blocks)
+      {
+         char where[512];
+         unsigned first;
+         size_t start, end;
+
+         if (     i < entry->block_count && i < remote->block_count
+               && entry->hashes[i] == remote->hashes[i])
+         {
+            i++;
+            continue;
+         }
+
+         first = i;
+         while (i < blocks && !(i < entry->block_count
+                  && i < remote->block_count
+                  && entry->hashes[i] == remote->hashes[i]))
+            i++;
+
+         start = (size_t)first * NETPLAY_FORENSICS_BLOCK_SIZE;
+         end   = (size_t)i * NETPLAY_FORENSICS_BLOCK_SIZE;
+         netplay_forensics_describe_range(start, end, regions, offsets,
+               offsets ? region_count : 0, sections, section_count,
+               where, sizeof(where));
+         filestream_printf(file, "0x%08llx 0x%08llx %u%s\n",
+               (unsigned long long)start, (unsigned long long)end,
+               i - first, where);
+
+         diff_blocks += i - first;
+         ranges++;
+      }
+
+      filestream_printf(file, "\ndivergent blocks: %u of %u in %u range(s)\n",
+            diff_blocks, blocks, ranges);
+   }
+   else
+   {
+      filestream_printf(file, "\n# Block hashes, compare with the other peer's report\n");
+      for (i = 0; i < entry->block_count; i++)
+         filestream_printf(file, "%u %08x\n", i, entry->hashes[i]);
+   }
+
+   if (section_count)
+   {
+      filestream_printf(file, "\n# Section tags\n");
+      for (i = 0; i < section_count; i++)
+         filestream_printf(file, "0x%08llx %s\n",
+               (unsigned long long)sections[i].offset, sections[i].name);
+   }
+
+   free(offsets);
+   free(sections);
+   filestream_close(file);
+   return true;
+}
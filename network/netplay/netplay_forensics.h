@@ -0,0 +1,173 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2021 - Daniel De Matteis
+ *  Copyright (C) 2024-2025 - Jamie Meyer
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RARCH_NETPLAY_FORENSICS_H
+#define __RARCH_NETPLAY_FORENSICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <boolean.h>
+#include <retro_common_api.h>
+
+RETRO_BEGIN_DECLS
+
+/* Granularity of the state comparison */
+#define NETPLAY_FORENSICS_BLOCK_SIZE    4096
+#define NETPLAY_FORENSICS_MAX_HISTORY   120
+#define NETPLAY_FORENSICS_MAX_REMOTES   4
+/* Block hashes per message; keeps every message below the MTU */
+#define NETPLAY_FORENSICS_CHUNK_HASHES  256
+#define NETPLAY_FORENSICS_MESSAGE_MAX   (20 + NETPLAY_FORENSICS_CHUNK_HASHES * 4)
+
+/* Block hashes of one saved frame */
+typedef struct netplay_forensics_entry
+{
+   uint32_t *hashes;
+   unsigned  block_capacity;
+   unsigned  block_count;
+   uint32_t  state_len;
+   int       frame;
+} netplay_forensics_entry_t;
+
+/* Block hashes of the desynced frame as a peer saw them, assembled
+ * from its messages */
+typedef struct netplay_forensics_remote
+{
+   char      name[64];
+   uint32_t *hashes;
+   uint8_t  *have;
+   unsigned  block_count;
+   unsigned  received;
+   uint32_t  state_len;
+   int       frame;
+   bool      reported;
+} netplay_forensics_remote_t;
+
+/* A piece of core memory, from a memory map descriptor or
+ * retro_get_memory_data() */
+typedef struct netplay_forensics_region
+{
+   char           name[48];
+   const uint8_t *ptr;
+   size_t         len;
+   /* Emulated address of ptr[0] */
+   uint64_t       start;
+} netplay_forensics_region_t;
+
+/* Keeps per-block hashes of the last saved frames, so that two peers
+ * can work out which parts of a desynced state differ while
+ * exchanging a few kilobytes rather than whole states. */
+typedef struct netplay_forensics
+{
+   netplay_forensics_entry_t  *entries;
+   unsigned                    history;
+   netplay_forensics_remote_t  remotes[NETPLAY_FORENSICS_MAX_REMOTES];
+   unsigned                    remote_count;
+   /* Hashes of the first desynced frame, kept once it leaves the
+    * history so they can be sent again */
+   netplay_forensics_entry_t   pinned;
+   /* First desync reported by GekkoNet, -1 if none yet */
+   int                         desync_frame;
+   /* Frame the pinned hashes were last sent at */
+   int                         sent_frame;
+} netplay_forensics_t;
+
+/**
+ * netplay_forensics_init
+ * @history              : frames to remember, 0 disables recording
+ *
+ * Returns false if the history could not be allocated.
+ */
+bool netplay_forensics_init(netplay_forensics_t *f, unsigned history);
+
+void netplay_forensics_free(netplay_forensics_t *f);
+
+/**
+ * netplay_forensics_record
+ *
+ * Hash @state block by block as the state of @frame. Saving a frame
+ * again, as happens during rollbacks, replaces the older hashes.
+ */
+void netplay_forensics_record(netplay_forensics_t *f, int frame,
+      const void *state, size_t len);
+
+/**
+ * netplay_forensics_find
+ *
+ * Returns the hashes recorded for @frame, or NULL if it has already
+ * left the history.
+ */
+const netplay_forensics_entry_t *netplay_forensics_find(
+      const netplay_forensics_t *f, int frame);
+
+/**
+ * netplay_forensics_pin
+ *
+ * Remember @frame as the desynced frame and keep a copy of its
+ * hashes. Only the first desync of a session is pinned.
+ *
+ * Returns the pinned hashes, or NULL if @frame is no longer in the
+ * history or another frame was pinned before.
+ */
+const netplay_forensics_entry_t *netplay_forensics_pin(
+      netplay_forensics_t *f, int frame);
+
+/**
+ * netplay_forensics_message
+ * @chunk                : 0 for the first message
+ * @buf                  : at least NETPLAY_FORENSICS_MESSAGE_MAX bytes
+ *
+ * Encode one message of the block hashes of @entry.
+ * Returns its length, or 0 once @chunk is past the last one.
+ */
+size_t netplay_forensics_message(const netplay_forensics_entry_t *entry,
+      unsigned chunk, uint8_t *buf, size_t len);
+
+/**
+ * netplay_forensics_receive
+ * @from                 : printable address of the sender
+ *
+ * Store a message of block hashes from a peer.
+ * Returns the peer once all of its blocks have arrived and no report
+ * was written for it yet, NULL otherwise.
+ */
+netplay_forensics_remote_t *netplay_forensics_receive(netplay_forensics_t *f,
+      const char *from, const uint8_t *data, size_t len);
+
+/**
+ * netplay_forensics_write_report
+ * @remote               : hashes of the other peer, or NULL to only
+ *                         list the local ones
+ * @live_state           : state serialized now, used to locate the
+ *                         regions and section tags; may be NULL
+ * @header               : free text placed at the top of the report
+ *
+ * Write a text report of the blocks of @frame that differ, mapped to
+ * the memory regions and section tags they fall into. Regions are
+ * found by looking for their current contents in @live_state, which
+ * works for the many cores that store memory verbatim.
+ */
+bool netplay_forensics_write_report(const netplay_forensics_t *f,
+      int frame, const netplay_forensics_remote_t *remote,
+      const netplay_forensics_region_t *regions, unsigned region_count,
+      const uint8_t *live_state, size_t live_len,
+      const char *header, const char *path);
+
+RETRO_END_DECLS
+
+#endif
@@ -20,6 +20,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <time.h>
 
 #if defined(__linux__)
 #include <unistd.h>
@@ -35,14 +36,17 @@
 
 #include <libretro.h>
 #include <lists/string_list.h>
-#include <encodings/crc32.h>
+#include <features/features_cpu.h>
 #include <string/stdstring.h>
 
 #include "../../configuration.h"
 #include "../../core.h"
+#include "../../driver.h"
 #include "../../paths.h"
 #include "../../runloop.h"
 #include "../../runahead.h"
+#include "../../content.h"
+#include "../../file_path_special.h"
 #include "../../verbosity.h"
 #include "../../msg_hash.h"
 #include "../../audio/audio_driver.h"
@@ -58,6 +62,7 @@
 
 #include "netplay.h"
 #include "netplay_private.h"
+#include "netplay_adapter.h"
 
 #include <file/file_path.h>
 #include <streams/file_stream.h>
@@ -87,27 +92,6 @@
 #include <wchar.h>
 #endif
 
-#define NETPLAY_BUTTON_COUNT 16
-
-static const unsigned netplay_button_map[NETPLAY_BUTTON_COUNT] = {
-   RETRO_DEVICE_ID_JOYPAD_B,
-   RETRO_DEVICE_ID_JOYPAD_Y,
-   RETRO_DEVICE_ID_JOYPAD_SELECT,
-   RETRO_DEVICE_ID_JOYPAD_START,
-   RETRO_DEVICE_ID_JOYPAD_UP,
-   RETRO_DEVICE_ID_JOYPAD_DOWN,
-   RETRO_DEVICE_ID_JOYPAD_LEFT,
-   RETRO_DEVICE_ID_JOYPAD_RIGHT,
-   RETRO_DEVICE_ID_JOYPAD_A,
-   RETRO_DEVICE_ID_JOYPAD_X,
-   RETRO_DEVICE_ID_JOYPAD_L,
-   RETRO_DEVICE_ID_JOYPAD_R,
-   RETRO_DEVICE_ID_JOYPAD_L2,
-   RETRO_DEVICE_ID_JOYPAD_R2,
-   RETRO_DEVICE_ID_JOYPAD_L3,
-   RETRO_DEVICE_ID_JOYPAD_R3
-};
-
 static net_driver_state_t networking_driver_st;
 
 static const char *netplay_diag_last_error_string(void);
@@ -202,6 +186,8 @@ static bool netplay_register_remote_actor_from_string(netplay_t *netplay,
       const char *server, unsigned fallback_port,
       netplay_host_diagnostics_t *diag, const char *failure_stage);
 
+static void netplay_open_replay(netplay_t *netplay);
+
 static void netplay_session_status_set(const char *status,
       unsigned current, unsigned total)
 {
@@ -258,12 +244,13 @@ typedef bool (GEKKONET_CALL *gekkonet_destroy_proc_t)(GekkoSession *session);
 typedef void (GEKKONET_CALL *gekkonet_start_proc_t)(GekkoSession *session, GekkoConfig *config);
 typedef void (GEKKONET_CALL *gekkonet_net_adapter_set_proc_t)(GekkoSession *session, GekkoNetAdapter *adapter);
 typedef int  (GEKKONET_CALL *gekkonet_add_actor_proc_t)(GekkoSession *session, GekkoPlayerType player_type, GekkoNetAddress *addr);
+typedef void (GEKKONET_CALL *gekkonet_set_local_delay_proc_t)(GekkoSession *session, int player, unsigned char delay);
 typedef void (GEKKONET_CALL *gekkonet_add_local_input_proc_t)(GekkoSession *session, int player, void *input);
 typedef GekkoGameEvent **(GEKKONET_CALL *gekkonet_update_session_proc_t)(GekkoSession *session, int *count);
 typedef GekkoSessionEvent **(GEKKONET_CALL *gekkonet_session_events_proc_t)(GekkoSession *session, int *count);
+typedef float (GEKKONET_CALL *gekkonet_frames_ahead_proc_t)(GekkoSession *session);
 typedef void (GEKKONET_CALL *gekkonet_network_stats_proc_t)(GekkoSession *session, int player, GekkoNetworkStats *stats);
 typedef void (GEKKONET_CALL *gekkonet_network_poll_proc_t)(GekkoSession *session);
-typedef GekkoNetAdapter *(GEKKONET_CALL *gekkonet_default_adapter_proc_t)(unsigned short port);
 typedef const char *(GEKKONET_CALL *gekkonet_last_error_proc_t)(void);
 
 typedef struct gekkonet_dynamic_api
@@ -277,12 +264,13 @@ typedef struct gekkonet_dynamic_api
    gekkonet_start_proc_t             start;
    gekkonet_net_adapter_set_proc_t   net_adapter_set;
    gekkonet_add_actor_proc_t         add_actor;
+   gekkonet_set_local_delay_proc_t   set_local_delay;
    gekkonet_add_local_input_proc_t   add_local_input;
    gekkonet_update_session_proc_t    update_session;
    gekkonet_session_events_proc_t    session_events;
+   gekkonet_frames_ahead_proc_t      frames_ahead;
    gekkonet_network_stats_proc_t     network_stats;
    gekkonet_network_poll_proc_t      network_poll;
-   gekkonet_default_adapter_proc_t   default_adapter;
    gekkonet_last_error_proc_t        last_error;
 } gekkonet_dynamic_api_t;
 
@@ -378,7 +366,7 @@ static void gekkonet_log_win32_error(const char *context, DWORD error_code)
 
    if (error_code == ERROR_MOD_NOT_FOUND)
       RARCH_ERR("[GekkoNet] The DLL or one of its dependencies was not found. "
-            "Ensure libGekkoNet.dll ships with all required runtimes.\n");
+            "Ensure libGekkoNet_NO_ASIO.dll ships with all required runtimes.\n");
    else if (error_code == ERROR_BAD_EXE_FORMAT)
       RARCH_ERR("[GekkoNet] The DLL is built for a different architecture. "
             "Use the 64-bit build of libGekkoNet with 64-bit RetroArch.\n");
@@ -408,14 +396,14 @@ static void gekkonet_log_load_context(const wchar_t *path,
    {
       if (gekkonet_file_exists(path))
       {
-         RARCH_ERR("[GekkoNet] libGekkoNet.dll exists at %s but a required "
+         RARCH_ERR("[GekkoNet] libGekkoNet_NO_ASIO.dll exists at %s but a required "
                "dependency is missing. Use a dependency checker (e.g. "
                "Dependencies or Dependency Walker) to identify the missing "
                "runtime.\n", path_utf8);
       }
       else
       {
-         RARCH_ERR("[GekkoNet] libGekkoNet.dll was not found at %s. Confirm "
+         RARCH_ERR("[GekkoNet] libGekkoNet_NO_ASIO.dll was not found at %s. Confirm "
                "the file is present and readable.\n", path_utf8);
       }
    }
@@ -476,7 +464,7 @@ static bool gekkonet_load_library(void)
    module = NULL;
    module_path_utf8[0] = '\0';
 
-   if (gekkonet_build_module_path(L"libGekkoNet.dll",
+   if (gekkonet_build_module_path(L"libGekkoNet_NO_ASIO.dll",
          module_path, ARRAY_SIZE(module_path)))
    {
       have_module_path = true;
@@ -496,11 +484,11 @@ static bool gekkonet_load_library(void)
 
    if (!module)
    {
-      module = LoadLibraryW(L"libGekkoNet.dll");
+      module = LoadLibraryW(L"libGekkoNet_NO_ASIO.dll");
       if (!module)
       {
          fallback_error = GetLastError();
-         RARCH_ERR("[GekkoNet] Failed to load libGekkoNet.dll\n");
+         RARCH_ERR("[GekkoNet] Failed to load libGekkoNet_NO_ASIO.dll\n");
          if (!have_module_path)
          {
             wchar_t fallback_path[MAX_PATH];
@@ -528,7 +516,7 @@ static bool gekkonet_load_library(void)
             else if (!have_module_path)
             {
                wchar_t located_path[MAX_PATH];
-               DWORD  located_len = SearchPathW(NULL, L"libGekkoNet.dll", NULL,
+               DWORD  located_len = SearchPathW(NULL, L"libGekkoNet_NO_ASIO.dll", NULL,
                      ARRAY_SIZE(located_path), located_path, NULL);
 
                if (located_len > 0 && located_len < ARRAY_SIZE(located_path))
@@ -580,12 +568,13 @@ static bool gekkonet_load_library(void)
    GEKKONET_RESOLVE(start);
    GEKKONET_RESOLVE(net_adapter_set);
    GEKKONET_RESOLVE(add_actor);
+   GEKKONET_RESOLVE(set_local_delay);
    GEKKONET_RESOLVE(add_local_input);
    GEKKONET_RESOLVE(update_session);
    GEKKONET_RESOLVE(session_events);
+   GEKKONET_RESOLVE(frames_ahead);
    GEKKONET_RESOLVE(network_stats);
    GEKKONET_RESOLVE(network_poll);
-   GEKKONET_RESOLVE(default_adapter);
 
 #undef GEKKONET_RESOLVE
 
@@ -623,7 +612,7 @@ static void gekkonet_log_session_create_failure(void)
    if (path)
       RARCH_ERR("[GekkoNet] Loaded library: %s\n", path);
    else if (g_gekkonet_api.load_failed)
-      RARCH_ERR("[GekkoNet] libGekkoNet.dll could not be located or failed to initialise.\n");
+      RARCH_ERR("[GekkoNet] libGekkoNet_NO_ASIO.dll could not be located or failed to initialise.\n");
 
    if (reason && reason[0])
       RARCH_ERR("[GekkoNet] Library error: %s\n", reason);
@@ -684,7 +673,7 @@ static bool gekkonet_load_library(void)
    module = NULL;
    module_path[0] = '\0';
 
-   if (gekkonet_build_module_path("libGekkoNet.so", module_path,
+   if (gekkonet_build_module_path("libGekkoNet_NO_ASIO.so", module_path,
          sizeof(module_path)))
    {
       dlerror();
@@ -702,13 +691,13 @@ static bool gekkonet_load_library(void)
    if (!module)
    {
       dlerror();
-      module = dlopen("libGekkoNet.so", RTLD_NOW | RTLD_LOCAL);
+      module = dlopen("libGekkoNet_NO_ASIO.so", RTLD_NOW | RTLD_LOCAL);
       if (module)
-         selected_path = "libGekkoNet.so";
+         selected_path = "libGekkoNet_NO_ASIO.so";
       else
       {
          const char *error = dlerror();
-         RARCH_ERR("[GekkoNet] Failed to load libGekkoNet.so\n");
+         RARCH_ERR("[GekkoNet] Failed to load libGekkoNet_NO_ASIO.so\n");
          if (error)
             RARCH_ERR("[GekkoNet] dlopen error: %s\n", error);
          g_gekkonet_api.attempted_load = false;
@@ -754,12 +743,13 @@ static bool gekkonet_load_library(void)
    GEKKONET_RESOLVE(start);
    GEKKONET_RESOLVE(net_adapter_set);
    GEKKONET_RESOLVE(add_actor);
+   GEKKONET_RESOLVE(set_local_delay);
    GEKKONET_RESOLVE(add_local_input);
    GEKKONET_RESOLVE(update_session);
    GEKKONET_RESOLVE(session_events);
+   GEKKONET_RESOLVE(frames_ahead);
    GEKKONET_RESOLVE(network_stats);
    GEKKONET_RESOLVE(network_poll);
-   GEKKONET_RESOLVE(default_adapter);
 
 #undef GEKKONET_RESOLVE
 
@@ -805,12 +795,12 @@ static void gekkonet_log_session_create_failure(void)
    if (path)
       RARCH_ERR("[GekkoNet] Loaded library: %s\n", path);
    else if (g_gekkonet_api.load_failed)
-      RARCH_ERR("[GekkoNet] libGekkoNet.so could not be located or failed to initialise.\n");
+      RARCH_ERR("[GekkoNet] libGekkoNet_NO_ASIO.so could not be located or failed to initialise.\n");
 
    if (reason && reason[0])
       RARCH_ERR("[GekkoNet] Library error: %s\n", reason);
 
-   RARCH_ERR("[GekkoNet] Ensure libGekkoNet.so matches this RetroArch build and exports the required symbols.\n");
+   RARCH_ERR("[GekkoNet] Ensure libGekkoNet_NO_ASIO.so matches this RetroArch build and exports the required symbols.\n");
 }
 
 #else
@@ -872,6 +862,13 @@ static int gekkonet_api_add_actor(GekkoSession *session, GekkoPlayerType player_
    return g_gekkonet_api.add_actor(session, player_type, addr);
 }
 
+static void gekkonet_api_set_local_delay(GekkoSession *session, int player, unsigned char delay)
+{
+   if (!gekkonet_load_library())
+      return;
+   g_gekkonet_api.set_local_delay(session, player, delay);
+}
+
 static void gekkonet_api_add_local_input(GekkoSession *session, int player, void *input)
 {
    if (!gekkonet_load_library())
@@ -893,6 +890,13 @@ static GekkoSessionEvent **gekkonet_api_session_events(GekkoSession *session, in
    return g_gekkonet_api.session_events(session, count);
 }
 
+static float gekkonet_api_frames_ahead(GekkoSession *session)
+{
+   if (!gekkonet_load_library())
+      return 0.0f;
+   return g_gekkonet_api.frames_ahead(session);
+}
+
 static void gekkonet_api_network_stats(GekkoSession *session, int player, GekkoNetworkStats *stats)
 {
    if (!gekkonet_load_library())
@@ -907,13 +911,6 @@ static void gekkonet_api_network_poll(GekkoSession *session)
    g_gekkonet_api.network_poll(session);
 }
 
-static GekkoNetAdapter *gekkonet_api_default_adapter(unsigned short port)
-{
-   if (!gekkonet_load_library())
-      return NULL;
-   return g_gekkonet_api.default_adapter(port);
-}
-
 #ifdef GEKKONET_CALL
 #undef GEKKONET_CALL
 #endif
@@ -951,6 +948,11 @@ static int gekkonet_api_add_actor(GekkoSession *session, GekkoPlayerType player_
    return gekko_add_actor(session, player_type, addr);
 }
 
+static void gekkonet_api_set_local_delay(GekkoSession *session, int player, unsigned char delay)
+{
+   gekko_set_local_delay(session, player, delay);
+}
+
 static void gekkonet_api_add_local_input(GekkoSession *session, int player, void *input)
 {
    gekko_add_local_input(session, player, input);
@@ -966,6 +968,11 @@ static GekkoSessionEvent **gekkonet_api_session_events(GekkoSession *session, in
    return gekko_session_events(session, count);
 }
 
+static float gekkonet_api_frames_ahead(GekkoSession *session)
+{
+   return gekko_frames_ahead(session);
+}
+
 static void gekkonet_api_network_stats(GekkoSession *session, int player, GekkoNetworkStats *stats)
 {
    gekko_network_stats(session, player, stats);
@@ -976,11 +983,6 @@ static void gekkonet_api_network_poll(GekkoSession *session)
    gekko_network_poll(session);
 }
 
-static GekkoNetAdapter *gekkonet_api_default_adapter(unsigned short port)
-{
-   return gekko_default_adapter(port);
-}
-
 #endif
 
 static const char *netplay_diag_last_error_string(void)
@@ -1312,6 +1314,68 @@ static void netplay_host_diag_dump(netplay_host_diagnostics_t *diag)
       NETPLAY_DIAG_LOG("Diagnostics written to %s.", diag->diagnosis_path);
 }
 
+static void netplay_release_adapter(netplay_t *netplay)
+{
+   if (netplay->native_adapter)
+      netplay_adapter_destroy();
+   netplay->native_adapter = false;
+   netplay->adapter        = NULL;
+}
+
+static void netplay_close_replay(netplay_t *netplay)
+{
+   uint64_t frames;
+
+   if (!netplay->replay)
+      return;
+
+   frames          = netplay_replay_free(netplay->replay);
+   netplay->replay = NULL;
+   RARCH_LOG("[Netplay] Replay closed after %llu frames.\n",
+         (unsigned long long)frames);
+}
+
+static void netplay_join_states_free(netplay_t *netplay)
+{
+   free(netplay->join_states);
+   free(netplay->join_state_frames);
+   netplay->join_states           = NULL;
+   netplay->join_state_frames     = NULL;
+   netplay->join_state_slots      = 0;
+   netplay->join_event_frame      = -1;
+   netplay->join_save_delta       = 0;
+   netplay->join_save_delta_known = false;
+}
+
+static void netplay_join_free(netplay_t *netplay)
+{
+   unsigned i;
+
+   for (i = 0; i < NETPLAY_JOIN_MAX_SENDERS; i++)
+      netplay_join_sender_free(&netplay->join_senders[i]);
+   netplay_join_receiver_free(&netplay->join);
+   free(netplay->join_live_inputs);
+   free(netplay->join_live_frames);
+   netplay->join_live_inputs = NULL;
+   netplay->join_live_frames = NULL;
+   netplay->join_host[0]     = '\0';
+   netplay->join_request_at  = 0;
+   netplay->join_done_at     = 0;
+   netplay->join_frames_run  = 0;
+   netplay->join_next_frame  = -1;
+   netplay->join_live_frame  = -1;
+   netplay->joining          = false;
+   netplay_join_states_free(netplay);
+}
+
+static void netplay_relay_close(netplay_t *netplay)
+{
+   if (netplay->relay_fd >= 0)
+      socket_close(netplay->relay_fd);
+   netplay->relay_fd = -1;
+   netplay_relay_stream_free(&netplay->relay_stream);
+}
+
 static void netplay_free(netplay_t *netplay)
 {
    if (!netplay)
@@ -1320,10 +1384,17 @@ static void netplay_free(netplay_t *netplay)
    if (netplay->session)
       gekkonet_api_destroy(netplay->session);
 
-   (void)netplay->adapter;
+   netplay_release_adapter(netplay);
 
-   free(netplay->state_buffer);
+   netplay_telemetry_free(&netplay->telemetry);
+   netplay_forensics_free(&netplay->forensics);
+   netplay_close_replay(netplay);
+   netplay_join_free(netplay);
+   netplay_relay_close(netplay);
+   netplay_events_free(&netplay->events);
    free(netplay->authoritative_input);
+   free(netplay->local_input);
+   free(netplay->input_ports);
    free(netplay->remote_actors);
    free(netplay);
 }
@@ -1347,18 +1418,17 @@ static bool netplay_refresh_serialization(netplay_t *netplay)
       return false;
    }
 
-   if (size != netplay->state_size)
+   /* GekkoNet sizes its save slots once at session start; a core
+    * that grows its state afterwards can no longer be saved. */
+   if (     netplay->session_state_size
+         && size > netplay->session_state_size)
    {
-      uint8_t *new_buf = (uint8_t*)realloc(netplay->state_buffer, size);
-      if (!new_buf)
-      {
-         RARCH_ERR("[Netplay] Failed to allocate %zu bytes for the serialization buffer.\n", size);
-         return false;
-      }
-      netplay->state_buffer = new_buf;
-      netplay->state_size   = size;
+      RARCH_ERR("[Netplay] Save state grew to %zu bytes, exceeding the %u bytes reserved by the session.\n",
+            size, netplay->session_state_size);
+      return false;
    }
 
+   netplay->state_size = size;
    return true;
 }
 
@@ -1386,177 +1456,1214 @@ static void netplay_copy_authoritative_input(netplay_t *netplay,
 
    memcpy(netplay->authoritative_input, data, len);
    netplay->authoritative_valid = true;
+
+   netplay_input_decode(&netplay->input_layout, data, len,
+         netplay->num_players, netplay->input_ports, &netplay->input_keys);
 }
 
-static uint16_t netplay_get_port_mask(const netplay_t *netplay, unsigned port)
+static bool netplay_layout_peer_known(const netplay_t *netplay,
+      const char *peer)
 {
-   size_t per_player;
-   size_t offset;
-   uint16_t mask;
+   unsigned i;
 
-   if (!netplay || !netplay->authoritative_valid)
-      return 0;
+   for (i = 0; i < netplay->layout_peer_count; i++)
+      if (string_is_equal(netplay->layout_peers[i], peer))
+         return true;
+   return false;
+}
 
-   if (!netplay->authoritative_input)
-      return 0;
+static void netplay_layout_send(netplay_t *netplay, const char *to,
+      bool reply)
+{
+   uint8_t msg[NETPLAY_INPUT_LAYOUT_MSG_SIZE
+      + NETPLAY_CHECKSUM_CONFIG_SIZE];
+   size_t len = netplay_input_layout_message(&netplay->input_layout,
+         reply, msg, sizeof(msg));
 
-   if (netplay->authoritative_size < sizeof(uint16_t))
-      return 0;
+   if (!len)
+      return;
+   /* The state checksums are compared too, so they go along */
+   len += netplay_checksum_config_pack(&netplay->checksum,
+         msg + len, sizeof(msg) - len);
+   if (to)
+      netplay_adapter_send_oob_to(to, msg, len);
+   else
+      netplay_adapter_send_oob(msg, len);
+}
+
+/**
+ * netplay_layout_received
+ *
+ * A peer announced its input layout. Each side derives the layout
+ * from its own port devices and GekkoNet only knows the record size,
+ * so differing layouts would hand the core misread input. The state
+ * checksum configuration comes with it: peers hashing states another
+ * way report a desync on every checked frame. A side that has not run
+ * a frame yet stops; one already running only logs it, since the
+ * newcomer refuses on its end.
+ */
+static void netplay_layout_received(netplay_t *netplay, const char *from,
+      const uint8_t *data, size_t len)
+{
+   char ours[64];
+   char theirs[64];
+   bool layout_ok;
+   bool checksum_ok;
+   bool reply = false;
+   netplay_input_layout_t layout;
+   netplay_checksum_t checksum;
+
+   if (!netplay_input_layout_parse(data, len, &layout, &reply))
+      return;
 
-   per_player = sizeof(uint16_t);
-   offset     = per_player * port;
+   /* Answer right away rather than on our next announcement */
+   if (!reply)
+      netplay_layout_send(netplay, from, true);
 
-   if (offset + per_player > netplay->authoritative_size)
-      return 0;
+   layout_ok   = netplay_input_layout_equal(&layout, &netplay->input_layout);
+   checksum_ok = netplay_checksum_config_unpack(
+            data + NETPLAY_INPUT_LAYOUT_MSG_SIZE,
+            len  - NETPLAY_INPUT_LAYOUT_MSG_SIZE, &checksum)
+      && netplay_checksum_config_equal(&checksum, &netplay->checksum);
+
+   if (layout_ok && checksum_ok)
+   {
+      if (     !netplay_layout_peer_known(netplay, from)
+            &&  netplay->layout_peer_count < NETPLAY_LAYOUT_MAX_PEERS)
+         strlcpy(netplay->layout_peers[netplay->layout_peer_count++],
+               from, sizeof(netplay->layout_peers[0]));
+      return;
+   }
+
+   if (netplay->layout_mismatch)
+      return;
+
+   if (!layout_ok)
+   {
+      netplay_input_layout_describe(&netplay->input_layout,
+            ours, sizeof(ours));
+      netplay_input_layout_describe(&layout, theirs, sizeof(theirs));
+      RARCH_ERR("[Netplay] Peer %s sends input as %s, %u port(s), %u byte(s) per frame; this side as %s, %u port(s), %u byte(s). Bind the same devices to the core's ports on both sides.\n",
+            from, theirs, layout.ports, layout.record_size,
+            ours, netplay->input_layout.ports,
+            netplay->input_layout.record_size);
+   }
+
+   if (!checksum_ok)
+   {
+      netplay_checksum_config_describe(&netplay->checksum,
+            ours, sizeof(ours));
+      if (len < NETPLAY_INPUT_LAYOUT_MSG_SIZE + NETPLAY_CHECKSUM_CONFIG_SIZE)
+         strlcpy(theirs, "unknown", sizeof(theirs));
+      else
+         netplay_checksum_config_describe(&checksum, theirs, sizeof(theirs));
+      RARCH_ERR("[Netplay] Peer %s checks states with %s; this side with %s. Use the same netplay_checksum_* settings on both sides.\n",
+            from, theirs, ours);
+   }
+
+   if (!netplay->layout_confirmed)
+      netplay->layout_mismatch = true;
+}
+
+/**
+ * netplay_layout_update
+ *
+ * Announce the input layout until every peer seen so far answered
+ * with the same one. Returns true once local input may be handed to
+ * the session; until then GekkoNet cannot advance past our frames.
+ */
+static bool netplay_layout_update(netplay_t *netplay)
+{
+   size_t i;
+   size_t peers;
+   retro_time_t now;
+
+   if (netplay->layout_confirmed || !netplay->native_adapter)
+      return true;
+   if (netplay->layout_mismatch)
+      return false;
+
+   now = cpu_features_get_time_usec();
+   if (now - netplay->layout_sent_at >= NETPLAY_LAYOUT_RESEND_USEC)
+   {
+      netplay_layout_send(netplay, NULL, false);
+      netplay->layout_sent_at = now;
+   }
+
+   if (!(peers = netplay_adapter_peer_count()))
+      return false;
+
+   for (i = 0; i < peers; i++)
+   {
+      netplay_adapter_peer_stats_t stats;
+      if (     !netplay_adapter_get_peer_stats(i, &stats)
+            || !netplay_layout_peer_known(netplay, stats.address))
+         return false;
+   }
 
-   memcpy(&mask, netplay->authoritative_input + offset, sizeof(mask));
-   return mask;
+   netplay->layout_confirmed = true;
+   RARCH_LOG("[Netplay] Input layout matches on %u peer(s).\n",
+         (unsigned)peers);
+   return true;
 }
 
 static void netplay_collect_local_input(netplay_t *netplay)
+{
+   if (!netplay || !netplay->local_input)
+      return;
+
+   netplay_input_collect(&netplay->input_layout, netplay->cbs.state_cb,
+         0, netplay->local_input);
+
+   if (     netplay->session
+         && netplay->local_handle >= 0
+         && netplay_layout_update(netplay))
+      gekkonet_api_add_local_input(netplay->session, netplay->local_handle,
+            netplay->local_input);
+}
+
+/**
+ * netplay_state_checksum
+ *
+ * Hash the configured core memory regions, or the serialized state if
+ * there are none or the core exposes none of them. The core holds the
+ * frame it just saved, so its memory matches the state.
+ */
+static uint32_t netplay_state_checksum(netplay_t *netplay, int frame,
+      const void *state, size_t len)
 {
    unsigned i;
-   uint16_t mask = 0;
+   unsigned count = 0;
+   netplay_checksum_region_t regions[NETPLAY_CHECKSUM_MAX_REGIONS];
+   const netplay_checksum_t *cs = &netplay->checksum;
 
-   if (!netplay)
-      return;
+   if (!netplay_checksum_wants_frame(cs, frame))
+      return 0;
 
-   for (i = 0; i < NETPLAY_BUTTON_COUNT; i++)
+   for (i = 0; i < cs->region_count; i++)
    {
-      int16_t value = netplay->cbs.state_cb(0,
-            RETRO_DEVICE_JOYPAD, 0, netplay_button_map[i]);
-      if (value)
-         mask |= (1U << i);
+      retro_ctx_memory_info_t mem;
+
+      mem.id   = cs->region_ids[i];
+      mem.data = NULL;
+      mem.size = 0;
+      if (!core_get_memory(&mem) || !mem.data || !mem.size)
+         continue;
+
+      regions[count].data = mem.data;
+      regions[count].len  = mem.size;
+      count++;
    }
 
-   netplay->local_input_mask = mask;
-   if (netplay->session && netplay->local_handle >= 0)
-      gekkonet_api_add_local_input(netplay->session, netplay->local_handle,
-            &netplay->local_input_mask);
+   if (count)
+      return netplay_checksum_compute_regions(cs, regions, count);
+   return netplay_checksum_compute(cs, state, len);
 }
 
+/**
+ * netplay_handle_save_event
+ *
+ * Serialize the core straight into the slot provided by GekkoNet.
+ * The slot is sized from the session's state_size, so there is no
+ * intermediate buffer and no copy; the checksum is taken over the
+ * slot contents in place.
+ */
 static void netplay_handle_save_event(netplay_t *netplay,
       const GekkoGameEvent *event)
 {
    retro_ctx_serialize_info_t info;
-   unsigned int payload = 0;
+   unsigned int capacity;
 
    if (!netplay || !event)
       return;
 
-   if (!netplay_refresh_serialization(netplay))
+   if (!event->data.save.state || !event->data.save.state_len)
+      return;
+
+   capacity = netplay->session_state_size;
+   if (!capacity || netplay->state_size > capacity)
+   {
+      *event->data.save.state_len = 0;
       return;
+   }
 
-   info.data = netplay->state_buffer;
+   info.data = event->data.save.state;
    info.size = netplay->state_size;
 
    if (!core_serialize_special(&info))
+   {
+      RARCH_WARN("[Netplay] Failed to save state requested by GekkoNet.\n");
+      *event->data.save.state_len = 0;
+      return;
+   }
+
+   *event->data.save.state_len = (unsigned int)info.size;
+
+   if (event->data.save.checksum)
+      *event->data.save.checksum = netplay_state_checksum(netplay,
+            event->data.save.frame, event->data.save.state, info.size);
+
+   netplay_forensics_record(&netplay->forensics, event->data.save.frame,
+         event->data.save.state, info.size);
+}
+
+/**
+ * netplay_start_replay
+ *
+ * Called with the last advance of an update waiting for core_run(),
+ * so the core holds the state @frame starts from.
+ */
+static void netplay_start_replay(netplay_t *netplay, int frame)
+{
+   retro_ctx_serialize_info_t info;
+   void *state = malloc(netplay->state_size);
+
+   if (!state)
       return;
 
-   payload = (unsigned int)info.size;
+   info.data = state;
+   info.size = netplay->state_size;
+   if (core_serialize_special(&info))
+      netplay_replay_start(netplay->replay, frame, state, info.size);
+   else
+      RARCH_WARN("[Netplay] Failed to save the state the replay starts from.\n");
+
+   free(state);
+}
+
+/**
+ * netplay_join_keep_state
+ *
+ * Keep the state after @frame of the catch-up. The ring holds the
+ * last prediction window of frames, as far as GekkoNet can roll back.
+ */
+static void netplay_join_keep_state(netplay_t *netplay, int frame)
+{
+   retro_ctx_serialize_info_t info;
+   unsigned idx;
 
-   if (event->data.save.state && event->data.save.state_len)
+   if (!netplay->state_size)
+      return;
+
+   if (!netplay->join_states)
    {
-      unsigned int copy_size = payload;
-      if (copy_size > *event->data.save.state_len)
-         copy_size = *event->data.save.state_len;
-      memcpy(event->data.save.state, netplay->state_buffer, copy_size);
-      *event->data.save.state_len = copy_size;
+      unsigned slots = netplay->input_prediction_window + 2;
+
+      netplay->join_states       = (uint8_t*)malloc(
+            slots * netplay->state_size);
+      netplay->join_state_frames = (int*)malloc(slots * sizeof(int));
+      if (!netplay->join_states || !netplay->join_state_frames)
+      {
+         free(netplay->join_states);
+         free(netplay->join_state_frames);
+         netplay->join_states       = NULL;
+         netplay->join_state_frames = NULL;
+         return;
+      }
+      memset(netplay->join_state_frames, 0xff, slots * sizeof(int));
+      netplay->join_state_slots  = slots;
    }
 
-   if (event->data.save.checksum)
-      *event->data.save.checksum = encoding_crc32(
-            0, netplay->state_buffer, payload);
+   idx       = (unsigned)frame % netplay->join_state_slots;
+   info.data = netplay->join_states + idx * netplay->state_size;
+   info.size = netplay->state_size;
+   netplay->join_state_frames[idx] = core_serialize_special(&info)
+      ? frame : -1;
+}
+
+static bool netplay_join_restore_state(netplay_t *netplay, int frame)
+{
+   retro_ctx_serialize_info_t info;
+   unsigned idx;
+
+   if (!netplay->join_states || frame < 0)
+      return false;
+
+   idx = (unsigned)frame % netplay->join_state_slots;
+   if (netplay->join_state_frames[idx] != frame)
+      return false;
+
+   info.data = netplay->join_states + idx * netplay->state_size;
+   info.size = netplay->state_size;
+   return core_unserialize_special(&info);
+}
+
+static void netplay_desync_detected(netplay_t *netplay, int frame);
+
+/**
+ * netplay_load_failed
+ *
+ * A rollback that could not restore its frame goes on from the wrong
+ * state, and nothing repairs that later; report it as a desync.
+ */
+static void netplay_load_failed(netplay_t *netplay, int frame,
+      const char *why)
+{
+   char status[64];
+
+   RARCH_ERR("[Netplay] Cannot roll back to frame %d: %s.\n", frame, why);
+   snprintf(status, sizeof(status), "Desync detected (frame %d)", frame);
+   netplay_session_status_set(status, 0, 0);
+   netplay_desync_detected(netplay, frame);
 }
 
 static void netplay_handle_load_event(netplay_t *netplay,
       const GekkoGameEvent *event)
 {
    retro_ctx_serialize_info_t info;
+   int frame;
 
    if (!netplay || !event)
       return;
 
+   frame = event->data.load.frame;
+
+   /* Saved while joining: the state is in the catch-up ring, if at all */
    if (!event->data.load.state || !event->data.load.state_len)
+   {
+      if (!netplay->join_save_delta_known)
+         netplay_load_failed(netplay, frame, "its state was never saved");
+      else if (!netplay_join_restore_state(netplay,
+               frame - netplay->join_save_delta))
+         netplay_load_failed(netplay, frame,
+               "its state is not among the frames caught up through");
       return;
+   }
 
    info.data = event->data.load.state;
    info.size = event->data.load.state_len;
 
    if (!core_unserialize_special(&info))
-      RARCH_WARN("[Netplay] Failed to load state requested by GekkoNet.\n");
+      netplay_load_failed(netplay, frame, "the core refused its state");
 }
 
-static void netplay_handle_game_events(netplay_t *netplay)
+/**
+ * netplay_resimulate_frame
+ *
+ * Run the core for a single rollback frame using the inputs currently
+ * held in authoritative_input. Video and audio produced by the core are
+ * discarded by video_frame_net()/audio_sample_net() while the
+ * resimulating flag is set, and input polling is suppressed since the
+ * inputs for the frame are already known.
+ */
+static void netplay_resimulate_frame(netplay_t *netplay)
 {
-   int count = 0;
-   GekkoGameEvent **events;
+   runloop_state_t     *runloop_st   = runloop_state_get_ptr();
+   struct retro_core_t *current_core = &runloop_st->current_core;
+   retro_time_t         start        = cpu_features_get_time_usec();
+
+   netplay->resimulating = true;
+   current_core->retro_set_input_poll(retro_input_poll_null);
+   current_core->retro_run();
+   current_core->retro_set_input_poll(
+         runloop_st->input_poll_callback_original);
+   netplay->resimulating = false;
+
+   netplay_telemetry_add_resim(&netplay->telemetry,
+         (uint32_t)(cpu_features_get_time_usec() - start));
+}
 
-   if (!netplay || !netplay->session)
+/* Frames of the session's own inputs a joiner keeps while it waits
+ * for the host's state */
+#define NETPLAY_JOIN_LIVE_FRAMES     256
+/* A client asks for the state during its first frames only, and the
+ * host answers when it is this many frames further */
+#define NETPLAY_JOIN_REQUEST_FRAMES  300
+#define NETPLAY_JOIN_MIN_BEHIND      60
+#define NETPLAY_JOIN_REQUEST_USEC    500000
+/* Chunks all transfers together send per frame */
+#define NETPLAY_JOIN_CHUNK_BUDGET    32
+/* Frames a joiner runs per frame while catching up */
+#define NETPLAY_JOIN_CATCHUP_FRAMES  8
+/* How long a joiner keeps confirming the end of its transfer */
+#define NETPLAY_JOIN_LINGER_USEC     2000000
+
+static size_t netplay_join_record_len(const netplay_t *netplay)
+{
+   return (size_t)netplay->input_layout.record_size * netplay->num_players;
+}
+
+static void netplay_join_send(void *data, const uint8_t *msg, size_t len)
+{
+   netplay_adapter_send_oob_to((const char*)data, msg, len);
+}
+
+/**
+ * netplay_join_requested
+ *
+ * Host side of a join request. Peers that ran about as many frames as
+ * the session joined with it and need nothing; for a late joiner the
+ * state is snapshot at the next frame boundary.
+ */
+static void netplay_join_requested(netplay_t *netplay, const char *from,
+      const uint8_t *data, size_t len)
+{
+   unsigned i, frames;
+   netplay_join_sender_t *slot = NULL;
+
+   if (     !netplay->late_join
+         ||  netplay->join_client
+         || !netplay->session_started
+         || !netplay_join_parse_request(data, len, NULL, &frames)
+         ||  netplay->current_frame < frames
+            + netplay->input_prediction_window + NETPLAY_JOIN_MIN_BEHIND)
       return;
 
-   events = gekkonet_api_update_session(netplay->session, &count);
-   for (; count > 0 && events; count--, events++)
-   {
-      GekkoGameEvent *event = *events;
-      if (!event)
-         continue;
+   /* A transfer under way resumes from the joiner's acknowledgements */
+   for (i = 0; i < NETPLAY_JOIN_MAX_SENDERS; i++)
+      if (string_is_equal(netplay->join_senders[i].peer, from))
+         return;
 
-      switch (event->type)
-      {
-         case AdvanceEvent:
-            netplay->current_frame = (unsigned)event->data.adv.frame;
-            netplay_copy_authoritative_input(netplay,
-                  event->data.adv.inputs,
-                  event->data.adv.input_len);
-            break;
-         case SaveEvent:
-            netplay_handle_save_event(netplay, event);
-            break;
-         case LoadEvent:
-            netplay_handle_load_event(netplay, event);
-            break;
-         default:
-            break;
-      }
+   for (i = 0; i < NETPLAY_JOIN_MAX_SENDERS && !slot; i++)
+      if (!netplay->join_senders[i].peer[0])
+         slot = &netplay->join_senders[i];
+
+   if (!slot)
+   {
+      RARCH_WARN("[Netplay] Too many peers joining at once; %s has to wait.\n",
+            from);
+      return;
    }
+
+   strlcpy(slot->peer, from, sizeof(slot->peer));
 }
 
-static void netplay_handle_session_events(netplay_t *netplay)
+/**
+ * netplay_join_snapshot
+ * @advance              : the advance waiting for core_run()
+ *
+ * Serialize the core once for every peer waiting for a state. The
+ * core holds the state @advance starts from, whose inputs are the
+ * first ones sent along.
+ */
+static void netplay_join_snapshot(netplay_t *netplay,
+      const GekkoGameEvent *advance)
 {
-   int count = 0;
-   GekkoSessionEvent **events;
-   char status_buf[128];
+   unsigned i;
+   retro_ctx_serialize_info_t info;
+   uint8_t *state = NULL;
+   int frame      = advance->data.adv.frame;
 
-   if (!netplay || !netplay->session)
-      return;
+   info.data      = NULL;
+   info.size      = 0;
 
-   events = gekkonet_api_session_events(netplay->session, &count);
-   for (; count > 0 && events; count--, events++)
+   for (i = 0; i < NETPLAY_JOIN_MAX_SENDERS; i++)
    {
-      GekkoSessionEvent *event = *events;
-      if (!event)
+      char peer[sizeof(netplay->join_senders[i].peer)];
+      netplay_join_sender_t *s = &netplay->join_senders[i];
+      uint32_t id;
+
+      if (!s->peer[0] || s->active)
          continue;
 
-      switch (event->type)
+      if (!state)
       {
-         case PlayerSyncing:
+         if ((state = (uint8_t*)malloc(netplay->state_size)))
          {
-            unsigned current = (unsigned)event->data.syncing.current;
-            unsigned total   = (unsigned)event->data.syncing.max;
+            info.data = state;
+            info.size = netplay->state_size;
+            if (!core_serialize_special(&info))
+            {
+               free(state);
+               state = NULL;
+            }
+         }
+         if (!state)
+         {
+            RARCH_WARN("[Netplay] Failed to save the state for %s to join from.\n",
+                  s->peer);
+            netplay_join_sender_free(s);
+            continue;
+         }
+      }
 
-            netplay->connected = true;
+      if (!(id = ++netplay->join_next_id))
+         id = ++netplay->join_next_id;
+      strlcpy(peer, s->peer, sizeof(peer));
+      if (!netplay_join_sender_begin(s, peer, id, frame, state, info.size,
+               netplay_join_record_len(netplay),
+               netplay->input_prediction_window))
+      {
+         netplay_join_sender_free(s);
+         continue;
+      }
 
-            snprintf(status_buf, sizeof(status_buf),
-                  "Syncing players (%u/%u)", current, total);
-            netplay_session_status_set(status_buf, current, total);
-            break;
-         }
-         case SessionStarted:
-            netplay->session_started = true;
-            netplay->connected       = true;
-            netplay_session_status_set(
-                  msg_hash_to_str(MSG_NETPLAY_STATUS_PLAYING), 0, 0);
+      netplay_join_sender_input(s, frame, advance->data.adv.inputs,
+            advance->data.adv.input_len);
+      RARCH_LOG("[Netplay] Sending the state of frame %d (%u bytes) to %s.\n",
+            frame, (unsigned)info.size, peer);
+   }
+
+   free(state);
+}
+
+static void netplay_join_begin(netplay_t *netplay, const char *from)
+{
+   strlcpy(netplay->join_host, from, sizeof(netplay->join_host));
+   netplay->joining         = true;
+   netplay->join_next_frame = -1;
+   netplay->join_live_frame = -1;
+   netplay->advance_pending = false;
+   netplay->events_deferred = NULL;
+   netplay_join_states_free(netplay);
+   /* Frames run before the state arrived are not part of the session */
+   netplay_close_replay(netplay);
+
+   RARCH_LOG("[Netplay] Joining a running session; receiving the state from %s.\n",
+         from);
+}
+
+static void netplay_join_received(netplay_t *netplay, const char *from,
+      const uint8_t *data, size_t len)
+{
+   if (     !netplay->late_join
+         || !netplay->join_client
+         || (netplay->join_done_at && !netplay->join.id)
+         || (netplay->join_host[0]
+            && !string_is_equal(netplay->join_host, from))
+         || !netplay_join_receiver_receive(&netplay->join, data, len))
+      return;
+
+   if (!netplay->joining && !netplay->join_done_at)
+      netplay_join_begin(netplay, from);
+}
+
+/**
+ * netplay_join_store_live
+ *
+ * While the state is on its way, the session keeps advancing; keep
+ * the inputs it delivers for the frames the host did not confirm yet.
+ */
+static void netplay_join_store_live(netplay_t *netplay,
+      const GekkoGameEvent *event)
+{
+   size_t record_len = netplay_join_record_len(netplay);
+   int frame         = event->data.adv.frame;
+   unsigned idx      = (unsigned)frame % NETPLAY_JOIN_LIVE_FRAMES;
+   size_t len        = event->data.adv.input_len;
+
+   if (!netplay->join_live_inputs)
+   {
+      netplay->join_live_inputs = (uint8_t*)calloc(
+            NETPLAY_JOIN_LIVE_FRAMES, record_len);
+      netplay->join_live_frames = (int*)malloc(
+            NETPLAY_JOIN_LIVE_FRAMES * sizeof(int));
+      if (!netplay->join_live_inputs || !netplay->join_live_frames)
+      {
+         free(netplay->join_live_inputs);
+         free(netplay->join_live_frames);
+         netplay->join_live_inputs = NULL;
+         netplay->join_live_frames = NULL;
+         return;
+      }
+      memset(netplay->join_live_frames, 0xff,
+            NETPLAY_JOIN_LIVE_FRAMES * sizeof(int));
+   }
+
+   memset(netplay->join_live_inputs + idx * record_len, 0, record_len);
+   memcpy(netplay->join_live_inputs + idx * record_len,
+         event->data.adv.inputs, len < record_len ? len : record_len);
+   netplay->join_live_frames[idx] = frame;
+}
+
+/**
+ * netplay_join_events
+ *
+ * Game events while joining: advances are recorded, not run, and the
+ * core's state is worthless to GekkoNet until the host's arrived, so
+ * saves are left empty. A load into frames already caught up through
+ * takes the catch-up back there so they run again with the corrected
+ * inputs; loads into frames not run yet need nothing.
+ */
+static void netplay_join_events(netplay_t *netplay,
+      GekkoGameEvent **events, int count)
+{
+   int i;
+
+   for (i = 0; i < count; i++)
+   {
+      GekkoGameEvent *event = events[i];
+      if (!event)
+         continue;
+
+      switch (event->type)
+      {
+         case AdvanceEvent:
+            netplay->current_frame = (unsigned)event->data.adv.frame;
+            if (event->data.adv.frame > netplay->join_live_frame)
+               netplay->join_live_frame = event->data.adv.frame;
+            netplay->join_event_frame = event->data.adv.frame;
+            netplay_join_store_live(netplay, event);
+            break;
+         case SaveEvent:
+            if (netplay->join_event_frame >= 0)
+            {
+               netplay->join_save_delta       = event->data.save.frame
+                  - netplay->join_event_frame;
+               netplay->join_save_delta_known = true;
+            }
+            if (event->data.save.state_len)
+               *event->data.save.state_len = 0;
+            break;
+         case LoadEvent:
+            if (     netplay->join_next_frame >= 0
+                  && netplay->join_save_delta_known)
+            {
+               int frame = event->data.load.frame
+                  - netplay->join_save_delta;
+
+               if (frame >= netplay->join_next_frame - 1)
+                  break;
+               /* Earlier frames are inside the host's state */
+               if (frame < netplay->join.frame - 1)
+                  frame = netplay->join.frame - 1;
+               if (netplay_join_restore_state(netplay, frame))
+                  netplay->join_next_frame = frame + 1;
+               else
+                  netplay_load_failed(netplay, event->data.load.frame,
+                        "its state is not among the frames caught up through");
+            }
+            break;
+         default:
+            break;
+      }
+   }
+}
+
+static const uint8_t *netplay_join_input(const netplay_t *netplay,
+      int frame)
+{
+   unsigned idx = (unsigned)frame % NETPLAY_JOIN_LIVE_FRAMES;
+   /* What the host confirmed is final; the session may still predict */
+   const uint8_t *inputs = netplay_join_receiver_input(&netplay->join,
+         frame);
+
+   if (     !inputs
+         && netplay->join_live_frames
+         && netplay->join_live_frames[idx] == frame)
+      inputs = netplay->join_live_inputs
+         + idx * netplay_join_record_len(netplay);
+   return inputs;
+}
+
+static bool netplay_join_load(netplay_t *netplay)
+{
+   retro_ctx_serialize_info_t info;
+   bool loaded    = false;
+   uint8_t *state = netplay_join_receiver_state(&netplay->join);
+
+   if (!state)
+   {
+      RARCH_ERR("[Netplay] The host's state did not survive the transfer.\n");
+      return false;
+   }
+
+   info.data = state;
+   info.size = netplay->join.raw_size;
+   if ((loaded = core_unserialize_special(&info)))
+   {
+      netplay->join_next_frame = netplay->join.frame;
+      netplay_join_keep_state(netplay, netplay->join.frame - 1);
+   }
+   else
+      RARCH_ERR("[Netplay] Failed to load the host's state.\n");
+
+   free(state);
+   return loaded;
+}
+
+static void netplay_join_finish(netplay_t *netplay, bool joined)
+{
+   netplay->joining          = false;
+   netplay->join.finished    = true;
+   netplay->join_done_at     = cpu_features_get_time_usec();
+   netplay->advance_pending  = false;
+   netplay->events_deferred  = NULL;
+   free(netplay->join_live_inputs);
+   free(netplay->join_live_frames);
+   netplay->join_live_inputs = NULL;
+   netplay->join_live_frames = NULL;
+
+   if (joined)
+      RARCH_LOG("[Netplay] Caught up at frame %d from the state of frame %d.\n",
+            netplay->join_next_frame, netplay->join.frame);
+   else
+      RARCH_WARN("[Netplay] Continuing without the host's state.\n");
+
+   netplay_session_status_set(
+         msg_hash_to_str(MSG_NETPLAY_STATUS_PLAYING), 0, 0);
+   netplay_open_replay(netplay);
+}
+
+static void netplay_save_event(netplay_t *netplay,
+      const GekkoGameEvent *event)
+{
+   retro_time_t start = cpu_features_get_time_usec();
+   netplay_handle_save_event(netplay, event);
+   netplay_telemetry_add_save(&netplay->telemetry, (uint32_t)
+         (cpu_features_get_time_usec() - start));
+}
+
+static void netplay_handle_game_events(netplay_t *netplay, bool present)
+{
+   int i;
+   unsigned j;
+   int presented;
+   int count                   = 0;
+   unsigned rollback_frames    = 0;
+   retro_time_t rollback_start = 0;
+   retro_time_t event_start;
+   netplay_event_plan_t *plan;
+   GekkoGameEvent **events;
+
+   if (!netplay || !netplay->session)
+      return;
+
+   /* The advance the saves follow has run by now */
+   if (netplay->events_deferred)
+   {
+      for (i = 0; i < netplay->events.count; i++)
+         if (netplay->events.plan[i].action == NETPLAY_EVENT_SAVE_AFTER)
+            netplay_save_event(netplay, netplay->events_deferred[i]);
+      netplay->events_deferred = NULL;
+   }
+
+   netplay->advance_pending = false;
+
+   events = gekkonet_api_update_session(netplay->session, &count);
+   if (!events)
+      return;
+
+   if (netplay->joining)
+   {
+      netplay_join_events(netplay, events, count);
+      return;
+   }
+
+   if (!(plan = netplay_events_begin(&netplay->events, count)))
+   {
+      if (count > 0)
+         RARCH_ERR("[Netplay] Out of memory for %d game events.\n", count);
+      return;
+   }
+
+   for (i = 0; i < count; i++)
+   {
+      if (!events[i])
+         continue;
+      switch (events[i]->type)
+      {
+         case AdvanceEvent:
+            plan[i].type         = NETPLAY_EVENT_ADVANCE;
+            plan[i].rolling_back = events[i]->data.adv.rolling_back;
+            break;
+         case SaveEvent:
+            plan[i].type         = NETPLAY_EVENT_SAVE;
+            break;
+         case LoadEvent:
+            plan[i].type         = NETPLAY_EVENT_LOAD;
+            break;
+         default:
+            break;
+      }
+   }
+
+   /* Only a core_run() follows the update before the frame, so after
+    * it every advance is run here */
+   presented                = netplay_events_plan(&netplay->events, present);
+   netplay->advance_pending = presented >= 0;
+
+   for (i = 0; i < count; i++)
+   {
+      GekkoGameEvent *event = events[i];
+      if (!event)
+         continue;
+
+      switch (plan[i].action)
+      {
+         case NETPLAY_EVENT_RESIMULATE:
+         case NETPLAY_EVENT_PRESENT:
+            netplay->current_frame = (unsigned)event->data.adv.frame;
+            netplay_copy_authoritative_input(netplay,
+                  event->data.adv.inputs,
+                  event->data.adv.input_len);
+            netplay_replay_input(netplay->replay, event->data.adv.frame,
+                  event->data.adv.inputs, event->data.adv.input_len);
+            for (j = 0; j < NETPLAY_JOIN_MAX_SENDERS; j++)
+               netplay_join_sender_input(&netplay->join_senders[j],
+                     event->data.adv.frame, event->data.adv.inputs,
+                     event->data.adv.input_len);
+            netplay_relay_stream_set(&netplay->relay_stream,
+                  (unsigned)event->data.adv.frame, event->data.adv.inputs,
+                  event->data.adv.input_len);
+            if (!event->data.adv.rolling_back)
+               netplay->join_frames_run++;
+            /* The presented advance is left for the regular core_run()
+             * so that it is the only frame shown */
+            if (plan[i].action == NETPLAY_EVENT_RESIMULATE)
+            {
+               if (event->data.adv.rolling_back && !rollback_frames++)
+                  rollback_start = cpu_features_get_time_usec();
+               netplay_resimulate_frame(netplay);
+            }
+            break;
+         case NETPLAY_EVENT_SAVE_NOW:
+            netplay_save_event(netplay, event);
+            break;
+         case NETPLAY_EVENT_SAVE_AFTER:
+            netplay->events_deferred = events;
+            break;
+         case NETPLAY_EVENT_LOAD_NOW:
+            event_start = cpu_features_get_time_usec();
+            netplay_handle_load_event(netplay, event);
+            netplay_telemetry_add_load(&netplay->telemetry, (uint32_t)
+                  (cpu_features_get_time_usec() - event_start));
+            break;
+         default:
+            break;
+      }
+   }
+
+   if (     netplay->replay
+         && netplay->advance_pending
+         && !netplay_replay_started(netplay->replay))
+      netplay_start_replay(netplay, events[presented]->data.adv.frame);
+
+   if (netplay->advance_pending)
+      netplay_join_snapshot(netplay, events[presented]);
+
+   if (rollback_frames)
+   {
+      retro_time_t elapsed = cpu_features_get_time_usec() - rollback_start;
+
+      netplay->rollback_last_frames   = rollback_frames;
+      netplay->rollback_last_usec     = elapsed;
+      netplay->rollback_count++;
+      netplay->rollback_total_frames += rollback_frames;
+      netplay->rollback_total_usec   += elapsed;
+      netplay_telemetry_add_rollback(&netplay->telemetry, rollback_frames);
+
+      RARCH_DBG("[Netplay] Rolled back %u frame(s) to frame %u in %lld usec.\n",
+            rollback_frames, netplay->current_frame, (long long)elapsed);
+   }
+}
+
+/**
+ * netplay_output_path
+ *
+ * Place @name in the log directory, or next to the configuration
+ * file when no log directory is set.
+ */
+static void netplay_output_path(const char *name, char *s, size_t len)
+{
+   char base_dir[PATH_MAX_LENGTH];
+   settings_t *settings  = config_get_ptr();
+   const char *log_dir   = settings ? settings->paths.log_dir : NULL;
+
+   base_dir[0] = '\0';
+   if (!string_is_empty(log_dir))
+      strlcpy(base_dir, log_dir, sizeof(base_dir));
+   else if (!string_is_empty(path_get(RARCH_PATH_CONFIG)))
+      fill_pathname_basedir(base_dir, path_get(RARCH_PATH_CONFIG),
+            sizeof(base_dir));
+
+   if (!string_is_empty(base_dir))
+      fill_pathname_join(s, base_dir, name, len);
+   else
+      strlcpy(s, name, len);
+}
+
+/**
+ * netplay_open_replay
+ *
+ * Create the session's replay beside the content's regular replays,
+ * or in the log directory when there is no content name. Recording
+ * begins with the first frame that runs.
+ */
+static void netplay_open_replay(netplay_t *netplay)
+{
+   char name[64];
+   char path[PATH_MAX_LENGTH];
+   struct retro_system_av_info *av_info = &video_state_get_ptr()->av_info;
+   time_t now = time(NULL);
+   unsigned batch_frames = 60;
+
+   netplay_close_replay(netplay);
+   if (!netplay->record_replay)
+      return;
+
+   strftime(name, sizeof(name), "-netplay-%Y%m%d-%H%M%S"
+         FILE_PATH_BSV_EXTENSION, localtime(&now));
+   if (runloop_get_replay_path(path, sizeof(path), -1))
+   {
+      path_remove_extension(path);
+      strlcat(path, name, sizeof(path));
+   }
+   else
+      netplay_output_path(name + 1, path, sizeof(path));
+
+   /* The writer gets a second of frames at a time */
+   if (av_info->timing.fps > 0.0)
+      batch_frames = (unsigned)(av_info->timing.fps + 0.5);
+
+   netplay->replay = netplay_replay_new(path, &netplay->input_layout,
+         netplay->num_players, netplay->input_prediction_window,
+         batch_frames, content_get_crc());
+   if (netplay->replay)
+      RARCH_LOG("[Netplay] Recording replay to \"%s\".\n", path);
+}
+
+/* Memory the core exposes, to map divergent blocks back to */
+static unsigned netplay_desync_regions(netplay_forensics_region_t *regions,
+      unsigned max)
+{
+   static const struct
+   {
+      unsigned    id;
+      const char *name;
+   } ids[] = {
+      { RETRO_MEMORY_SYSTEM_RAM, "system_ram" },
+      { RETRO_MEMORY_SAVE_RAM,   "save_ram"   },
+      { RETRO_MEMORY_VIDEO_RAM,  "video_ram"  }
+   };
+   unsigned i;
+   unsigned count                  = 0;
+   runloop_state_t *runloop_st     = runloop_state_get_ptr();
+   const rarch_memory_map_t *mmaps = &runloop_st->system.mmaps;
+
+   for (i = 0; i < mmaps->num_descriptors && count < max; i++)
+   {
+      const struct retro_memory_descriptor *desc =
+         &mmaps->descriptors[i].core;
+      netplay_forensics_region_t *region = &regions[count];
+
+      if (!desc->ptr || !desc->len)
+         continue;
+
+      if (!string_is_empty(desc->addrspace))
+         snprintf(region->name, sizeof(region->name), "%s@%llx",
+               desc->addrspace, (unsigned long long)desc->start);
+      else
+         snprintf(region->name, sizeof(region->name), "map%u@%llx",
+               i, (unsigned long long)desc->start);
+      region->ptr   = (const uint8_t*)desc->ptr + desc->offset;
+      region->len   = desc->len;
+      region->start = desc->start;
+      count++;
+   }
+
+   for (i = 0; i < ARRAY_SIZE(ids) && count < max; i++)
+   {
+      retro_ctx_memory_info_t mem;
+
+      mem.id   = ids[i].id;
+      mem.data = NULL;
+      mem.size = 0;
+      if (!core_get_memory(&mem) || !mem.data || !mem.size)
+         continue;
+
+      strlcpy(regions[count].name, ids[i].name, sizeof(regions[count].name));
+      regions[count].ptr   = (const uint8_t*)mem.data;
+      regions[count].len   = mem.size;
+      regions[count].start = 0;
+      count++;
+   }
+
+   return count;
+}
+
+static void netplay_desync_write_report(netplay_t *netplay, int frame,
+      const netplay_forensics_remote_t *remote, unsigned remote_index)
+{
+   netplay_forensics_region_t regions[32];
+   retro_ctx_serialize_info_t info;
+   char header[512];
+   char name[96];
+   char path[PATH_MAX_LENGTH];
+   size_t live_len             = 0;
+   uint8_t *live               = NULL;
+   runloop_state_t *runloop_st = runloop_state_get_ptr();
+   unsigned region_count       = netplay_desync_regions(regions,
+         ARRAY_SIZE(regions));
+
+   /* Regions are located in a fresh state, taken at the same moment
+    * as the memory they are compared against */
+   if (netplay->state_size && (live = (uint8_t*)malloc(netplay->state_size)))
+   {
+      info.data = live;
+      info.size = netplay->state_size;
+      if (core_serialize_special(&info))
+         live_len = info.size;
+   }
+
+   snprintf(header, sizeof(header),
+         "core: %s %s\nlocal handle: %d\nrecorded frames: %u\n",
+         runloop_st->system.info.library_name
+            ? runloop_st->system.info.library_name : "unknown",
+         runloop_st->system.info.library_version
+            ? runloop_st->system.info.library_version : "",
+         netplay->local_handle, netplay->forensics.history);
+
+   if (remote)
+      snprintf(name, sizeof(name), "netplay-desync-%d-peer%u.txt",
+            frame, remote_index);
+   else
+      snprintf(name, sizeof(name), "netplay-desync-%d-local.txt", frame);
+   netplay_output_path(name, path, sizeof(path));
+
+   if (netplay_forensics_write_report(&netplay->forensics, frame, remote,
+            regions, region_count, live, live_len, header, path))
+      RARCH_LOG("[Netplay] Desync report written to \"%s\".\n", path);
+   else
+      RARCH_WARN("[Netplay] Unable to write desync report to \"%s\".\n",
+            path);
+
+   free(live);
+}
+
+/* Compare with a peer once both sides' hashes are here */
+static void netplay_desync_try_report(netplay_t *netplay,
+      netplay_forensics_remote_t *remote)
+{
+   netplay_forensics_t *f = &netplay->forensics;
+
+   if (     remote->reported
+         || remote->received != remote->block_count
+         || f->desync_frame < 0
+         || !netplay_forensics_find(f, remote->frame))
+      return;
+
+   remote->reported = true;
+   netplay_desync_write_report(netplay, remote->frame, remote,
+         (unsigned)(remote - f->remotes));
+}
+
+static void netplay_oob(const char *from, const uint8_t *data,
+      size_t len)
+{
+   netplay_forensics_remote_t *remote;
+   netplay_t *netplay = networking_driver_st.data;
+
+   if (!netplay || !len)
+      return;
+
+   switch (data[0])
+   {
+      case NETPLAY_JOIN_MSG_REQUEST:
+         netplay_join_requested(netplay, from, data, len);
+         break;
+      case NETPLAY_JOIN_MSG_ACK:
+         {
+            unsigned i;
+            for (i = 0; i < NETPLAY_JOIN_MAX_SENDERS; i++)
+               if (string_is_equal(netplay->join_senders[i].peer, from))
+                  netplay_join_sender_receive(&netplay->join_senders[i],
+                        data, len, cpu_features_get_time_usec());
+         }
+         break;
+      case NETPLAY_JOIN_MSG_CHUNK:
+      case NETPLAY_JOIN_MSG_INPUT:
+         netplay_join_received(netplay, from, data, len);
+         break;
+      case NETPLAY_INPUT_MSG_LAYOUT:
+         netplay_layout_received(netplay, from, data, len);
+         break;
+      default:
+         if ((remote = netplay_forensics_receive(&netplay->forensics,
+                     from, data, len)))
+            netplay_desync_try_report(netplay, remote);
+         break;
+   }
+}
+
+/**
+ * netplay_desync_detected
+ *
+ * Pin the hashes of the first desynced frame, write the local report
+ * and send the hashes to the other peers. GekkoNet keeps reporting
+ * desyncs while the states differ; the hashes are sent again on those
+ * until a peer's answer arrived, since they travel over plain UDP.
+ */
+static void netplay_desync_detected(netplay_t *netplay, int frame)
+{
+   unsigned i;
+   size_t len;
+   uint8_t buf[NETPLAY_FORENSICS_MESSAGE_MAX];
+   const netplay_forensics_entry_t *entry;
+   netplay_forensics_t *f = &netplay->forensics;
+
+   if (!f->history)
+      return;
+
+   if (f->desync_frame < 0)
+   {
+      if (!(entry = netplay_forensics_pin(f, frame)))
+      {
+         RARCH_WARN("[Netplay] Frame %d already left the desync history; raise netplay_desync_history for a report.\n",
+               frame);
+         return;
+      }
+
+      netplay_desync_write_report(netplay, frame, NULL, 0);
+      for (i = 0; i < f->remote_count; i++)
+         netplay_desync_try_report(netplay, &f->remotes[i]);
+   }
+   else
+   {
+      if (     !(entry = netplay_forensics_find(f, f->desync_frame))
+            || frame - f->sent_frame < 60
+            || frame - f->desync_frame > 600)
+         return;
+      for (i = 0; i < f->remote_count; i++)
+         if (f->remotes[i].reported)
+            return;
+   }
+
+   if (!netplay->native_adapter)
+      return;
+
+   for (i = 0; (len = netplay_forensics_message(entry, i,
+               buf, sizeof(buf))); i++)
+      netplay_adapter_send_oob(buf, len);
+   netplay_adapter_flush();
+   f->sent_frame = frame;
+}
+
+static void netplay_handle_session_events(netplay_t *netplay)
+{
+   int count = 0;
+   GekkoSessionEvent **events;
+   char status_buf[128];
+
+   if (!netplay || !netplay->session)
+      return;
+
+   events = gekkonet_api_session_events(netplay->session, &count);
+   for (; count > 0 && events; count--, events++)
+   {
+      GekkoSessionEvent *event = *events;
+      if (!event)
+         continue;
+
+      switch (event->type)
+      {
+         case PlayerSyncing:
+         {
+            unsigned current = (unsigned)event->data.syncing.current;
+            unsigned total   = (unsigned)event->data.syncing.max;
+
+            netplay->connected = true;
+
+            snprintf(status_buf, sizeof(status_buf),
+                  "Syncing players (%u/%u)", current, total);
+            netplay_session_status_set(status_buf, current, total);
+            break;
+         }
+         case SessionStarted:
+            netplay->session_started = true;
+            netplay->connected       = true;
+            netplay_session_status_set(
+                  msg_hash_to_str(MSG_NETPLAY_STATUS_PLAYING), 0, 0);
             break;
          case PlayerConnected:
             netplay->connected       = true;
@@ -1592,6 +2699,7 @@ static void netplay_handle_session_events(netplay_t *netplay)
                   "Desync detected (frame %d)",
                   event->data.desynced.frame);
             netplay_session_status_set(status_buf, 0, 0);
+            netplay_desync_detected(netplay, event->data.desynced.frame);
             break;
          default:
             break;
@@ -1599,26 +2707,512 @@ static void netplay_handle_session_events(netplay_t *netplay)
    }
 }
 
-static void netplay_pump_events(netplay_t *netplay)
+/**
+ * netplay_pump_events
+ * @present              : core_run() follows and presents the last
+ *                         advance of the update
+ *
+ * Run GekkoNet's game and session events.
+ */
+static void netplay_pump_events(netplay_t *netplay, bool present)
+{
+   if (!netplay)
+      return;
+
+   netplay_handle_game_events(netplay, present);
+   netplay_handle_session_events(netplay);
+   if (netplay->native_adapter)
+      netplay_adapter_flush();
+}
+
+static void netplay_update_network_stats(netplay_t *netplay)
+{
+   size_t i;
+   net_driver_state_t *net_st;
+   GekkoNetworkStats stats;
+   int worst_ping = -1;
+
+   if (!netplay || !netplay->session)
+      return;
+
+   net_st = &networking_driver_st;
+
+   for (i = 0; i < netplay->remote_actor_count; i++)
+   {
+      const netplay_remote_actor_t *actor = &netplay->remote_actors[i];
+
+      if (!actor->registered || actor->handle < 0)
+         continue;
+
+      memset(&stats, 0, sizeof(stats));
+      gekkonet_api_network_stats(netplay->session, actor->handle, &stats);
+      netplay_telemetry_set_peer(&netplay->telemetry, actor->handle,
+            stats.last_ping, stats.avg_ping, stats.jitter);
+      if ((int)stats.last_ping > worst_ping)
+         worst_ping = (int)stats.last_ping;
+   }
+
+   if (worst_ping < 0)
+   {
+      gekkonet_api_network_stats(netplay->session, netplay->local_handle,
+            &stats);
+      worst_ping = (int)stats.last_ping;
+   }
+
+   net_st->latest_ping = worst_ping;
+}
+
+/**
+ * netplay_update_local_delay
+ *
+ * In automatic delay mode, periodically re-evaluate the local input
+ * delay against the worst link among the remote players.
+ */
+static void netplay_update_local_delay(netplay_t *netplay)
+{
+   size_t i;
+   float rtt_ms    = 0.0f;
+   float jitter_ms = 0.0f;
+   struct retro_system_av_info *av_info = &video_state_get_ptr()->av_info;
+
+   if (     !netplay->local_delay_auto
+         || !netplay->session
+         || !netplay->session_started
+         ||  netplay->spectator
+         ||  netplay->local_handle < 0)
+      return;
+
+   if (!netplay_autodelay_tick(&netplay->autodelay))
+      return;
+
+   for (i = 0; i < netplay->remote_actor_count; i++)
+   {
+      GekkoNetworkStats stats;
+      const netplay_remote_actor_t *actor = &netplay->remote_actors[i];
+
+      if (!actor->registered || actor->handle < 0)
+         continue;
+
+      memset(&stats, 0, sizeof(stats));
+      gekkonet_api_network_stats(netplay->session, actor->handle, &stats);
+      if (stats.avg_ping > rtt_ms)
+         rtt_ms    = stats.avg_ping;
+      if (stats.jitter > jitter_ms)
+         jitter_ms = stats.jitter;
+   }
+
+   /* No round trip measured yet */
+   if (rtt_ms <= 0.0f || av_info->timing.fps <= 0.0)
+      return;
+
+   if (netplay_autodelay_evaluate(&netplay->autodelay, rtt_ms, jitter_ms,
+            (float)(1000.0 / av_info->timing.fps)))
+   {
+      gekkonet_api_set_local_delay(netplay->session, netplay->local_handle,
+            (unsigned char)netplay->autodelay.delay);
+      RARCH_LOG("[Netplay] Local delay set to %u frame(s) (RTT %.1f ms, jitter %.1f ms).\n",
+            netplay->autodelay.delay, rtt_ms, jitter_ms);
+   }
+}
+
+static void netplay_update_timesync(netplay_t *netplay)
+{
+   if (     !netplay->session
+         || !netplay->session_started
+         ||  netplay->spectator)
+      return;
+
+   netplay_timesync_update(&netplay->timesync,
+         gekkonet_api_frames_ahead(netplay->session));
+}
+
+/**
+ * netplay_timesync_frame
+ *
+ * Apply the time sync decision for the upcoming frame. Returns false
+ * if the frame is to be held, in which case core_run() presents the
+ * previous frame again. A skipped frame is run here, unpresented, on
+ * top of the regular one.
+ */
+static bool netplay_timesync_frame(netplay_t *netplay)
+{
+   int frame_usec = 0;
+   struct retro_system_av_info *av_info = &video_state_get_ptr()->av_info;
+
+   if (     !netplay->session_started
+         ||  netplay->spectator)
+      return true;
+
+   if (av_info->timing.fps > 0.0)
+      frame_usec = (int)(1000000.0 / av_info->timing.fps);
+
+   switch (netplay_timesync_next_action(&netplay->timesync, frame_usec))
+   {
+      case NETPLAY_TIMESYNC_HOLD:
+         RARCH_DBG("[Netplay] Time sync: holding a frame (%.2f frames ahead).\n",
+               netplay->timesync.frames_ahead);
+         /* Keep packets flowing while the session waits for us */
+         if (netplay->session)
+            gekkonet_api_network_poll(netplay->session);
+         if (netplay->native_adapter)
+            netplay_adapter_flush();
+         return false;
+      case NETPLAY_TIMESYNC_SKIP:
+         RARCH_DBG("[Netplay] Time sync: skipping a frame (%.2f frames behind).\n",
+               -netplay->timesync.frames_ahead);
+         netplay_collect_local_input(netplay);
+         netplay_pump_events(netplay, false);
+         break;
+      case NETPLAY_TIMESYNC_RUN:
+      default:
+         break;
+   }
+
+   return true;
+}
+
+/* Relay messages per frame */
+#define NETPLAY_RELAY_BURST          8
+#define NETPLAY_RELAY_WATCH_USEC     50000
+/* A relay spectator further behind than this runs the extra frames
+ * unpresented, up to NETPLAY_JOIN_CATCHUP_FRAMES per frame */
+#define NETPLAY_RELAY_BEHIND_FRAMES  30
+
+static void netplay_relay_send(void *data, const uint8_t *msg, size_t len)
+{
+   netplay_t *netplay = (netplay_t*)data;
+
+   sendto(netplay->relay_fd, (const char*)msg, (int)len, 0,
+         (const struct sockaddr*)&netplay->relay_addr,
+         netplay->relay_addr_len);
+}
+
+/**
+ * netplay_relay_open
+ * @watch                : spectate through the relay instead of feeding it
+ *
+ * Resolve netplay_relay_server, "host" or "host:port".
+ */
+static bool netplay_relay_open(netplay_t *netplay,
+      const settings_t *settings, bool watch)
+{
+   char host[NAME_MAX_LENGTH];
+   char *sep;
+   int fd;
+   struct addrinfo *addr = NULL;
+   unsigned port         = NETPLAY_RELAY_DEFAULT_PORT;
+
+   strlcpy(host, settings->paths.netplay_relay_server, sizeof(host));
+   if (string_is_empty(host))
+      return false;
+
+   if ((sep = strrchr(host, ':')))
+   {
+      *sep = '\0';
+      port = (unsigned)strtoul(sep + 1, NULL, 10);
+   }
+
+   fd = socket_init((void**)&addr, (uint16_t)port, host,
+         SOCKET_TYPE_DATAGRAM, AF_INET);
+   if (fd < 0 || !addr || !socket_set_block(fd, false))
+   {
+      RARCH_ERR("[Netplay] Unable to reach the relay at %s:%u.\n",
+            host, port);
+      if (addr)
+         freeaddrinfo_retro(addr);
+      if (fd >= 0)
+         socket_close(fd);
+      return false;
+   }
+
+   memcpy(&netplay->relay_addr, addr->ai_addr, addr->ai_addrlen);
+   netplay->relay_addr_len = (socklen_t)addr->ai_addrlen;
+   freeaddrinfo_retro(addr);
+
+   netplay->relay_fd         = fd;
+   netplay->relay_watch      = watch;
+   netplay->relay_warned     = false;
+   netplay->relay_next_frame = 0;
+   netplay_relay_link_reset(&netplay->relay_link, 0,
+         cpu_features_get_time_usec());
+   /* A spectator takes the session of the first frames it receives */
+   netplay_relay_stream_init(&netplay->relay_stream,
+         watch ? 0 : ((uint32_t)cpu_features_get_time_usec() | 1),
+         netplay_join_record_len(netplay));
+
+   if (watch)
+      RARCH_LOG("[Netplay] Watching through the relay at %s:%u.\n",
+            host, port);
+   else
+      RARCH_LOG("[Netplay] Sending the session to spectators through the relay at %s:%u.\n",
+            host, port);
+   return true;
+}
+
+static void netplay_relay_frames(netplay_t *netplay,
+      const uint8_t *msg, size_t len)
+{
+   uint32_t session;
+   size_t record_len;
+   netplay_relay_stream_t *s = &netplay->relay_stream;
+
+   if (!netplay_relay_peek(msg, len, NULL, &session, &record_len))
+      return;
+
+   if (session != s->session)
+   {
+      if (record_len != s->record_len)
+      {
+         if (!netplay->relay_warned)
+            RARCH_ERR("[Netplay] The relayed session sends %u byte(s) per frame, expected %u; check that the input devices and player count match the host.\n",
+                  (unsigned)record_len, (unsigned)s->record_len);
+         netplay->relay_warned = true;
+         return;
+      }
+      if (s->count)
+      {
+         if (!netplay->relay_warned)
+            RARCH_WARN("[Netplay] The host started a new session; reconnect to watch it.\n");
+         netplay->relay_warned = true;
+         return;
+      }
+      netplay_relay_stream_init(s, session, record_len);
+   }
+
+   netplay_relay_unpack(s, msg, len);
+}
+
+static void netplay_relay_receive(netplay_t *netplay, retro_time_t now)
+{
+   uint8_t msg[NETPLAY_RELAY_PACKET_MAX];
+   int len;
+
+   while ((len = (int)recvfrom(netplay->relay_fd, (char*)msg, sizeof(msg),
+               0, NULL, NULL)) >= 0)
+   {
+      uint8_t type;
+      uint32_t session;
+      unsigned count;
+
+      if (netplay->relay_watch)
+         netplay_relay_frames(netplay, msg, (size_t)len);
+      else if (netplay_relay_parse_control(msg, (size_t)len,
+               &type, &session, &count)
+            && type    == NETPLAY_RELAY_MSG_ACK
+            && session == netplay->relay_stream.session)
+      {
+         /* A restarted relay has nothing and cannot be refilled */
+         if (     count < netplay->relay_link.acked
+               && !netplay->relay_warned)
+         {
+            RARCH_WARN("[Netplay] The relay lost the session's inputs; its spectators have to wait for the next session.\n");
+            netplay->relay_warned = true;
+         }
+         netplay_relay_link_ack(&netplay->relay_link, count, now);
+      }
+   }
+}
+
+/**
+ * netplay_relay_feed
+ *
+ * Send the frames no rollback can change any more to the relay, once,
+ * whatever the number of spectators behind it.
+ */
+static void netplay_relay_feed(netplay_t *netplay)
 {
-   if (!netplay)
+   unsigned end;
+   retro_time_t now             = cpu_features_get_time_usec();
+   netplay_relay_stream_t *s    = &netplay->relay_stream;
+   unsigned window              = netplay->input_prediction_window + 1;
+
+   if (netplay->relay_fd < 0 || netplay->relay_watch)
       return;
 
-   netplay_handle_game_events(netplay);
-   netplay_handle_session_events(netplay);
+   netplay_relay_receive(netplay, now);
+
+   end = s->count > window ? s->count - window : 0;
+   netplay_relay_link_poll(&netplay->relay_link, s, end, now,
+         NETPLAY_RELAY_BURST, netplay_relay_send, netplay);
+   netplay_relay_stream_trim(s, netplay->relay_link.acked);
 }
 
-static void netplay_update_network_stats(netplay_t *netplay)
+/**
+ * netplay_relay_watch_frame
+ *
+ * A frame of a relay spectator: run the next relayed frame, holding
+ * until it arrived. Spectators start from the session's first frame
+ * and run what they missed unpresented.
+ */
+static bool netplay_relay_watch_frame(netplay_t *netplay)
 {
-   net_driver_state_t *net_st;
-   GekkoNetworkStats stats;
+   unsigned i, available;
+   retro_time_t now          = cpu_features_get_time_usec();
+   netplay_relay_stream_t *s = &netplay->relay_stream;
 
-   if (!netplay || !netplay->session)
+   netplay_relay_receive(netplay, now);
+
+   if (now - netplay->relay_watch_at >= NETPLAY_RELAY_WATCH_USEC)
+   {
+      uint8_t msg[NETPLAY_RELAY_CONTROL_SIZE];
+      size_t len = netplay_relay_control(msg, sizeof(msg),
+            NETPLAY_RELAY_MSG_WATCH, s->session, s->count);
+
+      if (len)
+         netplay_relay_send(netplay, msg, len);
+      netplay->relay_watch_at = now;
+   }
+
+   if (s->count <= netplay->relay_next_frame)
+      return false;
+
+   if (!netplay->session_started)
+   {
+      netplay->session_started = true;
+      netplay->connected       = true;
+      netplay->spectator       = true;
+      netplay_session_status_set(
+            msg_hash_to_str(MSG_NETPLAY_STATUS_SPECTATING), 0, 0);
+   }
+
+   available = s->count - netplay->relay_next_frame;
+   for (i = 0;    i < NETPLAY_JOIN_CATCHUP_FRAMES
+               && available > NETPLAY_RELAY_BEHIND_FRAMES; i++, available--)
+   {
+      netplay_copy_authoritative_input(netplay,
+            netplay_relay_stream_get(s, netplay->relay_next_frame++),
+            (unsigned)s->record_len);
+      netplay_resimulate_frame(netplay);
+   }
+
+   netplay->current_frame = netplay->relay_next_frame;
+   netplay_copy_authoritative_input(netplay,
+         netplay_relay_stream_get(s, netplay->relay_next_frame++),
+         (unsigned)s->record_len);
+   netplay_relay_stream_trim(s, netplay->relay_next_frame);
+   return true;
+}
+
+/**
+ * netplay_join_update
+ *
+ * Move the transfers along: the host compresses and sends, a joiner
+ * asks for the state and acknowledges what arrived.
+ */
+static void netplay_join_update(netplay_t *netplay)
+{
+   unsigned i;
+   uint8_t buf[NETPLAY_JOIN_MESSAGE_MAX];
+   size_t len;
+   unsigned budget   = NETPLAY_JOIN_CHUNK_BUDGET;
+   retro_time_t now  = cpu_features_get_time_usec();
+
+   if (!netplay->late_join || !netplay->native_adapter)
       return;
 
-   net_st = &networking_driver_st;
-   gekkonet_api_network_stats(netplay->session, netplay->local_handle, &stats);
-   net_st->latest_ping = stats.last_ping;
+   for (i = 0; i < NETPLAY_JOIN_MAX_SENDERS; i++)
+   {
+      unsigned sent;
+      netplay_join_sender_t *s = &netplay->join_senders[i];
+
+      if (!s->active)
+         continue;
+
+      sent   = netplay_join_sender_poll(s, now, budget,
+            netplay_join_send, s->peer);
+      budget = sent < budget ? budget - sent : 0;
+      if (s->finished)
+      {
+         RARCH_LOG("[Netplay] Transfer to %s ended after %u frame(s) of input.\n",
+               s->peer, s->input_acked);
+         netplay_join_sender_free(s);
+      }
+   }
+
+   if (!netplay->join_client)
+      return;
+
+   if (netplay->join.id)
+   {
+      if (     netplay->join_done_at
+            && now - netplay->join_done_at > NETPLAY_JOIN_LINGER_USEC)
+         netplay_join_receiver_free(&netplay->join);
+      else
+         netplay_join_receiver_poll(&netplay->join, now,
+               netplay_join_send, netplay->join_host);
+      return;
+   }
+
+   if (     netplay->join_done_at
+         || netplay->joining
+         || !netplay->session_started
+         || netplay->join_frames_run >= NETPLAY_JOIN_REQUEST_FRAMES
+         || now - netplay->join_request_at < NETPLAY_JOIN_REQUEST_USEC)
+      return;
+
+   if ((len = netplay_join_request(buf, sizeof(buf), &netplay->join,
+               netplay->join_frames_run)))
+      netplay_adapter_send_oob(buf, len);
+   netplay->join_request_at = now;
+}
+
+/**
+ * netplay_join_frame
+ *
+ * A frame while joining: keep the session and the transfer going and
+ * once the state is in, run the frames since it at up to
+ * NETPLAY_JOIN_CATCHUP_FRAMES per frame, unpresented. Nothing is shown
+ * until the joiner caught up with the session, so this always holds.
+ */
+static bool netplay_join_frame(netplay_t *netplay)
+{
+   unsigned i;
+
+   netplay_collect_local_input(netplay);
+   netplay_pump_events(netplay, true);
+   netplay_join_update(netplay);
+
+   if (netplay->join_next_frame < 0)
+   {
+      if (netplay->join.chunk_count)
+         netplay_session_status_set("Receiving the session",
+               netplay->join.received, netplay->join.chunk_count);
+
+      if (!netplay_join_receiver_complete(&netplay->join))
+         goto hold;
+      if (!netplay_join_load(netplay))
+      {
+         netplay_join_finish(netplay, false);
+         goto hold;
+      }
+      netplay_session_status_set("Catching up", 0, 0);
+   }
+
+   for (i = 0; i < NETPLAY_JOIN_CATCHUP_FRAMES; i++)
+   {
+      const uint8_t *inputs;
+
+      if (netplay->join_next_frame > netplay->join_live_frame)
+      {
+         netplay_join_finish(netplay, true);
+         break;
+      }
+      if (!(inputs = netplay_join_input(netplay, netplay->join_next_frame)))
+         break;
+
+      netplay_copy_authoritative_input(netplay, inputs,
+            (unsigned)netplay_join_record_len(netplay));
+      netplay_resimulate_frame(netplay);
+      netplay_join_keep_state(netplay, netplay->join_next_frame);
+      netplay->join_next_frame++;
+   }
+
+hold:
+   if (netplay->session)
+      gekkonet_api_network_poll(netplay->session);
+   if (netplay->native_adapter)
+      netplay_adapter_flush();
+   return false;
 }
 
 static bool netplay_pre_frame(netplay_t *netplay)
@@ -1633,8 +3227,36 @@ static bool netplay_pre_frame(netplay_t *netplay)
    if (!netplay->running)
       return false;
 
+   if (netplay->relay_watch)
+      return netplay_relay_watch_frame(netplay);
+
+   /* A peer reads input or checks states another way; refuse to
+    * play with it */
+   if (netplay->layout_mismatch)
+   {
+      const char *msg = "Netplay stopped: the peers' core port devices or state checksums differ.";
+      runloop_msg_queue_push(msg, strlen(msg), 1, 180, false, NULL,
+            MESSAGE_QUEUE_ICON_DEFAULT, MESSAGE_QUEUE_CATEGORY_ERROR);
+      deinit_netplay();
+      return false;
+   }
+
+   if (netplay->joining)
+      return netplay_join_frame(netplay);
+
+   if (!netplay_timesync_frame(netplay))
+      return false;
+
+   /* With the network thread, whatever arrived during the last frame
+    * is already queued; take it in before sampling local input so the
+    * session predicts as little as possible. */
+   if (     netplay->session
+         && netplay->native_adapter
+         && netplay_adapter_threaded())
+      gekkonet_api_network_poll(netplay->session);
+
    netplay_collect_local_input(netplay);
-   netplay_pump_events(netplay);
+   netplay_pump_events(netplay, true);
    return true;
 }
 
@@ -1643,10 +3265,74 @@ static void netplay_post_frame(netplay_t *netplay)
    if (!netplay || !netplay->running)
       return;
 
-   netplay_pump_events(netplay);
+   /* GekkoNet advances a frame on every update while it holds local
+    * input, and with a local delay it always holds some. Another
+    * update here would run a second frame on one input and leave a
+    * later frame with none, stalling the session; the game events
+    * wait for netplay_pre_frame(). */
+   netplay_handle_session_events(netplay);
    netplay_update_network_stats(netplay);
+   netplay_update_timesync(netplay);
+   netplay_update_local_delay(netplay);
+   netplay_join_update(netplay);
+   netplay_relay_feed(netplay);
+   if (netplay->session_started)
+      netplay_telemetry_end_frame(&netplay->telemetry,
+            netplay->timesync.frames_ahead, cpu_features_get_time_usec());
    if (netplay->session)
       gekkonet_api_network_poll(netplay->session);
+   if (netplay->native_adapter)
+      netplay_adapter_flush();
+}
+
+/**
+ * netplay_prepare_input_layout
+ *
+ * Derive the per-player input record from the device bound to each
+ * core port a player can drive. Sticks are always carried, since many
+ * cores read them from a plain RetroPad. The layout depends only on
+ * settings and the loaded core, so peers running the same content
+ * with the same port devices agree on it; netplay_layout_update()
+ * makes sure they do before the first frame.
+ */
+static bool netplay_prepare_input_layout(netplay_t *netplay,
+      const settings_t *settings)
+{
+   char desc[64];
+   unsigned port;
+   unsigned ports    = settings->uints.netplay_input_ports;
+   unsigned sections = NETPLAY_INPUT_ANALOG;
+
+   if (!ports)
+      ports = 1;
+   else if (ports > NETPLAY_INPUT_MAX_PORTS)
+      ports = NETPLAY_INPUT_MAX_PORTS;
+
+   for (port = 0; port < netplay->num_players * ports
+         && port < MAX_USERS; port++)
+      sections |= netplay_input_sections_for_device(
+            input_config_get_device(port));
+
+   netplay_input_layout_init(&netplay->input_layout, sections, ports);
+
+   free(netplay->local_input);
+   free(netplay->input_ports);
+   netplay->input_port_count = (size_t)netplay->num_players * ports;
+   netplay->input_keys       = 0;
+   netplay->local_input      = (uint8_t*)calloc(1,
+         netplay->input_layout.record_size);
+   netplay->input_ports      = (netplay_input_port_t*)calloc(
+         netplay->input_port_count, sizeof(*netplay->input_ports));
+
+   if (!netplay->local_input || !netplay->input_ports)
+      return false;
+
+   netplay_input_layout_describe(&netplay->input_layout,
+         desc, sizeof(desc));
+   RARCH_LOG("[Netplay] Input layout: %s, %u port(s) per player, %u byte(s) per frame.\n",
+         desc, netplay->input_layout.ports,
+         netplay->input_layout.record_size);
+   return true;
 }
 
 static bool netplay_apply_settings(netplay_t *netplay,
@@ -1674,12 +3360,70 @@ static bool netplay_apply_settings(netplay_t *netplay,
 
    if (!netplay->num_players)
       netplay->num_players = 1;
+
+   if (!netplay_prepare_input_layout(netplay, settings))
+   {
+      RARCH_ERR("[Netplay] Unable to allocate input buffers.\n");
+      if (diag)
+      {
+         strlcpy(diag->failure_stage, "allocate_input",
+               sizeof(diag->failure_stage));
+         strlcpy(diag->failure_reason,
+               "Failed to allocate netplay input buffers",
+               sizeof(diag->failure_reason));
+      }
+      return false;
+   }
    netplay->input_prediction_window = (unsigned char)
       (settings->uints.netplay_prediction_window <= 255
          ? settings->uints.netplay_prediction_window : 255);
    netplay->spectator_delay = (unsigned char)
-      (settings->uints.netplay_local_delay <= 255
-         ? settings->uints.netplay_local_delay : 255);
+      (settings->uints.netplay_spectator_delay <= 255
+         ? settings->uints.netplay_spectator_delay : 255);
+
+   netplay->local_delay_auto = settings->bools.netplay_local_delay_auto;
+   netplay->telemetry_csv    = settings->bools.netplay_telemetry_csv;
+   netplay->desync_history   = settings->uints.netplay_desync_history;
+   netplay->record_replay    = settings->bools.netplay_record_replay;
+   netplay->late_join        = settings->bools.netplay_late_join;
+   if (netplay->local_delay_auto)
+   {
+      netplay_autodelay_init(&netplay->autodelay,
+            settings->uints.netplay_local_delay,
+            settings->uints.netplay_rollback_target,
+            NETPLAY_AUTODELAY_MAX,
+            settings->uints.netplay_delay_interval);
+      RARCH_LOG("[Netplay] Local delay: auto (start %u, rollback target %u, every %u frames).\n",
+            netplay->autodelay.delay,
+            netplay->autodelay.target_rollback,
+            netplay->autodelay.interval);
+   }
+   else
+   {
+      netplay_autodelay_init(&netplay->autodelay,
+            settings->uints.netplay_local_delay <= 255
+               ? settings->uints.netplay_local_delay : 255, 0, 255, 0);
+      RARCH_LOG("[Netplay] Local delay: %u frame(s).\n",
+            netplay->autodelay.delay);
+   }
+
+   netplay->checksum.mode     = netplay_checksum_mode_from_string(
+         settings->arrays.netplay_checksum_mode);
+   netplay->checksum.interval = settings->uints.netplay_checksum_interval;
+   netplay->checksum.stride   = settings->uints.netplay_checksum_stride;
+   netplay->checksum.region_count = netplay_checksum_regions_from_string(
+         settings->arrays.netplay_checksum_regions,
+         netplay->checksum.region_ids, NETPLAY_CHECKSUM_MAX_REGIONS);
+
+   RARCH_LOG("[Netplay] State checksum: %s%s, interval %u, stride %u%s%s.\n",
+         netplay_checksum_mode_to_string(netplay->checksum.mode),
+         (netplay->checksum.mode == NETPLAY_CHECKSUM_CRC32C
+          && netplay_checksum_hw_accelerated()) ? " (hardware)" : "",
+         netplay->checksum.interval ? netplay->checksum.interval : 1,
+         (unsigned)netplay->checksum.stride,
+         netplay->checksum.region_count ? ", regions " : "",
+         netplay->checksum.region_count
+            ? settings->arrays.netplay_checksum_regions : "");
 
    if (!netplay_prepare_remote_actor_pool(netplay))
    {
@@ -1737,8 +3481,10 @@ retry_host_setup:
       gekkonet_api_destroy(netplay->session);
       netplay->session = NULL;
       netplay->local_handle = -1;
-      netplay->adapter = NULL;
    }
+   netplay_release_adapter(netplay);
+
+   netplay->session_state_size = 0;
 
    if (string_is_empty(client_server) &&
          net_st->server_address_deferred[0])
@@ -1802,8 +3548,9 @@ retry_host_setup:
          ? settings->uints.netplay_spectator_limit : 255);
    cfg.input_prediction_window = netplay->input_prediction_window;
    cfg.spectator_delay         = netplay->spectator_delay;
-   cfg.input_size              = sizeof(uint16_t);
+   cfg.input_size              = netplay->input_layout.record_size;
    cfg.state_size              = (unsigned int)netplay->state_size;
+   netplay->session_state_size = cfg.state_size;
    cfg.limited_saving          = false;
    cfg.post_sync_joining       = true;
    cfg.desync_detection        = true;
@@ -1905,17 +3652,20 @@ retry_host_setup:
       netplay->tcp_port       = udp_port;
       netplay->ext_tcp_port   = udp_port;
       diag->resolved_port     = udp_port;
-      netplay->adapter        = gekkonet_api_default_adapter(udp_port);
+      netplay->adapter        = netplay_adapter_create(udp_port,
+            settings->bools.netplay_io_thread);
+      netplay->native_adapter = netplay->adapter != NULL;
+      netplay_adapter_set_oob_handler(netplay_oob);
    }
 
    if (!netplay->adapter)
    {
-      RARCH_ERR("[GekkoNet] Unable to create the default UDP adapter on port %u. Check firewall rules or choose a different port.\n",
+      RARCH_ERR("[GekkoNet] Unable to create a UDP adapter on port %u. Check firewall rules or choose a different port.\n",
             requested_port);
       strlcpy(diag->failure_stage, "adapter_initialisation",
             sizeof(diag->failure_stage));
       strlcpy(diag->failure_reason,
-            "gekkonet_api_default_adapter returned NULL",
+            "no UDP adapter could be created",
             sizeof(diag->failure_reason));
       goto netplay_host_fail;
    }
@@ -1956,8 +3706,8 @@ retry_host_setup:
          retried_local_actor = true;
          gekkonet_api_destroy(netplay->session);
          netplay->session       = NULL;
-         netplay->adapter       = NULL;
          netplay->local_handle  = -1;
+         netplay_release_adapter(netplay);
          diag->failure_stage[0] = '\0';
          diag->failure_reason[0] = '\0';
          diag->session_created  = false;
@@ -1975,6 +3725,10 @@ retry_host_setup:
    NETPLAY_DIAG_LOG("Registered local player handle %d with libGekkoNet.",
          netplay->local_handle);
 
+   gekkonet_api_set_local_delay(netplay->session, netplay->local_handle,
+         (unsigned char)netplay->autodelay.delay);
+
+   netplay->join_client = want_client;
    if (want_client)
    {
       netplay_session_status_set("Resolving remote host", 0, 0);
@@ -2012,7 +3766,7 @@ netplay_host_fail:
       netplay->local_handle = -1;
    }
 
-   netplay->adapter = NULL;
+   netplay_release_adapter(netplay);
    netplay_host_diag_capture_gekkonet_state(diag);
    return false;
 }
@@ -2024,6 +3778,7 @@ static netplay_t *netplay_new(void)
       return NULL;
 
    netplay->local_handle = -1;
+   netplay->relay_fd     = -1;
    netplay->running      = true;
    netplay->spectator    = false;
 
@@ -2035,10 +3790,29 @@ static void netplay_reset_state(netplay_t *netplay)
    if (!netplay)
       return;
 
-   netplay->connected           = false;
-   netplay->session_started     = false;
-   netplay->authoritative_valid = false;
-   netplay->current_frame       = 0;
+   netplay->connected             = false;
+   netplay->session_started       = false;
+   netplay->authoritative_valid   = false;
+   netplay->resimulating          = false;
+   netplay->current_frame         = 0;
+   netplay->rollback_last_frames  = 0;
+   netplay->rollback_last_usec    = 0;
+   netplay->rollback_count        = 0;
+   netplay->rollback_total_frames = 0;
+   netplay->rollback_total_usec   = 0;
+   netplay->advance_pending       = false;
+   netplay->events_deferred       = NULL;
+   netplay->layout_peer_count     = 0;
+   netplay->layout_sent_at        = 0;
+   netplay->layout_confirmed      = false;
+   netplay->layout_mismatch       = false;
+   netplay->join_next_id          = (uint32_t)cpu_features_get_time_usec();
+   netplay_join_free(netplay);
+   netplay_timesync_reset(&netplay->timesync);
+   netplay_telemetry_init(&netplay->telemetry, netplay->telemetry_csv);
+   if (!netplay_forensics_init(&netplay->forensics, netplay->desync_history))
+      RARCH_WARN("[Netplay] Unable to allocate the desync history.\n");
+   netplay_open_replay(netplay);
    netplay_session_status_reset();
 }
 
@@ -2051,10 +3825,24 @@ static bool netplay_begin_session(netplay_t *netplay,
    if (!settings || !netplay)
       return false;
 
+   if (     diag->netplay_driver_request_client
+         && settings->bools.netplay_relay_spectate)
+   {
+      if (     !netplay_apply_settings(netplay, settings, diag)
+            || !netplay_relay_open(netplay, settings, true))
+         return false;
+      netplay_reset_state(netplay);
+      netplay_session_status_set("Waiting for the relay", 0, 0);
+      return true;
+   }
+
    if (!netplay_setup_session(netplay, settings, &port, server, diag))
       return false;
 
    netplay_reset_state(netplay);
+   if (     !diag->netplay_driver_request_client
+         && !string_is_empty(settings->paths.netplay_relay_server))
+      netplay_relay_open(netplay, settings, false);
    return true;
 }
 
@@ -2213,6 +4001,28 @@ bool init_netplay_deferred(const char *server, unsigned port,
    return true;
 }
 
+/**
+ * netplay_write_telemetry_csv
+ *
+ * Dump the session's telemetry next to the logs, or next to the
+ * configuration file when no log directory is set.
+ */
+static void netplay_write_telemetry_csv(netplay_t *netplay)
+{
+   char name[64];
+   char path[PATH_MAX_LENGTH];
+   time_t now = time(NULL);
+
+   strftime(name, sizeof(name), "netplay-%Y%m%d-%H%M%S.csv",
+         localtime(&now));
+   netplay_output_path(name, path, sizeof(path));
+
+   if (netplay_telemetry_write_csv(&netplay->telemetry, path))
+      RARCH_LOG("[Netplay] Telemetry written to \"%s\".\n", path);
+   else
+      RARCH_WARN("[Netplay] Unable to write telemetry to \"%s\".\n", path);
+}
+
 void deinit_netplay(void)
 {
    net_driver_state_t *net_st  = &networking_driver_st;
@@ -2220,6 +4030,8 @@ void deinit_netplay(void)
 
    if (netplay)
    {
+      if (netplay->telemetry_csv && netplay->telemetry.frames)
+         netplay_write_telemetry_csv(netplay);
       netplay_free(netplay);
       net_st->data = NULL;
    }
@@ -2282,6 +4094,24 @@ bool netplay_driver_ctl(enum rarch_netplay_ctl_state state, void *data)
          return netplay ? netplay->allow_pausing : false;
       case RARCH_NETPLAY_CTL_ALLOW_TIMESKIP:
          return netplay ? netplay->allow_timeskip : false;
+      case RARCH_NETPLAY_CTL_TIMESYNC_ADJUST:
+         if (     !netplay
+               || !netplay->session_started
+               ||  netplay->spectator
+               || !data)
+            return false;
+         *(int*)data = netplay_timesync_consume_adjust(&netplay->timesync);
+         return *(int*)data != 0;
+      case RARCH_NETPLAY_CTL_GET_TELEMETRY:
+         {
+            netplay_telemetry_report_t *report =
+               (netplay_telemetry_report_t*)data;
+            if (!netplay || !report || !report->s || !report->len)
+               return false;
+            netplay_telemetry_describe(&netplay->telemetry,
+                  report->s, report->len);
+         }
+         return true;
       case RARCH_NETPLAY_CTL_PAUSE:
       case RARCH_NETPLAY_CTL_UNPAUSE:
       case RARCH_NETPLAY_CTL_GAME_WATCH:
@@ -2338,6 +4168,26 @@ bool netplay_driver_ctl(enum rarch_netplay_ctl_state state, void *data)
                   sizeof(status->message));
             status->session_sync_current = net_st->session_sync_current;
             status->session_sync_total   = net_st->session_sync_total;
+            if (netplay)
+            {
+               status->frames_ahead          = netplay->timesync.frames_ahead;
+               status->frames_ahead_smoothed = netplay->timesync.smoothed;
+               status->frame_adjust_usec     = netplay->timesync.frame_adjust_usec;
+               status->frames_held           = (unsigned)netplay->timesync.frames_held;
+               status->frames_skipped        = (unsigned)netplay->timesync.frames_skipped;
+               status->local_delay           = netplay->autodelay.delay;
+               status->local_delay_auto      = netplay->local_delay_auto;
+            }
+            else
+            {
+               status->frames_ahead          = 0.0f;
+               status->frames_ahead_smoothed = 0.0f;
+               status->frame_adjust_usec     = 0;
+               status->frames_held           = 0;
+               status->frames_skipped        = 0;
+               status->local_delay           = 0;
+               status->local_delay_auto      = false;
+            }
          }
          return true;
       case RARCH_NETPLAY_CTL_NONE:
@@ -2787,19 +4637,16 @@ int16_t input_state_net(unsigned port, unsigned device,
    if (!netplay || !netplay->running)
       return 0;
 
-   if (device == RETRO_DEVICE_JOYPAD && idx == 0)
-   {
-      unsigned i;
-      uint16_t mask = netplay_get_port_mask(netplay, port);
-
-      for (i = 0; i < NETPLAY_BUTTON_COUNT; i++)
-      {
-         if (netplay_button_map[i] == id)
-            return (mask & (1U << i)) ? 1 : 0;
-      }
-   }
+   /* Everything the core reads comes from the authoritative frame;
+    * local devices are never consulted, so all peers see the same
+    * values. */
+   if (!netplay->authoritative_valid)
+      return 0;
 
-   return netplay->cbs.state_cb(port, device, idx, id);
+   return netplay_input_query(&netplay->input_layout,
+         port < netplay->input_port_count
+            ? &netplay->input_ports[port] : NULL,
+         netplay->input_keys, device, idx, id);
 }
 
 #ifdef HAVE_GFX_WIDGETS
@@ -2822,10 +4669,25 @@ static void gfx_widget_netplay_chat_frame(void *data, void *userdata)
    (void)userdata;
 }
 
+#define NETPLAY_PING_WIDGET_LINES 3
+
+/* Text shown by the ping widget, refreshed on the main thread and
+ * drawn on the video thread */
+static struct
+{
+   char lines[NETPLAY_PING_WIDGET_LINES][96];
+   unsigned count;
+} gfx_widget_netplay_ping_st;
+
 static void gfx_widget_netplay_ping_iterate(void *user_data,
       unsigned width, unsigned height, bool fullscreen,
       const char *dir_assets, char *font_path, bool is_threaded)
 {
+   net_driver_state_t        *net_st   = &networking_driver_st;
+   netplay_t                 *netplay  = net_st->data;
+   settings_t                *settings = config_get_ptr();
+   const netplay_telemetry_t *t;
+
    (void)user_data;
    (void)width;
    (void)height;
@@ -2833,12 +4695,84 @@ static void gfx_widget_netplay_ping_iterate(void *user_data,
    (void)dir_assets;
    (void)font_path;
    (void)is_threaded;
+
+   gfx_widget_netplay_ping_st.count = 0;
+
+   if (     !netplay
+         || !netplay->session_started
+         || !settings
+         || !settings->bools.netplay_ping_show)
+      return;
+
+   t = &netplay->telemetry;
+
+   snprintf(gfx_widget_netplay_ping_st.lines[0],
+         sizeof(gfx_widget_netplay_ping_st.lines[0]),
+         "Ping %d ms  jitter %.1f ms  ahead %+.1f",
+         net_st->latest_ping, t->last.jitter_ms, t->frames_ahead);
+   snprintf(gfx_widget_netplay_ping_st.lines[1],
+         sizeof(gfx_widget_netplay_ping_st.lines[1]),
+         "Rollback %u/s  max depth %u",
+         (unsigned)t->last.rollbacks, (unsigned)t->last.max_depth);
+   snprintf(gfx_widget_netplay_ping_st.lines[2],
+         sizeof(gfx_widget_netplay_ping_st.lines[2]),
+         "Save %u  load %u  resim %u us/frame",
+         (unsigned)t->last.save_usec, (unsigned)t->last.load_usec,
+         (unsigned)t->last.resim_usec);
+   gfx_widget_netplay_ping_st.count = NETPLAY_PING_WIDGET_LINES;
 }
 
 static void gfx_widget_netplay_ping_frame(void *data, void *userdata)
 {
-   (void)data;
-   (void)userdata;
+   unsigned i;
+   unsigned text_width            = 0;
+   unsigned count                 = gfx_widget_netplay_ping_st.count;
+   video_frame_info_t *video_info = (video_frame_info_t*)data;
+   dispgfx_widget_t *p_dispwidget = (dispgfx_widget_t*)userdata;
+   gfx_widget_font_data_t *font;
+   gfx_display_t *p_disp;
+   unsigned padding;
+   unsigned line_height;
+   unsigned block_width;
+   unsigned block_height;
+   int x;
+   int y;
+
+   if (!count || !video_info || !p_dispwidget)
+      return;
+
+   font        = &p_dispwidget->gfx_widget_fonts.msg_queue;
+   p_disp      = (gfx_display_t*)video_info->disp_userdata;
+   padding     = p_dispwidget->simple_widget_padding;
+   line_height = (unsigned)font->line_height;
+
+   for (i = 0; i < count; i++)
+   {
+      const char *line = gfx_widget_netplay_ping_st.lines[i];
+      unsigned w       = (unsigned)font_driver_get_message_width(
+            font->font, line, strlen(line), 1.0f);
+      if (w > text_width)
+         text_width = w;
+   }
+
+   block_width  = text_width + padding * 2;
+   block_height = line_height * count + padding;
+   x            = (int)video_info->width  - (int)block_width;
+   y            = (int)video_info->height - (int)block_height;
+
+   gfx_display_draw_quad(p_disp, video_info->userdata,
+         video_info->width, video_info->height,
+         x, y, block_width, block_height,
+         video_info->width, video_info->height,
+         p_dispwidget->backdrop_orig, NULL);
+
+   for (i = 0; i < count; i++)
+      gfx_widgets_draw_text(font, gfx_widget_netplay_ping_st.lines[i],
+            x + padding,
+            y + padding / 2 + line_height * i + font->line_centre_offset
+               + line_height / 2,
+            video_info->width, video_info->height,
+            TEXT_COLOR_INFO, TEXT_ALIGN_LEFT, true);
 }
 
 const gfx_widget_t gfx_widget_netplay_chat = {
@@ -2868,6 +4802,9 @@ void video_frame_net(const void *data,
    net_driver_state_t *net_st  = &networking_driver_st;
    netplay_t          *netplay = net_st ? net_st->data : NULL;
 
+   if (netplay && netplay->resimulating)
+      return;
+
    if (netplay && netplay->cbs.frame_cb)
       netplay->cbs.frame_cb(data, width, height, pitch);
    else
@@ -2879,6 +4816,9 @@ void audio_sample_net(int16_t left, int16_t right)
    net_driver_state_t *net_st  = &networking_driver_st;
    netplay_t          *netplay = net_st ? net_st->data : NULL;
 
+   if (netplay && netplay->resimulating)
+      return;
+
    if (netplay && netplay->cbs.sample_cb)
       netplay->cbs.sample_cb(left, right);
    else
@@ -2890,6 +4830,9 @@ size_t audio_sample_batch_net(const int16_t *data, size_t frames)
    net_driver_state_t *net_st  = &networking_driver_st;
    netplay_t          *netplay = net_st ? net_st->data : NULL;
 
+   if (netplay && netplay->resimulating)
+      return frames;
+
    if (netplay && netplay->cbs.sample_batch_cb)
       return netplay->cbs.sample_batch_cb(data, frames);
 
@@ -0,0 +1,650 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2021 - Daniel De Matteis
+ *  Copyright (C) 2024-2025 - Jamie Meyer
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include <libretro.h>
+#include <compat/strl.h>
+
+#include "netplay_input.h"
+
+#define NETPLAY_INPUT_JOYPAD_BITS    16
+#define NETPLAY_INPUT_ANALOG_BITS    8
+#define NETPLAY_INPUT_COORD_BITS     16
+#define NETPLAY_INPUT_MOUSE_BUTTONS  9
+#define NETPLAY_INPUT_POINTER_FLAGS  2
+
+#define NETPLAY_INPUT_POINTER_PRESSED   (1 << 0)
+#define NETPLAY_INPUT_POINTER_OFFSCREEN (1 << 1)
+
+/* Largest record: every section on every port, plus the keyboard */
+#define NETPLAY_INPUT_RECORD_MAX \
+   ((NETPLAY_INPUT_MAX_PORTS * (NETPLAY_INPUT_JOYPAD_BITS \
+      + 4 * NETPLAY_INPUT_ANALOG_BITS \
+      + 2 * NETPLAY_INPUT_COORD_BITS + NETPLAY_INPUT_MOUSE_BUTTONS \
+      + 2 * NETPLAY_INPUT_COORD_BITS + 16 \
+      + 2 * NETPLAY_INPUT_COORD_BITS + NETPLAY_INPUT_POINTER_FLAGS) \
+      + NETPLAY_INPUT_KEY_COUNT + 7) / 8)
+
+/* Lightgun ids carried in the record, by bit */
+static const unsigned netplay_input_lightgun_ids[] = {
+   RETRO_DEVICE_ID_LIGHTGUN_TRIGGER,
+   RETRO_DEVICE_ID_LIGHTGUN_RELOAD,
+   RETRO_DEVICE_ID_LIGHTGUN_AUX_A,
+   RETRO_DEVICE_ID_LIGHTGUN_AUX_B,
+   RETRO_DEVICE_ID_LIGHTGUN_AUX_C,
+   RETRO_DEVICE_ID_LIGHTGUN_START,
+   RETRO_DEVICE_ID_LIGHTGUN_SELECT,
+   RETRO_DEVICE_ID_LIGHTGUN_DPAD_UP,
+   RETRO_DEVICE_ID_LIGHTGUN_DPAD_DOWN,
+   RETRO_DEVICE_ID_LIGHTGUN_DPAD_LEFT,
+   RETRO_DEVICE_ID_LIGHTGUN_DPAD_RIGHT,
+   RETRO_DEVICE_ID_LIGHTGUN_IS_OFFSCREEN
+};
+
+#define NETPLAY_INPUT_LIGHTGUN_BUTTONS \
+   (sizeof(netplay_input_lightgun_ids) / sizeof(netplay_input_lightgun_ids[0]))
+
+/* Keys that computer cores commonly bind to game controls. Anything
+ * outside this set reads as released during netplay. */
+static const unsigned netplay_input_keys[NETPLAY_INPUT_KEY_COUNT] = {
+   RETROK_a, RETROK_b, RETROK_c, RETROK_d, RETROK_e, RETROK_f,
+   RETROK_g, RETROK_h, RETROK_i, RETROK_j, RETROK_k, RETROK_l,
+   RETROK_m, RETROK_n, RETROK_o, RETROK_p, RETROK_q, RETROK_r,
+   RETROK_s, RETROK_t, RETROK_u, RETROK_v, RETROK_w, RETROK_x,
+   RETROK_y, RETROK_z,
+   RETROK_0, RETROK_1, RETROK_2, RETROK_3, RETROK_4,
+   RETROK_5, RETROK_6, RETROK_7, RETROK_8, RETROK_9,
+   RETROK_UP, RETROK_DOWN, RETROK_LEFT, RETROK_RIGHT,
+   RETROK_SPACE, RETROK_RETURN, RETROK_ESCAPE, RETROK_BACKSPACE,
+   RETROK_TAB, RETROK_LSHIFT, RETROK_RSHIFT, RETROK_LCTRL,
+   RETROK_LALT,
+   RETROK_F1, RETROK_F2, RETROK_F3, RETROK_F4,
+   RETROK_F5, RETROK_F6, RETROK_F7, RETROK_F8,
+   RETROK_COMMA, RETROK_PERIOD, RETROK_SLASH, RETROK_MINUS,
+   RETROK_EQUALS, RETROK_SEMICOLON, RETROK_QUOTE
+};
+
+static void netplay_input_put(uint8_t *buf, unsigned *pos,
+      uint32_t value, unsigned bits)
+{
+   unsigned i;
+   for (i = 0; i < bits; i++, (*pos)++)
+   {
+      if (value & (1UL << i))
+         buf[*pos >> 3] |= (uint8_t)(1 << (*pos & 7));
+   }
+}
+
+static uint32_t netplay_input_get(const uint8_t *buf, unsigned *pos,
+      unsigned bits)
+{
+   unsigned i;
+   uint32_t value = 0;
+   for (i = 0; i < bits; i++, (*pos)++)
+   {
+      if (buf[*pos >> 3] & (1 << (*pos & 7)))
+         value |= (1UL << i);
+   }
+   return value;
+}
+
+/* Sticks travel as 8 bits per axis, rounded to the nearest step and
+ * offset so that a centred stick packs to zero, like released buttons.
+ * Centre and both extremes survive the round trip exactly. */
+static uint32_t netplay_input_quantize_axis(int16_t value)
+{
+   int32_t q = ((int32_t)value + 32768 + 128) >> 8;
+   if (q > 255)
+      q = 255;
+   return (uint32_t)q ^ 0x80;
+}
+
+static int16_t netplay_input_expand_axis(uint32_t q)
+{
+   q ^= 0x80;
+   if (q >= 255)
+      return 32767;
+   return (int16_t)(((int32_t)q - 128) * 256);
+}
+
+static int netplay_input_key_index(unsigned keycode)
+{
+   unsigned i;
+   for (i = 0; i < NETPLAY_INPUT_KEY_COUNT; i++)
+   {
+      if (netplay_input_keys[i] == keycode)
+         return (int)i;
+   }
+   return -1;
+}
+
+unsigned netplay_input_sections_for_device(unsigned device)
+{
+   switch (device & RETRO_DEVICE_MASK)
+   {
+      case RETRO_DEVICE_ANALOG:
+         return NETPLAY_INPUT_ANALOG;
+      case RETRO_DEVICE_MOUSE:
+         return NETPLAY_INPUT_MOUSE;
+      case RETRO_DEVICE_LIGHTGUN:
+         return NETPLAY_INPUT_LIGHTGUN;
+      case RETRO_DEVICE_POINTER:
+         return NETPLAY_INPUT_POINTER;
+      case RETRO_DEVICE_KEYBOARD:
+         return NETPLAY_INPUT_KEYBOARD;
+      default:
+         break;
+   }
+   return 0;
+}
+
+void netplay_input_layout_init(netplay_input_layout_t *layout,
+      unsigned sections, unsigned ports)
+{
+   unsigned bits = NETPLAY_INPUT_JOYPAD_BITS;
+
+   if (!layout)
+      return;
+
+   if (!ports)
+      ports = 1;
+   else if (ports > NETPLAY_INPUT_MAX_PORTS)
+      ports = NETPLAY_INPUT_MAX_PORTS;
+
+   if (sections & NETPLAY_INPUT_ANALOG)
+      bits += 4 * NETPLAY_INPUT_ANALOG_BITS;
+   if (sections & NETPLAY_INPUT_MOUSE)
+      bits += 2 * NETPLAY_INPUT_COORD_BITS + NETPLAY_INPUT_MOUSE_BUTTONS;
+   if (sections & NETPLAY_INPUT_LIGHTGUN)
+      bits += 2 * NETPLAY_INPUT_COORD_BITS
+         + (unsigned)NETPLAY_INPUT_LIGHTGUN_BUTTONS;
+   if (sections & NETPLAY_INPUT_POINTER)
+      bits += 2 * NETPLAY_INPUT_COORD_BITS + NETPLAY_INPUT_POINTER_FLAGS;
+
+   layout->sections    = sections;
+   layout->ports       = ports;
+   layout->port_bits   = bits;
+   layout->record_bits = bits * ports;
+   if (sections & NETPLAY_INPUT_KEYBOARD)
+      layout->record_bits += NETPLAY_INPUT_KEY_COUNT;
+   layout->record_size = (layout->record_bits + 7) / 8;
+}
+
+size_t netplay_input_layout_describe(const netplay_input_layout_t *layout,
+      char *s, size_t len)
+{
+   size_t _len;
+
+   if (!layout || !s || !len)
+      return 0;
+
+   _len = strlcpy(s, "joypad", len);
+   if (layout->sections & NETPLAY_INPUT_ANALOG)
+      _len += strlcpy(s + _len, "+analog", len - _len);
+   if (layout->sections & NETPLAY_INPUT_MOUSE)
+      _len += strlcpy(s + _len, "+mouse", len - _len);
+   if (layout->sections & NETPLAY_INPUT_LIGHTGUN)
+      _len += strlcpy(s + _len, "+lightgun", len - _len);
+   if (layout->sections & NETPLAY_INPUT_POINTER)
+      _len += strlcpy(s + _len, "+pointer", len - _len);
+   if (layout->sections & NETPLAY_INPUT_KEYBOARD)
+      _len += strlcpy(s + _len, "+keyboard", len - _len);
+   return _len;
+}
+
+size_t netplay_input_layout_message(const netplay_input_layout_t *layout,
+      bool reply, uint8_t *buf, size_t len)
+{
+   if (!layout || !buf || len < NETPLAY_INPUT_LAYOUT_MSG_SIZE)
+      return 0;
+
+   buf[0] = NETPLAY_INPUT_MSG_LAYOUT;
+   buf[1] = reply ? 1 : 0;
+   buf[2] = (uint8_t)layout->sections;
+   buf[3] = (uint8_t)layout->ports;
+   buf[4] = (uint8_t)(layout->record_size >> 8);
+   buf[5] = (uint8_t)layout->record_size;
+   return NETPLAY_INPUT_LAYOUT_MSG_SIZE;
+}
+
+bool netplay_input_layout_parse(const uint8_t *buf, size_t len,
+      netplay_input_layout_t *layout, bool *reply)
+{
+   if (     !buf || !layout
+         || len < NETPLAY_INPUT_LAYOUT_MSG_SIZE
+         || buf[0] != NETPLAY_INPUT_MSG_LAYOUT
+         || !buf[3]
+         || buf[3] > NETPLAY_INPUT_MAX_PORTS)
+      return false;
+
+   netplay_input_layout_init(layout, buf[2], buf[3]);
+   /* A peer that packs the same sections differently is a mismatch
+    * too, so keep its record size rather than the one derived here */
+   layout->record_size = ((unsigned)buf[4] << 8) | buf[5];
+   if (reply)
+      *reply = (buf[1] & 1) != 0;
+   return true;
+}
+
+bool netplay_input_layout_equal(const netplay_input_layout_t *a,
+      const netplay_input_layout_t *b)
+{
+   return   a->sections    == b->sections
+         && a->ports       == b->ports
+         && a->record_size == b->record_size;
+}
+
+static void netplay_input_read_port(const netplay_input_layout_t *layout,
+      netplay_input_state_cb_t state_cb, unsigned port,
+      netplay_input_port_t *out)
+{
+   unsigned i;
+
+   memset(out, 0, sizeof(*out));
+
+   for (i = 0; i < NETPLAY_INPUT_JOYPAD_BITS; i++)
+   {
+      if (state_cb(port, RETRO_DEVICE_JOYPAD, 0, i))
+         out->buttons |= (uint16_t)(1U << i);
+   }
+
+   if (layout->sections & NETPLAY_INPUT_ANALOG)
+   {
+      for (i = 0; i < 4; i++)
+         out->analog[i] = state_cb(port, RETRO_DEVICE_ANALOG,
+               i >> 1, i & 1);
+   }
+
+   if (layout->sections & NETPLAY_INPUT_MOUSE)
+   {
+      out->mouse_x = state_cb(port, RETRO_DEVICE_MOUSE, 0,
+            RETRO_DEVICE_ID_MOUSE_X);
+      out->mouse_y = state_cb(port, RETRO_DEVICE_MOUSE, 0,
+            RETRO_DEVICE_ID_MOUSE_Y);
+      for (i = 0; i < NETPLAY_INPUT_MOUSE_BUTTONS; i++)
+      {
+         if (state_cb(port, RETRO_DEVICE_MOUSE, 0,
+                  RETRO_DEVICE_ID_MOUSE_LEFT + i))
+            out->mouse_buttons |= (uint16_t)(1U << i);
+      }
+   }
+
+   if (layout->sections & NETPLAY_INPUT_LIGHTGUN)
+   {
+      out->lightgun_x = state_cb(port, RETRO_DEVICE_LIGHTGUN, 0,
+            RETRO_DEVICE_ID_LIGHTGUN_SCREEN_X);
+      out->lightgun_y = state_cb(port, RETRO_DEVICE_LIGHTGUN, 0,
+            RETRO_DEVICE_ID_LIGHTGUN_SCREEN_Y);
+      for (i = 0; i < NETPLAY_INPUT_LIGHTGUN_BUTTONS; i++)
+      {
+         if (state_cb(port, RETRO_DEVICE_LIGHTGUN, 0,
+                  netplay_input_lightgun_ids[i]))
+            out->lightgun_buttons |= (uint16_t)(1U << i);
+      }
+   }
+
+   if (layout->sections & NETPLAY_INPUT_POINTER)
+   {
+      out->pointer_x = state_cb(port, RETRO_DEVICE_POINTER, 0,
+            RETRO_DEVICE_ID_POINTER_X);
+      out->pointer_y = state_cb(port, RETRO_DEVICE_POINTER, 0,
+            RETRO_DEVICE_ID_POINTER_Y);
+      if (state_cb(port, RETRO_DEVICE_POINTER, 0,
+               RETRO_DEVICE_ID_POINTER_PRESSED))
+         out->pointer_flags |= NETPLAY_INPUT_POINTER_PRESSED;
+      if (state_cb(port, RETRO_DEVICE_POINTER, 0,
+               RETRO_DEVICE_ID_POINTER_IS_OFFSCREEN))
+         out->pointer_flags |= NETPLAY_INPUT_POINTER_OFFSCREEN;
+   }
+}
+
+static void netplay_input_pack_port(const netplay_input_layout_t *layout,
+      const netplay_input_port_t *in, uint8_t *buf, unsigned *pos)
+{
+   unsigned i;
+
+   netplay_input_put(buf, pos, in->buttons, NETPLAY_INPUT_JOYPAD_BITS);
+
+   if (layout->sections & NETPLAY_INPUT_ANALOG)
+   {
+      for (i = 0; i < 4; i++)
+         netplay_input_put(buf, pos,
+               netplay_input_quantize_axis(in->analog[i]),
+               NETPLAY_INPUT_ANALOG_BITS);
+   }
+
+   if (layout->sections & NETPLAY_INPUT_MOUSE)
+   {
+      netplay_input_put(buf, pos, (uint16_t)in->mouse_x,
+            NETPLAY_INPUT_COORD_BITS);
+      netplay_input_put(buf, pos, (uint16_t)in->mouse_y,
+            NETPLAY_INPUT_COORD_BITS);
+      netplay_input_put(buf, pos, in->mouse_buttons,
+            NETPLAY_INPUT_MOUSE_BUTTONS);
+   }
+
+   if (layout->sections & NETPLAY_INPUT_LIGHTGUN)
+   {
+      netplay_input_put(buf, pos, (uint16_t)in->lightgun_x,
+            NETPLAY_INPUT_COORD_BITS);
+      netplay_input_put(buf, pos, (uint16_t)in->lightgun_y,
+            NETPLAY_INPUT_COORD_BITS);
+      netplay_input_put(buf, pos, in->lightgun_buttons,
+            (unsigned)NETPLAY_INPUT_LIGHTGUN_BUTTONS);
+   }
+
+   if (layout->sections & NETPLAY_INPUT_POINTER)
+   {
+      netplay_input_put(buf, pos, (uint16_t)in->pointer_x,
+            NETPLAY_INPUT_COORD_BITS);
+      netplay_input_put(buf, pos, (uint16_t)in->pointer_y,
+            NETPLAY_INPUT_COORD_BITS);
+      netplay_input_put(buf, pos, in->pointer_flags,
+            NETPLAY_INPUT_POINTER_FLAGS);
+   }
+}
+
+static void netplay_input_unpack_port(const netplay_input_layout_t *layout,
+      const uint8_t *buf, unsigned *pos, netplay_input_port_t *out)
+{
+   unsigned i;
+
+   memset(out, 0, sizeof(*out));
+
+   out->buttons = (uint16_t)netplay_input_get(buf, pos,
+         NETPLAY_INPUT_JOYPAD_BITS);
+
+   if (layout->sections & NETPLAY_INPUT_ANALOG)
+   {
+      for (i = 0; i < 4; i++)
+         out->analog[i] = netplay_input_expand_axis(
+               netplay_input_get(buf, pos, NETPLAY_INPUT_ANALOG_BITS));
+   }
+
+   if (layout->sections & NETPLAY_INPUT_MOUSE)
+   {
+      out->mouse_x       = (int16_t)netplay_input_get(buf, pos,
+            NETPLAY_INPUT_COORD_BITS);
+      out->mouse_y       = (int16_t)netplay_input_get(buf, pos,
+            NETPLAY_INPUT_COORD_BITS);
+      out->mouse_buttons = (uint16_t)netplay_input_get(buf, pos,
+            NETPLAY_INPUT_MOUSE_BUTTONS);
+   }
+
+   if (layout->sections & NETPLAY_INPUT_LIGHTGUN)
+   {
+      out->lightgun_x       = (int16_t)netplay_input_get(buf, pos,
+            NETPLAY_INPUT_COORD_BITS);
+      out->lightgun_y       = (int16_t)netplay_input_get(buf, pos,
+            NETPLAY_INPUT_COORD_BITS);
+      out->lightgun_buttons = (uint16_t)netplay_input_get(buf, pos,
+            (unsigned)NETPLAY_INPUT_LIGHTGUN_BUTTONS);
+   }
+
+   if (layout->sections & NETPLAY_INPUT_POINTER)
+   {
+      out->pointer_x     = (int16_t)netplay_input_get(buf, pos,
+            NETPLAY_INPUT_COORD_BITS);
+      out->pointer_y     = (int16_t)netplay_input_get(buf, pos,
+            NETPLAY_INPUT_COORD_BITS);
+      out->pointer_flags = (uint8_t)netplay_input_get(buf, pos,
+            NETPLAY_INPUT_POINTER_FLAGS);
+   }
+}
+
+bool netplay_input_collect(const netplay_input_layout_t *layout,
+      netplay_input_state_cb_t state_cb, unsigned first_port,
+      uint8_t *record)
+{
+   unsigned i;
+   unsigned pos = 0;
+   uint8_t  buf[NETPLAY_INPUT_RECORD_MAX];
+
+   if (!layout || !state_cb || !record || !layout->record_size
+         || layout->record_size > sizeof(buf))
+      return false;
+
+   memset(buf, 0, layout->record_size);
+
+   for (i = 0; i < layout->ports; i++)
+   {
+      netplay_input_port_t port;
+      netplay_input_read_port(layout, state_cb, first_port + i, &port);
+      netplay_input_pack_port(layout, &port, buf, &pos);
+   }
+
+   if (layout->sections & NETPLAY_INPUT_KEYBOARD)
+   {
+      for (i = 0; i < NETPLAY_INPUT_KEY_COUNT; i++)
+         netplay_input_put(buf, &pos, state_cb(first_port,
+                  RETRO_DEVICE_KEYBOARD, 0, netplay_input_keys[i]) ? 1 : 0,
+               1);
+   }
+
+   if (!memcmp(buf, record, layout->record_size))
+      return false;
+
+   memcpy(record, buf, layout->record_size);
+   return true;
+}
+
+void netplay_input_decode(const netplay_input_layout_t *layout,
+      const uint8_t *inputs, size_t len, unsigned players,
+      netplay_input_port_t *ports, uint64_t *keys)
+{
+   unsigned p;
+
+   if (!layout || !ports || !keys)
+      return;
+
+   *keys = 0;
+
+   for (p = 0; p < players; p++)
+   {
+      unsigned i;
+      unsigned pos           = 0;
+      netplay_input_port_t *out = ports + (size_t)p * layout->ports;
+      size_t offset          = (size_t)p * layout->record_size;
+
+      /* A short frame leaves the missing players idle */
+      if (!inputs || offset + layout->record_size > len)
+      {
+         memset(out, 0, layout->ports * sizeof(*out));
+         continue;
+      }
+
+      for (i = 0; i < layout->ports; i++)
+         netplay_input_unpack_port(layout, inputs + offset, &pos, out + i);
+
+      if (layout->sections & NETPLAY_INPUT_KEYBOARD)
+      {
+         for (i = 0; i < NETPLAY_INPUT_KEY_COUNT; i++)
+         {
+            if (netplay_input_get(inputs + offset, &pos, 1))
+               *keys |= ((uint64_t)1) << i;
+         }
+      }
+   }
+}
+
+int16_t netplay_input_query(const netplay_input_layout_t *layout,
+      const netplay_input_port_t *port, uint64_t keys,
+      unsigned device, unsigned idx, unsigned id)
+{
+   unsigned i;
+
+   if (!layout)
+      return 0;
+
+   /* The keyboard is shared: any player may press a key */
+   if ((device & RETRO_DEVICE_MASK) == RETRO_DEVICE_KEYBOARD)
+   {
+      int key;
+      if (!(layout->sections & NETPLAY_INPUT_KEYBOARD))
+         return 0;
+      key = netplay_input_key_index(id);
+      return (key >= 0 && (keys & (((uint64_t)1) << key))) ? 1 : 0;
+   }
+
+   if (!port)
+      return 0;
+
+   switch (device & RETRO_DEVICE_MASK)
+   {
+      case RETRO_DEVICE_JOYPAD:
+         if (idx)
+            return 0;
+         if (id == RETRO_DEVICE_ID_JOYPAD_MASK)
+            return (int16_t)port->buttons;
+         if (id < NETPLAY_INPUT_JOYPAD_BITS)
+            return (port->buttons & (1U << id)) ? 1 : 0;
+         return 0;
+      case RETRO_DEVICE_ANALOG:
+         if (idx == RETRO_DEVICE_INDEX_ANALOG_BUTTON)
+         {
+            if (id < NETPLAY_INPUT_JOYPAD_BITS)
+               return (port->buttons & (1U << id)) ? 0x7fff : 0;
+            return 0;
+         }
+         if (     !(layout->sections & NETPLAY_INPUT_ANALOG)
+               || idx > RETRO_DEVICE_INDEX_ANALOG_RIGHT
+               || id  > RETRO_DEVICE_ID_ANALOG_Y)
+            return 0;
+         return port->analog[idx * 2 + id];
+      case RETRO_DEVICE_MOUSE:
+         if (!(layout->sections & NETPLAY_INPUT_MOUSE))
+            return 0;
+         if (id == RETRO_DEVICE_ID_MOUSE_X)
+            return port->mouse_x;
+         if (id == RETRO_DEVICE_ID_MOUSE_Y)
+            return port->mouse_y;
+         if (     id >= RETRO_DEVICE_ID_MOUSE_LEFT
+               && id <  RETRO_DEVICE_ID_MOUSE_LEFT
+                      + NETPLAY_INPUT_MOUSE_BUTTONS)
+            return (port->mouse_buttons
+                  & (1U << (id - RETRO_DEVICE_ID_MOUSE_LEFT))) ? 1 : 0;
+         return 0;
+      case RETRO_DEVICE_LIGHTGUN:
+         if (!(layout->sections & NETPLAY_INPUT_LIGHTGUN))
+            return 0;
+         if (id == RETRO_DEVICE_ID_LIGHTGUN_SCREEN_X)
+            return port->lightgun_x;
+         if (id == RETRO_DEVICE_ID_LIGHTGUN_SCREEN_Y)
+            return port->lightgun_y;
+         for (i = 0; i < NETPLAY_INPUT_LIGHTGUN_BUTTONS; i++)
+         {
+            if (netplay_input_lightgun_ids[i] == id)
+               return (port->lightgun_buttons & (1U << i)) ? 1 : 0;
+         }
+         return 0;
+      case RETRO_DEVICE_POINTER:
+         if (!(layout->sections & NETPLAY_INPUT_POINTER) || idx)
+            return 0;
+         switch (id)
+         {
+            case RETRO_DEVICE_ID_POINTER_X:
+               return port->pointer_x;
+            case RETRO_DEVICE_ID_POINTER_Y:
+               return port->pointer_y;
+            case RETRO_DEVICE_ID_POINTER_PRESSED:
+            case RETRO_DEVICE_ID_POINTER_COUNT:
+               return (port->pointer_flags
+                     & NETPLAY_INPUT_POINTER_PRESSED) ? 1 : 0;
+            case RETRO_DEVICE_ID_POINTER_IS_OFFSCREEN:
+               return (port->pointer_flags
+                     & NETPLAY_INPUT_POINTER_OFFSCREEN) ? 1 : 0;
+            default:
+               break;
+         }
+         return 0;
+      default:
+         break;
+   }
+
+   return 0;
+}
+
+static void netplay_input_enumerate_one(const netplay_input_layout_t *layout,
+      const netplay_input_port_t *port, unsigned device, unsigned idx,
+      unsigned id, netplay_input_value_cb_t cb, void *data)
+{
+   int16_t value = netplay_input_query(layout, port, 0, device, idx, id);
+   if (value)
+      cb(data, device, idx, id, value);
+}
+
+void netplay_input_enumerate(const netplay_input_layout_t *layout,
+      const netplay_input_port_t *port, uint64_t keys,
+      netplay_input_value_cb_t cb, void *data)
+{
+   unsigned i, j;
+
+   if (!layout || !cb)
+      return;
+
+   if (!port)
+   {
+      if (!(layout->sections & NETPLAY_INPUT_KEYBOARD))
+         return;
+      for (i = 0; i < NETPLAY_INPUT_KEY_COUNT; i++)
+         if (keys & (((uint64_t)1) << i))
+            cb(data, RETRO_DEVICE_KEYBOARD, 0, netplay_input_keys[i], 1);
+      return;
+   }
+
+   netplay_input_enumerate_one(layout, port, RETRO_DEVICE_JOYPAD, 0,
+         RETRO_DEVICE_ID_JOYPAD_MASK, cb, data);
+   for (i = 0; i < NETPLAY_INPUT_JOYPAD_BITS; i++)
+      netplay_input_enumerate_one(layout, port, RETRO_DEVICE_JOYPAD, 0,
+            i, cb, data);
+   for (i = 0; i < NETPLAY_INPUT_JOYPAD_BITS; i++)
+      netplay_input_enumerate_one(layout, port, RETRO_DEVICE_ANALOG,
+            RETRO_DEVICE_INDEX_ANALOG_BUTTON, i, cb, data);
+   for (i = RETRO_DEVICE_INDEX_ANALOG_LEFT;
+         i <= RETRO_DEVICE_INDEX_ANALOG_RIGHT; i++)
+      for (j = RETRO_DEVICE_ID_ANALOG_X; j <= RETRO_DEVICE_ID_ANALOG_Y; j++)
+         netplay_input_enumerate_one(layout, port, RETRO_DEVICE_ANALOG,
+               i, j, cb, data);
+
+   netplay_input_enumerate_one(layout, port, RETRO_DEVICE_MOUSE, 0,
+         RETRO_DEVICE_ID_MOUSE_X, cb, data);
+   netplay_input_enumerate_one(layout, port, RETRO_DEVICE_MOUSE, 0,
+         RETRO_DEVICE_ID_MOUSE_Y, cb, data);
+   for (i = 0; i < NETPLAY_INPUT_MOUSE_BUTTONS; i++)
+      netplay_input_enumerate_one(layout, port, RETRO_DEVICE_MOUSE, 0,
+            RETRO_DEVICE_ID_MOUSE_LEFT + i, cb, data);
+
+   netplay_input_enumerate_one(layout, port, RETRO_DEVICE_LIGHTGUN, 0,
+         RETRO_DEVICE_ID_LIGHTGUN_SCREEN_X, cb, data);
+   netplay_input_enumerate_one(layout, port, RETRO_DEVICE_LIGHTGUN, 0,
+         RETRO_DEVICE_ID_LIGHTGUN_SCREEN_Y, cb, data);
+   for (i = 0; i < NETPLAY_INPUT_LIGHTGUN_BUTTONS; i++)
+      netplay_input_enumerate_one(layout, port, RETRO_DEVICE_LIGHTGUN, 0,
+            netplay_input_lightgun_ids[i], cb, data);
+
+   netplay_input_enumerate_one(layout, port, RETRO_DEVICE_POINTER, 0,
+         RETRO_DEVICE_ID_POINTER_X, cb, data);
+   netplay_input_enumerate_one(layout, port, RETRO_DEVICE_POINTER, 0,
+         RETRO_DEVICE_ID_POINTER_Y, cb, data);
+   netplay_input_enumerate_one(layout, port, RETRO_DEVICE_POINTER, 0,
+         RETRO_DEVICE_ID_POINTER_PRESSED, cb, data);
+   netplay_input_enumerate_one(layout, port, RETRO_DEVICE_POINTER, 0,
+         RETRO_DEVICE_ID_POINTER_COUNT, cb, data);
+   netplay_input_enumerate_one(layout, port, RETRO_DEVICE_POINTER, 0,
+         RETRO_DEVICE_ID_POINTER_IS_OFFSCREEN, cb, data);
+}
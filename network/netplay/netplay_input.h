@@ -0,0 +1,188 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2021 - Daniel De Matteis
+ *  Copyright (C) 2024-2025 - Jamie Meyer
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RARCH_NETPLAY_INPUT_H
+#define __RARCH_NETPLAY_INPUT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <boolean.h>
+#include <retro_common_api.h>
+
+RETRO_BEGIN_DECLS
+
+/* Core ports a single player may drive */
+#define NETPLAY_INPUT_MAX_PORTS      4
+/* Keys carried in the keyboard subset, see netplay_input_keys */
+#define NETPLAY_INPUT_KEY_COUNT      64
+/* Out-of-band message announcing a peer's layout, see
+ * netplay_input_layout_message */
+#define NETPLAY_INPUT_MSG_LAYOUT      24
+#define NETPLAY_INPUT_LAYOUT_MSG_SIZE 6
+
+/* Optional sections of a port record; the joypad bits are always there */
+enum netplay_input_section
+{
+   /* Both sticks, 8 bits per axis */
+   NETPLAY_INPUT_ANALOG   = (1 << 0),
+   /* Relative motion and buttons */
+   NETPLAY_INPUT_MOUSE    = (1 << 1),
+   /* Screen position and buttons */
+   NETPLAY_INPUT_LIGHTGUN = (1 << 2),
+   /* First touch point */
+   NETPLAY_INPUT_POINTER  = (1 << 3),
+   /* Keyboard subset, once per player rather than per port */
+   NETPLAY_INPUT_KEYBOARD = (1 << 4)
+};
+
+/* Describes the record a player contributes to each GekkoNet frame.
+ * Every peer must derive the same layout, since GekkoNet only knows
+ * the record size. */
+typedef struct netplay_input_layout
+{
+   unsigned sections;
+   /* Local ports packed into one record */
+   unsigned ports;
+   unsigned port_bits;
+   unsigned record_bits;
+   /* Bytes per player, handed to GekkoNet as input_size */
+   unsigned record_size;
+} netplay_input_layout_t;
+
+/* One port as seen by the core, after quantization */
+typedef struct netplay_input_port
+{
+   int16_t  analog[4];
+   int16_t  mouse_x;
+   int16_t  mouse_y;
+   int16_t  lightgun_x;
+   int16_t  lightgun_y;
+   int16_t  pointer_x;
+   int16_t  pointer_y;
+   uint16_t buttons;
+   uint16_t mouse_buttons;
+   uint16_t lightgun_buttons;
+   uint8_t  pointer_flags;
+} netplay_input_port_t;
+
+typedef int16_t (*netplay_input_state_cb_t)(unsigned port,
+      unsigned device, unsigned idx, unsigned id);
+
+typedef void (*netplay_input_value_cb_t)(void *data,
+      unsigned device, unsigned idx, unsigned id, int16_t value);
+
+/**
+ * netplay_input_sections_for_device
+ * @device               : device type bound to a core port
+ *
+ * Returns the record sections needed to carry @device.
+ */
+unsigned netplay_input_sections_for_device(unsigned device);
+
+/**
+ * netplay_input_layout_init
+ * @sections             : mask of enum netplay_input_section
+ * @ports                : local ports per player, at least 1
+ *
+ * Compute bit and byte sizes of the record for @sections.
+ */
+void netplay_input_layout_init(netplay_input_layout_t *layout,
+      unsigned sections, unsigned ports);
+
+/**
+ * netplay_input_layout_describe
+ *
+ * Writes a short human readable summary of the layout to @s.
+ */
+size_t netplay_input_layout_describe(const netplay_input_layout_t *layout,
+      char *s, size_t len);
+
+/**
+ * netplay_input_layout_message
+ * @reply                : the message answers one from the peer
+ *
+ * Writes the out-of-band message peers compare their layouts with.
+ * Returns its length, or 0 if @len is too small.
+ */
+size_t netplay_input_layout_message(const netplay_input_layout_t *layout,
+      bool reply, uint8_t *buf, size_t len);
+
+/**
+ * netplay_input_layout_parse
+ *
+ * Reads a peer's layout from a message written by
+ * netplay_input_layout_message(). Returns false if it is malformed.
+ */
+bool netplay_input_layout_parse(const uint8_t *buf, size_t len,
+      netplay_input_layout_t *layout, bool *reply);
+
+bool netplay_input_layout_equal(const netplay_input_layout_t *a,
+      const netplay_input_layout_t *b);
+
+/**
+ * netplay_input_collect
+ * @state_cb             : input_state callback of the local frontend
+ * @first_port           : local port of the record's first entry
+ * @record               : layout->record_size bytes
+ *
+ * Poll every field of the layout from local input and pack it.
+ * Returns true if the record differs from what it held before.
+ */
+bool netplay_input_collect(const netplay_input_layout_t *layout,
+      netplay_input_state_cb_t state_cb, unsigned first_port,
+      uint8_t *record);
+
+/**
+ * netplay_input_decode
+ * @inputs               : @players records back to back, as delivered
+ *                         by an AdvanceEvent
+ * @ports                : @players * layout->ports entries
+ * @keys                 : union of every player's keyboard subset
+ *
+ * Unpack a whole frame so input_state lookups are plain reads.
+ */
+void netplay_input_decode(const netplay_input_layout_t *layout,
+      const uint8_t *inputs, size_t len, unsigned players,
+      netplay_input_port_t *ports, uint64_t *keys);
+
+/**
+ * netplay_input_query
+ * @port                 : decoded port, or NULL if none
+ *
+ * Answer an input_state query from decoded input. Devices and ids the
+ * layout does not carry read as 0 on every peer.
+ */
+int16_t netplay_input_query(const netplay_input_layout_t *layout,
+      const netplay_input_port_t *port, uint64_t keys,
+      unsigned device, unsigned idx, unsigned id);
+
+/**
+ * netplay_input_enumerate
+ * @port                 : decoded port, or NULL for the keyboard
+ *
+ * Call @cb for every query netplay_input_query() answers with a
+ * non-zero value, either on @port or, without a port, for the keys
+ * held in @keys.
+ */
+void netplay_input_enumerate(const netplay_input_layout_t *layout,
+      const netplay_input_port_t *port, uint64_t keys,
+      netplay_input_value_cb_t cb, void *data);
+
+RETRO_END_DECLS
+
+#endif
@@ -0,0 +1,695 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2021 - Daniel De Matteis
+ *  Copyright (C) 2024-2025 - Jamie Meyer
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <encodings/crc32.h>
+#include <compat/strl.h>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "netplay_join.h"
+
+#define NETPLAY_JOIN_VERSION         1
+#define NETPLAY_JOIN_CODEC_RAW       0
+#define NETPLAY_JOIN_CODEC_ZSTD      1
+
+#define NETPLAY_JOIN_REQUEST_SIZE    14
+#define NETPLAY_JOIN_INPUT_HEADER    18
+#define NETPLAY_JOIN_ACK_SIZE        (16 + NETPLAY_JOIN_ACK_WINDOW / 8)
+#define NETPLAY_JOIN_FLAG_FINISHED   (1 << 0)
+
+/* State bytes compressed per poll; about a millisecond at level 1 */
+#define NETPLAY_JOIN_SLICE           (256 * 1024)
+#define NETPLAY_JOIN_LEVEL           1
+/* Largest state a joiner accepts */
+#define NETPLAY_JOIN_MAX_STATE       (256u * 1024 * 1024)
+#define NETPLAY_JOIN_RESEND_USEC     200000
+#define NETPLAY_JOIN_ACK_USEC        50000
+#define NETPLAY_JOIN_IDLE_ACK_USEC   250000
+/* A joiner silent this long has gone away */
+#define NETPLAY_JOIN_TIMEOUT_USEC    15000000
+/* Input messages per poll */
+#define NETPLAY_JOIN_INPUT_BURST     4
+
+static void netplay_join_put16(uint8_t *p, uint16_t v)
+{
+   p[0] = (uint8_t)(v);
+   p[1] = (uint8_t)(v >> 8);
+}
+
+static void netplay_join_put32(uint8_t *p, uint32_t v)
+{
+   p[0] = (uint8_t)(v);
+   p[1] = (uint8_t)(v >> 8);
+   p[2] = (uint8_t)(v >> 16);
+   p[3] = (uint8_t)(v >> 24);
+}
+
+static uint16_t netplay_join_get16(const uint8_t *p)
+{
+   return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t netplay_join_get32(const uint8_t *p)
+{
+   return  (uint32_t)p[0]
+        | ((uint32_t)p[1] << 8)
+        | ((uint32_t)p[2] << 16)
+        | ((uint32_t)p[3] << 24);
+}
+
+static void netplay_join_header(uint8_t *buf, uint8_t type, uint32_t id)
+{
+   buf[0] = type;
+   buf[1] = NETPLAY_JOIN_VERSION;
+   netplay_join_put32(buf + 2, id);
+}
+
+static bool netplay_join_check(const uint8_t *msg, size_t len,
+      uint8_t type, size_t min_len)
+{
+   return msg
+      && len >= min_len
+      && msg[0] == type
+      && msg[1] == NETPLAY_JOIN_VERSION;
+}
+
+/* Grow @buf to hold @count items of @size bytes, zeroing the new ones */
+static bool netplay_join_grow(void **buf, unsigned *capacity,
+      unsigned count, size_t size)
+{
+   void *grown;
+   unsigned new_capacity;
+
+   if (count <= *capacity)
+      return true;
+
+   new_capacity = *capacity ? *capacity : 64;
+   while (new_capacity < count)
+      new_capacity *= 2;
+
+   if (!(grown = realloc(*buf, (size_t)new_capacity * size)))
+      return false;
+
+   memset((uint8_t*)grown + (size_t)*capacity * size, 0,
+         (size_t)(new_capacity - *capacity) * size);
+   *buf      = grown;
+   *capacity = new_capacity;
+   return true;
+}
+
+size_t netplay_join_request(uint8_t *buf, size_t len,
+      const netplay_join_receiver_t *r, unsigned frames)
+{
+   if (!buf || len < NETPLAY_JOIN_REQUEST_SIZE)
+      return 0;
+
+   netplay_join_header(buf, NETPLAY_JOIN_MSG_REQUEST, r ? r->id : 0);
+   netplay_join_put32(buf + 6,  (uint32_t)frames);
+   netplay_join_put32(buf + 10, r ? r->first_missing : 0);
+   return NETPLAY_JOIN_REQUEST_SIZE;
+}
+
+bool netplay_join_parse_request(const uint8_t *msg, size_t len,
+      uint32_t *id, unsigned *frames)
+{
+   if (!netplay_join_check(msg, len, NETPLAY_JOIN_MSG_REQUEST,
+            NETPLAY_JOIN_REQUEST_SIZE))
+      return false;
+
+   if (id)
+      *id    = netplay_join_get32(msg + 2);
+   if (frames)
+      *frames = netplay_join_get32(msg + 6);
+   return true;
+}
+
+/* Host side */
+
+bool netplay_join_sender_begin(netplay_join_sender_t *s, const char *peer,
+      uint32_t id, int frame, const void *state, size_t len,
+      size_t record_len, unsigned window)
+{
+   if (!s || !state || !len || len > NETPLAY_JOIN_MAX_STATE)
+      return false;
+
+   netplay_join_sender_free(s);
+
+   if (!(s->state = (uint8_t*)malloc(len)))
+      return false;
+   memcpy(s->state, state, len);
+
+   strlcpy(s->peer, peer ? peer : "", sizeof(s->peer));
+   s->id         = id;
+   s->frame      = frame;
+   s->raw_size   = (uint32_t)len;
+   s->raw_crc    = encoding_crc32(0, s->state, len);
+   s->codec      = NETPLAY_JOIN_CODEC_RAW;
+   s->record_len = record_len;
+   s->window     = window;
+   s->active     = true;
+
+#ifdef HAVE_ZSTD
+   if ((s->cctx = ZSTD_createCCtx()))
+   {
+      ZSTD_CCtx_setParameter((ZSTD_CCtx*)s->cctx,
+            ZSTD_c_compressionLevel, NETPLAY_JOIN_LEVEL);
+      ZSTD_CCtx_setPledgedSrcSize((ZSTD_CCtx*)s->cctx, len);
+      s->codec = NETPLAY_JOIN_CODEC_ZSTD;
+   }
+#endif
+
+   return true;
+}
+
+void netplay_join_sender_free(netplay_join_sender_t *s)
+{
+   if (!s)
+      return;
+
+#ifdef HAVE_ZSTD
+   if (s->cctx)
+      ZSTD_freeCCtx((ZSTD_CCtx*)s->cctx);
+#endif
+   free(s->state);
+   free(s->data);
+   free(s->sent_at);
+   free(s->inputs);
+   memset(s, 0, sizeof(*s));
+}
+
+/* The state goes out as is */
+static void netplay_join_sender_store_raw(netplay_join_sender_t *s)
+{
+   free(s->data);
+   s->data          = s->state;
+   s->data_len      = s->raw_size;
+   s->data_capacity = s->raw_size;
+   s->state         = NULL;
+   s->codec         = NETPLAY_JOIN_CODEC_RAW;
+   s->compressed    = true;
+}
+
+static void netplay_join_sender_compress(netplay_join_sender_t *s)
+{
+#ifdef HAVE_ZSTD
+   ZSTD_inBuffer in;
+   ZSTD_EndDirective mode;
+   size_t end;
+
+   if (s->codec != NETPLAY_JOIN_CODEC_ZSTD)
+   {
+      netplay_join_sender_store_raw(s);
+      return;
+   }
+
+   end = s->state_pos + NETPLAY_JOIN_SLICE;
+   if (end >= s->raw_size)
+      end = s->raw_size;
+   mode    = end == s->raw_size ? ZSTD_e_end : ZSTD_e_continue;
+
+   in.src  = s->state;
+   in.size = end;
+   in.pos  = s->state_pos;
+
+   for (;;)
+   {
+      size_t ret;
+      ZSTD_outBuffer out;
+      size_t need = s->data_len + ZSTD_CStreamOutSize();
+
+      if (need > s->data_capacity)
+      {
+         uint8_t *data = (uint8_t*)realloc(s->data, need * 2);
+         if (!data)
+         {
+            s->finished = true;
+            return;
+         }
+         s->data          = data;
+         s->data_capacity = need * 2;
+      }
+
+      out.dst  = s->data;
+      out.size = s->data_capacity;
+      out.pos  = s->data_len;
+
+      ret         = ZSTD_compressStream2((ZSTD_CCtx*)s->cctx,
+            &out, &in, mode);
+      s->data_len = out.pos;
+
+      /* Chunks of this stream may be out already; the joiner asks
+       * again and gets a new transfer */
+      if (ZSTD_isError(ret))
+      {
+         s->finished = true;
+         return;
+      }
+
+      if (mode == ZSTD_e_end ? !ret : in.pos == in.size)
+         break;
+   }
+
+   s->state_pos = in.pos;
+   if (mode == ZSTD_e_end)
+   {
+      ZSTD_freeCCtx((ZSTD_CCtx*)s->cctx);
+      s->cctx       = NULL;
+      free(s->state);
+      s->state      = NULL;
+      s->compressed = true;
+   }
+#else
+   netplay_join_sender_store_raw(s);
+#endif
+}
+
+void netplay_join_sender_input(netplay_join_sender_t *s, int frame,
+      const uint8_t *inputs, size_t len)
+{
+   unsigned idx;
+
+   if (!s || !s->active || !inputs || frame < s->frame || !s->record_len)
+      return;
+
+   idx = (unsigned)(frame - s->frame);
+   if (!netplay_join_grow((void**)&s->inputs, &s->input_capacity,
+            idx + 1, s->record_len))
+      return;
+
+   memset(s->inputs + (size_t)idx * s->record_len, 0, s->record_len);
+   memcpy(s->inputs + (size_t)idx * s->record_len, inputs,
+         len < s->record_len ? len : s->record_len);
+   if (idx + 1 > s->input_count)
+      s->input_count = idx + 1;
+}
+
+void netplay_join_sender_receive(netplay_join_sender_t *s,
+      const uint8_t *msg, size_t len, int64_t now)
+{
+   unsigned i, first_missing, input_count;
+
+   if (     !s
+         || !s->active
+         || !netplay_join_check(msg, len, NETPLAY_JOIN_MSG_ACK,
+            NETPLAY_JOIN_ACK_SIZE)
+         || netplay_join_get32(msg + 2) != s->id)
+      return;
+
+   first_missing = netplay_join_get32(msg + 6);
+   input_count   = netplay_join_get32(msg + 10);
+   s->last_ack   = now;
+
+   if (msg[14] & NETPLAY_JOIN_FLAG_FINISHED)
+      s->finished = true;
+
+   for (i = s->acked; i < first_missing && i < s->chunk_capacity; i++)
+      s->sent_at[i] = -1;
+   if (first_missing > s->acked)
+      s->acked = first_missing;
+
+   for (i = 0; i < NETPLAY_JOIN_ACK_WINDOW; i++)
+   {
+      unsigned chunk = first_missing + 1 + i;
+      if (chunk >= s->chunk_capacity)
+         break;
+      if (msg[16 + i / 8] & (1 << (i & 7)))
+         s->sent_at[chunk] = -1;
+   }
+
+   if (input_count > s->input_acked && input_count <= s->input_count)
+      s->input_acked = input_count;
+}
+
+static void netplay_join_sender_send_chunk(netplay_join_sender_t *s,
+      unsigned idx, unsigned count, netplay_join_send_t send, void *data)
+{
+   uint8_t buf[NETPLAY_JOIN_MESSAGE_MAX];
+   size_t offset = (size_t)idx * NETPLAY_JOIN_CHUNK_SIZE;
+   size_t len    = s->data_len - offset;
+
+   if (len > NETPLAY_JOIN_CHUNK_SIZE)
+      len = NETPLAY_JOIN_CHUNK_SIZE;
+
+   netplay_join_header(buf, NETPLAY_JOIN_MSG_CHUNK, s->id);
+   netplay_join_put32(buf + 6,  (uint32_t)s->frame);
+   netplay_join_put32(buf + 10, s->raw_size);
+   netplay_join_put32(buf + 14, s->raw_crc);
+   netplay_join_put32(buf + 18, idx);
+   netplay_join_put32(buf + 22, count);
+   buf[26] = s->codec;
+   buf[27] = 0;
+   memcpy(buf + NETPLAY_JOIN_CHUNK_HEADER, s->data + offset, len);
+
+   send(data, buf, NETPLAY_JOIN_CHUNK_HEADER + len);
+}
+
+static void netplay_join_sender_send_inputs(netplay_join_sender_t *s,
+      unsigned first, unsigned count, netplay_join_send_t send, void *data)
+{
+   uint8_t buf[NETPLAY_JOIN_MESSAGE_MAX];
+
+   netplay_join_header(buf, NETPLAY_JOIN_MSG_INPUT, s->id);
+   netplay_join_put32(buf + 6,  (uint32_t)s->frame);
+   netplay_join_put32(buf + 10, first);
+   netplay_join_put16(buf + 14, (uint16_t)count);
+   netplay_join_put16(buf + 16, (uint16_t)s->record_len);
+   memcpy(buf + NETPLAY_JOIN_INPUT_HEADER,
+         s->inputs + (size_t)first * s->record_len,
+         (size_t)count * s->record_len);
+
+   send(data, buf, NETPLAY_JOIN_INPUT_HEADER + (size_t)count * s->record_len);
+}
+
+unsigned netplay_join_sender_poll(netplay_join_sender_t *s, int64_t now,
+      unsigned max_messages, netplay_join_send_t send, void *data)
+{
+   unsigned i, total, count, confirmed, per_message;
+   unsigned sent = 0;
+
+   if (!s || !s->active || s->finished || !send)
+      return 0;
+
+   if (!s->last_ack)
+      s->last_ack = now;
+   else if (now - s->last_ack > NETPLAY_JOIN_TIMEOUT_USEC)
+   {
+      s->finished = true;
+      return 0;
+   }
+
+   if (!s->compressed)
+      netplay_join_sender_compress(s);
+   if (s->finished)
+      return 0;
+
+   /* Only whole chunks go out until the end of the data is known */
+   total = (unsigned)(s->data_len / NETPLAY_JOIN_CHUNK_SIZE);
+   count = 0;
+   if (s->compressed)
+   {
+      total = (unsigned)((s->data_len + NETPLAY_JOIN_CHUNK_SIZE - 1)
+            / NETPLAY_JOIN_CHUNK_SIZE);
+      count = total;
+   }
+
+   if (!netplay_join_grow((void**)&s->sent_at, &s->chunk_capacity,
+            total, sizeof(*s->sent_at)))
+      return 0;
+
+   for (i = s->acked; i < total && sent < max_messages; i++)
+   {
+      if (s->sent_at[i] < 0)
+         continue;
+      if (s->sent_at[i] && now - s->sent_at[i] < NETPLAY_JOIN_RESEND_USEC)
+         continue;
+      netplay_join_sender_send_chunk(s, i, count, send, data);
+      s->sent_at[i] = now;
+      sent++;
+   }
+
+   /* Inputs the session can no longer roll back */
+   confirmed   = s->input_count > s->window + 1
+      ? s->input_count - s->window - 1 : 0;
+   per_message = s->record_len
+      ? (unsigned)((NETPLAY_JOIN_MESSAGE_MAX - NETPLAY_JOIN_INPUT_HEADER)
+         / s->record_len) : 0;
+   if (!per_message)
+      return sent;
+
+   /* Every message repeats what the joiner has not acknowledged yet;
+    * inputs are small and this needs no per-frame bookkeeping */
+   if (     s->input_sent < confirmed
+         || (  s->input_acked < confirmed
+            && now - s->input_sent_at >= NETPLAY_JOIN_RESEND_USEC))
+   {
+      unsigned first = s->input_acked;
+
+      for (i = 0; i < NETPLAY_JOIN_INPUT_BURST && first < confirmed; i++)
+      {
+         unsigned n = confirmed - first;
+         if (n > per_message)
+            n = per_message;
+         netplay_join_sender_send_inputs(s, first, n, send, data);
+         first += n;
+         sent++;
+      }
+      s->input_sent    = first;
+      s->input_sent_at = now;
+   }
+
+   return sent;
+}
+
+/* Joiner side */
+
+void netplay_join_receiver_free(netplay_join_receiver_t *r)
+{
+   if (!r)
+      return;
+
+   free(r->data);
+   free(r->have);
+   free(r->inputs);
+   memset(r, 0, sizeof(*r));
+}
+
+static size_t netplay_join_bound(uint32_t raw_size)
+{
+#ifdef HAVE_ZSTD
+   return ZSTD_compressBound(raw_size);
+#else
+   return raw_size;
+#endif
+}
+
+static bool netplay_join_receiver_chunk(netplay_join_receiver_t *r,
+      const uint8_t *msg, size_t len)
+{
+   unsigned idx, count, max_chunks;
+   uint32_t id, raw_size;
+   size_t payload = len - NETPLAY_JOIN_CHUNK_HEADER;
+
+   id       = netplay_join_get32(msg + 2);
+   raw_size = netplay_join_get32(msg + 10);
+   idx      = netplay_join_get32(msg + 18);
+   count    = netplay_join_get32(msg + 22);
+
+   if (!id || !raw_size || raw_size > NETPLAY_JOIN_MAX_STATE)
+      return true;
+
+   if (id != r->id)
+   {
+      netplay_join_receiver_free(r);
+      r->id       = id;
+      r->frame    = (int)netplay_join_get32(msg + 6);
+      r->raw_size = raw_size;
+      r->raw_crc  = netplay_join_get32(msg + 14);
+      r->codec    = msg[26];
+   }
+
+   max_chunks = (unsigned)(netplay_join_bound(r->raw_size)
+         / NETPLAY_JOIN_CHUNK_SIZE + 1);
+   if (     idx >= max_chunks
+         || count > max_chunks
+         || (count && idx >= count)
+         || (r->chunk_count && count && count != r->chunk_count)
+         || msg[26] != r->codec
+         || !payload
+         || payload > NETPLAY_JOIN_CHUNK_SIZE
+         || (payload < NETPLAY_JOIN_CHUNK_SIZE && idx + 1 != count))
+      return true;
+
+   if (count)
+      r->chunk_count = count;
+
+   if (!netplay_join_grow((void**)&r->have, &r->chunk_capacity,
+            idx + 1, 1))
+      return true;
+   if ((size_t)r->chunk_capacity * NETPLAY_JOIN_CHUNK_SIZE
+         > r->data_capacity)
+   {
+      size_t capacity = (size_t)r->chunk_capacity * NETPLAY_JOIN_CHUNK_SIZE;
+      uint8_t *grown  = (uint8_t*)realloc(r->data, capacity);
+      if (!grown)
+         return true;
+      r->data          = grown;
+      r->data_capacity = capacity;
+   }
+
+   r->dirty = true;
+   if (r->have[idx])
+      return true;
+
+   memcpy(r->data + (size_t)idx * NETPLAY_JOIN_CHUNK_SIZE,
+         msg + NETPLAY_JOIN_CHUNK_HEADER, payload);
+   r->have[idx] = 1;
+   r->received++;
+   if (idx + 1 == count)
+      r->last_len = (unsigned)payload;
+
+   while (     r->first_missing < r->chunk_capacity
+         && r->have[r->first_missing])
+      r->first_missing++;
+
+   return true;
+}
+
+static bool netplay_join_receiver_inputs(netplay_join_receiver_t *r,
+      const uint8_t *msg, size_t len)
+{
+   unsigned first, count;
+   size_t record_len;
+
+   if (netplay_join_get32(msg + 2) != r->id || !r->id)
+      return true;
+
+   first      = netplay_join_get32(msg + 10);
+   count      = netplay_join_get16(msg + 14);
+   record_len = netplay_join_get16(msg + 16);
+
+   if (     !record_len
+         || (r->record_len && record_len != r->record_len)
+         || len < NETPLAY_JOIN_INPUT_HEADER + (size_t)count * record_len
+         || first > r->input_count
+         || !count)
+      return true;
+
+   if (!netplay_join_grow((void**)&r->inputs, &r->input_capacity,
+            first + count, record_len))
+      return true;
+
+   r->record_len = record_len;
+   memcpy(r->inputs + (size_t)first * record_len,
+         msg + NETPLAY_JOIN_INPUT_HEADER, (size_t)count * record_len);
+   if (first + count > r->input_count)
+   {
+      r->input_count = first + count;
+      r->dirty       = true;
+   }
+   return true;
+}
+
+bool netplay_join_receiver_receive(netplay_join_receiver_t *r,
+      const uint8_t *msg, size_t len)
+{
+   if (!r)
+      return false;
+   if (netplay_join_check(msg, len, NETPLAY_JOIN_MSG_CHUNK,
+            NETPLAY_JOIN_CHUNK_HEADER + 1))
+      return netplay_join_receiver_chunk(r, msg, len);
+   if (netplay_join_check(msg, len, NETPLAY_JOIN_MSG_INPUT,
+            NETPLAY_JOIN_INPUT_HEADER))
+      return netplay_join_receiver_inputs(r, msg, len);
+   return false;
+}
+
+bool netplay_join_receiver_complete(const netplay_join_receiver_t *r)
+{
+   return r
+      && r->chunk_count
+      && r->last_len
+      && r->received == r->chunk_count;
+}
+
+uint8_t *netplay_join_receiver_state(const netplay_join_receiver_t *r)
+{
+   size_t len;
+   uint8_t *state;
+
+   if (!netplay_join_receiver_complete(r))
+      return NULL;
+
+   len = (size_t)(r->chunk_count - 1) * NETPLAY_JOIN_CHUNK_SIZE
+      + r->last_len;
+   if (!(state = (uint8_t*)malloc(r->raw_size)))
+      return NULL;
+
+   switch (r->codec)
+   {
+      case NETPLAY_JOIN_CODEC_RAW:
+         if (len != r->raw_size)
+            goto error;
+         memcpy(state, r->data, len);
+         break;
+#ifdef HAVE_ZSTD
+      case NETPLAY_JOIN_CODEC_ZSTD:
+         if (ZSTD_decompress(state, r->raw_size, r->data, len)
+               != r->raw_size)
+            goto error;
+         break;
+#endif
+      default:
+         goto error;
+   }
+
+   if (encoding_crc32(0, state, r->raw_size) != r->raw_crc)
+      goto error;
+
+   return state;
+
+error:
+   free(state);
+   return NULL;
+}
+
+const uint8_t *netplay_join_receiver_input(const netplay_join_receiver_t *r,
+      int frame)
+{
+   if (     !r
+         || !r->id
+         || frame < r->frame
+         || (unsigned)(frame - r->frame) >= r->input_count)
+      return NULL;
+   return r->inputs + (size_t)(frame - r->frame) * r->record_len;
+}
+
+void netplay_join_receiver_poll(netplay_join_receiver_t *r, int64_t now,
+      netplay_join_send_t send, void *data)
+{
+   unsigned i;
+   uint8_t buf[NETPLAY_JOIN_ACK_SIZE];
+
+   if (!r || !r->id || !send)
+      return;
+   if (     now - r->ack_at < NETPLAY_JOIN_ACK_USEC
+         || (!r->dirty && now - r->ack_at < NETPLAY_JOIN_IDLE_ACK_USEC))
+      return;
+
+   memset(buf, 0, sizeof(buf));
+   netplay_join_header(buf, NETPLAY_JOIN_MSG_ACK, r->id);
+   netplay_join_put32(buf + 6,  r->first_missing);
+   netplay_join_put32(buf + 10, r->input_count);
+   buf[14] = r->finished ? NETPLAY_JOIN_FLAG_FINISHED : 0;
+
+   for (i = 0; i < NETPLAY_JOIN_ACK_WINDOW; i++)
+   {
+      unsigned chunk = r->first_missing + 1 + i;
+      if (chunk >= r->chunk_capacity)
+         break;
+      if (r->have[chunk])
+         buf[16 + i / 8] |= (uint8_t)(1 << (i & 7));
+   }
+
+   send(data, buf, sizeof(buf));
+   r->ack_at = now;
+   r->dirty  = false;
+}
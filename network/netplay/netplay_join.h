@@ -0,0 +1,224 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2021 - Daniel De Matteis
+ *  Copyright (C) 2024-2025 - Jamie Meyer
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RARCH_NETPLAY_JOIN_H
+#define __RARCH_NETPLAY_JOIN_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <boolean.h>
+#include <retro_common_api.h>
+
+RETRO_BEGIN_DECLS
+
+/* Compressed state bytes per message; with the header this stays
+ * below a 1280 byte path MTU */
+#define NETPLAY_JOIN_CHUNK_SIZE      1152
+#define NETPLAY_JOIN_CHUNK_HEADER    28
+/* Chunks an acknowledgement reports past the first missing one */
+#define NETPLAY_JOIN_ACK_WINDOW      512
+#define NETPLAY_JOIN_MESSAGE_MAX     (NETPLAY_JOIN_CHUNK_HEADER + NETPLAY_JOIN_CHUNK_SIZE)
+/* Peers the host streams a state to at the same time */
+#define NETPLAY_JOIN_MAX_SENDERS     4
+
+enum netplay_join_msg
+{
+   /* Joiner to host: send me the running session */
+   NETPLAY_JOIN_MSG_REQUEST = 16,
+   /* Host to joiner: a piece of the compressed state */
+   NETPLAY_JOIN_MSG_CHUNK,
+   /* Host to joiner: confirmed inputs from the state's frame on */
+   NETPLAY_JOIN_MSG_INPUT,
+   /* Joiner to host: what arrived so far */
+   NETPLAY_JOIN_MSG_ACK
+};
+
+typedef void (*netplay_join_send_t)(void *data,
+      const uint8_t *msg, size_t len);
+
+/* Host side of one transfer. The state is copied once and compressed
+ * a slice per frame, so chunks start flowing before compression is
+ * done and the host never stalls on a large state. */
+typedef struct netplay_join_sender
+{
+   char      peer[64];
+   uint32_t  id;
+   /* Frame the state was saved before */
+   int       frame;
+   uint32_t  raw_size;
+   uint32_t  raw_crc;
+   uint8_t   codec;
+
+   uint8_t  *state;
+   size_t    state_pos;
+   void     *cctx;
+   uint8_t  *data;
+   size_t    data_len;
+   size_t    data_capacity;
+   bool      compressed;
+
+   /* Per chunk send time, 0 when due, -1 once acknowledged */
+   int64_t  *sent_at;
+   unsigned  chunk_capacity;
+   /* Every chunk below this one was acknowledged */
+   unsigned  acked;
+
+   /* Inputs of frames from @frame on, overwritten by rollbacks */
+   uint8_t  *inputs;
+   size_t    record_len;
+   unsigned  input_count;
+   unsigned  input_capacity;
+   unsigned  window;
+   /* Frames the joiner has, and the end of the last send */
+   unsigned  input_acked;
+   unsigned  input_sent;
+   int64_t   input_sent_at;
+
+   int64_t   last_ack;
+   bool      active;
+   bool      finished;
+} netplay_join_sender_t;
+
+/* Joiner side: reassembles the state in any order and keeps chunks
+ * across interruptions, so a transfer resumes where it stopped. */
+typedef struct netplay_join_receiver
+{
+   uint32_t  id;
+   int       frame;
+   uint32_t  raw_size;
+   uint32_t  raw_crc;
+   uint8_t   codec;
+
+   uint8_t  *data;
+   size_t    data_capacity;
+   uint8_t  *have;
+   unsigned  chunk_capacity;
+   /* 0 until the host finished compressing */
+   unsigned  chunk_count;
+   /* Bytes in the last chunk, once it arrived */
+   unsigned  last_len;
+   unsigned  received;
+   unsigned  first_missing;
+
+   uint8_t  *inputs;
+   size_t    record_len;
+   unsigned  input_count;
+   unsigned  input_capacity;
+
+   int64_t   ack_at;
+   bool      dirty;
+   bool      finished;
+} netplay_join_receiver_t;
+
+/**
+ * netplay_join_request
+ * @frames               : frames the joiner ran since it connected
+ *
+ * Encode a request for the running session into @buf. The host
+ * compares @frames with its own frame to tell a late joiner from a
+ * peer that was there from the start.
+ * Returns its length.
+ */
+size_t netplay_join_request(uint8_t *buf, size_t len,
+      const netplay_join_receiver_t *r, unsigned frames);
+
+bool netplay_join_parse_request(const uint8_t *msg, size_t len,
+      uint32_t *id, unsigned *frames);
+
+/**
+ * netplay_join_sender_begin
+ * @record_len           : bytes of one frame's inputs, all players
+ * @window               : input prediction window of the session
+ *
+ * Start streaming @state, saved before @frame, to @peer.
+ * Returns false if the state could not be copied.
+ */
+bool netplay_join_sender_begin(netplay_join_sender_t *s, const char *peer,
+      uint32_t id, int frame, const void *state, size_t len,
+      size_t record_len, unsigned window);
+
+void netplay_join_sender_free(netplay_join_sender_t *s);
+
+/**
+ * netplay_join_sender_input
+ *
+ * Remember the inputs of @frame. Frames are sent once the session
+ * can no longer roll them back.
+ */
+void netplay_join_sender_input(netplay_join_sender_t *s, int frame,
+      const uint8_t *inputs, size_t len);
+
+/**
+ * netplay_join_sender_receive
+ *
+ * Apply an acknowledgement from the joiner.
+ */
+void netplay_join_sender_receive(netplay_join_sender_t *s,
+      const uint8_t *msg, size_t len, int64_t now);
+
+/**
+ * netplay_join_sender_poll
+ * @max_messages         : chunk messages this call may send
+ *
+ * Compress the next slice of the state and send the chunks that are
+ * new or overdue, plus pending inputs. Returns the messages sent.
+ */
+unsigned netplay_join_sender_poll(netplay_join_sender_t *s, int64_t now,
+      unsigned max_messages, netplay_join_send_t send, void *data);
+
+/**
+ * netplay_join_receiver_receive
+ *
+ * Store a chunk or an input message. Chunks of another transfer
+ * replace the current one. Returns false for other messages.
+ */
+bool netplay_join_receiver_receive(netplay_join_receiver_t *r,
+      const uint8_t *msg, size_t len);
+
+void netplay_join_receiver_free(netplay_join_receiver_t *r);
+
+bool netplay_join_receiver_complete(const netplay_join_receiver_t *r);
+
+/**
+ * netplay_join_receiver_state
+ *
+ * Decompress the state and check it against the host's checksum.
+ * Returns a buffer of raw_size bytes to free(), or NULL.
+ */
+uint8_t *netplay_join_receiver_state(const netplay_join_receiver_t *r);
+
+/**
+ * netplay_join_receiver_input
+ *
+ * Returns the inputs of @frame sent by the host, or NULL.
+ */
+const uint8_t *netplay_join_receiver_input(const netplay_join_receiver_t *r,
+      int frame);
+
+/**
+ * netplay_join_receiver_poll
+ *
+ * Acknowledge what arrived, at most every 50 ms and only after
+ * progress, or every 250 ms to keep a stalled transfer going.
+ */
+void netplay_join_receiver_poll(netplay_join_receiver_t *r, int64_t now,
+      netplay_join_send_t send, void *data);
+
+RETRO_END_DECLS
+
+#endif
@@ -19,6 +19,16 @@
 #define __RARCH_NETPLAY_PRIVATE_H
 
 #include "netplay.h"
+#include "netplay_checksum.h"
+#include "netplay_events.h"
+#include "netplay_timesync.h"
+#include "netplay_autodelay.h"
+#include "netplay_input.h"
+#include "netplay_telemetry.h"
+#include "netplay_forensics.h"
+#include "netplay_replay.h"
+#include "netplay_join.h"
+#include "netplay_relay.h"
 #include "netplay_protocol.h"
 
 /* Forward declarations for the GekkoNet integration.
@@ -80,6 +90,11 @@ typedef struct GekkoNetAdapter GekkoNetAdapter;
 #define NETPLAY_MAX_REQ_STALL_TIME      60
 #define NETPLAY_MAX_REQ_STALL_FREQUENCY 120
 
+/* Peers whose input layout is tracked, and how often it is announced
+ * until they all answered */
+#define NETPLAY_LAYOUT_MAX_PEERS        16
+#define NETPLAY_LAYOUT_RESEND_USEC      250000
+
 #define PREV_PTR(x) ((x) == 0 ? netplay->buffer_size - 1 : (x) - 1)
 #define NEXT_PTR(x) ((x + 1) % netplay->buffer_size)
 
@@ -720,23 +735,115 @@ struct netplay
    /* GekkoNet frontend state */
    GekkoSession    *session;
    GekkoNetAdapter *adapter;
+   /* adapter is the frontend's own transport (netplay_adapter.c) */
+   bool             native_adapter;
    int              local_handle;
    netplay_remote_actor_t *remote_actors;
    size_t           remote_actor_count;
    unsigned char    num_players;
    unsigned char    input_prediction_window;
    unsigned char    spectator_delay;
-   uint8_t         *state_buffer;
+   /* Input delay of the local player, chosen automatically when
+    * local_delay_auto is set */
+   netplay_autodelay_t autodelay;
+   bool             local_delay_auto;
+   /* Per-slot capacity GekkoNet was started with */
+   unsigned int     session_state_size;
+   netplay_checksum_t checksum;
    uint8_t         *authoritative_input;
    size_t           authoritative_size;
    bool             authoritative_valid;
-   uint16_t         local_input_mask;
+   /* Wire format of one player's input, shared by all peers */
+   netplay_input_layout_t input_layout;
+   /* Peers that announced the same layout and state checksums. Local
+    * input is held back until every peer seen did; a peer with
+    * another one stops the session before its first frame. */
+   char             layout_peers[NETPLAY_LAYOUT_MAX_PEERS][64];
+   unsigned         layout_peer_count;
+   retro_time_t     layout_sent_at;
+   bool             layout_confirmed;
+   bool             layout_mismatch;
+   /* Record last handed to GekkoNet for the local player */
+   uint8_t         *local_input;
+   /* Authoritative frame unpacked per core port, for input_state_net */
+   netplay_input_port_t *input_ports;
+   size_t           input_port_count;
+   uint64_t         input_keys;
    bool             running;
    bool             connected;
    bool             session_started;
    bool             spectator;
    bool             allow_timeskip;
+   /* Set while replaying rollback frames requested by GekkoNet;
+    * video/audio output of the core is discarded meanwhile. */
+   bool             resimulating;
    unsigned         current_frame;
+   /* Depth and cost of the most recent rollback */
+   unsigned         rollback_last_frames;
+   retro_time_t     rollback_last_usec;
+   /* Running totals since the session started */
+   uint64_t         rollback_count;
+   uint64_t         rollback_total_frames;
+   retro_time_t     rollback_total_usec;
+   /* Rollback, serialization and link statistics for the OSD, the
+    * command interface and the CSV dump */
+   netplay_telemetry_t telemetry;
+   bool             telemetry_csv;
+   /* Block hashes of recent saves, exchanged on a desync to report
+    * which parts of the state differ */
+   netplay_forensics_t forensics;
+   unsigned         desync_history;
+   /* Confirmed inputs of the session, written as a regular replay */
+   netplay_replay_t *replay;
+   bool             record_replay;
+   /* Late join: the host streams its state to a peer that joined a
+    * running session, which holds until it arrived and then runs the
+    * frames it missed. A sender with a peer but not active yet waits
+    * for the next state to snapshot. */
+   netplay_join_sender_t   join_senders[NETPLAY_JOIN_MAX_SENDERS];
+   netplay_join_receiver_t join;
+   uint8_t         *join_live_inputs;
+   int             *join_live_frames;
+   char             join_host[64];
+   uint32_t         join_next_id;
+   retro_time_t     join_request_at;
+   retro_time_t     join_done_at;
+   unsigned         join_frames_run;
+   int              join_next_frame;
+   int              join_live_frame;
+   /* The states caught up through, by frame: GekkoNet's saves in the
+    * join window are empty, so rollbacks into it load from here.
+    * join_save_delta is a save's tag minus the frame of the advance
+    * it follows, learned from the events while joining. */
+   uint8_t         *join_states;
+   int             *join_state_frames;
+   unsigned         join_state_slots;
+   int              join_event_frame;
+   int              join_save_delta;
+   bool             join_save_delta_known;
+   bool             late_join;
+   bool             join_client;
+   bool             joining;
+   /* Spectator relay: the host feeds its confirmed inputs to a relay
+    * that sends them on to every spectator. A relay spectator runs
+    * from that stream alone, without a GekkoNet session. */
+   netplay_relay_stream_t relay_stream;
+   netplay_relay_link_t   relay_link;
+   struct sockaddr_storage relay_addr;
+   socklen_t        relay_addr_len;
+   int              relay_fd;
+   unsigned         relay_next_frame;
+   retro_time_t     relay_watch_at;
+   bool             relay_watch;
+   bool             relay_warned;
+   /* Frame pacing against the remote peer */
+   netplay_timesync_t timesync;
+   /* What is done with the events of the latest update. Its last
+    * advance may be waiting for core_run(), and the saves after it
+    * for the next update; the events stay GekkoNet's until then. */
+   netplay_events_t events;
+   struct GekkoGameEvent **events_deferred;
+   bool             advance_pending;
 };
 
 void video_frame_net(const void *data,
@@ -0,0 +1,477 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2021 - Daniel De Matteis
+ *  Copyright (C) 2024-2025 - Jamie Meyer
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "netplay_relay.h"
+
+#define NETPLAY_RELAY_VERSION        1
+#define NETPLAY_RELAY_FRAMES_HEADER  14
+/* Frames in one FRAMES message */
+#define NETPLAY_RELAY_MAX_FRAMES     0xffff
+#define NETPLAY_RELAY_RESEND_USEC    200000
+
+/* FRAMES: [0] type, [1] version, [2..5] session, [6..9] first frame,
+ * [10..11] frames, [12..13] record length, then one token per frame
+ * or run of frames:
+ *    varint (n << 1)     : n bytes changed, each a varint gap from
+ *                          the byte after the last change and the
+ *                          new value
+ *    varint (n << 1) | 1 : the previous frame, n times
+ * The first frame of a message is relative to a zeroed record, so
+ * messages decode on their own in any order.
+ *
+ * ACK and WATCH: [0] type, [1] version, [2..5] session, [6..9] frames */
+
+static void netplay_relay_put16(uint8_t *p, uint16_t v)
+{
+   p[0] = (uint8_t)(v);
+   p[1] = (uint8_t)(v >> 8);
+}
+
+static void netplay_relay_put32(uint8_t *p, uint32_t v)
+{
+   p[0] = (uint8_t)(v);
+   p[1] = (uint8_t)(v >> 8);
+   p[2] = (uint8_t)(v >> 16);
+   p[3] = (uint8_t)(v >> 24);
+}
+
+static uint16_t netplay_relay_get16(const uint8_t *p)
+{
+   return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t netplay_relay_get32(const uint8_t *p)
+{
+   return  (uint32_t)p[0]
+        | ((uint32_t)p[1] << 8)
+        | ((uint32_t)p[2] << 16)
+        | ((uint32_t)p[3] << 24);
+}
+
+/* Returns the bytes written, 0 if @v does not fit in @avail */
+static size_t netplay_relay_put_varint(uint8_t *p, size_t avail,
+      uint32_t v)
+{
+   size_t n = 0;
+
+   do
+   {
+      if (n >= avail)
+         return 0;
+      p[n++] = (uint8_t)((v & 0x7f) | (v > 0x7f ? 0x80 : 0));
+      v    >>= 7;
+   } while (v);
+
+   return n;
+}
+
+/* Returns the bytes read, 0 if the varint is cut short or too long */
+static size_t netplay_relay_get_varint(const uint8_t *p, size_t avail,
+      uint32_t *v)
+{
+   size_t n       = 0;
+   unsigned shift = 0;
+
+   *v = 0;
+   while (n < avail && shift < 32)
+   {
+      uint8_t b = p[n++];
+      *v       |= (uint32_t)(b & 0x7f) << shift;
+      if (!(b & 0x80))
+         return n;
+      shift    += 7;
+   }
+
+   return 0;
+}
+
+bool netplay_relay_stream_init(netplay_relay_stream_t *s,
+      uint32_t session, size_t record_len)
+{
+   if (!s || !record_len || record_len > 0xffff)
+      return false;
+
+   netplay_relay_stream_free(s);
+   s->session    = session;
+   s->record_len = record_len;
+   return true;
+}
+
+void netplay_relay_stream_free(netplay_relay_stream_t *s)
+{
+   if (!s)
+      return;
+
+   free(s->frames);
+   memset(s, 0, sizeof(*s));
+}
+
+bool netplay_relay_stream_set(netplay_relay_stream_t *s, unsigned frame,
+      const uint8_t *record, size_t len)
+{
+   uint8_t *dst;
+
+   if (     !s
+         || !s->record_len
+         || !record
+         || frame < s->base
+         || frame > s->count)
+      return false;
+
+   if (frame == s->count)
+   {
+      if (frame - s->base >= s->capacity)
+      {
+         unsigned capacity = s->capacity ? s->capacity * 2 : 1024;
+         uint8_t *grown    = (uint8_t*)realloc(s->frames,
+               (size_t)capacity * s->record_len);
+
+         if (!grown)
+            return false;
+         s->frames   = grown;
+         s->capacity = capacity;
+      }
+      s->count++;
+   }
+
+   dst = s->frames + (size_t)(frame - s->base) * s->record_len;
+   memset(dst, 0, s->record_len);
+   memcpy(dst, record, len < s->record_len ? len : s->record_len);
+   return true;
+}
+
+const uint8_t *netplay_relay_stream_get(const netplay_relay_stream_t *s,
+      unsigned frame)
+{
+   if (!s || frame < s->base || frame >= s->count)
+      return NULL;
+   return s->frames + (size_t)(frame - s->base) * s->record_len;
+}
+
+void netplay_relay_stream_trim(netplay_relay_stream_t *s, unsigned frame)
+{
+   unsigned drop;
+
+   if (!s || frame <= s->base)
+      return;
+
+   if (frame > s->count)
+      frame = s->count;
+   drop = frame - s->base;
+
+   memmove(s->frames, s->frames + (size_t)drop * s->record_len,
+         (size_t)(s->count - frame) * s->record_len);
+   s->base = frame;
+}
+
+size_t netplay_relay_pack(const netplay_relay_stream_t *s,
+      unsigned first, unsigned end, uint8_t *buf, size_t len,
+      unsigned *frames)
+{
+   size_t pos   = NETPLAY_RELAY_FRAMES_HEADER;
+   unsigned n   = 0;
+
+   if (frames)
+      *frames = 0;
+
+   if (     !s
+         || !buf
+         || len <= NETPLAY_RELAY_FRAMES_HEADER
+         || first < s->base
+         || first >= end
+         || end > s->count)
+      return 0;
+
+   while (first + n < end && n < NETPLAY_RELAY_MAX_FRAMES)
+   {
+      size_t w;
+      const uint8_t *cur  = netplay_relay_stream_get(s, first + n);
+      const uint8_t *prev = n ? cur - s->record_len : NULL;
+
+      if (prev && !memcmp(cur, prev, s->record_len))
+      {
+         unsigned run = 1;
+
+         while (     first + n + run < end
+               &&    n + run < NETPLAY_RELAY_MAX_FRAMES
+               && !memcmp(cur + (size_t)run * s->record_len,
+                  cur + (size_t)(run - 1) * s->record_len, s->record_len))
+            run++;
+
+         if (!(w = netplay_relay_put_varint(buf + pos, len - pos,
+                     (run << 1) | 1)))
+            break;
+         pos += w;
+         n   += run;
+      }
+      else
+      {
+         size_t i;
+         size_t start    = pos;
+         size_t next     = 0;
+         unsigned change = 0;
+
+         for (i = 0; i < s->record_len; i++)
+            if (cur[i] != (prev ? prev[i] : 0))
+               change++;
+
+         if (!(w = netplay_relay_put_varint(buf + pos, len - pos,
+                     change << 1)))
+            break;
+         pos += w;
+
+         for (i = 0; i < s->record_len && w; i++)
+         {
+            if (cur[i] == (prev ? prev[i] : 0))
+               continue;
+            if (     !(w = netplay_relay_put_varint(buf + pos, len - pos,
+                        (uint32_t)(i - next)))
+                  || pos + w >= len)
+            {
+               w = 0;
+               break;
+            }
+            pos          += w;
+            buf[pos++]    = cur[i];
+            next          = i + 1;
+         }
+
+         if (!w && change)
+         {
+            pos = start;
+            break;
+         }
+         n++;
+      }
+   }
+
+   if (!n)
+      return 0;
+
+   buf[0] = NETPLAY_RELAY_MSG_FRAMES;
+   buf[1] = NETPLAY_RELAY_VERSION;
+   netplay_relay_put32(buf + 2,  s->session);
+   netplay_relay_put32(buf + 6,  first);
+   netplay_relay_put16(buf + 10, (uint16_t)n);
+   netplay_relay_put16(buf + 12, (uint16_t)s->record_len);
+
+   if (frames)
+      *frames = n;
+   return pos;
+}
+
+bool netplay_relay_unpack(netplay_relay_stream_t *s,
+      const uint8_t *msg, size_t len)
+{
+   uint8_t *cur;
+   unsigned first, count;
+   unsigned n = 0;
+   size_t pos = NETPLAY_RELAY_FRAMES_HEADER;
+   bool ok    = true;
+
+   if (     !s
+         || !s->record_len
+         || !msg
+         || len < NETPLAY_RELAY_FRAMES_HEADER
+         || msg[0] != NETPLAY_RELAY_MSG_FRAMES
+         || msg[1] != NETPLAY_RELAY_VERSION
+         || netplay_relay_get32(msg + 2) != s->session
+         || netplay_relay_get16(msg + 12) != s->record_len)
+      return false;
+
+   first = netplay_relay_get32(msg + 6);
+   count = netplay_relay_get16(msg + 10);
+
+   /* Nothing new, or not contiguous with what we have */
+   if (first > s->count || first + count <= s->count)
+      return true;
+
+   if (!(cur = (uint8_t*)calloc(1, s->record_len)))
+      return false;
+
+   while (ok && n < count)
+   {
+      uint32_t token;
+      size_t r = netplay_relay_get_varint(msg + pos, len - pos, &token);
+
+      if (!r)
+      {
+         ok = false;
+         break;
+      }
+      pos += r;
+
+      if (token & 1)
+      {
+         unsigned run = token >> 1;
+
+         if (!run || run > count - n)
+         {
+            ok = false;
+            break;
+         }
+         for (; run; run--, n++)
+            if (first + n == s->count)
+               ok = netplay_relay_stream_set(s, first + n,
+                     cur, s->record_len);
+      }
+      else
+      {
+         uint32_t change;
+         size_t next = 0;
+
+         for (change = token >> 1; change; change--)
+         {
+            uint32_t gap;
+
+            if (     !(r = netplay_relay_get_varint(msg + pos,
+                        len - pos, &gap))
+                  || pos + r >= len
+                  || next + gap >= s->record_len)
+            {
+               ok = false;
+               break;
+            }
+            pos              += r;
+            next             += gap;
+            cur[next++]       = msg[pos++];
+         }
+
+         if (ok && first + n == s->count)
+            ok = netplay_relay_stream_set(s, first + n, cur, s->record_len);
+         n++;
+      }
+   }
+
+   free(cur);
+   return ok;
+}
+
+bool netplay_relay_peek(const uint8_t *msg, size_t len,
+      uint8_t *type, uint32_t *session, size_t *record_len)
+{
+   if (     !msg
+         || len < NETPLAY_RELAY_CONTROL_SIZE
+         || msg[1] != NETPLAY_RELAY_VERSION)
+      return false;
+
+   if (type)
+      *type       = msg[0];
+   if (session)
+      *session    = netplay_relay_get32(msg + 2);
+   if (record_len)
+      *record_len = (msg[0] == NETPLAY_RELAY_MSG_FRAMES
+            && len >= NETPLAY_RELAY_FRAMES_HEADER)
+         ? netplay_relay_get16(msg + 12) : 0;
+   return true;
+}
+
+size_t netplay_relay_control(uint8_t *buf, size_t len, uint8_t type,
+      uint32_t session, unsigned count)
+{
+   if (!buf || len < NETPLAY_RELAY_CONTROL_SIZE)
+      return 0;
+
+   buf[0] = type;
+   buf[1] = NETPLAY_RELAY_VERSION;
+   netplay_relay_put32(buf + 2, session);
+   netplay_relay_put32(buf + 6, count);
+   return NETPLAY_RELAY_CONTROL_SIZE;
+}
+
+bool netplay_relay_parse_control(const uint8_t *msg, size_t len,
+      uint8_t *type, uint32_t *session, unsigned *count)
+{
+   if (     !msg
+         || len < NETPLAY_RELAY_CONTROL_SIZE
+         || msg[1] != NETPLAY_RELAY_VERSION
+         || (     msg[0] != NETPLAY_RELAY_MSG_ACK
+               && msg[0] != NETPLAY_RELAY_MSG_WATCH))
+      return false;
+
+   if (type)
+      *type    = msg[0];
+   if (session)
+      *session = netplay_relay_get32(msg + 2);
+   if (count)
+      *count   = netplay_relay_get32(msg + 6);
+   return true;
+}
+
+void netplay_relay_link_reset(netplay_relay_link_t *link,
+      unsigned acked, int64_t now)
+{
+   link->acked       = acked;
+   link->sent        = acked;
+   link->progress_at = now;
+   link->heard_at    = now;
+}
+
+void netplay_relay_link_ack(netplay_relay_link_t *link, unsigned count,
+      int64_t now)
+{
+   link->heard_at = now;
+   if (count > link->acked)
+   {
+      link->acked       = count;
+      link->progress_at = now;
+   }
+   if (link->sent < link->acked)
+      link->sent = link->acked;
+}
+
+unsigned netplay_relay_link_poll(netplay_relay_link_t *link,
+      const netplay_relay_stream_t *s, unsigned end, int64_t now,
+      unsigned max_packets, netplay_relay_send_t send, void *data)
+{
+   uint8_t buf[NETPLAY_RELAY_PACKET_MAX];
+   unsigned packets = 0;
+
+   if (!link || !s || !send)
+      return 0;
+
+   if (end > s->count)
+      end = s->count;
+
+   /* Go back to the first frame the destination is missing */
+   if (     link->acked < link->sent
+         && now - link->progress_at >= NETPLAY_RELAY_RESEND_USEC)
+   {
+      link->sent        = link->acked;
+      link->progress_at = now;
+   }
+
+   while (packets < max_packets && link->sent < end)
+   {
+      unsigned frames;
+      size_t len = netplay_relay_pack(s, link->sent, end,
+            buf, sizeof(buf), &frames);
+
+      if (!len)
+         break;
+      if (link->sent == link->acked)
+         link->progress_at = now;
+      send(data, buf, len);
+      link->sent += frames;
+      packets++;
+   }
+
+   return packets;
+}
@@ -0,0 +1,153 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2021 - Daniel De Matteis
+ *  Copyright (C) 2024-2025 - Jamie Meyer
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RARCH_NETPLAY_RELAY_H
+#define __RARCH_NETPLAY_RELAY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <boolean.h>
+#include <retro_common_api.h>
+
+RETRO_BEGIN_DECLS
+
+/* Spectator relay: the host sends its confirmed inputs once to a relay,
+ * which sends them on to every spectator. Shared by the frontend and
+ * tools/netplay_relay; nothing here touches a socket. */
+
+#define NETPLAY_RELAY_PACKET_MAX     1200
+#define NETPLAY_RELAY_CONTROL_SIZE   10
+#define NETPLAY_RELAY_DEFAULT_PORT   55436
+
+enum netplay_relay_msg
+{
+   /* Host to relay, relay to spectator: packed frames */
+   NETPLAY_RELAY_MSG_FRAMES = 1,
+   /* Relay to host: frames stored so far */
+   NETPLAY_RELAY_MSG_ACK,
+   /* Spectator to relay: subscribe, and frames received so far */
+   NETPLAY_RELAY_MSG_WATCH
+};
+
+typedef void (*netplay_relay_send_t)(void *data,
+      const uint8_t *msg, size_t len);
+
+/* Confirmed inputs of a session, one record per frame */
+typedef struct netplay_relay_stream
+{
+   uint32_t  session;
+   size_t    record_len;
+   /* Records of frames [base, count) */
+   uint8_t  *frames;
+   unsigned  base;
+   unsigned  count;
+   unsigned  capacity;
+} netplay_relay_stream_t;
+
+/* Sending side of a stream to one destination. Every frame from the
+ * last acknowledged one on is sent again once no acknowledgement made
+ * progress for a while; confirmed inputs are tiny once packed. */
+typedef struct netplay_relay_link
+{
+   unsigned  acked;
+   unsigned  sent;
+   int64_t   progress_at;
+   int64_t   heard_at;
+} netplay_relay_link_t;
+
+bool netplay_relay_stream_init(netplay_relay_stream_t *s,
+      uint32_t session, size_t record_len);
+
+void netplay_relay_stream_free(netplay_relay_stream_t *s);
+
+/**
+ * netplay_relay_stream_set
+ *
+ * Store the record of @frame, which is at most one past the newest.
+ * Records shorter than the stream's are padded with zeroes.
+ */
+bool netplay_relay_stream_set(netplay_relay_stream_t *s, unsigned frame,
+      const uint8_t *record, size_t len);
+
+const uint8_t *netplay_relay_stream_get(const netplay_relay_stream_t *s,
+      unsigned frame);
+
+/**
+ * netplay_relay_stream_trim
+ *
+ * Forget the frames before @frame.
+ */
+void netplay_relay_stream_trim(netplay_relay_stream_t *s, unsigned frame);
+
+/**
+ * netplay_relay_pack
+ *
+ * Pack the frames from @first up to @end into a FRAMES message. Each
+ * frame is stored as the bytes that differ from the frame before it,
+ * as varint gaps, and runs of unchanged frames as a single varint.
+ * Returns the message length and the frames in it in @frames.
+ */
+size_t netplay_relay_pack(const netplay_relay_stream_t *s,
+      unsigned first, unsigned end, uint8_t *buf, size_t len,
+      unsigned *frames);
+
+/**
+ * netplay_relay_unpack
+ *
+ * Append the frames of a FRAMES message of @s's session that are new
+ * to @s. Frames past a gap are dropped. Returns false if the message
+ * is malformed or belongs to another session.
+ */
+bool netplay_relay_unpack(netplay_relay_stream_t *s,
+      const uint8_t *msg, size_t len);
+
+/**
+ * netplay_relay_peek
+ *
+ * Read the type and session of any relay message, and the record
+ * length of a FRAMES message.
+ */
+bool netplay_relay_peek(const uint8_t *msg, size_t len,
+      uint8_t *type, uint32_t *session, size_t *record_len);
+
+size_t netplay_relay_control(uint8_t *buf, size_t len, uint8_t type,
+      uint32_t session, unsigned count);
+
+bool netplay_relay_parse_control(const uint8_t *msg, size_t len,
+      uint8_t *type, uint32_t *session, unsigned *count);
+
+void netplay_relay_link_reset(netplay_relay_link_t *link,
+      unsigned acked, int64_t now);
+
+void netplay_relay_link_ack(netplay_relay_link_t *link, unsigned count,
+      int64_t now);
+
+/**
+ * netplay_relay_link_poll
+ * @end                  : frames the destination may have by now
+ *
+ * Send what the destination is missing, at most @max_packets messages.
+ * Returns the messages sent.
+ */
+unsigned netplay_relay_link_poll(netplay_relay_link_t *link,
+      const netplay_relay_stream_t *s, unsigned end, int64_t now,
+      unsigned max_packets, netplay_relay_send_t send, void *data);
+
+RETRO_END_DECLS
+
+#endif
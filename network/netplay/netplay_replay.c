@@ -0,0 +1,542 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2021 - Daniel De Matteis
+ *  Copyright (C) 2024-2025 - Jamie Meyer
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libretro.h>
+#include <retro_endianness.h>
+#include <streams/file_stream.h>
+
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include "../../verbosity.h"
+
+#ifdef HAVE_BSV_MOVIE
+#include "../../input/bsv/bsvmovie.h"
+#endif
+
+#include "netplay_replay.h"
+
+#ifdef HAVE_BSV_MOVIE
+
+/* Same tuning the regular recorder writes into its header, so that
+ * playback sets up its checkpoint indices the usual way */
+#define NETPLAY_REPLAY_COMMIT_INTERVAL   4
+#define NETPLAY_REPLAY_COMMIT_THRESHOLD  2
+#define NETPLAY_REPLAY_SUPERBLOCK_SIZE   16
+#define NETPLAY_REPLAY_BLOCK_SIZE        16384
+#define NETPLAY_REPLAY_SMALL_STATE       (1 << 20)
+#define NETPLAY_REPLAY_SMALL_BLOCK_SIZE  128
+
+/* Input events the player keeps per frame */
+#define NETPLAY_REPLAY_MAX_EVENTS        512
+/* Frames kept for rollbacks, whatever the prediction window says */
+#define NETPLAY_REPLAY_MAX_RING          258
+
+struct netplay_replay
+{
+   RFILE                 *file;
+   netplay_input_layout_t layout;
+   netplay_input_port_t  *ports;
+   unsigned               port_count;
+   unsigned               players;
+   unsigned               window;
+   unsigned               batch_frames;
+   uint32_t               content_crc;
+
+   /* Raw frame inputs not yet final, indexed by frame % ring_size */
+   uint8_t               *ring;
+   int                   *ring_frames;
+   size_t                 record_len;
+   unsigned               ring_size;
+   /* Next frame to turn into a replay frame, and the newest one seen */
+   int                    next_frame;
+   int                    newest_frame;
+
+   /* Encoded frames not yet handed to the writer */
+   uint8_t               *batch;
+   size_t                 batch_len;
+   size_t                 batch_capacity;
+   unsigned               batch_count;
+   /* Length of the previous frame, its back reference */
+   uint32_t               last_len;
+
+   bsv_input_data_t       events[NETPLAY_REPLAY_MAX_EVENTS];
+   unsigned               event_count;
+   uint64_t               dropped_events;
+
+   uint64_t               frames;
+   bool                   started;
+   bool                   failed;
+
+#ifdef HAVE_THREADS
+   sthread_t             *thread;
+   slock_t               *lock;
+   scond_t               *cond;
+   /* Batch owned by the writer while pending_len is non-zero */
+   uint8_t               *pending;
+   size_t                 pending_len;
+   size_t                 pending_capacity;
+   bool                   write_failed;
+   bool                   quit;
+#endif
+};
+
+static bool netplay_replay_reserve(netplay_replay_t *replay, size_t len)
+{
+   uint8_t *batch;
+   size_t capacity;
+
+   if (replay->batch_len + len <= replay->batch_capacity)
+      return true;
+
+   capacity = replay->batch_capacity ? replay->batch_capacity : 4096;
+   while (capacity < replay->batch_len + len)
+      capacity *= 2;
+
+   if (!(batch = (uint8_t*)realloc(replay->batch, capacity)))
+      return false;
+
+   replay->batch          = batch;
+   replay->batch_capacity = capacity;
+   return true;
+}
+
+static void netplay_replay_put(netplay_replay_t *replay,
+      const void *data, size_t len)
+{
+   memcpy(replay->batch + replay->batch_len, data, len);
+   replay->batch_len += len;
+}
+
+static bool netplay_replay_write(RFILE *file, const uint8_t *data,
+      size_t len)
+{
+   if (filestream_write(file, data, len) == (int64_t)len)
+      return true;
+   RARCH_ERR("[Netplay] Writing the netplay replay failed; recording stopped.\n");
+   return false;
+}
+
+#ifdef HAVE_THREADS
+static void netplay_replay_thread(void *data)
+{
+   bool ok                  = true;
+   netplay_replay_t *replay = (netplay_replay_t*)data;
+
+   slock_lock(replay->lock);
+   for (;;)
+   {
+      while (!replay->pending_len && !replay->quit)
+         scond_wait(replay->cond, replay->lock);
+      if (!replay->pending_len)
+         break;
+
+      /* The buffer is ours until pending_len drops back to 0 */
+      slock_unlock(replay->lock);
+      if (ok)
+         ok = netplay_replay_write(replay->file, replay->pending,
+               replay->pending_len);
+      slock_lock(replay->lock);
+
+      replay->pending_len = 0;
+      replay->write_failed = !ok;
+      scond_signal(replay->cond);
+   }
+   slock_unlock(replay->lock);
+}
+#endif
+
+/* Pass the batch to the writer. A writer still busy with the previous
+ * batch is not waited for unless @wait is set; the frames then simply
+ * stay in the batch until the next attempt. */
+static void netplay_replay_hand_off(netplay_replay_t *replay, bool wait)
+{
+#ifdef HAVE_THREADS
+   if (replay->thread)
+   {
+      slock_lock(replay->lock);
+      while (wait && replay->pending_len)
+         scond_wait(replay->cond, replay->lock);
+      if (replay->write_failed)
+         replay->failed = true;
+      if (!replay->pending_len && replay->batch_len)
+      {
+         uint8_t *buf                = replay->pending;
+         size_t capacity             = replay->pending_capacity;
+         replay->pending             = replay->batch;
+         replay->pending_capacity    = replay->batch_capacity;
+         replay->pending_len         = replay->batch_len;
+         replay->batch               = buf;
+         replay->batch_capacity      = capacity;
+         replay->batch_len           = 0;
+         replay->batch_count         = 0;
+         scond_signal(replay->cond);
+      }
+      slock_unlock(replay->lock);
+      return;
+   }
+#endif
+
+   if (!replay->failed && replay->batch_len)
+      replay->failed = !netplay_replay_write(replay->file,
+            replay->batch, replay->batch_len);
+   replay->batch_len   = 0;
+   replay->batch_count = 0;
+}
+
+static void netplay_replay_event(void *data,
+      unsigned device, unsigned idx, unsigned id, int16_t value)
+{
+   bsv_input_data_t *evt;
+   netplay_replay_t *replay = (netplay_replay_t*)data;
+
+   if (replay->event_count >= NETPLAY_REPLAY_MAX_EVENTS)
+   {
+      replay->dropped_events++;
+      return;
+   }
+
+   evt            = &replay->events[replay->event_count++];
+   evt->port      = 0;
+   evt->device    = (uint8_t)device;
+   evt->idx       = (uint8_t)idx;
+   evt->_padding  = 0;
+   evt->id        = swap_if_big16((uint16_t)id);
+   evt->value     = swap_if_big16(value);
+}
+
+/* Append one replay frame holding every value the core could read
+ * from @inputs; NULL writes a frame without input. */
+static void netplay_replay_encode(netplay_replay_t *replay,
+      const uint8_t *inputs)
+{
+   unsigned p, first, i;
+   uint8_t  key_count = 0;
+   uint8_t  token     = REPLAY_TOKEN_REGULAR_FRAME;
+   uint16_t count;
+   uint32_t backref;
+   uint32_t len;
+   uint64_t keys      = 0;
+
+   replay->event_count = 0;
+
+   if (inputs)
+   {
+      netplay_input_decode(&replay->layout, inputs, replay->record_len,
+            replay->players, replay->ports, &keys);
+
+      for (p = 0; p < replay->port_count; p++)
+      {
+         first = replay->event_count;
+         netplay_input_enumerate(&replay->layout, &replay->ports[p], 0,
+               netplay_replay_event, replay);
+         for (i = first; i < replay->event_count; i++)
+            replay->events[i].port = (uint8_t)p;
+      }
+      /* Keyboard queries are answered the same on every port; record
+       * them where cores ask, on port 0 */
+      netplay_input_enumerate(&replay->layout, NULL, keys,
+            netplay_replay_event, replay);
+   }
+
+   len = (uint32_t)(sizeof(uint32_t) + 1 + sizeof(uint16_t)
+         + replay->event_count * sizeof(bsv_input_data_t) + 1);
+   if (!netplay_replay_reserve(replay, len))
+   {
+      RARCH_ERR("[Netplay] Out of memory while recording the netplay replay.\n");
+      replay->failed = true;
+      return;
+   }
+
+   backref = swap_if_big32(replay->last_len);
+   count   = swap_if_big16((uint16_t)replay->event_count);
+   netplay_replay_put(replay, &backref, sizeof(backref));
+   netplay_replay_put(replay, &key_count, 1);
+   netplay_replay_put(replay, &count, sizeof(count));
+   netplay_replay_put(replay, replay->events,
+         replay->event_count * sizeof(bsv_input_data_t));
+   netplay_replay_put(replay, &token, 1);
+
+   replay->last_len = len;
+   replay->frames++;
+   replay->batch_count++;
+}
+
+/* Encode every frame up to and including @last */
+static void netplay_replay_commit(netplay_replay_t *replay, int last)
+{
+   while (!replay->failed && replay->next_frame <= last)
+   {
+      unsigned slot = (unsigned)replay->next_frame % replay->ring_size;
+
+      if (replay->ring_frames[slot] == replay->next_frame)
+         netplay_replay_encode(replay,
+               replay->ring + slot * replay->record_len);
+      else
+      {
+         RARCH_WARN("[Netplay] Replay is missing the inputs of frame %d.\n",
+               replay->next_frame);
+         netplay_replay_encode(replay, NULL);
+      }
+      replay->next_frame++;
+
+      if (replay->batch_count >= replay->batch_frames)
+         netplay_replay_hand_off(replay, false);
+   }
+}
+
+netplay_replay_t *netplay_replay_new(const char *path,
+      const netplay_input_layout_t *layout, unsigned players,
+      unsigned window, unsigned batch_frames, uint32_t content_crc)
+{
+   unsigned i;
+   netplay_replay_t *replay;
+
+   if (!path || !*path || !layout || !players || !layout->record_size)
+      return NULL;
+
+   if (!(replay = (netplay_replay_t*)calloc(1, sizeof(*replay))))
+      return NULL;
+
+   replay->layout       = *layout;
+   replay->players      = players;
+   replay->port_count   = players * layout->ports;
+   replay->window       = window;
+   replay->batch_frames = batch_frames ? batch_frames : 1;
+   replay->content_crc  = content_crc;
+   replay->record_len   = (size_t)layout->record_size * players;
+   replay->ring_size    = window + 2;
+   if (replay->ring_size > NETPLAY_REPLAY_MAX_RING)
+      replay->ring_size = NETPLAY_REPLAY_MAX_RING;
+   replay->newest_frame = -1;
+
+   replay->ports        = (netplay_input_port_t*)calloc(
+         replay->port_count, sizeof(*replay->ports));
+   replay->ring         = (uint8_t*)malloc(
+         replay->ring_size * replay->record_len);
+   replay->ring_frames  = (int*)malloc(
+         replay->ring_size * sizeof(*replay->ring_frames));
+   if (!replay->ports || !replay->ring || !replay->ring_frames)
+      goto error;
+   for (i = 0; i < replay->ring_size; i++)
+      replay->ring_frames[i] = -1;
+
+   if (!(replay->file = filestream_open(path, RETRO_VFS_FILE_ACCESS_WRITE,
+         RETRO_VFS_FILE_ACCESS_HINT_NONE)))
+   {
+      RARCH_ERR("[Netplay] Could not create netplay replay \"%s\".\n", path);
+      goto error;
+   }
+
+#ifdef HAVE_THREADS
+   replay->lock = slock_new();
+   replay->cond = scond_new();
+   if (replay->lock && replay->cond)
+      replay->thread = sthread_create(netplay_replay_thread, replay);
+   if (!replay->thread)
+   {
+      RARCH_WARN("[Netplay] No replay writer thread; writing inline.\n");
+      if (replay->cond)
+         scond_free(replay->cond);
+      if (replay->lock)
+         slock_free(replay->lock);
+      replay->cond = NULL;
+      replay->lock = NULL;
+   }
+#endif
+
+   return replay;
+
+error:
+   free(replay->ring_frames);
+   free(replay->ring);
+   free(replay->ports);
+   free(replay);
+   return NULL;
+}
+
+bool netplay_replay_start(netplay_replay_t *replay, int frame,
+      const void *state, size_t len)
+{
+   uint32_t header[REPLAY_HEADER_LEN];
+   uint32_t sizes[3];
+   uint8_t  compression = REPLAY_CHECKPOINT2_COMPRESSION_NONE;
+   uint8_t  encoding    = REPLAY_CHECKPOINT2_ENCODING_RAW;
+   int64_t  identifier  = swap_if_big64((int64_t)time(NULL));
+
+   if (!replay || replay->started || !state || !len || frame < 0)
+      return false;
+
+   memset(header, 0, sizeof(header));
+   header[REPLAY_HEADER_MAGIC_INDEX]      = swap_if_big32(REPLAY_MAGIC);
+   header[REPLAY_HEADER_VERSION_INDEX]    = swap_if_big32(REPLAY_FORMAT_VERSION);
+   header[REPLAY_HEADER_CRC_INDEX]        = swap_if_big32(replay->content_crc);
+   header[REPLAY_HEADER_STATE_SIZE_INDEX] = swap_if_big32(
+         (uint32_t)(2 + sizeof(sizes) + len));
+   memcpy(header + REPLAY_HEADER_IDENTIFIER_INDEX, &identifier,
+         sizeof(identifier));
+   header[REPLAY_HEADER_BLOCK_SIZE_INDEX] = swap_if_big32(
+         len < NETPLAY_REPLAY_SMALL_STATE
+         ? NETPLAY_REPLAY_SMALL_BLOCK_SIZE : NETPLAY_REPLAY_BLOCK_SIZE);
+   header[REPLAY_HEADER_SUPERBLOCK_SIZE_INDEX] =
+         swap_if_big32(NETPLAY_REPLAY_SUPERBLOCK_SIZE);
+   header[REPLAY_HEADER_CHECKPOINT_CONFIG_INDEX] =
+           ((uint32_t)NETPLAY_REPLAY_COMMIT_INTERVAL  << 24)
+         | ((uint32_t)NETPLAY_REPLAY_COMMIT_THRESHOLD << 16)
+         | ((uint32_t)compression << 8);
+
+   /* Uncompressed, encoded and compressed sizes are all the same for
+    * a raw checkpoint */
+   sizes[0] = sizes[1] = sizes[2] = swap_if_big32((uint32_t)len);
+
+   if (!netplay_replay_reserve(replay,
+         sizeof(header) + 2 + sizeof(sizes) + len))
+      return false;
+
+   netplay_replay_put(replay, header, sizeof(header));
+   netplay_replay_put(replay, &compression, 1);
+   netplay_replay_put(replay, &encoding, 1);
+   netplay_replay_put(replay, sizes, sizeof(sizes));
+   netplay_replay_put(replay, state, len);
+
+   replay->started    = true;
+   replay->next_frame = frame;
+   if (replay->newest_frame - (int)replay->window > frame)
+      netplay_replay_commit(replay,
+            replay->newest_frame - (int)replay->window - 1);
+
+   RARCH_LOG("[Netplay] Recording netplay replay from frame %d.\n", frame);
+   return true;
+}
+
+bool netplay_replay_started(const netplay_replay_t *replay)
+{
+   return replay && replay->started;
+}
+
+void netplay_replay_input(netplay_replay_t *replay, int frame,
+      const uint8_t *inputs, size_t len)
+{
+   unsigned slot;
+
+   if (!replay || replay->failed || !inputs || frame < 0)
+      return;
+   if (replay->started && frame < replay->next_frame)
+      return;
+
+   slot = (unsigned)frame % replay->ring_size;
+   memset(replay->ring + slot * replay->record_len, 0, replay->record_len);
+   memcpy(replay->ring + slot * replay->record_len, inputs,
+         len < replay->record_len ? len : replay->record_len);
+   replay->ring_frames[slot] = frame;
+
+   if (frame > replay->newest_frame)
+      replay->newest_frame = frame;
+
+   if (replay->started)
+      netplay_replay_commit(replay,
+            replay->newest_frame - (int)replay->window - 1);
+}
+
+uint64_t netplay_replay_free(netplay_replay_t *replay)
+{
+   uint32_t count;
+   uint64_t frames;
+
+   if (!replay)
+      return 0;
+
+   /* Frames still open to rollback are written as last seen */
+   if (replay->started)
+      netplay_replay_commit(replay, replay->newest_frame);
+   netplay_replay_hand_off(replay, true);
+
+#ifdef HAVE_THREADS
+   if (replay->thread)
+   {
+      slock_lock(replay->lock);
+      replay->quit = true;
+      scond_signal(replay->cond);
+      slock_unlock(replay->lock);
+      sthread_join(replay->thread);
+      scond_free(replay->cond);
+      slock_free(replay->lock);
+   }
+   free(replay->pending);
+#endif
+
+   frames = replay->frames;
+   if (replay->started && !replay->failed)
+   {
+      count = swap_if_big32((uint32_t)frames);
+      filestream_seek(replay->file,
+            REPLAY_HEADER_FRAME_COUNT_INDEX * sizeof(uint32_t),
+            RETRO_VFS_SEEK_POSITION_START);
+      filestream_write(replay->file, &count, sizeof(count));
+   }
+   if (replay->dropped_events)
+      RARCH_WARN("[Netplay] Replay dropped %llu input events beyond %u per frame.\n",
+            (unsigned long long)replay->dropped_events,
+            NETPLAY_REPLAY_MAX_EVENTS);
+
+   filestream_close(replay->file);
+   free(replay->batch);
+   free(replay->ring_frames);
+   free(replay->ring);
+   free(replay->ports);
+   free(replay);
+   return frames;
+}
+
+#else
+
+netplay_replay_t *netplay_replay_new(const char *path,
+      const netplay_input_layout_t *layout, unsigned players,
+      unsigned window, unsigned batch_frames, uint32_t content_crc)
+{
+   return NULL;
+}
+
+bool netplay_replay_start(netplay_replay_t *replay, int frame,
+      const void *state, size_t len)
+{
+   return false;
+}
+
+bool netplay_replay_started(const netplay_replay_t *replay)
+{
+   return false;
+}
+
+void netplay_replay_input(netplay_replay_t *replay, int frame,
+      const uint8_t *inputs, size_t len) { }
+
+uint64_t netplay_replay_free(netplay_replay_t *replay)
+{
+   return 0;
+}
+
+#endif
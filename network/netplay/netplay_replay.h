@@ -0,0 +1,81 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2021 - Daniel De Matteis
+ *  Copyright (C) 2024-2025 - Jamie Meyer
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RARCH_NETPLAY_REPLAY_H
+#define __RARCH_NETPLAY_REPLAY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <boolean.h>
+#include <retro_common_api.h>
+
+#include "netplay_input.h"
+
+RETRO_BEGIN_DECLS
+
+typedef struct netplay_replay netplay_replay_t;
+
+/**
+ * netplay_replay_new
+ * @players              : records per GekkoNet frame
+ * @window               : input prediction window; a frame is final once
+ *                         the session is this many frames past it
+ * @batch_frames         : frames handed to the writer at once
+ *
+ * Open @path for a BSV replay (REPLAY_FORMAT_VERSION 2) of a netplay
+ * session. Nothing is written until netplay_replay_start().
+ *
+ * Returns NULL if the file could not be created.
+ */
+netplay_replay_t *netplay_replay_new(const char *path,
+      const netplay_input_layout_t *layout, unsigned players,
+      unsigned window, unsigned batch_frames, uint32_t content_crc);
+
+/**
+ * netplay_replay_start
+ *
+ * Begin the replay with @state as the state @frame starts from.
+ * Inputs of earlier frames are ignored.
+ */
+bool netplay_replay_start(netplay_replay_t *replay, int frame,
+      const void *state, size_t len);
+
+bool netplay_replay_started(const netplay_replay_t *replay);
+
+/**
+ * netplay_replay_input
+ * @inputs               : the whole frame, as delivered by an AdvanceEvent
+ *
+ * Remember the inputs of @frame. Frames run again by a rollback
+ * replace what was stored; frames that can no longer be rolled back
+ * are turned into replay frames and batched for the writer.
+ */
+void netplay_replay_input(netplay_replay_t *replay, int frame,
+      const uint8_t *inputs, size_t len);
+
+/**
+ * netplay_replay_free
+ *
+ * Write the frames still pending, close the file and stop the writer.
+ * Returns the number of frames in the replay.
+ */
+uint64_t netplay_replay_free(netplay_replay_t *replay);
+
+RETRO_END_DECLS
+
+#endif
@@ -0,0 +1,296 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2021 - Daniel De Matteis
+ *  Copyright (C) 2024-2025 - Jamie Meyer
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <streams/file_stream.h>
+
+#include "netplay_telemetry.h"
+
+#define NETPLAY_TELEMETRY_WINDOW_USEC 1000000
+
+void netplay_telemetry_init(netplay_telemetry_t *t, bool keep_rows)
+{
+   if (!t)
+      return;
+
+   free(t->rows);
+   memset(t, 0, sizeof(*t));
+   t->keep_rows    = keep_rows;
+   t->window_start = -1;
+}
+
+void netplay_telemetry_free(netplay_telemetry_t *t)
+{
+   if (!t)
+      return;
+
+   free(t->rows);
+   t->rows         = NULL;
+   t->row_count    = 0;
+   t->row_capacity = 0;
+}
+
+void netplay_telemetry_add_save(netplay_telemetry_t *t, uint32_t usec)
+{
+   if (!t)
+      return;
+   t->saves++;
+   t->save_usec_total += usec;
+   t->frame_save_usec += usec;
+   if (usec > t->save_usec_max)
+      t->save_usec_max = usec;
+}
+
+void netplay_telemetry_add_load(netplay_telemetry_t *t, uint32_t usec)
+{
+   if (!t)
+      return;
+   t->loads++;
+   t->load_usec_total += usec;
+   t->frame_load_usec += usec;
+   if (usec > t->load_usec_max)
+      t->load_usec_max = usec;
+}
+
+void netplay_telemetry_add_resim(netplay_telemetry_t *t, uint32_t usec)
+{
+   if (!t)
+      return;
+   t->resim_usec_total += usec;
+   t->frame_resim_usec += usec;
+}
+
+void netplay_telemetry_add_rollback(netplay_telemetry_t *t, unsigned depth)
+{
+   unsigned bucket;
+
+   if (!t || !depth)
+      return;
+
+   bucket = depth < NETPLAY_TELEMETRY_DEPTH_BUCKETS
+      ? depth - 1 : NETPLAY_TELEMETRY_DEPTH_BUCKETS - 1;
+
+   t->rollbacks++;
+   t->rollback_frames += depth;
+   t->depth_histogram[bucket]++;
+
+   t->window.rollbacks++;
+   t->window.rollback_frames += depth;
+   if (depth > t->window.max_depth)
+      t->window.max_depth = depth;
+}
+
+void netplay_telemetry_set_peer(netplay_telemetry_t *t, int handle,
+      unsigned last_ping, float avg_ping, float jitter)
+{
+   unsigned i;
+   netplay_telemetry_peer_t *peer = NULL;
+
+   if (!t)
+      return;
+
+   for (i = 0; i < t->peer_count; i++)
+   {
+      if (t->peers[i].handle == handle)
+      {
+         peer = &t->peers[i];
+         break;
+      }
+   }
+
+   if (!peer)
+   {
+      if (t->peer_count >= NETPLAY_TELEMETRY_MAX_PEERS)
+         return;
+      peer         = &t->peers[t->peer_count++];
+      peer->handle = handle;
+   }
+
+   peer->last_ping = last_ping;
+   peer->avg_ping  = avg_ping;
+   peer->jitter    = jitter;
+}
+
+static void netplay_telemetry_store_row(netplay_telemetry_t *t,
+      const netplay_telemetry_row_t *row)
+{
+   if (!t->keep_rows || t->row_count >= NETPLAY_TELEMETRY_MAX_ROWS)
+      return;
+
+   if (t->row_count == t->row_capacity)
+   {
+      size_t capacity = t->row_capacity ? t->row_capacity * 2 : 256;
+      netplay_telemetry_row_t *rows = (netplay_telemetry_row_t*)
+         realloc(t->rows, capacity * sizeof(*rows));
+      if (!rows)
+         return;
+      t->rows         = rows;
+      t->row_capacity = capacity;
+   }
+
+   t->rows[t->row_count++] = *row;
+}
+
+static void netplay_telemetry_close_window(netplay_telemetry_t *t)
+{
+   unsigned i;
+   netplay_telemetry_row_t *w = &t->window;
+
+   if (w->frames)
+   {
+      w->save_usec  /= w->frames;
+      w->load_usec  /= w->frames;
+      w->resim_usec /= w->frames;
+   }
+
+   w->frames_ahead = t->frames_ahead;
+   w->ping_ms      = 0.0f;
+   w->jitter_ms    = 0.0f;
+   for (i = 0; i < t->peer_count; i++)
+   {
+      if (t->peers[i].avg_ping > w->ping_ms)
+         w->ping_ms   = t->peers[i].avg_ping;
+      if (t->peers[i].jitter > w->jitter_ms)
+         w->jitter_ms = t->peers[i].jitter;
+   }
+
+   t->last = *w;
+   netplay_telemetry_store_row(t, w);
+
+   memset(w, 0, sizeof(*w));
+   w->second = t->last.second + 1;
+}
+
+void netplay_telemetry_end_frame(netplay_telemetry_t *t,
+      float frames_ahead, int64_t now)
+{
+   uint32_t frame_usec;
+
+   if (!t)
+      return;
+
+   if (t->window_start < 0)
+      t->window_start = now;
+
+   frame_usec = t->frame_save_usec + t->frame_load_usec
+      + t->frame_resim_usec;
+
+   t->frames++;
+   t->frames_ahead = frames_ahead;
+   if (t->frame_resim_usec > t->resim_usec_max)
+      t->resim_usec_max = t->frame_resim_usec;
+
+   t->window.frames++;
+   t->window.save_usec  += t->frame_save_usec;
+   t->window.load_usec  += t->frame_load_usec;
+   t->window.resim_usec += t->frame_resim_usec;
+   if (frame_usec > t->window.frame_usec_max)
+      t->window.frame_usec_max = frame_usec;
+
+   t->frame_save_usec  = 0;
+   t->frame_load_usec  = 0;
+   t->frame_resim_usec = 0;
+
+   if (now - t->window_start >= NETPLAY_TELEMETRY_WINDOW_USEC)
+   {
+      t->window_start = now;
+      netplay_telemetry_close_window(t);
+   }
+}
+
+size_t netplay_telemetry_describe(const netplay_telemetry_t *t,
+      char *s, size_t len)
+{
+   unsigned i;
+   size_t _len;
+
+   if (!t || !s || !len)
+      return 0;
+
+   _len = (size_t)snprintf(s, len,
+         "rollbacks_per_sec=%u max_depth=%u save_usec=%u load_usec=%u"
+         " resim_usec=%u frame_usec_max=%u frames_ahead=%.2f"
+         " frames=%llu rollbacks=%llu rollback_frames=%llu"
+         " save_usec_max=%u load_usec_max=%u resim_usec_max=%u"
+         " depth_histogram=",
+         (unsigned)t->last.rollbacks, (unsigned)t->last.max_depth,
+         (unsigned)t->last.save_usec, (unsigned)t->last.load_usec,
+         (unsigned)t->last.resim_usec, (unsigned)t->last.frame_usec_max,
+         t->frames_ahead,
+         (unsigned long long)t->frames,
+         (unsigned long long)t->rollbacks,
+         (unsigned long long)t->rollback_frames,
+         (unsigned)t->save_usec_max, (unsigned)t->load_usec_max,
+         (unsigned)t->resim_usec_max);
+
+   for (i = 0; i < NETPLAY_TELEMETRY_DEPTH_BUCKETS && _len < len; i++)
+      _len += (size_t)snprintf(s + _len, len - _len, "%s%llu",
+            i ? "," : "", (unsigned long long)t->depth_histogram[i]);
+
+   for (i = 0; i < t->peer_count && _len < len; i++)
+      _len += (size_t)snprintf(s + _len, len - _len,
+            " peer%d_ping=%u peer%d_avg_ping=%.1f peer%d_jitter=%.1f",
+            t->peers[i].handle, t->peers[i].last_ping,
+            t->peers[i].handle, t->peers[i].avg_ping,
+            t->peers[i].handle, t->peers[i].jitter);
+
+   return _len < len ? _len : len - 1;
+}
+
+bool netplay_telemetry_write_csv(const netplay_telemetry_t *t,
+      const char *path)
+{
+   size_t i;
+   RFILE *file;
+
+   if (!t || !path || !*path)
+      return false;
+
+   if (!(file = filestream_open(path, RETRO_VFS_FILE_ACCESS_WRITE,
+         RETRO_VFS_FILE_ACCESS_HINT_NONE)))
+      return false;
+
+   filestream_printf(file,
+         "second,frames,rollbacks,rollback_frames,max_depth,"
+         "save_usec,load_usec,resim_usec,frame_usec_max,"
+         "frames_ahead,ping_ms,jitter_ms\n");
+
+   for (i = 0; i < t->row_count; i++)
+   {
+      const netplay_telemetry_row_t *row = &t->rows[i];
+      filestream_printf(file,
+            "%u,%u,%u,%u,%u,%u,%u,%u,%u,%.2f,%.1f,%.1f\n",
+            (unsigned)row->second, (unsigned)row->frames,
+            (unsigned)row->rollbacks, (unsigned)row->rollback_frames,
+            (unsigned)row->max_depth, (unsigned)row->save_usec,
+            (unsigned)row->load_usec, (unsigned)row->resim_usec,
+            (unsigned)row->frame_usec_max, row->frames_ahead,
+            row->ping_ms, row->jitter_ms);
+   }
+
+   filestream_printf(file, "\nrollback_depth,count\n");
+   for (i = 0; i < NETPLAY_TELEMETRY_DEPTH_BUCKETS; i++)
+      filestream_printf(file, "%u%s,%llu\n", (unsigned)(i + 1),
+            i == NETPLAY_TELEMETRY_DEPTH_BUCKETS - 1 ? "+" : "",
+            (unsigned long long)t->depth_histogram[i]);
+
+   filestream_close(file);
+   return true;
+}
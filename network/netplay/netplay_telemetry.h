@@ -0,0 +1,158 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2021 - Daniel De Matteis
+ *  Copyright (C) 2024-2025 - Jamie Meyer
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RARCH_NETPLAY_TELEMETRY_H
+#define __RARCH_NETPLAY_TELEMETRY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <boolean.h>
+#include <retro_common_api.h>
+
+RETRO_BEGIN_DECLS
+
+/* Rollback depths 1..15 get their own bucket; the last one is 16+ */
+#define NETPLAY_TELEMETRY_DEPTH_BUCKETS 16
+#define NETPLAY_TELEMETRY_MAX_PEERS     8
+/* One day of one-second rows */
+#define NETPLAY_TELEMETRY_MAX_ROWS      86400
+
+typedef struct netplay_telemetry_peer
+{
+   int      handle;
+   unsigned last_ping;
+   float    avg_ping;
+   float    jitter;
+} netplay_telemetry_peer_t;
+
+/* One second of play. Timings are per frame averages, except for
+ * frame_usec_max which is the slowest frame of the second. */
+typedef struct netplay_telemetry_row
+{
+   uint32_t second;
+   uint32_t frames;
+   uint32_t rollbacks;
+   uint32_t rollback_frames;
+   uint32_t max_depth;
+   uint32_t save_usec;
+   uint32_t load_usec;
+   uint32_t resim_usec;
+   uint32_t frame_usec_max;
+   float    frames_ahead;
+   /* Worst remote peer */
+   float    ping_ms;
+   float    jitter_ms;
+} netplay_telemetry_row_t;
+
+/* Where the frontend's time goes during a rollback session, split
+ * between the network (ping, jitter, frames ahead) and the core
+ * (serialization and resimulation cost). */
+typedef struct netplay_telemetry
+{
+   /* Whole session */
+   uint64_t frames;
+   uint64_t rollbacks;
+   uint64_t rollback_frames;
+   uint64_t depth_histogram[NETPLAY_TELEMETRY_DEPTH_BUCKETS];
+   uint64_t saves;
+   uint64_t loads;
+   uint64_t save_usec_total;
+   uint64_t load_usec_total;
+   uint64_t resim_usec_total;
+   uint32_t save_usec_max;
+   uint32_t load_usec_max;
+   uint32_t resim_usec_max;
+
+   /* Spent on the frame being built */
+   uint32_t frame_save_usec;
+   uint32_t frame_load_usec;
+   uint32_t frame_resim_usec;
+
+   /* Open one-second window; timings are sums until it closes */
+   int64_t  window_start;
+   netplay_telemetry_row_t window;
+   /* Last closed window, as shown on screen */
+   netplay_telemetry_row_t last;
+
+   float    frames_ahead;
+   netplay_telemetry_peer_t peers[NETPLAY_TELEMETRY_MAX_PEERS];
+   unsigned peer_count;
+
+   /* Every closed window, kept for the CSV dump */
+   netplay_telemetry_row_t *rows;
+   size_t   row_count;
+   size_t   row_capacity;
+   bool     keep_rows;
+} netplay_telemetry_t;
+
+void netplay_telemetry_init(netplay_telemetry_t *t, bool keep_rows);
+
+void netplay_telemetry_free(netplay_telemetry_t *t);
+
+void netplay_telemetry_add_save(netplay_telemetry_t *t, uint32_t usec);
+
+void netplay_telemetry_add_load(netplay_telemetry_t *t, uint32_t usec);
+
+/**
+ * netplay_telemetry_add_resim
+ *
+ * Account for one frame run without presentation, whether it is part
+ * of a rollback or a catch-up.
+ */
+void netplay_telemetry_add_resim(netplay_telemetry_t *t, uint32_t usec);
+
+/**
+ * netplay_telemetry_add_rollback
+ * @depth                : frames replayed by the rollback
+ */
+void netplay_telemetry_add_rollback(netplay_telemetry_t *t, unsigned depth);
+
+void netplay_telemetry_set_peer(netplay_telemetry_t *t, int handle,
+      unsigned last_ping, float avg_ping, float jitter);
+
+/**
+ * netplay_telemetry_end_frame
+ * @now                  : current time in microseconds
+ *
+ * Close the frame built since the previous call. Once a second has
+ * passed, the window is averaged into t->last and stored as a row.
+ */
+void netplay_telemetry_end_frame(netplay_telemetry_t *t,
+      float frames_ahead, int64_t now);
+
+/**
+ * netplay_telemetry_describe
+ *
+ * Writes the last second, the session totals, the rollback depth
+ * histogram and every peer as space separated key=value pairs.
+ */
+size_t netplay_telemetry_describe(const netplay_telemetry_t *t,
+      char *s, size_t len);
+
+/**
+ * netplay_telemetry_write_csv
+ *
+ * Dump one line per second of play, followed by the rollback depth
+ * histogram. Returns false if the file could not be written.
+ */
+bool netplay_telemetry_write_csv(const netplay_telemetry_t *t,
+      const char *path);
+
+RETRO_END_DECLS
+
+#endif
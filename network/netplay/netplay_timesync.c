@@ -0,0 +1,106 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2021 - Daniel De Matteis
+ *  Copyright (C) 2024-2025 - Jamie Meyer
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "netplay_timesync.h"
+
+/* Weight of a new sample in the moving average; GekkoNet's estimate
+ * moves in whole frames as packets arrive, so it needs damping. */
+#define NETPLAY_TIMESYNC_SMOOTHING 0.1f
+
+void netplay_timesync_reset(netplay_timesync_t *ts)
+{
+   if (ts)
+      memset(ts, 0, sizeof(*ts));
+}
+
+void netplay_timesync_update(netplay_timesync_t *ts, float frames_ahead)
+{
+   float excess;
+
+   if (!ts)
+      return;
+
+   ts->frames_ahead = frames_ahead;
+   ts->smoothed    += (frames_ahead - ts->smoothed)
+      * NETPLAY_TIMESYNC_SMOOTHING;
+
+   if (ts->smoothed > NETPLAY_TIMESYNC_DEADZONE)
+      excess = ts->smoothed - NETPLAY_TIMESYNC_DEADZONE;
+   else if (ts->smoothed < -NETPLAY_TIMESYNC_DEADZONE)
+      excess = ts->smoothed + NETPLAY_TIMESYNC_DEADZONE;
+   else
+      excess = 0.0f;
+
+   ts->frame_adjust_usec = (int)(excess * NETPLAY_TIMESYNC_USEC_PER_FRAME);
+   if (ts->frame_adjust_usec > NETPLAY_TIMESYNC_MAX_ADJUST_USEC)
+      ts->frame_adjust_usec = NETPLAY_TIMESYNC_MAX_ADJUST_USEC;
+   else if (ts->frame_adjust_usec < -NETPLAY_TIMESYNC_MAX_ADJUST_USEC)
+      ts->frame_adjust_usec = -NETPLAY_TIMESYNC_MAX_ADJUST_USEC;
+}
+
+int netplay_timesync_consume_adjust(netplay_timesync_t *ts)
+{
+   if (!ts)
+      return 0;
+   ts->adjust_consumed = true;
+   return ts->frame_adjust_usec;
+}
+
+enum netplay_timesync_action netplay_timesync_next_action(
+      netplay_timesync_t *ts, int frame_usec)
+{
+   if (!ts)
+      return NETPLAY_TIMESYNC_RUN;
+
+   /* Whatever the frame limiter did not absorb last frame is owed */
+   if (!ts->frame_adjust_usec)
+      ts->debt_usec  = 0;
+   else if (!ts->adjust_consumed)
+      ts->debt_usec += ts->frame_adjust_usec;
+   ts->adjust_consumed = false;
+
+   if (ts->cooldown)
+   {
+      ts->cooldown--;
+      return NETPLAY_TIMESYNC_RUN;
+   }
+
+   if (     ts->smoothed >= NETPLAY_TIMESYNC_CORRECT_FRAMES
+         || (frame_usec > 0 && ts->debt_usec >= frame_usec))
+   {
+      /* Assume the hold is worth one frame until new samples agree */
+      ts->smoothed -= 1.0f;
+      ts->debt_usec = 0;
+      ts->cooldown  = NETPLAY_TIMESYNC_COOLDOWN;
+      ts->frames_held++;
+      return NETPLAY_TIMESYNC_HOLD;
+   }
+
+   if (     ts->smoothed <= -NETPLAY_TIMESYNC_CORRECT_FRAMES
+         || (frame_usec > 0 && ts->debt_usec <= -frame_usec))
+   {
+      ts->smoothed += 1.0f;
+      ts->debt_usec = 0;
+      ts->cooldown  = NETPLAY_TIMESYNC_COOLDOWN;
+      ts->frames_skipped++;
+      return NETPLAY_TIMESYNC_SKIP;
+   }
+
+   return NETPLAY_TIMESYNC_RUN;
+}
@@ -0,0 +1,100 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2021 - Daniel De Matteis
+ *  Copyright (C) 2024-2025 - Jamie Meyer
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RARCH_NETPLAY_TIMESYNC_H
+#define __RARCH_NETPLAY_TIMESYNC_H
+
+#include <stdint.h>
+
+#include <boolean.h>
+#include <retro_common_api.h>
+
+RETRO_BEGIN_DECLS
+
+/* Frames-ahead values within this band are left alone */
+#define NETPLAY_TIMESYNC_DEADZONE        0.75f
+/* Frame time stretch per frame of advantage, and its bound */
+#define NETPLAY_TIMESYNC_USEC_PER_FRAME  250
+#define NETPLAY_TIMESYNC_MAX_ADJUST_USEC 1000
+/* Beyond this advantage a whole frame is held or skipped at once */
+#define NETPLAY_TIMESYNC_CORRECT_FRAMES  3.0f
+/* Frames to wait after a hold/skip before correcting again */
+#define NETPLAY_TIMESYNC_COOLDOWN        20
+
+enum netplay_timesync_action
+{
+   /* Run the next frame normally */
+   NETPLAY_TIMESYNC_RUN = 0,
+   /* Present the previous frame again instead of running one */
+   NETPLAY_TIMESYNC_HOLD,
+   /* Run one extra frame without presenting it */
+   NETPLAY_TIMESYNC_SKIP
+};
+
+/* Keeps the local peer from drifting ahead of (or behind) the remote
+ * one, based on GekkoNet's frames-ahead estimate. Small differences are
+ * paid back by adjusting the frame limiter; when the limiter is not in
+ * use (vsync) the adjustment is accumulated and settled with whole-frame
+ * holds and skips instead. */
+typedef struct netplay_timesync
+{
+   /* Last raw sample and its moving average, in frames.
+    * Positive means we are ahead of the remote peer. */
+   float    frames_ahead;
+   float    smoothed;
+   /* Per-frame stretch (positive) or shrink (negative) */
+   int      frame_adjust_usec;
+   /* Adjustment the frame limiter did not apply */
+   int      debt_usec;
+   unsigned cooldown;
+   uint64_t frames_held;
+   uint64_t frames_skipped;
+   /* Set once the frame limiter took frame_adjust_usec this frame */
+   bool     adjust_consumed;
+} netplay_timesync_t;
+
+void netplay_timesync_reset(netplay_timesync_t *ts);
+
+/**
+ * netplay_timesync_update
+ * @frames_ahead         : gekko_frames_ahead() sample for this frame
+ *
+ * Feed a new sample and recompute the frame time adjustment.
+ */
+void netplay_timesync_update(netplay_timesync_t *ts, float frames_ahead);
+
+/**
+ * netplay_timesync_consume_adjust
+ *
+ * Returns the number of microseconds the frame limiter should add to
+ * the current frame, and marks it as applied.
+ */
+int netplay_timesync_consume_adjust(netplay_timesync_t *ts);
+
+/**
+ * netplay_timesync_next_action
+ * @frame_usec           : nominal duration of one frame
+ *
+ * Decide whether the upcoming frame is run, held or skipped.
+ * Must be called once per frame, before the core runs.
+ */
+enum netplay_timesync_action netplay_timesync_next_action(
+      netplay_timesync_t *ts, int frame_usec);
+
+RETRO_END_DECLS
+
+#endif
@@ -106,7 +106,7 @@ do_build()
    RetroArch_DIR="$1"
    LIBZIPNAME="$2"
    BUILDTYPE="$3"
-   GEKKONET_DLL="${SCRIPT_DIR}/gekkonet/windows/lib/libGekkoNet.dll"
+   GEKKONET_DLL="${SCRIPT_DIR}/gekkonet/windows/lib/libGekkoNet_NO_ASIO.dll"
 
    if [ ! -d "$RetroArch_DIR" ]; then
       git clone git://github.com/libretro/RetroArch.git "$RetroArch_DIR"
@@ -3275,8 +3275,7 @@ bool command_event(enum event_command cmd, void *data)
          break;
       case CMD_EVENT_PREEMPT_RESET_BUFFER:
 #if HAVE_RUNAHEAD
-         if (runloop_st->preempt_data)
-            runloop_st->preempt_data->frame_count = 0;
+         runahead_reset_buffer(runloop_st);
 #endif
          break;
       case CMD_EVENT_RECORDING_TOGGLE:
@@ -3802,7 +3801,10 @@ bool command_event(enum event_command cmd, void *data)
 #ifdef HAVE_REWIND
          {
             bool rewind_enable        = settings->bools.rewind_enable;
+            bool rewind_dedup         = settings->bools.rewind_dedup;
+            bool rewind_compress      = settings->bools.rewind_compress;
             size_t rewind_buf_size    = settings->sizes.rewind_buffer_size;
+            size_t rewind_spill_size  = settings->sizes.rewind_spill_size;
             bool core_type_is_dummy   = runloop_st->current_core_type == CORE_TYPE_DUMMY;
 
             if (core_type_is_dummy)
@@ -3825,7 +3827,10 @@ bool command_event(enum event_command cmd, void *data)
 #endif
                {
                   state_manager_event_init(&runloop_st->rewind_st,
-                        (unsigned)rewind_buf_size);
+                        (unsigned)rewind_buf_size, rewind_dedup,
+                        rewind_compress, rewind_spill_size,
+                        settings->paths.directory_cache,
+                        settings->uints.rewind_seconds);
                }
             }
          }
@@ -4272,6 +4277,7 @@ bool command_event(enum event_command cmd, void *data)
 
                /* Deallocate preemptive frames */
                preempt_deinit(runloop_st);
+               runahead_auto_reset(runloop_st);
             }
 #endif
 
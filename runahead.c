@@ -29,10 +29,23 @@
 #endif
 
 #include <encodings/utf.h>
+#include <features/features_cpu.h>
+#include <memalign.h>
 #include <string/stdstring.h>
 #include <streams/file_stream.h>
 #include <time/rtime.h>
 
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
+/* dlmopen() is a GNU extension, which the Linux builds enable
+ * globally; musl and bionic do not have it */
+#if defined(HAVE_DYNAMIC) && defined(__linux__) && defined(__GLIBC__) && defined(_GNU_SOURCE)
+#include <dlfcn.h>
+#define RUNAHEAD_DLMOPEN 1
+#endif
+
 #include "configuration.h"
 #include "content.h"
 #include "core.h"
@@ -180,9 +193,300 @@ static void strcat_alloc(char **dst, const char *s)
    strcpy(src + _len, s);
 }
 
+#ifdef HAVE_THREADS
+/* RUNAHEAD - SECONDARY CORE THREAD
+ *
+ * The secondary core runs its visible frame on a worker thread while
+ * the main thread runs the real frame, betting that the input did not
+ * change. The threads only meet once the real frame is done: unchanged
+ * input presents the worker's frame, changed input drops it and the
+ * secondary core is resynced from the real frame's state as before.
+ *
+ * The worker must not touch shared frontend state, so for its run the
+ * secondary core gets callbacks of its own. Video is kept until the main
+ * thread presents it, audio is dropped and input is read from a copy of
+ * the last input taken before the real frame logs new input. Only
+ * software rendered cores can do this. */
+struct runahead_pipe
+{
+   sthread_t *thread;
+   slock_t *lock;
+   scond_t *cond;
+   /* Copy of input_state_list, input_capacity elements */
+   input_list_element *input;
+   const void *frame_data;
+   size_t frame_pitch;
+   /* Set by the worker's frame, applied on the main thread after it */
+   struct retro_system_av_info av_info;
+   struct retro_game_geometry geometry;
+   int input_count;
+   int input_capacity;
+   /* Environment command the worker had to refuse, 0 if none */
+   unsigned refused_cmd;
+   unsigned frame_width;
+   unsigned frame_height;
+   bool av_info_pending;
+   bool geometry_pending;
+   /* The core needs the main thread for its frames */
+   bool disabled;
+   bool frame;
+   bool busy;
+   bool quit;
+};
+
+static void runahead_pipe_thread(void *data)
+{
+   runloop_state_t *runloop_st = runloop_state_get_ptr();
+   runahead_pipe_t *pipe       = (runahead_pipe_t*)data;
+
+   slock_lock(pipe->lock);
+   for (;;)
+   {
+      while (!pipe->busy && !pipe->quit)
+         scond_wait(pipe->cond, pipe->lock);
+      if (pipe->quit)
+         break;
+      slock_unlock(pipe->lock);
+
+      runloop_st->secondary_core.retro_run();
+
+      slock_lock(pipe->lock);
+      pipe->busy = false;
+      scond_signal(pipe->cond);
+   }
+   slock_unlock(pipe->lock);
+}
+
+static void runahead_pipe_free(runloop_state_t *runloop_st)
+{
+   int i;
+   runahead_pipe_t *pipe = runloop_st->runahead_pipe;
+
+   if (!pipe)
+      return;
+
+   if (pipe->thread)
+   {
+      slock_lock(pipe->lock);
+      pipe->quit = true;
+      scond_signal(pipe->cond);
+      slock_unlock(pipe->lock);
+      sthread_join(pipe->thread);
+   }
+   if (pipe->cond)
+      scond_free(pipe->cond);
+   if (pipe->lock)
+      slock_free(pipe->lock);
+   for (i = 0; i < pipe->input_capacity; i++)
+      free(pipe->input[i].state);
+   free(pipe->input);
+   free(pipe);
+   runloop_st->runahead_pipe = NULL;
+}
+
+static bool runahead_pipe_on_worker(runloop_state_t *runloop_st)
+{
+   return     runloop_st->runahead_pipe
+           && runloop_st->runahead_pipe->thread
+           && sthread_isself(runloop_st->runahead_pipe->thread);
+}
+
+static void runahead_pipe_video(const void *data,
+      unsigned width, unsigned height, size_t pitch)
+{
+   runahead_pipe_t *pipe = runloop_state_get_ptr()->runahead_pipe;
+   pipe->frame_data      = data;
+   pipe->frame_width     = width;
+   pipe->frame_height    = height;
+   pipe->frame_pitch     = pitch;
+   pipe->frame           = true;
+}
+
+static void runahead_pipe_audio(int16_t left, int16_t right) { }
+
+static size_t runahead_pipe_audio_batch(const int16_t *data, size_t frames)
+{
+   return frames;
+}
+
+static void runahead_pipe_input_poll(void) { }
+
+static int16_t runahead_pipe_input_state(unsigned port,
+      unsigned device, unsigned index, unsigned id)
+{
+   int i;
+   runahead_pipe_t *pipe = runloop_state_get_ptr()->runahead_pipe;
+
+   for (i = 0; i < pipe->input_count; i++)
+   {
+      input_list_element *element = &pipe->input[i];
+      if (     (element->port   == port)
+            && (element->device == device)
+            && (element->index  == index))
+      {
+         if (id < element->state_size)
+            return element->state[id];
+         break;
+      }
+   }
+
+   return 0;
+}
+
+static bool runahead_pipe_copy_input(runahead_pipe_t *pipe,
+      const my_list *list)
+{
+   int i;
+   int count = list ? list->size : 0;
+
+   pipe->input_count = 0;
+   if (count > pipe->input_capacity)
+   {
+      input_list_element *input = (input_list_element*)realloc(
+            pipe->input, count * sizeof(*input));
+      if (!input)
+         return false;
+      memset(input + pipe->input_capacity, 0,
+            (count - pipe->input_capacity) * sizeof(*input));
+      pipe->input          = input;
+      pipe->input_capacity = count;
+   }
+
+   for (i = 0; i < count; i++)
+   {
+      const input_list_element *src = (const input_list_element*)list->data[i];
+      input_list_element *dst       = &pipe->input[i];
+
+      if (dst->state_size < src->state_size)
+      {
+         int16_t *state = (int16_t*)realloc(dst->state,
+               src->state_size * sizeof(int16_t));
+         if (!state)
+            return false;
+         dst->state      = state;
+         dst->state_size = src->state_size;
+      }
+      dst->port   = src->port;
+      dst->device = src->device;
+      dst->index  = src->index;
+      memcpy(dst->state, src->state, src->state_size * sizeof(int16_t));
+      memset(dst->state + src->state_size, 0,
+            (dst->state_size - src->state_size) * sizeof(int16_t));
+   }
+
+   pipe->input_count = count;
+   return true;
+}
+
+/**
+ * runahead_pipe_start
+ *
+ * Starts the secondary core's visible frame on the worker thread,
+ * creating the thread on first use. Returns false if the frame has to
+ * run on the main thread instead.
+ */
+static bool runahead_pipe_start(runloop_state_t *runloop_st)
+{
+   runahead_pipe_t *pipe = runloop_st->runahead_pipe;
+
+   if (!pipe)
+   {
+      if (!(pipe = (runahead_pipe_t*)calloc(1, sizeof(*pipe))))
+         return false;
+      runloop_st->runahead_pipe = pipe;
+
+      /* With a single core there is nothing to overlap; keep the
+       * threadless pipe around so this is only decided once */
+      if (cpu_features_get_core_amount() < 2)
+         RARCH_LOG("[Run-Ahead] Single CPU core, secondary instance stays on the main thread.\n");
+      else if (      !(pipe->lock   = slock_new())
+                  || !(pipe->cond   = scond_new())
+                  || !(pipe->thread = sthread_create(runahead_pipe_thread, pipe)))
+         RARCH_WARN("[Run-Ahead] Failed to start secondary instance thread.\n");
+      else
+         RARCH_LOG("[Run-Ahead] Secondary instance runs on its own thread.\n");
+   }
+
+   if (!pipe->thread || pipe->disabled)
+      return false;
+   if (!runahead_pipe_copy_input(pipe, runloop_st->input_state_list))
+      return false;
+
+   runloop_st->secondary_core.retro_set_video_refresh(runahead_pipe_video);
+   runloop_st->secondary_core.retro_set_audio_sample(runahead_pipe_audio);
+   runloop_st->secondary_core.retro_set_audio_sample_batch(
+         runahead_pipe_audio_batch);
+   runloop_st->secondary_core.retro_set_input_state(runahead_pipe_input_state);
+   runloop_st->secondary_core.retro_set_input_poll(runahead_pipe_input_poll);
+   pipe->frame = false;
+
+   slock_lock(pipe->lock);
+   pipe->busy  = true;
+   scond_signal(pipe->cond);
+   slock_unlock(pipe->lock);
+   return true;
+}
+
+/**
+ * runahead_pipe_finish
+ *
+ * Waits for the worker's frame, applies the geometry and AV info it
+ * set and gives the secondary core back its usual callbacks.
+ */
+static void runahead_pipe_finish(runloop_state_t *runloop_st)
+{
+   runahead_pipe_t *pipe = runloop_st->runahead_pipe;
+
+   slock_lock(pipe->lock);
+   while (pipe->busy)
+      scond_wait(pipe->cond, pipe->lock);
+   slock_unlock(pipe->lock);
+
+   /* In the order the core would have had them applied */
+   if (pipe->av_info_pending)
+      runloop_environment_cb(RETRO_ENVIRONMENT_SET_SYSTEM_AV_INFO,
+            &pipe->av_info);
+   if (pipe->geometry_pending)
+      runloop_environment_cb(RETRO_ENVIRONMENT_SET_GEOMETRY,
+            &pipe->geometry);
+   pipe->av_info_pending  = false;
+   pipe->geometry_pending = false;
+
+   if (pipe->refused_cmd)
+   {
+      RARCH_WARN("[Run-Ahead] Core sent environment command %u from the secondary instance thread; running the secondary instance on the main thread.\n",
+            pipe->refused_cmd);
+      pipe->refused_cmd = 0;
+      pipe->disabled    = true;
+   }
+
+   runloop_st->secondary_core.retro_set_video_refresh(
+         runloop_st->secondary_callbacks.frame_cb);
+   runloop_st->secondary_core.retro_set_audio_sample(
+         runloop_st->secondary_callbacks.sample_cb);
+   runloop_st->secondary_core.retro_set_audio_sample_batch(
+         runloop_st->secondary_callbacks.sample_batch_cb);
+   runloop_st->secondary_core.retro_set_input_state(
+         runloop_st->secondary_callbacks.state_cb);
+   runloop_st->secondary_core.retro_set_input_poll(
+         runloop_st->secondary_callbacks.poll_cb);
+}
+
+static void runahead_pipe_present(runloop_state_t *runloop_st)
+{
+   runahead_pipe_t *pipe = runloop_st->runahead_pipe;
+   if (pipe->frame)
+      runloop_st->secondary_callbacks.frame_cb(pipe->frame_data,
+            pipe->frame_width, pipe->frame_height, pipe->frame_pitch);
+}
+#endif
+
 void runahead_secondary_core_destroy(void *data)
 {
    runloop_state_t *runloop_st      = (runloop_state_t*)data;
+#ifdef HAVE_THREADS
+   runahead_pipe_free(runloop_st);
+#endif
    if (!runloop_st->secondary_lib_handle)
       return;
 
@@ -198,9 +502,12 @@ void runahead_secondary_core_destroy(void *data)
 
    dylib_close(runloop_st->secondary_lib_handle);
    runloop_st->secondary_lib_handle = NULL;
-   filestream_delete(runloop_st->secondary_library_path);
+   /* No temporary copy when the core was opened with dlmopen */
    if (runloop_st->secondary_library_path)
+   {
+      filestream_delete(runloop_st->secondary_library_path);
       free(runloop_st->secondary_library_path);
+   }
    runloop_st->secondary_library_path = NULL;
 }
 
@@ -385,11 +692,95 @@ end:
    return NULL;
 }
 
+#ifdef HAVE_THREADS
+/* Queries the secondary core may make from the worker thread; they
+ * only read frontend state. Anything else would change that state
+ * while the real frame runs on the main thread. The worker's frame is
+ * the one presented, so geometry and AV info changes are kept for
+ * runahead_pipe_finish() to apply; any other command is refused, and
+ * the secondary instance goes back to the main thread for good. */
+static bool runahead_worker_environment_allowed(unsigned cmd)
+{
+   switch (cmd)
+   {
+      case RETRO_ENVIRONMENT_GET_VARIABLE:
+      case RETRO_ENVIRONMENT_GET_LOG_INTERFACE:
+      case RETRO_ENVIRONMENT_GET_PERF_INTERFACE:
+      case RETRO_ENVIRONMENT_GET_SYSTEM_DIRECTORY:
+      case RETRO_ENVIRONMENT_GET_SAVE_DIRECTORY:
+      case RETRO_ENVIRONMENT_GET_CORE_ASSETS_DIRECTORY:
+      case RETRO_ENVIRONMENT_GET_PLAYLIST_DIRECTORY:
+      case RETRO_ENVIRONMENT_GET_FILE_BROWSER_START_DIRECTORY:
+      case RETRO_ENVIRONMENT_GET_LIBRETRO_PATH:
+      case RETRO_ENVIRONMENT_GET_USERNAME:
+      case RETRO_ENVIRONMENT_GET_LANGUAGE:
+      case RETRO_ENVIRONMENT_GET_CAN_DUPE:
+      case RETRO_ENVIRONMENT_GET_OVERSCAN:
+      case RETRO_ENVIRONMENT_GET_INPUT_BITMASKS:
+      case RETRO_ENVIRONMENT_GET_INPUT_MAX_USERS:
+      case RETRO_ENVIRONMENT_GET_INPUT_DEVICE_CAPABILITIES:
+      case RETRO_ENVIRONMENT_GET_CORE_OPTIONS_VERSION:
+      case RETRO_ENVIRONMENT_GET_MESSAGE_INTERFACE_VERSION:
+      case RETRO_ENVIRONMENT_GET_DISK_CONTROL_INTERFACE_VERSION:
+      case RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE:
+      case RETRO_ENVIRONMENT_GET_FASTFORWARDING:
+      case RETRO_ENVIRONMENT_GET_TARGET_REFRESH_RATE:
+      case RETRO_ENVIRONMENT_GET_THROTTLE_STATE:
+      case RETRO_ENVIRONMENT_GET_SAVESTATE_CONTEXT:
+      case RETRO_ENVIRONMENT_GET_JIT_CAPABLE:
+      case RETRO_ENVIRONMENT_GET_GAME_INFO_EXT:
+         return true;
+      default:
+         break;
+   }
+   return false;
+}
+#endif
+
 static bool runloop_environment_secondary_core_hook(
       unsigned cmd, void *data)
 {
    runloop_state_t *runloop_st    = runloop_state_get_ptr();
-   bool result                    = runloop_environment_cb(cmd, data);
+   bool result;
+
+#ifdef HAVE_THREADS
+   /* A variable update waits for the next run on the main thread,
+    * the real frame may be reading the same flags right now */
+   if (runahead_pipe_on_worker(runloop_st))
+   {
+      if (cmd == RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE)
+      {
+         if (data)
+            *(bool*)data = false;
+         return true;
+      }
+      if (cmd == RETRO_ENVIRONMENT_SET_SYSTEM_AV_INFO && data)
+      {
+         runloop_st->runahead_pipe->av_info          =
+            *(const struct retro_system_av_info*)data;
+         runloop_st->runahead_pipe->av_info_pending  = true;
+         /* Carries a geometry of its own */
+         runloop_st->runahead_pipe->geometry_pending = false;
+         return true;
+      }
+      if (cmd == RETRO_ENVIRONMENT_SET_GEOMETRY && data)
+      {
+         runloop_st->runahead_pipe->geometry         =
+            *(const struct retro_game_geometry*)data;
+         runloop_st->runahead_pipe->geometry_pending = true;
+         return true;
+      }
+      if (!runahead_worker_environment_allowed(cmd))
+      {
+         if (!runloop_st->runahead_pipe->refused_cmd)
+            runloop_st->runahead_pipe->refused_cmd = cmd;
+         return false;
+      }
+      return runloop_environment_cb(cmd, data);
+   }
+#endif
+
+   result                         = runloop_environment_cb(cmd, data);
 
    if (runloop_st->flags & RUNLOOP_FLAG_HAS_VARIABLE_UPDATE)
    {
@@ -421,6 +812,10 @@ static bool secondary_core_create(runloop_state_t *runloop_st,
       last_core_type             = runloop_st->last_core_type;
    rarch_system_info_t *sys_info = &runloop_st->system;
    uint8_t flags                 = content_get_flags();
+   const char *core_path         = path_get(RARCH_PATH_CORE);
+   const char *load_method       = "temporary copy";
+   retro_time_t start_usec       = cpu_features_get_time_usec();
+   retro_time_t load_usec;
 
    if (     (last_core_type != CORE_TYPE_PLAIN)
          || (!runloop_st->load_content_info)
@@ -430,18 +825,36 @@ static bool secondary_core_create(runloop_state_t *runloop_st,
    if (runloop_st->secondary_library_path)
       free(runloop_st->secondary_library_path);
    runloop_st->secondary_library_path = NULL;
-   runloop_st->secondary_library_path = copy_core_to_temp_file(
-		   path_get(RARCH_PATH_CORE), path_directory_libretro);
 
-   if (!runloop_st->secondary_library_path)
-      return false;
+#ifdef RUNAHEAD_DLMOPEN
+   /* A new link-map namespace gives the second instance its own copy
+    * of every global of the core, without writing the core to disk */
+   if ((runloop_st->secondary_lib_handle = dlmopen(LM_ID_NEWLM,
+               core_path, RTLD_LAZY | RTLD_LOCAL)))
+      load_method = "dlmopen";
+   else
+      RARCH_LOG("[Run-Ahead] dlmopen failed, using a temporary copy of the core: %s\n",
+            dlerror());
+#endif
+
+   if (!runloop_st->secondary_lib_handle)
+   {
+      runloop_st->secondary_library_path = copy_core_to_temp_file(
+            core_path, path_directory_libretro);
+
+      if (!runloop_st->secondary_library_path)
+         return false;
+   }
 
    /* Load Core */
    if (!runloop_init_libretro_symbols(runloop_st,
             CORE_TYPE_PLAIN, &runloop_st->secondary_core,
-            runloop_st->secondary_library_path,
+            runloop_st->secondary_library_path
+            ? runloop_st->secondary_library_path
+            : core_path,
             &runloop_st->secondary_lib_handle))
       return false;
+   load_usec = cpu_features_get_time_usec();
 
    runloop_st->secondary_core.flags |= RETRO_CORE_FLAG_SYMBOLS_INITED;
    runloop_st->secondary_core.retro_set_environment(
@@ -519,6 +932,11 @@ static bool secondary_core_create(runloop_state_t *runloop_st,
    runahead_clear_controller_port_map(runloop_st);
 #endif
 
+   RARCH_LOG("[Run-Ahead] Secondary instance loaded by %s in %u ms, ready after %u ms.\n",
+         load_method,
+         (unsigned)((load_usec - start_usec) / 1000),
+         (unsigned)((cpu_features_get_time_usec() - start_usec) / 1000));
+
    return true;
 
 error:
@@ -959,9 +1377,21 @@ static void runahead_remove_hooks(runloop_state_t *runloop_st)
    runahead_remove_input_state_hook(runloop_st);
 }
 
+static void runahead_ring_free(runloop_state_t *runloop_st)
+{
+   if (runloop_st->runahead_ring)
+      memalign_free(runloop_st->runahead_ring);
+   runloop_st->runahead_ring        = NULL;
+   runloop_st->runahead_ring_stride = 0;
+   runloop_st->runahead_ring_slots  = 0;
+   runloop_st->runahead_ring_base   = 0;
+   runloop_st->runahead_ring_frames = 0;
+}
+
 static void runahead_destroy(runloop_state_t *runloop_st)
 {
    mylist_destroy(&runloop_st->runahead_save_state_list);
+   runahead_ring_free(runloop_st);
    runahead_remove_hooks(runloop_st);
    runahead_clear_variables(runloop_st);
 }
@@ -1012,6 +1442,7 @@ static void runahead_err(runloop_state_t *runloop_st)
 {
    runloop_st->flags &= ~RUNLOOP_FLAG_RUNAHEAD_AVAILABLE;
    mylist_destroy(&runloop_st->runahead_save_state_list);
+   runahead_ring_free(runloop_st);
    runahead_remove_hooks(runloop_st);
    runloop_st->runahead_save_state_size       = 0;
    runloop_st->flags                         |= RUNLOOP_FLAG_RUNAHEAD_SAVE_STATE_SIZE_KNOWN;
@@ -1113,6 +1544,149 @@ static void runahead_core_run_use_last_input(runloop_state_t *runloop_st)
    runloop_st->current_core.retro_set_input_state(cbs->state_cb);
 }
 
+/* Single instance ring - one savestate per frame run ahead.
+ *
+ * Slot k holds the state k frames after the last real frame, run with
+ * that frame's input; slot runahead_count is the state after the
+ * visible frame. When the next real frame reads the same input, it
+ * reproduces slot 1, so the ring moves up by one slot and only the
+ * visible frame has to run again. Changed input replays every frame
+ * after the real one, as before. */
+
+#define RUNAHEAD_RING_ALIGN 64
+
+static bool runahead_ring_ensure(runloop_state_t *runloop_st,
+      int runahead_count)
+{
+   int slots     = runahead_count + 1;
+   size_t stride = (runloop_st->runahead_save_state_size
+         + RUNAHEAD_RING_ALIGN - 1) & ~((size_t)RUNAHEAD_RING_ALIGN - 1);
+
+   if (     runloop_st->runahead_ring
+         && runloop_st->runahead_ring_slots  == slots
+         && runloop_st->runahead_ring_stride == stride)
+      return true;
+
+   runahead_ring_free(runloop_st);
+   if (!(runloop_st->runahead_ring = (uint8_t*)memalign_alloc(
+               RUNAHEAD_RING_ALIGN, stride * slots)))
+      return false;
+   runloop_st->runahead_ring_stride = stride;
+   runloop_st->runahead_ring_slots  = slots;
+   return true;
+}
+
+static uint8_t *runahead_ring_slot(runloop_state_t *runloop_st, int slot)
+{
+   int i = (runloop_st->runahead_ring_base + slot)
+      % runloop_st->runahead_ring_slots;
+   return runloop_st->runahead_ring + (size_t)i * runloop_st->runahead_ring_stride;
+}
+
+static bool runahead_ring_save(runloop_state_t *runloop_st, int slot)
+{
+   retro_ctx_serialize_info_t serialize_info;
+   serialize_info.data       = runahead_ring_slot(runloop_st, slot);
+   serialize_info.data_const = serialize_info.data;
+   serialize_info.size       = runloop_st->runahead_save_state_size;
+   return core_serialize_special(&serialize_info);
+}
+
+static bool runahead_ring_load(runloop_state_t *runloop_st, int slot)
+{
+   retro_ctx_serialize_info_t serialize_info;
+   bool last_dirty           = (runloop_st->flags & RUNLOOP_FLAG_INPUT_IS_DIRTY) ? true : false;
+   bool ret;
+   serialize_info.data       = runahead_ring_slot(runloop_st, slot);
+   serialize_info.data_const = serialize_info.data;
+   serialize_info.size       = runloop_st->runahead_save_state_size;
+   ret                       = core_unserialize_special(&serialize_info);
+   if (last_dirty)
+      runloop_st->flags     |=  RUNLOOP_FLAG_INPUT_IS_DIRTY;
+   else
+      runloop_st->flags     &= ~RUNLOOP_FLAG_INPUT_IS_DIRTY;
+   return ret;
+}
+
+static void runahead_ring_run(runloop_state_t *runloop_st,
+      video_driver_state_t *video_st, audio_driver_state_t *audio_st,
+      bool real_frame, bool last_frame)
+{
+   if (!last_frame)
+   {
+      audio_st->flags     |=  AUDIO_FLAG_SUSPENDED;
+      video_st->flags     &= ~VIDEO_FLAG_ACTIVE;
+   }
+
+   if (real_frame)
+      core_run();
+   else
+      runahead_core_run_use_last_input(runloop_st);
+
+   if (!last_frame)
+   {
+      if (video_st->flags & VIDEO_FLAG_RUNAHEAD_IS_ACTIVE)
+         video_st->flags |=  VIDEO_FLAG_ACTIVE;
+      else
+         video_st->flags &= ~VIDEO_FLAG_ACTIVE;
+
+      audio_st->flags    &= ~AUDIO_FLAG_SUSPENDED;
+   }
+}
+
+/**
+ * runahead_ring_frame
+ *
+ * Runs the real frame from the state in slot 0 and the frames ahead
+ * of it, then returns to the real frame's state.
+ * Returns MSG_UNKNOWN on success, or the message of the failed step.
+ */
+static enum msg_hash_enums runahead_ring_frame(runloop_state_t *runloop_st,
+      video_driver_state_t *video_st, audio_driver_state_t *audio_st,
+      int runahead_count)
+{
+   int frame_number;
+   bool dirty;
+
+   runahead_ring_run(runloop_st, video_st, audio_st, true, false);
+
+   dirty = (runloop_st->flags & (RUNLOOP_FLAG_INPUT_IS_DIRTY
+            | RUNLOOP_FLAG_RUNAHEAD_FORCE_INPUT_DIRTY))
+      || runloop_st->runahead_ring_frames != runahead_count;
+   runloop_st->flags &= ~RUNLOOP_FLAG_INPUT_IS_DIRTY;
+
+   if (!dirty)
+   {
+      /* Slot 1 became the real frame's state; the visible frame
+       * continues from the state after the previous visible one */
+      runloop_st->runahead_ring_base = (runloop_st->runahead_ring_base + 1)
+         % runloop_st->runahead_ring_slots;
+      if (!runahead_ring_load(runloop_st, runahead_count - 1))
+         return MSG_RUNAHEAD_FAILED_TO_LOAD_STATE;
+   }
+   else
+   {
+      runloop_st->runahead_ring_frames = 0;
+      if (!runahead_ring_save(runloop_st, 0))
+         return MSG_RUNAHEAD_FAILED_TO_SAVE_STATE;
+      for (frame_number = 1; frame_number < runahead_count; frame_number++)
+      {
+         runahead_ring_run(runloop_st, video_st, audio_st, false, false);
+         if (!runahead_ring_save(runloop_st, frame_number))
+            return MSG_RUNAHEAD_FAILED_TO_SAVE_STATE;
+      }
+   }
+
+   runahead_ring_run(runloop_st, video_st, audio_st, false, true);
+   if (!runahead_ring_save(runloop_st, runahead_count))
+      return MSG_RUNAHEAD_FAILED_TO_SAVE_STATE;
+   runloop_st->runahead_ring_frames = runahead_count;
+
+   if (!runahead_ring_load(runloop_st, 0))
+      return MSG_RUNAHEAD_FAILED_TO_LOAD_STATE;
+   return MSG_UNKNOWN;
+}
+
 void runahead_run(void *data,
       int runahead_count,
       bool runahead_hide_warnings,
@@ -1122,6 +1696,7 @@ void runahead_run(void *data,
    int frame_number        = 0;
    bool last_frame         = false;
    bool suspended_frame    = false;
+   bool pipelined          = false;
 #if defined(HAVE_DYNAMIC) || defined(HAVE_DYLIB)
    const bool have_dynamic = true;
    settings_t *settings    = config_get_ptr();
@@ -1183,56 +1758,75 @@ void runahead_run(void *data,
          || !have_dynamic
          || !(runloop_st->flags & RUNLOOP_FLAG_RUNAHEAD_SECONDARY_CORE_AVAILABLE))
    {
-      /* TODO: multiple savestates for higher performance
-       * when not using secondary core */
-      for (frame_number = 0; frame_number <= runahead_count; frame_number++)
+      /* With two or more frames, keep a state per frame so that
+       * unchanged input only runs the real and the visible frame */
+      if (      runahead_count >= 2
+            &&  runahead_ring_ensure(runloop_st, runahead_count))
       {
-         last_frame      = frame_number == runahead_count;
-         suspended_frame = !last_frame;
-
-         if (suspended_frame)
+         enum msg_hash_enums
+            err = runahead_ring_frame(runloop_st, video_st, audio_st,
+                  runahead_count);
+         if (err != MSG_UNKNOWN)
          {
-            audio_st->flags     |=  AUDIO_FLAG_SUSPENDED;
-            video_st->flags     &= ~VIDEO_FLAG_ACTIVE;
+            const char *_msg = msg_hash_to_str(err);
+            runahead_err(runloop_st);
+            runloop_msg_queue_push(_msg, strlen(_msg), 0, 3 * 60, true, NULL,
+                  MESSAGE_QUEUE_ICON_DEFAULT, MESSAGE_QUEUE_CATEGORY_INFO);
+            RARCH_WARN("[Run-Ahead] %s\n", _msg);
+            return;
          }
+      }
+      else
+      {
+         for (frame_number = 0; frame_number <= runahead_count; frame_number++)
+         {
+            last_frame      = frame_number == runahead_count;
+            suspended_frame = !last_frame;
 
-         if (frame_number == 0)
-            core_run();
-         else
-            runahead_core_run_use_last_input(runloop_st);
+            if (suspended_frame)
+            {
+               audio_st->flags     |=  AUDIO_FLAG_SUSPENDED;
+               video_st->flags     &= ~VIDEO_FLAG_ACTIVE;
+            }
 
-         if (suspended_frame)
-         {
-            if (video_st->flags & VIDEO_FLAG_RUNAHEAD_IS_ACTIVE)
-               video_st->flags |=  VIDEO_FLAG_ACTIVE;
+            if (frame_number == 0)
+               core_run();
             else
-               video_st->flags &= ~VIDEO_FLAG_ACTIVE;
+               runahead_core_run_use_last_input(runloop_st);
 
-            audio_st->flags    &= ~AUDIO_FLAG_SUSPENDED;
-         }
+            if (suspended_frame)
+            {
+               if (video_st->flags & VIDEO_FLAG_RUNAHEAD_IS_ACTIVE)
+                  video_st->flags |=  VIDEO_FLAG_ACTIVE;
+               else
+                  video_st->flags &= ~VIDEO_FLAG_ACTIVE;
 
-         if (frame_number == 0)
-         {
-            if (!runahead_save_state(runloop_st))
+               audio_st->flags    &= ~AUDIO_FLAG_SUSPENDED;
+            }
+
+            if (frame_number == 0)
             {
-               const char *_msg =
-                  msg_hash_to_str(MSG_RUNAHEAD_FAILED_TO_SAVE_STATE);
-               runloop_msg_queue_push(_msg, strlen(_msg), 0, 3 * 60, true, NULL,
-                     MESSAGE_QUEUE_ICON_DEFAULT, MESSAGE_QUEUE_CATEGORY_INFO);
-               RARCH_WARN("[Run-Ahead] %s\n", _msg);
-               return;
+               if (!runahead_save_state(runloop_st))
+               {
+                  const char *_msg =
+                     msg_hash_to_str(MSG_RUNAHEAD_FAILED_TO_SAVE_STATE);
+                  runloop_msg_queue_push(_msg, strlen(_msg), 0, 3 * 60, true, NULL,
+                        MESSAGE_QUEUE_ICON_DEFAULT, MESSAGE_QUEUE_CATEGORY_INFO);
+                  RARCH_WARN("[Run-Ahead] %s\n", _msg);
+                  return;
+               }
             }
-         }
 
-         if (last_frame)
-         {
-            if (!runahead_load_state(runloop_st))
+            if (last_frame)
             {
-               const char *_msg = msg_hash_to_str(MSG_RUNAHEAD_FAILED_TO_LOAD_STATE);
-               runloop_msg_queue_push(_msg, strlen(_msg), 0, 3 * 60, true, NULL,
-                     MESSAGE_QUEUE_ICON_DEFAULT, MESSAGE_QUEUE_CATEGORY_INFO);
-               RARCH_WARN("[Run-Ahead] %s\n", _msg);
-               return;
+               if (!runahead_load_state(runloop_st))
+               {
+                  const char *_msg = msg_hash_to_str(MSG_RUNAHEAD_FAILED_TO_LOAD_STATE);
+                  runloop_msg_queue_push(_msg, strlen(_msg), 0, 3 * 60, true, NULL,
+                        MESSAGE_QUEUE_ICON_DEFAULT, MESSAGE_QUEUE_CATEGORY_INFO);
+                  RARCH_WARN("[Run-Ahead] %s\n", _msg);
+                  return;
+               }
             }
          }
       }
@@ -1240,6 +1834,7 @@ void runahead_run(void *data,
    else
    {
 #if HAVE_DYNAMIC
+      runloop_st->runahead_ring_frames = 0;
       if (!secondary_core_ensure_exists(runloop_st, config_get_ptr()))
       {
          const char *_msg =
@@ -1252,6 +1847,15 @@ void runahead_run(void *data,
          goto force_input_dirty;
       }
 
+#ifdef HAVE_THREADS
+      /* Unless a resync is due anyway, run the secondary core's
+       * visible frame alongside the real one */
+      if (      settings->bools.run_ahead_secondary_thread
+            && !(runloop_st->flags & RUNLOOP_FLAG_RUNAHEAD_FORCE_INPUT_DIRTY)
+            &&  (video_st->hw_render.context_type == RETRO_HW_CONTEXT_NONE))
+         pipelined = runahead_pipe_start(runloop_st);
+#endif
+
       /* run main core with video suspended */
       video_st->flags &= ~VIDEO_FLAG_ACTIVE;
       core_run();
@@ -1260,10 +1864,17 @@ void runahead_run(void *data,
       else
          video_st->flags &= ~VIDEO_FLAG_ACTIVE;
 
+#ifdef HAVE_THREADS
+      if (pipelined)
+         runahead_pipe_finish(runloop_st);
+#endif
+
       if (     (runloop_st->flags & RUNLOOP_FLAG_INPUT_IS_DIRTY)
             || (runloop_st->flags & RUNLOOP_FLAG_RUNAHEAD_FORCE_INPUT_DIRTY))
       {
          runloop_st->flags &= ~RUNLOOP_FLAG_INPUT_IS_DIRTY;
+         /* The worker's frame assumed the old input */
+         pipelined          = false;
 
          if (!runahead_save_state(runloop_st))
          {
@@ -1300,14 +1911,21 @@ void runahead_run(void *data,
                video_st->flags          &= ~VIDEO_FLAG_ACTIVE;
          }
       }
-      audio_st->flags                   |= AUDIO_FLAG_SUSPENDED
-                                         | AUDIO_FLAG_HARD_DISABLE;
-      if (secondary_core_run_use_last_input(runloop_st))
-         runloop_st->flags              |=  RUNLOOP_FLAG_RUNAHEAD_SECONDARY_CORE_AVAILABLE;
+#ifdef HAVE_THREADS
+      if (pipelined)
+         runahead_pipe_present(runloop_st);
       else
-         runloop_st->flags              &= ~RUNLOOP_FLAG_RUNAHEAD_SECONDARY_CORE_AVAILABLE;
-      audio_st->flags                   &= ~(AUDIO_FLAG_SUSPENDED
+#endif
+      {
+         audio_st->flags                |= AUDIO_FLAG_SUSPENDED
+                                         | AUDIO_FLAG_HARD_DISABLE;
+         if (secondary_core_run_use_last_input(runloop_st))
+            runloop_st->flags           |=  RUNLOOP_FLAG_RUNAHEAD_SECONDARY_CORE_AVAILABLE;
+         else
+            runloop_st->flags           &= ~RUNLOOP_FLAG_RUNAHEAD_SECONDARY_CORE_AVAILABLE;
+         audio_st->flags                &= ~(AUDIO_FLAG_SUSPENDED
                                          | AUDIO_FLAG_HARD_DISABLE);
+      }
 #endif
    }
    runloop_st->flags &= ~RUNLOOP_FLAG_RUNAHEAD_FORCE_INPUT_DIRTY;
@@ -1318,6 +1936,15 @@ force_input_dirty:
    runloop_st->flags |=  RUNLOOP_FLAG_RUNAHEAD_FORCE_INPUT_DIRTY;
 }
 
+void runahead_reset_buffer(void *data)
+{
+   runloop_state_t *runloop_st      = (runloop_state_t*)data;
+   runloop_st->runahead_ring_frames = 0;
+   runloop_st->flags               |= RUNLOOP_FLAG_RUNAHEAD_FORCE_INPUT_DIRTY;
+   if (runloop_st->preempt_data)
+      runloop_st->preempt_data->frame_count = 0;
+}
+
 /* Preemptive Frames */
 
 static int16_t preempt_input_state(unsigned port,
@@ -1681,6 +2308,159 @@ error:
    RARCH_ERR("[Run-Ahead Preemptive] %s\n", _msg);
 }
 
+/* Frame count tuner */
+
+/* Share of the frame budget the core may take; the rest is left to the
+ * video and audio drivers */
+#define RUNAHEAD_AUTO_BUDGET_PERCENT 75
+/* Windows with room to spare before one more frame is tried */
+#define RUNAHEAD_AUTO_RAISE_WINDOWS  3
+
+/**
+ * preempt_resize:
+ *
+ * Changes the number of preemptive frames, keeping the buffers that
+ * are still needed. Replays resume once the buffer is full again.
+ **/
+static bool preempt_resize(preempt_t *preempt, uint8_t frames)
+{
+   uint8_t i;
+
+   for (i = frames; i < preempt->frames; i++)
+   {
+      free(preempt->buffer[i]);
+      preempt->buffer[i] = NULL;
+   }
+   for (i = preempt->frames; i < frames; i++)
+   {
+      if (!(preempt->buffer[i] = malloc(preempt->state_size)))
+      {
+         preempt->frames = i;
+         return false;
+      }
+   }
+
+   preempt->frames      = frames;
+   preempt->start_ptr   = 0;
+   preempt->replay_ptr  = 0;
+   preempt->frame_count = 0;
+   return true;
+}
+
+static int runahead_auto_compare(const void *a, const void *b)
+{
+   retro_time_t x = *(const retro_time_t*)a;
+   retro_time_t y = *(const retro_time_t*)b;
+   return (x > y) - (x < y);
+}
+
+unsigned runahead_auto_frames(void *data, unsigned max_frames)
+{
+   runloop_state_t *runloop_st = (runloop_state_t*)data;
+   runahead_auto_t *tuner      = &runloop_st->runahead_auto;
+   preempt_t *preempt          = runloop_st->preempt_data;
+
+   if (max_frames > MAX_RUNAHEAD_FRAMES)
+      max_frames = MAX_RUNAHEAD_FRAMES;
+
+   /* Start from the configured count and work down from there */
+   if (!tuner->started)
+   {
+      tuner->frames       = max_frames;
+      tuner->count        = 0;
+      tuner->over         = 0;
+      tuner->calm_windows = 0;
+      tuner->started      = true;
+   }
+   else if (tuner->frames > max_frames)
+      tuner->frames       = max_frames;
+   tuner->max_frames      = max_frames;
+
+   /* Preemptive frames need at least one frame */
+   if (preempt && tuner->frames < 1)
+      tuner->frames = 1;
+
+   if (     preempt
+         && tuner->frames != preempt->frames
+         && !preempt_resize(preempt, (uint8_t)tuner->frames))
+   {
+      RARCH_ERR("[Run-Ahead Preemptive] %s\n",
+            msg_hash_to_str(MSG_PREEMPT_FAILED_TO_ALLOCATE));
+      preempt_deinit(runloop_st);
+   }
+
+   return tuner->frames;
+}
+
+void runahead_auto_update(void *data, retro_time_t usec,
+      float refresh_rate)
+{
+   runloop_state_t *runloop_st = (runloop_state_t*)data;
+   runahead_auto_t *tuner      = &runloop_st->runahead_auto;
+   unsigned frames             = tuner->frames;
+   unsigned min_frames         = runloop_st->preempt_data ? 1 : 0;
+   retro_time_t budget;
+   retro_time_t p99;
+   retro_time_t sorted[RUNAHEAD_AUTO_WINDOW];
+
+   if (!tuner->started || refresh_rate <= 0.0f)
+      return;
+
+   budget = (retro_time_t)(1000000.0f / refresh_rate)
+      * RUNAHEAD_AUTO_BUDGET_PERCENT / 100;
+
+   tuner->samples[tuner->count++] = usec;
+   if (usec > budget)
+      tuner->over++;
+
+   /* More than 1% of the window over budget already puts the 99th
+    * percentile over it; react before the window ends */
+   if (tuner->over * 100 > RUNAHEAD_AUTO_WINDOW)
+   {
+      if (frames > min_frames)
+         frames--;
+      tuner->calm_windows = 0;
+   }
+   else if (tuner->count == RUNAHEAD_AUTO_WINDOW)
+   {
+      memcpy(sorted, tuner->samples, sizeof(sorted));
+      qsort(sorted, RUNAHEAD_AUTO_WINDOW, sizeof(*sorted),
+            runahead_auto_compare);
+      p99 = sorted[RUNAHEAD_AUTO_WINDOW * 99 / 100];
+
+      /* Frames run per displayed frame grow linearly with the count */
+      if (p99 * (frames + 2) / (frames + 1) < budget)
+      {
+         if (     ++tuner->calm_windows >= RUNAHEAD_AUTO_RAISE_WINDOWS
+               && frames < tuner->max_frames)
+         {
+            frames++;
+            tuner->calm_windows = 0;
+         }
+      }
+      else
+         tuner->calm_windows = 0;
+   }
+   else
+      return;
+
+   tuner->count = 0;
+   tuner->over  = 0;
+
+   if (frames != tuner->frames)
+   {
+      RARCH_LOG("[Run-Ahead] Auto frame count %u -> %u (budget %u us).\n",
+            tuner->frames, frames, (unsigned)budget);
+      tuner->frames = frames;
+   }
+}
+
+void runahead_auto_reset(void *data)
+{
+   runloop_state_t *runloop_st = (runloop_state_t*)data;
+   memset(&runloop_st->runahead_auto, 0, sizeof(runloop_st->runahead_auto));
+}
+
 void runahead_clear_variables(void *data)
 {
    runloop_state_t *runloop_st            = (runloop_state_t*)data;
@@ -66,6 +66,27 @@ typedef struct preemptive_frames_data
    uint8_t frames;
 } preempt_t;
 
+/* Frames of core time one decision of the frame count tuner looks at */
+#define RUNAHEAD_AUTO_WINDOW 120
+
+/* Frame count tuner: keeps the 99th percentile of the time the core
+ * takes per displayed frame, run-ahead included, inside the budget */
+typedef struct runahead_auto
+{
+   retro_time_t samples[RUNAHEAD_AUTO_WINDOW];
+   unsigned count;
+   /* Samples of the current window over budget */
+   unsigned over;
+   unsigned frames;
+   unsigned max_frames;
+   /* Windows in a row that left room for one more frame */
+   unsigned calm_windows;
+   bool started;
+} runahead_auto_t;
+
+/* Worker thread running the secondary instance next to the real frame */
+typedef struct runahead_pipe runahead_pipe_t;
+
 RETRO_BEGIN_DECLS
 
 typedef bool(*runahead_load_state_function)(const void*, size_t);
@@ -78,6 +99,10 @@ void runahead_run(
 
 void runahead_clear_variables(void *data);
 
+/* Drops the states kept ahead of the real frame, after the core's
+ * state changed behind run-ahead's back */
+void runahead_reset_buffer(void *data);
+
 void runahead_remember_controller_port_device(void *data,
       long port, long device);
 void runahead_clear_controller_port_map(void *data);
@@ -93,6 +118,29 @@ void preempt_deinit(void *data);
 
 void preempt_run(preempt_t *preempt, void *data);
 
+/**
+ * runahead_auto_frames:
+ * @max_frames : configured frame count, used as the upper limit
+ *
+ * Returns the frame count picked by the tuner, and resizes preemptive
+ * frames to it.
+ **/
+unsigned runahead_auto_frames(void *data, unsigned max_frames);
+
+/**
+ * runahead_auto_update:
+ * @usec         : time the core took for the frame just shown
+ * @refresh_rate : display refresh rate in Hz
+ *
+ * Feeds the tuner. One more frame is tried after a few windows with
+ * room to spare, one frame less as soon as the window's 99th percentile
+ * is over budget.
+ **/
+void runahead_auto_update(void *data, retro_time_t usec,
+      float refresh_rate);
+
+void runahead_auto_reset(void *data);
+
 RETRO_END_DECLS
 
 #endif
@@ -3757,12 +3757,16 @@ bool runloop_init_libretro_symbols(
             {
                /* for a secondary core, we already have a
                 * primary library loaded, so we can skip
-                * some checks and just load the library */
-               lib_handle_local = dylib_load(lib_path);
+                * some checks and just load the library,
+                * unless the caller opened it already */
+               if (!(lib_handle_local = *lib_handle_p))
+               {
+                  lib_handle_local = dylib_load(lib_path);
 
-               if (!lib_handle_local)
-                  return false;
-               *lib_handle_p = lib_handle_local;
+                  if (!lib_handle_local)
+                     return false;
+                  *lib_handle_p = lib_handle_local;
+               }
             }
 #endif
 #endif
@@ -7398,8 +7402,14 @@ int runloop_iterate(void)
       unsigned run_ahead_num_frames     = settings->uints.run_ahead_frames;
       bool run_ahead_hide_warnings      = settings->bools.run_ahead_hide_warnings;
       bool run_ahead_secondary_instance = settings->bools.run_ahead_secondary_instance;
+      bool run_ahead_auto               = settings->bools.run_ahead_auto
+            && (run_ahead_enabled || runloop_st->preempt_data);
+      bool want_runahead;
+      if (run_ahead_auto)
+         run_ahead_num_frames           = runahead_auto_frames(runloop_st,
+               run_ahead_num_frames);
       /* Run Ahead Feature replaces the call to core_run in this loop */
-      bool want_runahead                = run_ahead_enabled
+      want_runahead                     = run_ahead_enabled
             && (run_ahead_num_frames > 0)
             && (runloop_st->flags & RUNLOOP_FLAG_RUNAHEAD_AVAILABLE);
 #ifdef HAVE_NETWORKING
@@ -7417,6 +7427,13 @@ int runloop_iterate(void)
       else
 #endif
          core_run();
+
+#ifdef HAVE_RUNAHEAD
+      if (run_ahead_auto)
+         runahead_auto_update(runloop_st,
+               cpu_features_get_time_usec() - runloop_st->core_run_time,
+               settings->floats.video_refresh_rate);
+#endif
    }
 
    /* Increment runtime tick counter after each call to
@@ -7500,9 +7517,20 @@ end:
               || (runloop_st->flags & RUNLOOP_FLAG_PAUSED)))
    {
       const retro_time_t end_frame_time  = cpu_features_get_time_usec();
-      const retro_time_t to_sleep_ms     = (
+      retro_time_t frame_limit_time      = runloop_st->frame_limit_minimum_time;
+      retro_time_t to_sleep_ms;
+#ifdef HAVE_NETWORKING
+      int netplay_adjust_usec            = 0;
+
+      /* Netplay time sync stretches or shrinks the frame slightly
+       * to stay level with the remote peer. */
+      if (netplay_driver_ctl(RARCH_NETPLAY_CTL_TIMESYNC_ADJUST,
+               &netplay_adjust_usec))
+         frame_limit_time += netplay_adjust_usec;
+#endif
+      to_sleep_ms = (
             (  runloop_st->frame_limit_last_time
-             + runloop_st->frame_limit_minimum_time)
+             + frame_limit_time)
             - end_frame_time) / 1000;
 
       if (to_sleep_ms > 0)
@@ -7510,8 +7538,7 @@ end:
          unsigned               sleep_ms = (unsigned)to_sleep_ms;
 
          /* Combat jitter a bit. */
-         runloop_st->frame_limit_last_time +=
-            runloop_st->frame_limit_minimum_time;
+         runloop_st->frame_limit_last_time += frame_limit_time;
 
          if (sleep_ms > 0)
          {
@@ -185,7 +185,12 @@ struct runloop
 #endif
    my_list *runahead_save_state_list;
    my_list *input_state_list;
+   /* One state per frame run ahead when there is no secondary core,
+    * runahead_ring_slots buffers of runahead_ring_stride bytes */
+   uint8_t *runahead_ring;
    preempt_t *preempt_data;
+   runahead_pipe_t *runahead_pipe;
+   runahead_auto_t runahead_auto;
 #endif
 
 #ifdef HAVE_REWIND
@@ -234,6 +239,7 @@ struct runloop
    dylib_t secondary_lib_handle;                         /* ptr alignment */
 #endif
    size_t runahead_save_state_size;
+   size_t runahead_ring_stride;
 #endif
    size_t msg_queue_size;
 
@@ -241,6 +247,11 @@ struct runloop
 #if defined(HAVE_DYNAMIC) || defined(HAVE_DYLIB)
    int port_map[MAX_USERS];
 #endif
+   int runahead_ring_slots;
+   /* Slot of the state after the last real frame */
+   int runahead_ring_base;
+   /* Frames the ring was filled for, 0 when it holds nothing */
+   int runahead_ring_frames;
 #endif
 
    runloop_core_status_msg_t core_status_msg;
@@ -20,14 +20,21 @@
 #endif
 
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include <retro_inline.h>
 #include <compat/strl.h>
-#include <compat/intrinsics.h>
+
+#ifndef _WIN32
+#include <memmap.h>
+#endif
+#include <file/file_path.h>
+#include <string/stdstring.h>
 
 #include "state_manager.h"
+#include "state_manager_raw.h"
 #include "msg_hash.h"
 #include "core.h"
 #include "core_info.h"
@@ -40,345 +47,930 @@
 #include "network/netplay/netplay.h"
 #endif
 
+#include "gfx/video_driver.h"
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#include <features/features_cpu.h>
+#endif
+
 /* This makes Valgrind throw errors if a core overflows its savestate size. */
 /* Keep it off unless you're chasing a core bug, it slows things down. */
 #define STRICT_BUF_SIZE 0
 
-#ifndef UINT16_MAX
-#define UINT16_MAX 0xffff
+#ifdef HAVE_ZSTD
+/* Levels the second stage moves between; negative ones trade ratio
+ * for speed */
+#define ZSTD_STAGE_LEVEL_MIN    -5
+#define ZSTD_STAGE_LEVEL_MAX    9
+#define ZSTD_STAGE_LEVEL_START  1
+/* Pushes after a level change before the next one is considered, and
+ * before a higher level is tried */
+#define ZSTD_STAGE_SETTLE       8
+#define ZSTD_STAGE_CALM         60
 #endif
 
-#ifndef UINT32_MAX
-#define UINT32_MAX 0xffffffffu
+/* With a target depth, a quarter of the budget keeps every capture,
+ * the next quarter every TIER_THIN_MERGE-th, and the rest is a level
+ * whose spacing stretches to the target */
+#define TIER_THIN_MERGE         4
+#define TIER_COARSE             1
+#define TIER_COARSE_MERGE_START 8
+#define TIER_COARSE_MERGE_MAX   1024
+
+/* Patches evicted from the ring can spill to a memory-mapped
+ * scratch file */
+#if defined(HAVE_MMAN) && !defined(_WIN32)
+#define STATE_MANAGER_SPILL
+#include <fcntl.h>
+#include <unistd.h>
+/* Spilled bytes between writebacks */
+#define SPILL_SYNC_INTERVAL (1 << 20)
 #endif
 
-#if defined(__x86_64__) || defined(__i386__) || defined(__i486__) || defined(__i686__) || defined(_M_IX86) || defined(_M_AMD64) || defined(_M_X64)
-#define CPU_X86
-#endif
+/* The start offsets point to 'nextstart' of any given compressed frame.
+ * Each uint16 is stored native endian; anything that claims any other
+ * endianness refers to the endianness of this specific item.
+ * The uint32 is stored little endian.
+ *
+ * Each size value is stored native endian if alignment is not enforced;
+ * if it is, they're little endian.
+ *
+ * The start of the buffer contains a size pointing to the end of the
+ * buffer; the end points to its start.
+ *
+ * Wrapping is handled by returning to the start of the buffer if the
+ * compressed data could potentially hit the edge;
+ *
+ * if the compressed data could potentially overwrite the tail pointer,
+ * the tail retreats until it can no longer collide.
+ *
+ * This means that on average, ~2 * maxcompsize is
+ * unused at any given moment. */
 
-/* Other arches SIGBUS (usually) on unaligned accesses. */
-#ifndef CPU_X86
-#define NO_UNALIGNED_MEM
-#endif
+/* These are called very few constant times per frame,
+ * keep it as simple as possible. */
+static INLINE void write_size_t(void *ptr, size_t val)
+{
+   memcpy(ptr, &val, sizeof(val));
+}
 
-#if __SSE2__
-#include <emmintrin.h>
-#endif
+static INLINE size_t read_size_t(const void *ptr)
+{
+   size_t ret;
 
-/* Format per frame (pseudocode): */
-#if 0
-size nextstart;
-repeat {
-   uint16 numchanged; /* everything is counted in units of uint16 */
-   if (numchanged)
+   memcpy(&ret, ptr, sizeof(ret));
+   return ret;
+}
+
+#ifdef HAVE_ZSTD
+/* Follows the time a push takes: a level down as soon as the
+ * average goes over budget, a level up after a long stretch well
+ * below it. */
+static void state_manager_zstd_adapt(state_manager_t *state,
+      retro_time_t usec)
+{
+   state->zstd_usec = (state->zstd_usec * 7 + usec) / 8;
+
+   if (++state->zstd_pushes < ZSTD_STAGE_SETTLE)
+      return;
+
+   if (     state->zstd_usec > state->zstd_budget
+         && state->zstd_level > ZSTD_STAGE_LEVEL_MIN)
    {
-      uint16 numunchanged; /* skip these before handling numchanged */
-      uint16[numchanged] changeddata;
+      state->zstd_level--;
+      state->zstd_pushes = 0;
    }
-   else
+   else if (state->zstd_usec * 2 < state->zstd_budget
+         && state->zstd_pushes >= ZSTD_STAGE_CALM
+         && state->zstd_level < ZSTD_STAGE_LEVEL_MAX)
    {
-      uint32 numunchanged;
-      if (!numunchanged)
-         break;
+      state->zstd_level++;
+      state->zstd_pushes = 0;
    }
 }
-size thisstart;
 #endif
 
-/* There's no equivalent in libc, you'd think so ...
- * std::mismatch exists, but it's not optimized at all. */
-static size_t find_change(const uint16_t *a, const uint16_t *b)
+/* With the zstd stage, an entry is the u32 size of a zstd frame,
+ * padded to 4 bytes, or 0 and the patch as is when zstd did not
+ * make it smaller. Without it, an entry is just the patch. */
+static size_t state_manager_entry_store(state_manager_t *state,
+      const uint8_t *patch, size_t len, uint8_t *entry)
 {
-#if __SSE2__
-   const __m128i *a128 = (const __m128i*)a;
-   const __m128i *b128 = (const __m128i*)b;
-
-   for (;;)
+#ifdef HAVE_ZSTD
+   if (state->zstd_cctx)
    {
-      __m128i v0    = _mm_loadu_si128(a128);
-      __m128i v1    = _mm_loadu_si128(b128);
-      __m128i c     = _mm_cmpeq_epi8(v0, v1);
-      uint32_t mask = _mm_movemask_epi8(c);
+      uint32_t len32 = 0;
+      size_t zlen    = ZSTD_compressCCtx((ZSTD_CCtx*)state->zstd_cctx,
+            entry + sizeof(uint32_t), len, patch, len, state->zstd_level);
 
-      if (mask != 0xffff) /* Something has changed, figure out where. */
+      if (!ZSTD_isError(zlen) && zlen < len)
       {
-         /* calculate the real offset to the differing byte */
-         size_t ret = (((uint8_t*)a128 - (uint8_t*)a) |
-               (compat_ctz(~mask)));
-
-         /* and convert that to the uint16_t offset */
-         return (ret >> 1);
+         len32 = (uint32_t)zlen;
+         memcpy(entry, &len32, sizeof(len32));
+         return sizeof(uint32_t) + ((zlen + 3) & ~(size_t)3);
       }
 
-      a128++;
-      b128++;
+      memcpy(entry, &len32, sizeof(len32));
+      memcpy(entry + sizeof(uint32_t), patch, len);
+      return sizeof(uint32_t) + len;
    }
-#else
-   const uint16_t *a_org = a;
-#ifdef NO_UNALIGNED_MEM
-   while (((uintptr_t)a & (sizeof(size_t) - 1)) && *a == *b)
+#endif
+   memcpy(entry, patch, len);
+   return len;
+}
+
+static size_t state_manager_entry_compress(state_manager_t *state,
+      const void *src, const void *dst, uint8_t *entry)
+{
+#ifdef HAVE_ZSTD
+   if (state->zstd_cctx)
    {
-      a++;
-      b++;
+      size_t len;
+      retro_time_t start = cpu_features_get_time_usec();
+
+      len  = state_manager_raw_compress(src, dst, state->blocksize,
+            state->zstd_patch);
+      len  = state_manager_entry_store(state, state->zstd_patch, len, entry);
+      state_manager_zstd_adapt(state, cpu_features_get_time_usec() - start);
+      return len;
    }
-   if (*a == *b)
 #endif
+   return state_manager_raw_compress(src, dst, state->blocksize, entry);
+}
+
+/* Returns the patch of an entry, decompressed to buf if needed. */
+static const uint8_t *state_manager_entry_patch(state_manager_t *state,
+      const uint8_t *entry, uint8_t *buf)
+{
+#ifdef HAVE_ZSTD
+   if (state->zstd_cctx)
    {
-      const size_t *a_big = (const size_t*)a;
-      const size_t *b_big = (const size_t*)b;
+      uint32_t zlen;
 
-      while (*a_big == *b_big)
+      memcpy(&zlen, entry, sizeof(zlen));
+      entry += sizeof(uint32_t);
+      if (zlen)
       {
-         a_big++;
-         b_big++;
+         if (ZSTD_isError(ZSTD_decompressDCtx(
+                     (ZSTD_DCtx*)state->zstd_dctx, buf,
+                     state_manager_raw_maxsize(state->blocksize),
+                     entry, zlen)))
+         {
+            RARCH_ERR("[Rewind] Failed to decompress a rewind entry.\n");
+            return NULL;
+         }
+         return buf;
       }
-      a = (const uint16_t*)a_big;
-      b = (const uint16_t*)b_big;
+   }
+#endif
+   return entry;
+}
 
-      while (*a == *b)
-      {
-         a++;
-         b++;
-      }
+static void state_manager_entry_decompress(state_manager_t *state,
+      const uint8_t *entry, void *data)
+{
+   uint8_t *buf         = NULL;
+   const uint8_t *patch = NULL;
+
+#ifdef HAVE_ZSTD
+   buf                  = state->zstd_patch;
+#endif
+   if ((patch = state_manager_entry_patch(state, entry, buf)))
+      state_manager_raw_decompress(patch, data);
+}
+
+static size_t state_manager_entry_size(state_manager_t *state,
+      const uint8_t *entry)
+{
+#ifdef HAVE_ZSTD
+   if (state->zstd_cctx)
+   {
+      uint32_t zlen;
+
+      memcpy(&zlen, entry, sizeof(zlen));
+      if (zlen)
+         return sizeof(uint32_t) + ((zlen + 3) & ~(size_t)3);
+      return sizeof(uint32_t)
+         + state_manager_raw_patch_size(entry + sizeof(uint32_t));
    }
-   return a - a_org;
 #endif
+   return state_manager_raw_patch_size(entry);
+}
+
+/* Sets up the next level of older history on capacity bytes at data.
+ * The caller keeps ownership of data if this fails. */
+static bool state_manager_tier_init(state_manager_t *state,
+      uint8_t *data, size_t capacity, unsigned merge, bool mapped)
+{
+   struct state_manager_tier *tier = &state->tiers[state->tier_count];
+
+   if (     state->tier_count >= STATE_MANAGER_TIERS
+         || capacity < sizeof(size_t)
+            + (state->maxcompsize + sizeof(uint32_t)) * 2)
+      return false;
+
+   if (merge > 1 && !(tier->pending = (uint8_t*)malloc(
+               state_manager_raw_maxsize(state->blocksize))))
+      return false;
+
+   tier->data     = data;
+   tier->head     = data + sizeof(size_t);
+   tier->tail     = data + sizeof(size_t);
+   tier->capacity = capacity;
+   tier->merge    = merge;
+   tier->mapped   = mapped;
+   state->tier_count++;
+   return true;
+}
+
+static void state_manager_tier_push(state_manager_t *state, unsigned t,
+      const uint8_t *entry, uint32_t captures);
+
+/* Moves the oldest entry of level t down a level. */
+static void state_manager_tier_evict(state_manager_t *state, unsigned t)
+{
+   uint32_t captures;
+   struct state_manager_tier *tier = &state->tiers[t];
+
+   memcpy(&captures, tier->tail + sizeof(size_t), sizeof(captures));
+   tier->entries--;
+   tier->captures -= captures;
+   state_manager_tier_push(state, t + 1,
+         tier->tail + sizeof(size_t) + sizeof(uint32_t), captures);
+   tier->tail      = tier->data + read_size_t(tier->tail);
+}
+
+/* Makes room for an entry at the head of level t and returns where
+ * it starts. */
+static uint8_t *state_manager_tier_reserve(state_manager_t *state,
+      unsigned t)
+{
+   size_t headpos, tailpos, remaining;
+   struct state_manager_tier *tier = &state->tiers[t];
+
+recheckcapacity:;
+   headpos   = tier->head - tier->data;
+   tailpos   = tier->tail - tier->data;
+   remaining = (tailpos + tier->capacity -
+         sizeof(size_t) - headpos - 1) % tier->capacity + 1;
+
+   if (remaining <= state->maxcompsize + sizeof(uint32_t))
+   {
+      state_manager_tier_evict(state, t);
+      goto recheckcapacity;
+   }
+
+   return tier->head + sizeof(size_t);
 }
 
-static size_t find_same(const uint16_t *a, const uint16_t *b)
+/* Links the entry written up to end in as the newest of level t. */
+static void state_manager_tier_commit(state_manager_t *state, unsigned t,
+      uint8_t *end, uint32_t captures)
 {
-   const uint16_t *a_org = a;
-#ifdef NO_UNALIGNED_MEM
-   if (((uintptr_t)a & (sizeof(uint32_t) - 1)) && *a != *b)
+   struct state_manager_tier *tier = &state->tiers[t];
+
+#ifdef STATE_MANAGER_SPILL
+   if (tier->mapped)
+      tier->unsynced += end - tier->head;
+#endif
+
+   if (end - tier->data + state->maxcompsize + sizeof(uint32_t)
+         > tier->capacity)
+   {
+      end = tier->data;
+      if (tier->tail == tier->data + sizeof(size_t))
+         state_manager_tier_evict(state, t);
+   }
+   write_size_t(end, tier->head - tier->data);
+   end            += sizeof(size_t);
+   write_size_t(tier->head, end - tier->data);
+   tier->head      = end;
+   tier->entries++;
+   tier->captures += captures;
+
+#ifdef STATE_MANAGER_SPILL
+   /* Start writeback now and then so the page cache can let go of
+    * spilled pages instead of holding them all dirty */
+   if (tier->unsynced >= SPILL_SYNC_INTERVAL)
    {
-      a++;
-      b++;
+      msync(tier->data, tier->capacity, MS_ASYNC);
+      tier->unsynced = 0;
    }
-   if (*a != *b)
 #endif
+}
+
+/* Stores the patches merged so far as the newest entry of level t. */
+static void state_manager_tier_flush(state_manager_t *state, unsigned t)
+{
+   struct state_manager_tier *tier = &state->tiers[t];
+   uint32_t captures               = tier->pending_captures;
+   uint8_t *out                    = state_manager_tier_reserve(state, t);
+
+   memcpy(out, &captures, sizeof(captures));
+   out                   += sizeof(uint32_t);
+   out                   += state_manager_entry_store(state, tier->pending,
+         state_manager_raw_patch_size(tier->pending), out);
+   tier->pending_count    = 0;
+   tier->pending_captures = 0;
+   state_manager_tier_commit(state, t, out, captures);
+}
+
+/* With a target depth, the coarsest thinning level spans whatever the
+ * levels above leave of it. Only runs once history is being dropped,
+ * so the levels are full and their entry counts are what fits. */
+static void state_manager_tier_adapt(state_manager_t *state)
+{
+   unsigned above, merge;
+   struct state_manager_tier *coarse = &state->tiers[TIER_COARSE];
+   struct state_manager_tier *thin   = &state->tiers[TIER_COARSE - 1];
+
+   if (!coarse->entries || !thin->entries)
+      return;
+
+   above = state->captures - coarse->captures;
+   if (state->target_captures <= above)
+      merge = TIER_THIN_MERGE;
+   else
+      /* Captures each coarse entry should span, over what each
+       * entry coming down from the thin level does */
+      merge = (unsigned)(((uint64_t)(state->target_captures - above)
+               * thin->entries + (uint64_t)coarse->entries
+               * thin->captures - 1)
+            / ((uint64_t)coarse->entries * thin->captures));
+
+   if (merge < TIER_THIN_MERGE)
+      merge = TIER_THIN_MERGE;
+   else if (merge > TIER_COARSE_MERGE_MAX)
+      merge = TIER_COARSE_MERGE_MAX;
+   coarse->merge = merge;
+}
+
+/* Takes an entry evicted from the level before t. It is stored as is,
+ * merged with the ones before it, or dropped past the last level. */
+static void state_manager_tier_push(state_manager_t *state, unsigned t,
+      const uint8_t *entry, uint32_t captures)
+{
+   uint8_t *out;
+   const uint8_t *patch;
+   struct state_manager_tier *tier;
+
+   if (t >= state->tier_count)
    {
-      /* With this, it's random whether two consecutive identical
-       * words are caught.
-       *
-       * Luckily, compression rate is the same for both cases, and
-       * three is always caught.
-       *
-       * (We prefer to miss two-word blocks, anyways; fewer iterations
-       * of the outer loop, as well as in the decompressor.) */
-      const uint32_t *a_big = (const uint32_t*)a;
-      const uint32_t *b_big = (const uint32_t*)b;
+      state->entries--;
+      state->captures -= captures;
+      if (state->seconds)
+         state_manager_tier_adapt(state);
+      return;
+   }
 
-      while (*a_big != *b_big)
-      {
-         a_big++;
-         b_big++;
-      }
-      a = (const uint16_t*)a_big;
-      b = (const uint16_t*)b_big;
+   tier = &state->tiers[t];
+   if (tier->merge < 2)
+   {
+      size_t len = state_manager_entry_size(state, entry);
+
+      out        = state_manager_tier_reserve(state, t);
+      memcpy(out, &captures, sizeof(captures));
+      memcpy(out + sizeof(uint32_t), entry, len);
+      state_manager_tier_commit(state, t,
+            out + sizeof(uint32_t) + len, captures);
+      return;
+   }
+
+   if (!(patch = state_manager_entry_patch(state, entry,
+               state->tier_patch[0])))
+   {
+      state->entries--;
+      state->captures -= captures;
+      return;
+   }
+
+   if (tier->pending_count)
+   {
+      size_t len = state_manager_raw_merge(patch, tier->pending,
+            state->tier_patch[1],
+            state_manager_raw_maxsize(state->blocksize));
 
-      if (a != a_org && a[-1] == b[-1])
+      if (len)
       {
-         a--;
-         b--;
+         uint8_t *swap           = tier->pending;
+         tier->pending           = state->tier_patch[1];
+         state->tier_patch[1]    = swap;
+         tier->pending_captures += captures;
+         state->entries--;
+         if (++tier->pending_count >= tier->merge)
+            state_manager_tier_flush(state, t);
+         return;
       }
+
+      /* Too scattered to merge into one patch; store what there is
+       * and start over. Making room may reuse the decompressed patch,
+       * the entry itself is still there. */
+      state_manager_tier_flush(state, t);
+      patch = state_manager_entry_patch(state, entry, state->tier_patch[0]);
    }
-   return a - a_org;
+
+   memcpy(tier->pending, patch, state_manager_raw_patch_size(patch));
+   tier->pending_count    = 1;
+   tier->pending_captures = captures;
 }
 
-/* Returns the maximum compressed size of a savestate.
- * It is very likely to compress to far less. */
-static size_t state_manager_raw_maxsize(size_t uncomp)
+/* Applies the newest patch of level t to thisblock. */
+static bool state_manager_tier_pop(state_manager_t *state, unsigned t)
 {
-   /* bytes covered by a compressed block */
-   const int maxcblkcover = UINT16_MAX * sizeof(uint16_t);
-   /* uncompressed size, rounded to 16 bits */
-   size_t uncomp16        = (uncomp + sizeof(uint16_t) - 1) & -sizeof(uint16_t);
-   /* number of blocks */
-   size_t maxcblks        = (uncomp + maxcblkcover - 1) / maxcblkcover;
-   return uncomp16 + maxcblks * sizeof(uint16_t) * 2 /* two u16 overhead per block */ + sizeof(uint16_t) *
-      3; /* three u16 to end it */
+   uint32_t captures;
+   struct state_manager_tier *tier = &state->tiers[t];
+
+   if (tier->pending_count)
+   {
+      state_manager_raw_decompress(tier->pending, state->thisblock);
+      state->captures       -= tier->pending_captures;
+      tier->pending_count    = 0;
+      tier->pending_captures = 0;
+      return true;
+   }
+
+   if (tier->head == tier->tail)
+      return false;
+
+   tier->head       = tier->data + read_size_t(tier->head - sizeof(size_t));
+   memcpy(&captures, tier->head + sizeof(size_t), sizeof(captures));
+   state_manager_entry_decompress(state,
+         tier->head + sizeof(size_t) + sizeof(uint32_t), state->thisblock);
+   tier->entries--;
+   tier->captures  -= captures;
+   state->captures -= captures;
+   return true;
 }
 
-/*
- * See state_manager_raw_compress for information about this.
- * When you're done with it, send it to free().
- */
-static void *state_manager_raw_alloc(size_t len, uint16_t uniq)
+#ifdef STATE_MANAGER_SPILL
+/* Maps a scratch file of spill_size bytes as the last level of older
+ * history. The file is unlinked right away, so it is gone once the
+ * mapping is, even after a crash; pages are read back on demand. */
+static bool state_manager_spill_init(state_manager_t *state,
+      size_t spill_size, const char *dir)
 {
-   size_t  _len  = (len + sizeof(uint16_t) - 1) & -sizeof(uint16_t);
-   uint16_t *ret = (uint16_t*)calloc(_len + sizeof(uint16_t) * 4 + 16, 1);
+   char path[PATH_MAX_LENGTH];
+   int fd;
+   void *map;
 
-   if (!ret)
-      return NULL;
+   if (spill_size < sizeof(size_t)
+         + (state->maxcompsize + sizeof(uint32_t)) * 2)
+      return false;
 
-   /* Force in a different byte at the end, so we don't need to check
-    * bounds in the innermost loop (it's expensive).
-    *
-    * There is also a large amount of data that's the same, to stop
-    * the other scan.
-    *
-    * There is also some padding at the end. This is so we don't
-    * read outside the buffer end if we're reading in large blocks;
-    *
-    * It doesn't make any difference to us, but sacrificing 16 bytes to get
-    * Valgrind happy is worth it. */
-   ret[_len / sizeof(uint16_t) + 3] = uniq;
+   if (string_is_empty(dir))
+      dir = getenv("TMPDIR");
+   if (string_is_empty(dir))
+      dir = "/tmp";
 
-   return ret;
+   fill_pathname_join_special(path, dir, "retroarch_rewind_XXXXXX",
+         sizeof(path));
+   if ((fd = mkstemp(path)) < 0)
+      return false;
+   unlink(path);
+
+   /* Reserve the blocks up front; running out of disk space while
+    * writing through the mapping would raise SIGBUS */
+#ifdef __linux__
+   if (posix_fallocate(fd, 0, (off_t)spill_size) != 0)
+#else
+   if (ftruncate(fd, (off_t)spill_size) != 0)
+#endif
+   {
+      close(fd);
+      return false;
+   }
+
+   map = mmap(NULL, spill_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   close(fd);
+   if (map == MAP_FAILED)
+      return false;
+
+   if (!state_manager_tier_init(state, (uint8_t*)map, spill_size, 1, true))
+   {
+      munmap(map, spill_size);
+      return false;
+   }
+
+   RARCH_LOG("[Rewind] Spilling old history to a %u MB file in \"%s\".\n",
+         (unsigned)(spill_size / 1000000), dir);
+   return true;
 }
+#endif
 
-/*
- * Takes two savestates and creates a patch that turns 'src' into 'dst'.
- * Both 'src' and 'dst' must be returned from state_manager_raw_alloc(),
- * with the same 'len', and different 'uniq'.
- *
- * 'patch' must be size 'state_manager_raw_maxsize(len)' or more.
- * Returns the number of bytes actually written to 'patch'.
- */
-static size_t state_manager_raw_compress(const void *src,
-      const void *dst, size_t len, void *patch)
+#ifdef HAVE_STATESTREAM
+/* Superblock and block sizes of the deduplicating backend. Rewind
+ * captures every frame, so blocks are kept small enough that a few
+ * changed bytes don't drag a lot of unchanged ones along. */
+#define DEDUP_SUPERBLOCK_SIZE   16   /* measured in blocks */
+#define DEDUP_BLOCK_SIZE        1024 /* measured in bytes  */
+#define DEDUP_SMALL_STATE       (1 << 20)
+#define DEDUP_SMALL_BLOCK_SIZE  128  /* measured in bytes  */
+/* Bookkeeping of a stored block or superblock on top of its
+ * contents: the index's pointer, count and hash, and malloc's */
+#define DEDUP_OVERHEAD          (sizeof(void*) * 2 + sizeof(uint32_t) * 2)
+
+/* Most bytes a single state can add */
+static size_t state_manager_dedup_maxsize(state_manager_t *state)
 {
-   const uint16_t  *old16 = (const uint16_t*)src;
-   const uint16_t  *new16 = (const uint16_t*)dst;
-   uint16_t *compressed16 = (uint16_t*)patch;
-   size_t          num16s = (len + sizeof(uint16_t) - 1)
-      / sizeof(uint16_t);
+   return state->seq_len * (sizeof(uint32_t)
+         + DEDUP_SUPERBLOCK_SIZE * sizeof(uint32_t) + DEDUP_OVERHEAD
+         + DEDUP_SUPERBLOCK_SIZE * (state->dedup_block_size + DEDUP_OVERHEAD));
+}
 
-   while (num16s)
-   {
-      size_t i, changed;
-      size_t skip = find_change(old16, new16);
+static uint32_t *state_manager_dedup_seq(state_manager_t *state, size_t i)
+{
+   return state->seqs
+      + ((state->seq_first + i) % state->seq_slots) * state->seq_len;
+}
 
-      if (skip >= num16s)
-         break;
+/* Releases a stored state's superblocks, and the blocks of those
+ * it was the last user of. */
+static void state_manager_dedup_release(state_manager_t *state,
+      const uint32_t *seq)
+{
+   size_t i, j;
 
-      old16  += skip;
-      new16  += skip;
-      num16s -= skip;
+   for (i = 0; i < state->seq_len; i++)
+   {
+      uint32_t *superblock = uint32s_index_get(state->superblocks, seq[i]);
 
-      if (skip > UINT16_MAX)
+      if (     seq[i] != 0
+            && superblock
+            && state->superblocks->counts[seq[i]] == 1)
       {
-         /* This will make it scan the entire thing again,
-          * but it only hits on 8GB unchanged data anyways,
-          * and if you're doing that, you've got bigger problems. */
-         if (skip > UINT32_MAX)
-            skip         = UINT32_MAX;
-
-         *compressed16++ = 0;
-         *compressed16++ = skip;
-         *compressed16++ = skip >> 16;
-         continue;
+         for (j = 0; j < DEDUP_SUPERBLOCK_SIZE; j++)
+            if (uint32s_index_release(state->blocks, superblock[j]))
+               state->dedup_used -= state->dedup_block_size + DEDUP_OVERHEAD;
       }
+      if (uint32s_index_release(state->superblocks, seq[i]))
+         state->dedup_used -= DEDUP_SUPERBLOCK_SIZE * sizeof(uint32_t)
+            + DEDUP_OVERHEAD;
+   }
+}
 
-      changed = find_same(old16, new16);
-      if (changed > UINT16_MAX)
-         changed = UINT16_MAX;
+/* Returns the block of buf at offset, padded if it is the last one. */
+static uint32_t *state_manager_dedup_block(state_manager_t *state,
+      const uint8_t *buf, size_t offset)
+{
+   size_t len = state->blocksize - offset;
 
-      *compressed16++ = changed;
-      *compressed16++ = skip;
+   if (len >= state->dedup_block_size)
+      return (uint32_t*)(buf + offset);
 
-      for (i = 0; i < changed; i++)
-         compressed16[i] = old16[i];
+   memcpy(state->padblock, buf + offset, len);
+   memset((uint8_t*)state->padblock + len, 0,
+         state->dedup_block_size - len);
+   return state->padblock;
+}
 
-      old16        += changed;
-      new16        += changed;
-      num16s       -= changed;
-      compressed16 += changed;
+/* Stores buf as the newest state. Each superblock that matches the
+ * previous state's is shared with it without hashing; the others are
+ * built from blocks looked up by hash. */
+static bool state_manager_dedup_append(state_manager_t *state,
+      const uint8_t *buf)
+{
+   size_t i, j;
+   const uint32_t *prev = NULL;
+   uint32_t *seq        = NULL;
+   size_t maxsize       = state_manager_dedup_maxsize(state);
+   size_t block_size    = state->dedup_block_size;
+   size_t superblock_sz = DEDUP_SUPERBLOCK_SIZE * block_size;
+
+   if (state->capacity < maxsize)
+   {
+      RARCH_ERR("[Rewind] %s.\n",
+            msg_hash_to_str(MSG_REWIND_BUFFER_CAPACITY_INSUFFICIENT));
+      return false;
    }
 
-   compressed16[0]  = 0;
-   compressed16[1]  = 0;
-   compressed16[2]  = 0;
+   /* Age out the oldest states */
+   while (     state->seq_count
+         && state->dedup_used + maxsize > state->capacity)
+   {
+      state_manager_dedup_release(state, state_manager_dedup_seq(state, 0));
+      state->seq_first = (state->seq_first + 1) % state->seq_slots;
+      state->seq_count--;
+      state->entries--;
+      state->captures--;
+   }
 
-   return (uint8_t*)(compressed16 + 3) - (uint8_t*)patch;
-}
+   if (state->seq_count == state->seq_slots)
+   {
+      /* Double the sequence ring, oldest first */
+      size_t slots      = state->seq_slots ? state->seq_slots * 2 : 64;
+      size_t seq_bytes  = state->seq_len * sizeof(uint32_t);
+      uint32_t *seqs    = (uint32_t*)malloc(slots * seq_bytes);
+
+      if (!seqs)
+         return false;
+      for (i = 0; i < state->seq_count; i++)
+         memcpy(seqs + i * state->seq_len,
+               state_manager_dedup_seq(state, i), seq_bytes);
+      free(state->seqs);
+      state->dedup_used += (slots - state->seq_slots) * seq_bytes;
+      state->seqs        = seqs;
+      state->seq_first   = 0;
+      state->seq_slots   = slots;
+   }
 
-/*
- * Takes 'patch' from a previous call to 'state_manager_raw_compress'
- * and applies it to 'data' ('src' from that call),
- * yielding 'dst' in that call.
- *
- * If the given arguments do not match a previous call to
- * state_manager_raw_compress(), anything at all can happen.
- */
-static void state_manager_raw_decompress(const void *patch, void *data)
-{
-   uint16_t         *out16 = (uint16_t*)data;
-   const uint16_t *patch16 = (const uint16_t*)patch;
+   if (state->seq_count)
+      prev = state_manager_dedup_seq(state, state->seq_count - 1);
+   seq     = state_manager_dedup_seq(state, state->seq_count);
 
-   for (;;)
+   for (i = 0; i < state->seq_len; i++)
    {
-      uint16_t numchanged  = *(patch16++);
+      uint32s_insert_result_t found;
+      size_t same               = 0;
+      size_t offset             = i * superblock_sz;
+      const uint32_t *previous  = prev
+         ? uint32s_index_get(state->superblocks, prev[i]) : NULL;
+
+      /* Count the leading blocks that did not change */
+      if (previous)
+      {
+         for (; same < DEDUP_SUPERBLOCK_SIZE; same++)
+         {
+            size_t pos = offset + same * block_size;
+            if (pos >= state->blocksize)
+               same = DEDUP_SUPERBLOCK_SIZE;
+            else if (memcmp(state_manager_dedup_block(state, buf, pos),
+                     uint32s_index_get(state->blocks, previous[same]),
+                     block_size))
+               break;
+         }
+         if (same == DEDUP_SUPERBLOCK_SIZE)
+         {
+            uint32s_index_bump_count(state->superblocks, prev[i]);
+            seq[i] = prev[i];
+            continue;
+         }
+      }
 
-      if (numchanged)
+      for (j = 0; j < DEDUP_SUPERBLOCK_SIZE; j++)
       {
-         uint16_t i;
+         size_t pos = offset + j * block_size;
+         uint32_t *block = NULL;
 
-         out16       += *patch16++;
+         if (pos >= state->blocksize)
+         {
+            /* Superblocks past the end are padded with zero blocks */
+            uint32s_index_bump_count(state->blocks, 0);
+            state->superblock[j] = 0;
+            continue;
+         }
 
-         /* We could do memcpy, but it seems that memcpy has a
-          * constant-per-call overhead that actually shows up.
-          *
-          * Our average size in here seems to be 8 or something.
-          * Therefore, we do something with lower overhead. */
-         for (i = 0; i < numchanged; i++)
-            out16[i]  = patch16[i];
+         if (j >= same)
+            block = state_manager_dedup_block(state, buf, pos);
+         if (j < same || (previous && !memcmp(block,
+                     uint32s_index_get(state->blocks, previous[j]),
+                     block_size)))
+         {
+            uint32s_index_bump_count(state->blocks, previous[j]);
+            state->superblock[j] = previous[j];
+            continue;
+         }
 
-         patch16     += numchanged;
-         out16       += numchanged;
+         found = uint32s_index_insert(state->blocks, block, 0);
+         if (found.is_new)
+            state->dedup_used += block_size + DEDUP_OVERHEAD;
+         state->superblock[j] = found.index;
       }
+
+      found = uint32s_index_insert(state->superblocks, state->superblock, 0);
+      if (found.is_new)
+         state->dedup_used += DEDUP_SUPERBLOCK_SIZE * sizeof(uint32_t)
+            + DEDUP_OVERHEAD;
       else
       {
-         uint32_t numunchanged = patch16[0] | (patch16[1] << 16);
+         /* The stored superblock already holds its blocks */
+         for (j = 0; j < DEDUP_SUPERBLOCK_SIZE; j++)
+            uint32s_index_release(state->blocks, state->superblock[j]);
+      }
+      seq[i] = found.index;
+   }
+
+   state->seq_count++;
+   return true;
+}
+
+/* Rebuilds the newest stored state into data and drops it. */
+static bool state_manager_dedup_pop(state_manager_t *state, uint8_t *data)
+{
+   size_t i, j;
+   size_t superblock_sz = DEDUP_SUPERBLOCK_SIZE * state->dedup_block_size;
+   const uint32_t *seq  = NULL;
+
+   if (!state->seq_count)
+      return false;
+
+   seq = state_manager_dedup_seq(state, state->seq_count - 1);
+   for (i = 0; i < state->seq_len; i++)
+   {
+      const uint32_t *superblock = uint32s_index_get(
+            state->superblocks, seq[i]);
 
-         if (!numunchanged)
+      for (j = 0; j < DEDUP_SUPERBLOCK_SIZE; j++)
+      {
+         size_t pos = i * superblock_sz + j * state->dedup_block_size;
+         size_t len = state->dedup_block_size;
+
+         if (pos >= state->blocksize)
             break;
-         patch16 += 2;
-         out16   += numunchanged;
+         if (len > state->blocksize - pos)
+            len = state->blocksize - pos;
+         memcpy(data + pos,
+               uint32s_index_get(state->blocks, superblock[j]), len);
       }
    }
+
+   state_manager_dedup_release(state, seq);
+   state->seq_count--;
+   return true;
 }
+#endif
 
-/* The start offsets point to 'nextstart' of any given compressed frame.
- * Each uint16 is stored native endian; anything that claims any other
- * endianness refers to the endianness of this specific item.
- * The uint32 is stored little endian.
- *
- * Each size value is stored native endian if alignment is not enforced;
- * if it is, they're little endian.
- *
- * The start of the buffer contains a size pointing to the end of the
- * buffer; the end points to its start.
- *
- * Wrapping is handled by returning to the start of the buffer if the
- * compressed data could potentially hit the edge;
- *
- * if the compressed data could potentially overwrite the tail pointer,
- * the tail retreats until it can no longer collide.
- *
- * This means that on average, ~2 * maxcompsize is
- * unused at any given moment. */
+#ifdef HAVE_THREADS
+static void state_manager_wait(state_manager_t *state)
+{
+   if (!state->thread)
+      return;
 
-/* These are called very few constant times per frame,
- * keep it as simple as possible. */
-static INLINE void write_size_t(void *ptr, size_t val)
+   slock_lock(state->lock);
+   while (state->busy)
+      scond_wait(state->cond, state->lock);
+   slock_unlock(state->lock);
+}
+#endif
+
+/* Appends the patch that turns newb back into oldb to the ring,
+ * or stores oldb with the deduplicating backend.
+ * Returns false if the ring cannot hold a single patch. */
+static bool state_manager_append(state_manager_t *state,
+      const uint8_t *oldb, const uint8_t *newb)
 {
-   memcpy(ptr, &val, sizeof(val));
+   uint8_t *compressed;
+   size_t headpos, tailpos, remaining;
+
+#ifdef HAVE_STATESTREAM
+   /* The deduplicated states are stored whole, oldb is the one
+    * newb replaces as the newest */
+   if (state->blocks)
+      return state_manager_dedup_append(state, oldb);
+#endif
+
+   if (state->capacity < sizeof(size_t) + state->maxcompsize)
+   {
+      RARCH_ERR("[Rewind] %s.\n",
+            msg_hash_to_str(MSG_REWIND_BUFFER_CAPACITY_INSUFFICIENT));
+      return false;
+   }
+
+recheckcapacity:;
+   headpos   = state->head - state->data;
+   tailpos   = state->tail - state->data;
+   remaining = (tailpos + state->capacity -
+         sizeof(size_t) - headpos - 1) % state->capacity + 1;
+
+   if (remaining <= state->maxcompsize)
+   {
+      state_manager_tier_push(state, 0, state->tail + sizeof(size_t), 1);
+      state->tail = state->data + read_size_t(state->tail);
+      goto recheckcapacity;
+   }
+
+   compressed        = state->head + sizeof(size_t);
+
+   compressed       += state_manager_entry_compress(state, oldb, newb,
+         compressed);
+
+   if (compressed - state->data + state->maxcompsize > state->capacity)
+   {
+      compressed     = state->data;
+      if (state->tail == state->data + sizeof(size_t))
+      {
+         state_manager_tier_push(state, 0, state->tail + sizeof(size_t), 1);
+         state->tail = state->data + read_size_t(state->tail);
+      }
+   }
+   write_size_t(compressed, state->head-state->data);
+   compressed       += sizeof(size_t);
+   write_size_t(state->head, compressed-state->data);
+   state->head       = compressed;
+   return true;
 }
 
-static INLINE size_t read_size_t(const void *ptr)
+#ifdef HAVE_THREADS
+/* Compresses one capture at a time against the state pushed before
+ * it, then makes it the newest state. */
+static void state_manager_thread(void *data)
 {
-   size_t ret;
+   state_manager_t *state = (state_manager_t*)data;
 
-   memcpy(&ret, ptr, sizeof(ret));
-   return ret;
+   slock_lock(state->lock);
+   for (;;)
+   {
+      while (!state->busy && !state->quit)
+         scond_wait(state->cond, state->lock);
+      if (state->quit)
+         break;
+      slock_unlock(state->lock);
+
+      if (state_manager_append(state, state->thisblock, state->pendingblock))
+      {
+         uint8_t *swap       = state->thisblock;
+         state->thisblock    = state->pendingblock;
+         state->pendingblock = swap;
+         state->entries++;
+         state->captures++;
+      }
+
+      slock_lock(state->lock);
+      state->busy = false;
+      scond_signal(state->cond);
+   }
+   slock_unlock(state->lock);
 }
+#endif
 
 static void state_manager_free(state_manager_t *state)
 {
+   unsigned i;
+
    if (!state)
       return;
 
+#ifdef HAVE_THREADS
+   if (state->thread)
+   {
+      slock_lock(state->lock);
+      state->quit = true;
+      scond_signal(state->cond);
+      slock_unlock(state->lock);
+      sthread_join(state->thread);
+      state->thread = NULL;
+   }
+   if (state->cond)
+      scond_free(state->cond);
+   if (state->lock)
+      slock_free(state->lock);
+   if (state->pendingblock)
+      free(state->pendingblock);
+   state->cond         = NULL;
+   state->lock         = NULL;
+   state->pendingblock = NULL;
+#endif
+
+#ifdef HAVE_ZSTD
+   if (state->zstd_cctx)
+      ZSTD_freeCCtx((ZSTD_CCtx*)state->zstd_cctx);
+   if (state->zstd_dctx)
+      ZSTD_freeDCtx((ZSTD_DCtx*)state->zstd_dctx);
+   if (state->zstd_patch)
+      free(state->zstd_patch);
+   state->zstd_cctx   = NULL;
+   state->zstd_dctx   = NULL;
+   state->zstd_patch  = NULL;
+#endif
+
+   for (i = 0; i < state->tier_count; i++)
+   {
+      struct state_manager_tier *tier = &state->tiers[i];
+#ifdef STATE_MANAGER_SPILL
+      if (tier->mapped)
+         munmap(tier->data, tier->capacity);
+      else
+#endif
+         free(tier->data);
+      if (tier->pending)
+         free(tier->pending);
+   }
+   state->tier_count = 0;
+   if (state->tier_patch[0])
+      free(state->tier_patch[0]);
+   if (state->tier_patch[1])
+      free(state->tier_patch[1]);
+   state->tier_patch[0] = NULL;
+   state->tier_patch[1] = NULL;
+
+#ifdef HAVE_STATESTREAM
+   if (state->blocks)
+      uint32s_index_free(state->blocks);
+   if (state->superblocks)
+      uint32s_index_free(state->superblocks);
+   if (state->seqs)
+      free(state->seqs);
+   if (state->padblock)
+      free(state->padblock);
+   if (state->superblock)
+      free(state->superblock);
+   state->blocks      = NULL;
+   state->superblocks = NULL;
+   state->seqs        = NULL;
+   state->padblock    = NULL;
+   state->superblock  = NULL;
+#endif
+
    if (state->data)
       free(state->data);
    if (state->thisblock)
@@ -396,9 +988,10 @@ static void state_manager_free(state_manager_t *state)
 }
 
 static state_manager_t *state_manager_new(
-      size_t state_size, size_t buffer_size)
+      size_t state_size, size_t buffer_size, bool dedup, bool compress,
+      size_t spill_size, const char *spill_dir, unsigned seconds)
 {
-   size_t max_comp_size, block_size;
+   size_t max_comp_size, block_size, ring_size;
    uint8_t *next_block    = NULL;
    uint8_t *this_block    = NULL;
    uint8_t *state_data    = NULL;
@@ -407,13 +1000,88 @@ static state_manager_t *state_manager_new(
    if (!state)
       return NULL;
 
+   if (state_manager_raw_selected() == STATE_MANAGER_RAW_IMPL_SCALAR)
+   {
+      state_manager_raw_select(STATE_MANAGER_RAW_IMPL_AUTO);
+      RARCH_LOG("[Rewind] Using %s delta kernels.\n",
+            state_manager_raw_impl_name(state_manager_raw_selected()));
+   }
+
    block_size         = (state_size + sizeof(uint16_t) - 1) & -sizeof(uint16_t);
    /* the compressed data is surrounded by pointers to the other side */
    max_comp_size      = state_manager_raw_maxsize(state_size) + sizeof(size_t) * 2;
-   state_data         = (uint8_t*)malloc(buffer_size);
 
-   if (!state_data)
-      goto error;
+#ifdef HAVE_STATESTREAM
+   /* Deduplicated states are not kept in the ring the levels thin
+    * out, so there is nothing to split the buffer for */
+   if (seconds && dedup)
+   {
+      RARCH_WARN("[Rewind] History is not thinned out while deduplicating states.\n");
+      seconds         = 0;
+   }
+#endif
+
+   /* Each level needs room for a couple of entries, with the
+    * captures they span and a zstd header */
+   if (     seconds
+         && buffer_size / 4 < sizeof(size_t)
+            + (max_comp_size + sizeof(uint32_t) * 3) * 2)
+   {
+      RARCH_WARN("[Rewind] Buffer too small to thin out history, keeping every capture.\n");
+      seconds         = 0;
+   }
+   ring_size          = seconds ? buffer_size / 4 : buffer_size;
+
+#ifdef HAVE_STATESTREAM
+   if (dedup)
+   {
+      size_t dedup_block      = state_size < DEDUP_SMALL_STATE
+         ? DEDUP_SMALL_BLOCK_SIZE : DEDUP_BLOCK_SIZE;
+      size_t superblock_bytes = DEDUP_SUPERBLOCK_SIZE * dedup_block;
+
+      state->dedup_block_size = dedup_block;
+      state->seq_len          = (block_size + superblock_bytes - 1)
+         / superblock_bytes;
+      state->blocks           = uint32s_index_new(
+            dedup_block / sizeof(uint32_t), 0, 0);
+      state->superblocks      = uint32s_index_new(
+            DEDUP_SUPERBLOCK_SIZE, 0, 0);
+      state->padblock         = (uint32_t*)malloc(dedup_block);
+      state->superblock       = (uint32_t*)malloc(
+            DEDUP_SUPERBLOCK_SIZE * sizeof(uint32_t));
+
+      if (!state->padblock || !state->superblock)
+         goto error;
+
+      RARCH_LOG("[Rewind] Deduplicating states in %u byte blocks.\n",
+            (unsigned)dedup_block);
+   }
+   else
+#endif
+   {
+      state_data      = (uint8_t*)malloc(ring_size);
+
+      if (!state_data)
+         goto error;
+   }
+
+#ifdef HAVE_ZSTD
+   if (compress && !state->blocks)
+   {
+      /* Entries gain a size and up to 3 bytes of padding */
+      max_comp_size     += sizeof(uint32_t) * 2;
+      state->zstd_cctx   = ZSTD_createCCtx();
+      state->zstd_dctx   = ZSTD_createDCtx();
+      state->zstd_patch  = (uint8_t*)malloc(
+            state_manager_raw_maxsize(state_size));
+      state->zstd_level  = ZSTD_STAGE_LEVEL_START;
+
+      if (!state->zstd_cctx || !state->zstd_dctx || !state->zstd_patch)
+         goto error;
+
+      RARCH_LOG("[Rewind] Compressing deltas with zstd.\n");
+   }
+#endif
 
    this_block         = (uint8_t*)state_manager_raw_alloc(state_size, 0);
    next_block         = (uint8_t*)state_manager_raw_alloc(state_size, 1);
@@ -426,20 +1094,76 @@ static state_manager_t *state_manager_new(
    state->data        = state_data;
    state->thisblock   = this_block;
    state->nextblock   = next_block;
-   state->capacity    = buffer_size;
+   /* Deduplicated states always get the whole budget; only the
+    * ring shares it with the thinning levels */
+   state->capacity    = state_data ? ring_size : buffer_size;
 
-   state->head        = state->data + sizeof(size_t);
-   state->tail        = state->data + sizeof(size_t);
+   if (state->data)
+   {
+      state->head     = state->data + sizeof(size_t);
+      state->tail     = state->data + sizeof(size_t);
+   }
+
+   if (state->data && (seconds || spill_size))
+   {
+      size_t patch_size     = state_manager_raw_maxsize(state_size);
+
+      if (     !(state->tier_patch[0] = (uint8_t*)malloc(patch_size))
+            || !(state->tier_patch[1] = (uint8_t*)malloc(patch_size)))
+         goto error;
+   }
+
+   if (state->data && seconds)
+   {
+      size_t thin_size      = buffer_size / 4;
+      size_t coarse_size    = buffer_size - ring_size - thin_size;
+      uint8_t *thin_data    = (uint8_t*)malloc(thin_size);
+      uint8_t *coarse_data  = NULL;
+
+      if (!state_manager_tier_init(state, thin_data, thin_size,
+               TIER_THIN_MERGE, false))
+      {
+         free(thin_data);
+         goto error;
+      }
+      coarse_data           = (uint8_t*)malloc(coarse_size);
+      if (!state_manager_tier_init(state, coarse_data, coarse_size,
+               TIER_COARSE_MERGE_START, false))
+      {
+         free(coarse_data);
+         goto error;
+      }
+      state->seconds        = seconds;
+
+      RARCH_LOG("[Rewind] Thinning out history to keep %u seconds.\n",
+            seconds);
+   }
+
+#ifdef STATE_MANAGER_SPILL
+   if (     state->data
+         && spill_size
+         && !state_manager_spill_init(state, spill_size, spill_dir))
+      RARCH_WARN("[Rewind] Failed to map the spill file, keeping history in memory only.\n");
+#endif
 
 #if STRICT_BUF_SIZE
    state->debugsize   = state_size;
    state->debugblock  = (uint8_t*)malloc(state_size);
 #endif
 
+#ifdef HAVE_THREADS
+   /* Without a worker, captures are compressed on the spot */
+   if (     !(state->pendingblock = (uint8_t*)state_manager_raw_alloc(state_size, 2))
+         || !(state->lock         = slock_new())
+         || !(state->cond         = scond_new())
+         || !(state->thread       = sthread_create(state_manager_thread, state)))
+      RARCH_WARN("[Rewind] Failed to start compression thread, compressing on the main thread.\n");
+#endif
+
    return state;
 
 error:
-   if (state_data)
+   if (state_data && !state->data)
       free(state_data);
    state_manager_free(state);
    free(state);
@@ -455,26 +1179,58 @@ static bool state_manager_pop(state_manager_t *state, const void **data)
 
    *data                        = NULL;
 
+#ifdef HAVE_THREADS
+   /* The newest state may still be in flight */
+   state_manager_wait(state);
+#endif
+
    if (state->thisblock_valid)
    {
       state->thisblock_valid    = false;
       state->entries--;
+      state->captures--;
       *data                     = state->thisblock;
       return true;
    }
 
    *data                        = state->thisblock;
+
+#ifdef HAVE_STATESTREAM
+   if (state->blocks)
+   {
+      if (!state_manager_dedup_pop(state, state->thisblock))
+         return false;
+      state->entries--;
+      state->captures--;
+      return true;
+   }
+#endif
+
    if (state->head == state->tail)
+   {
+      unsigned t;
+
+      /* Past the ring, continue with the older levels */
+      for (t = 0; t < state->tier_count; t++)
+      {
+         if (state_manager_tier_pop(state, t))
+         {
+            state->entries--;
+            return true;
+         }
+      }
       return false;
+   }
 
    start                        = read_size_t(state->head - sizeof(size_t));
    state->head                  = state->data + start;
    compressed                   = state->data + start + sizeof(size_t);
    out                          = state->thisblock;
 
-   state_manager_raw_decompress(compressed, out);
+   state_manager_entry_decompress(state, compressed, out);
 
    state->entries--;
+   state->captures--;
    return true;
 }
 
@@ -491,6 +1247,7 @@ static void state_manager_push_where(state_manager_t *state, void **data)
       {
          state->thisblock_valid = true;
          state->entries++;
+         state->captures++;
       }
    }
 
@@ -500,7 +1257,10 @@ static void state_manager_push_where(state_manager_t *state, void **data)
 #endif
 }
 
-static void state_manager_push_do(state_manager_t *state)
+/* @target_captures is handed over here rather than written by the
+ * caller, since the worker reads it while thinning out history */
+static void state_manager_push_do(state_manager_t *state,
+      unsigned target_captures)
 {
    uint8_t *swap = NULL;
 
@@ -510,46 +1270,28 @@ static void state_manager_push_do(state_manager_t *state)
 
    if (state->thisblock_valid)
    {
-      uint8_t *compressed;
-      const uint8_t *oldb, *newb;
-      size_t headpos, tailpos, remaining;
-      if (state->capacity < sizeof(size_t) + state->maxcompsize)
+#ifdef HAVE_THREADS
+      if (state->thread)
       {
-         RARCH_ERR("[Rewind] %s.\n",
-               msg_hash_to_str(MSG_REWIND_BUFFER_CAPACITY_INSUFFICIENT));
+         /* Only waits if the previous capture is still being
+          * compressed; the capture slot swaps with the one the
+          * worker let go of */
+         state_manager_wait(state);
+         state->target_captures = target_captures;
+         swap                = state->pendingblock;
+         state->pendingblock = state->nextblock;
+         state->nextblock    = swap;
+
+         slock_lock(state->lock);
+         state->busy         = true;
+         scond_signal(state->cond);
+         slock_unlock(state->lock);
          return;
       }
-
-recheckcapacity:;
-      headpos   = state->head - state->data;
-      tailpos   = state->tail - state->data;
-      remaining = (tailpos + state->capacity -
-            sizeof(size_t) - headpos - 1) % state->capacity + 1;
-
-      if (remaining <= state->maxcompsize)
-      {
-         state->tail = state->data + read_size_t(state->tail);
-         state->entries--;
-         goto recheckcapacity;
-      }
-
-      oldb              = state->thisblock;
-      newb              = state->nextblock;
-      compressed        = state->head + sizeof(size_t);
-
-      compressed       += state_manager_raw_compress(oldb, newb,
-            state->blocksize, compressed);
-
-      if (compressed - state->data + state->maxcompsize > state->capacity)
-      {
-         compressed     = state->data;
-         if (state->tail == state->data + sizeof(size_t))
-            state->tail = state->data + read_size_t(state->tail);
-      }
-      write_size_t(compressed, state->head-state->data);
-      compressed       += sizeof(size_t);
-      write_size_t(state->head, compressed-state->data);
-      state->head       = compressed;
+#endif
+      state->target_captures = target_captures;
+      if (!state_manager_append(state, state->thisblock, state->nextblock))
+         return;
    }
    else
       state->thisblock_valid = true;
@@ -559,11 +1301,13 @@ recheckcapacity:;
    state->nextblock          = swap;
 
    state->entries++;
+   state->captures++;
 }
 
 void state_manager_event_init(
       struct state_manager_rewind_state *rewind_st,
-      unsigned rewind_buffer_size)
+      unsigned rewind_buffer_size, bool dedup, bool compress,
+      size_t spill_size, const char *spill_dir, unsigned seconds)
 {
    core_info_t *core_info = NULL;
    void *state            = NULL;
@@ -618,7 +1362,18 @@ void state_manager_event_init(
          (unsigned)(rewind_buffer_size / 1000000));
 
    rewind_st->state = state_manager_new(rewind_st->size,
-         rewind_buffer_size);
+         rewind_buffer_size, dedup, compress, spill_size, spill_dir,
+         seconds);
+
+#ifdef HAVE_ZSTD
+   /* A quarter of a frame, leaving the rest to the core and drivers */
+   if (rewind_st->state && rewind_st->state->zstd_cctx)
+   {
+      double fps = video_state_get_ptr()->av_info.timing.fps;
+      rewind_st->state->zstd_budget = (int64_t)(1000000.0
+            / (fps > 0.0 ? fps : 60.0) / 4);
+   }
+#endif
 
    if (!rewind_st->state)
       RARCH_WARN("[Rewind] %s.\n",
@@ -630,7 +1385,8 @@ void state_manager_event_init(
    content_serialize_state_rewind(state, rewind_st->size);
    rewind_st->flags &= ~STATE_MGR_REWIND_ST_FLAG_IS_REWIND_SERIALIZE;
 
-   state_manager_push_do(rewind_st->state);
+   state_manager_push_do(rewind_st->state,
+         rewind_st->state->target_captures);
 }
 
 void state_manager_event_deinit(
@@ -736,6 +1492,9 @@ bool state_manager_check_rewind(
 
       if (state_manager_pop(rewind_st->state, &buf))
       {
+         size_t _len;
+         double fps;
+
 #ifdef HAVE_NETWORKING
          /* Make sure netplay isn't confused */
          if (!was_reversed
@@ -747,7 +1506,15 @@ bool state_manager_check_rewind(
 
          audio_driver_setup_rewind();
 
-         strlcpy(s, msg_hash_to_str(MSG_REWINDING), len);
+         _len                   = strlcpy(s,
+               msg_hash_to_str(MSG_REWINDING), len);
+         fps                    = video_state_get_ptr()->av_info.timing.fps;
+
+         /* How far back the history still goes */
+         if (_len < len && fps > 0.0)
+            snprintf(s + _len, len - _len, " %.1f s",
+                  (double)rewind_st->state->captures
+                  * (rewind_granularity ? rewind_granularity : 1) / fps);
 
          *time                  = is_paused ? 1 : 30;
          ret                    = true;
@@ -802,14 +1569,24 @@ bool state_manager_check_rewind(
       if (     !is_paused
             && ((cnt == 0) || retroarch_ctl(RARCH_CTL_BSV_MOVIE_IS_INITED, NULL)))
       {
-         void *state = NULL;
+         void *state              = NULL;
+         unsigned target_captures = 0;
+
+         if (rewind_st->state->seconds)
+         {
+            double fps = video_state_get_ptr()->av_info.timing.fps;
+            target_captures = (unsigned)(
+                  rewind_st->state->seconds * (fps > 0.0 ? fps : 60.0)
+                  / (rewind_granularity ? rewind_granularity : 1));
+         }
+
          state_manager_push_where(rewind_st->state, &state);
 
          rewind_st->flags |= STATE_MGR_REWIND_ST_FLAG_IS_REWIND_SERIALIZE;
          content_serialize_state_rewind(state, rewind_st->size);
          rewind_st->flags &= ~STATE_MGR_REWIND_ST_FLAG_IS_REWIND_SERIALIZE;
 
-         state_manager_push_do(rewind_st->state);
+         state_manager_push_do(rewind_st->state, target_captures);
       }
    }
 
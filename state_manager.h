@@ -26,6 +26,14 @@
 
 #include "dynamic.h"
 
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
+#ifdef HAVE_STATESTREAM
+#include "input/bsv/uint32s_index.h"
+#endif
+
 RETRO_BEGIN_DECLS
 
 enum state_manager_rewind_st_flags
@@ -37,6 +45,31 @@ enum state_manager_rewind_st_flags
    STATE_MGR_REWIND_ST_FLAG_IS_REWIND_SERIALIZE   = (1 << 4)
 };
 
+/* Two levels that thin history out, and the spill file */
+#define STATE_MANAGER_TIERS 3
+
+/* Ring of patches evicted from the level before it, laid out like the
+ * rewind buffer; each entry starts with the number of captures it
+ * spans. Patches are merged 'merge' at a time before they are stored,
+ * so a level keeps every so many captures. */
+struct state_manager_tier
+{
+   uint8_t *data;
+   uint8_t *head;
+   uint8_t *tail;
+   /* Raw patch of the evicted patches merged so far */
+   uint8_t *pending;
+   size_t capacity;
+   /* Bytes written to a mapped file since the last writeback */
+   size_t unsynced;
+   unsigned entries;
+   unsigned captures;
+   unsigned merge;
+   unsigned pending_count;
+   unsigned pending_captures;
+   bool mapped;
+};
+
 struct state_manager
 {
    uint8_t *data;
@@ -47,6 +80,51 @@ struct state_manager
 
    uint8_t *thisblock;
    uint8_t *nextblock;
+#ifdef HAVE_THREADS
+   /* The newest capture while the worker compresses it against
+    * thisblock. Takes turns with nextblock as the capture slot. */
+   uint8_t *pendingblock;
+   sthread_t *thread;
+   slock_t *lock;
+   scond_t *cond;
+#endif
+#ifdef HAVE_STATESTREAM
+   /* Deduplicating backend; when set, states older than thisblock
+    * are kept here instead of in the ring at data. */
+   uint32s_index_t *blocks;
+   uint32s_index_t *superblocks;
+   /* Superblock sequence of each stored state, seq_len indices
+    * each, oldest at seq_first, wrapping around seq_slots */
+   uint32_t *seqs;
+   /* The last block of a state, padded with zeroes */
+   uint32_t *padblock;
+   uint32_t *superblock;
+   size_t seq_len;
+   size_t seq_first;
+   size_t seq_count;
+   size_t seq_slots;
+   size_t dedup_block_size;
+   /* Bytes held by blocks, superblocks and seqs */
+   size_t dedup_used;
+#endif
+#ifdef HAVE_ZSTD
+   /* Second stage run on each patch, when set */
+   void *zstd_cctx;
+   void *zstd_dctx;
+   /* The patch before, or after, the zstd stage */
+   uint8_t *zstd_patch;
+   /* Average push time and its budget, in microseconds */
+   int64_t zstd_usec;
+   int64_t zstd_budget;
+   int zstd_level;
+   unsigned zstd_pushes;
+#endif
+   /* Older history, newest level first; the spill file, if any,
+    * is the last one */
+   struct state_manager_tier tiers[STATE_MANAGER_TIERS];
+   unsigned tier_count;
+   /* Raw patches being merged */
+   uint8_t *tier_patch[2];
 #if STRICT_BUF_SIZE
    uint8_t *debugblock;
    size_t debugsize;
@@ -61,7 +139,18 @@ struct state_manager
    size_t maxcompsize;
 
    unsigned entries;
+   /* Captures the stored states span, and how many rewind_seconds
+    * asks for; 0 when only the buffer size counts */
+   unsigned captures;
+   unsigned target_captures;
+   unsigned seconds;
    bool thisblock_valid;
+#ifdef HAVE_THREADS
+   /* A capture is being compressed; head, tail, entries, thisblock
+    * and pendingblock belong to the worker until it is done */
+   bool busy;
+   bool quit;
+#endif
 };
 
 typedef struct state_manager state_manager_t;
@@ -80,8 +169,24 @@ void state_manager_event_deinit(
       struct state_manager_rewind_state *rewind_st,
       struct retro_core_t *current_core);
 
+/**
+ * state_manager_event_init:
+ * @rewind_buffer_size   : memory budget of the rewind buffer in bytes
+ * @dedup                : store states as deduplicated blocks, if built
+ *                         with HAVE_STATESTREAM
+ * @compress             : run each delta through zstd, if built with
+ *                         HAVE_ZSTD
+ * @spill_size           : size of the scratch file history evicted from
+ *                         the buffer moves to, 0 for none
+ * @spill_dir            : directory of the scratch file, the system's
+ *                         temporary directory if empty
+ * @seconds              : history to keep within @rewind_buffer_size,
+ *                         thinning out older captures; 0 keeps every
+ *                         capture until the buffer is full
+ **/
 void state_manager_event_init(struct state_manager_rewind_state *rewind_st,
-      unsigned rewind_buffer_size);
+      unsigned rewind_buffer_size, bool dedup, bool compress,
+      size_t spill_size, const char *spill_dir, unsigned seconds);
 
 /**
  * check_rewind:
@@ -0,0 +1,805 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2017 - Daniel De Matteis
+ *  Copyright (C) 2014-2017 - Alfred Agrell
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libretro.h>
+#include <retro_inline.h>
+#include <compat/intrinsics.h>
+#include <features/features_cpu.h>
+
+#include "state_manager_raw.h"
+
+#ifndef UINT16_MAX
+#define UINT16_MAX 0xffff
+#endif
+
+#ifndef UINT32_MAX
+#define UINT32_MAX 0xffffffffu
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(__i486__) || defined(__i686__) || defined(_M_IX86) || defined(_M_AMD64) || defined(_M_X64)
+#define CPU_X86
+#endif
+
+/* Other arches SIGBUS (usually) on unaligned accesses. */
+#ifndef CPU_X86
+#define NO_UNALIGNED_MEM
+#endif
+
+/* The vector kernels are built for any x86 target and picked at
+ * runtime; only NEON is a build-time choice. */
+#if defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__)) && defined(CPU_X86)
+#include <immintrin.h>
+#define STATE_MANAGER_RAW_SSE2 1
+#define STATE_MANAGER_RAW_AVX2 1
+#define STATE_MANAGER_RAW_SSE2_TARGET __attribute__((target("sse2")))
+#define STATE_MANAGER_RAW_AVX2_TARGET __attribute__((target("avx2")))
+#elif defined(_MSC_VER) && _MSC_VER >= 1800 && defined(CPU_X86)
+#include <immintrin.h>
+#define STATE_MANAGER_RAW_SSE2 1
+#define STATE_MANAGER_RAW_AVX2 1
+#define STATE_MANAGER_RAW_SSE2_TARGET
+#define STATE_MANAGER_RAW_AVX2_TARGET
+#elif __SSE2__
+#include <emmintrin.h>
+#define STATE_MANAGER_RAW_SSE2 1
+#define STATE_MANAGER_RAW_SSE2_TARGET
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define STATE_MANAGER_RAW_NEON 1
+#endif
+
+typedef size_t (*state_manager_raw_find_t)(const uint16_t *a,
+      const uint16_t *b);
+
+/* Format per frame (pseudocode): */
+#if 0
+size nextstart;
+repeat {
+   uint16 numchanged; /* everything is counted in units of uint16 */
+   if (numchanged)
+   {
+      uint16 numunchanged; /* skip these before handling numchanged */
+      uint16[numchanged] changeddata;
+   }
+   else
+   {
+      uint32 numunchanged;
+      if (!numunchanged)
+         break;
+   }
+}
+size thisstart;
+#endif
+
+/* There's no equivalent in libc, you'd think so ...
+ * std::mismatch exists, but it's not optimized at all. */
+static size_t find_change_scalar(const uint16_t *a, const uint16_t *b)
+{
+   const uint16_t *a_org = a;
+#ifdef NO_UNALIGNED_MEM
+   while (((uintptr_t)a & (sizeof(size_t) - 1)) && *a == *b)
+   {
+      a++;
+      b++;
+   }
+   if (*a == *b)
+#endif
+   {
+      const size_t *a_big = (const size_t*)a;
+      const size_t *b_big = (const size_t*)b;
+
+      while (*a_big == *b_big)
+      {
+         a_big++;
+         b_big++;
+      }
+      a = (const uint16_t*)a_big;
+      b = (const uint16_t*)b_big;
+
+      while (*a == *b)
+      {
+         a++;
+         b++;
+      }
+   }
+   return a - a_org;
+}
+
+static size_t find_same_scalar(const uint16_t *a, const uint16_t *b)
+{
+   const uint16_t *a_org = a;
+#ifdef NO_UNALIGNED_MEM
+   if (((uintptr_t)a & (sizeof(uint32_t) - 1)) && *a != *b)
+   {
+      a++;
+      b++;
+   }
+   if (*a != *b)
+#endif
+   {
+      /* With this, it's random whether two consecutive identical
+       * words are caught.
+       *
+       * Luckily, compression rate is the same for both cases, and
+       * three is always caught.
+       *
+       * (We prefer to miss two-word blocks, anyways; fewer iterations
+       * of the outer loop, as well as in the decompressor.) */
+      const uint32_t *a_big = (const uint32_t*)a;
+      const uint32_t *b_big = (const uint32_t*)b;
+
+      while (*a_big != *b_big)
+      {
+         a_big++;
+         b_big++;
+      }
+      a = (const uint16_t*)a_big;
+      b = (const uint16_t*)b_big;
+
+      if (a != a_org && a[-1] == b[-1])
+      {
+         a--;
+         b--;
+      }
+   }
+   return a - a_org;
+}
+
+#ifdef STATE_MANAGER_RAW_SSE2
+STATE_MANAGER_RAW_SSE2_TARGET
+static size_t find_change_sse2(const uint16_t *a, const uint16_t *b)
+{
+   const __m128i *a128 = (const __m128i*)a;
+   const __m128i *b128 = (const __m128i*)b;
+
+   for (;;)
+   {
+      __m128i v0    = _mm_loadu_si128(a128);
+      __m128i v1    = _mm_loadu_si128(b128);
+      __m128i c     = _mm_cmpeq_epi8(v0, v1);
+      uint32_t mask = _mm_movemask_epi8(c);
+
+      if (mask != 0xffff) /* Something has changed, figure out where. */
+      {
+         /* calculate the real offset to the differing byte */
+         size_t ret = (((uint8_t*)a128 - (uint8_t*)a) |
+               (compat_ctz(~mask)));
+
+         /* and convert that to the uint16_t offset */
+         return (ret >> 1);
+      }
+
+      a128++;
+      b128++;
+   }
+}
+
+/* Same words as find_same_scalar, four at a time. */
+STATE_MANAGER_RAW_SSE2_TARGET
+static size_t find_same_sse2(const uint16_t *a, const uint16_t *b)
+{
+   const __m128i *a128 = (const __m128i*)a;
+   const __m128i *b128 = (const __m128i*)b;
+   const uint16_t *a_org = a;
+
+   for (;;)
+   {
+      __m128i c     = _mm_cmpeq_epi32(_mm_loadu_si128(a128),
+            _mm_loadu_si128(b128));
+      uint32_t mask = _mm_movemask_epi8(c);
+
+      if (mask)
+      {
+         size_t ret = ((uint8_t*)a128 - (uint8_t*)a_org) + compat_ctz(mask);
+         a          = (const uint16_t*)((const uint8_t*)a_org + ret);
+         b          = (const uint16_t*)((const uint8_t*)b + ret);
+         break;
+      }
+
+      a128++;
+      b128++;
+   }
+
+   if (a != a_org && a[-1] == b[-1])
+      a--;
+   return a - a_org;
+}
+#endif
+
+#ifdef STATE_MANAGER_RAW_AVX2
+/* 64 bytes per iteration; state_manager_raw_alloc pads for it. */
+STATE_MANAGER_RAW_AVX2_TARGET
+static size_t find_change_avx2(const uint16_t *a, const uint16_t *b)
+{
+   const __m256i *a256 = (const __m256i*)a;
+   const __m256i *b256 = (const __m256i*)b;
+
+   for (;;)
+   {
+      __m256i c0 = _mm256_cmpeq_epi8(_mm256_loadu_si256(a256),
+            _mm256_loadu_si256(b256));
+      __m256i c1 = _mm256_cmpeq_epi8(_mm256_loadu_si256(a256 + 1),
+            _mm256_loadu_si256(b256 + 1));
+
+      if ((uint32_t)_mm256_movemask_epi8(_mm256_and_si256(c0, c1))
+            != 0xffffffff)
+      {
+         uint32_t mask = (uint32_t)_mm256_movemask_epi8(c0);
+         size_t ret    = (uint8_t*)a256 - (uint8_t*)a;
+
+         if (mask == 0xffffffff)
+         {
+            mask = (uint32_t)_mm256_movemask_epi8(c1);
+            ret += sizeof(__m256i);
+         }
+
+         return (ret + compat_ctz(~mask)) >> 1;
+      }
+
+      a256 += 2;
+      b256 += 2;
+   }
+}
+
+STATE_MANAGER_RAW_AVX2_TARGET
+static size_t find_same_avx2(const uint16_t *a, const uint16_t *b)
+{
+   const __m256i *a256 = (const __m256i*)a;
+   const __m256i *b256 = (const __m256i*)b;
+   const uint16_t *a_org = a;
+
+   for (;;)
+   {
+      __m256i c     = _mm256_cmpeq_epi32(_mm256_loadu_si256(a256),
+            _mm256_loadu_si256(b256));
+      uint32_t mask = (uint32_t)_mm256_movemask_epi8(c);
+
+      if (mask)
+      {
+         size_t ret = ((uint8_t*)a256 - (uint8_t*)a_org) + compat_ctz(mask);
+         a          = (const uint16_t*)((const uint8_t*)a_org + ret);
+         b          = (const uint16_t*)((const uint8_t*)b + ret);
+         break;
+      }
+
+      a256++;
+      b256++;
+   }
+
+   if (a != a_org && a[-1] == b[-1])
+      a--;
+   return a - a_org;
+}
+#endif
+
+#ifdef STATE_MANAGER_RAW_NEON
+static size_t find_change_neon(const uint16_t *a, const uint16_t *b)
+{
+   const uint8_t *a8 = (const uint8_t*)a;
+   const uint8_t *b8 = (const uint8_t*)b;
+
+   for (;;)
+   {
+      uint64x2_t c = vreinterpretq_u64_u8(
+            vceqq_u8(vld1q_u8(a8), vld1q_u8(b8)));
+
+      if ((vgetq_lane_u64(c, 0) & vgetq_lane_u64(c, 1)) != ~(uint64_t)0)
+      {
+         /* Find the word within these 16 bytes */
+         const uint16_t *a16 = (const uint16_t*)a8;
+         const uint16_t *b16 = (const uint16_t*)b8;
+
+         while (*a16 == *b16)
+         {
+            a16++;
+            b16++;
+         }
+         return a16 - a;
+      }
+
+      a8 += 16;
+      b8 += 16;
+   }
+}
+
+static size_t find_same_neon(const uint16_t *a, const uint16_t *b)
+{
+   const uint8_t *a8     = (const uint8_t*)a;
+   const uint8_t *b8     = (const uint8_t*)b;
+   const uint16_t *a_org = a;
+   size_t ret;
+
+   for (;;)
+   {
+      uint32x4_t c = vceqq_u32(vreinterpretq_u32_u8(vld1q_u8(a8)),
+            vreinterpretq_u32_u8(vld1q_u8(b8)));
+
+      if      (vgetq_lane_u32(c, 0))
+         ret = 0;
+      else if (vgetq_lane_u32(c, 1))
+         ret = 4;
+      else if (vgetq_lane_u32(c, 2))
+         ret = 8;
+      else if (vgetq_lane_u32(c, 3))
+         ret = 12;
+      else
+      {
+         a8 += 16;
+         b8 += 16;
+         continue;
+      }
+      break;
+   }
+
+   a = (const uint16_t*)(a8 + ret);
+   b = (const uint16_t*)(b8 + ret);
+   if (a != a_org && a[-1] == b[-1])
+      a--;
+   return a - a_org;
+}
+#endif
+
+static const char *state_manager_raw_impl_names[] = {
+   "auto", "scalar", "sse2", "avx2", "neon"
+};
+
+static enum state_manager_raw_impl state_manager_raw_current = STATE_MANAGER_RAW_IMPL_SCALAR;
+static state_manager_raw_find_t find_change = find_change_scalar;
+static state_manager_raw_find_t find_same   = find_same_scalar;
+
+bool state_manager_raw_supported(enum state_manager_raw_impl impl)
+{
+   uint64_t cpu = cpu_features_get();
+
+   switch (impl)
+   {
+      case STATE_MANAGER_RAW_IMPL_AUTO:
+      case STATE_MANAGER_RAW_IMPL_SCALAR:
+         return true;
+#ifdef STATE_MANAGER_RAW_SSE2
+      case STATE_MANAGER_RAW_IMPL_SSE2:
+#if __SSE2__
+         return true;
+#else
+         return (cpu & RETRO_SIMD_SSE2) != 0;
+#endif
+#endif
+#ifdef STATE_MANAGER_RAW_AVX2
+      case STATE_MANAGER_RAW_IMPL_AVX2:
+         return (cpu & RETRO_SIMD_AVX2) != 0;
+#endif
+#ifdef STATE_MANAGER_RAW_NEON
+      case STATE_MANAGER_RAW_IMPL_NEON:
+#if defined(__aarch64__) || defined(_M_ARM64)
+         return true;
+#else
+         return (cpu & RETRO_SIMD_NEON) != 0;
+#endif
+#endif
+      default:
+         break;
+   }
+
+   (void)cpu;
+   return false;
+}
+
+bool state_manager_raw_select(enum state_manager_raw_impl impl)
+{
+   if (impl == STATE_MANAGER_RAW_IMPL_AUTO)
+   {
+      for (impl = (enum state_manager_raw_impl)(STATE_MANAGER_RAW_IMPL_LAST - 1);
+            impl > STATE_MANAGER_RAW_IMPL_SCALAR;
+            impl = (enum state_manager_raw_impl)(impl - 1))
+         if (state_manager_raw_supported(impl))
+            break;
+   }
+   else if (!state_manager_raw_supported(impl))
+      return false;
+
+   switch (impl)
+   {
+#ifdef STATE_MANAGER_RAW_SSE2
+      case STATE_MANAGER_RAW_IMPL_SSE2:
+         find_change = find_change_sse2;
+         find_same   = find_same_sse2;
+         break;
+#endif
+#ifdef STATE_MANAGER_RAW_AVX2
+      case STATE_MANAGER_RAW_IMPL_AVX2:
+         find_change = find_change_avx2;
+         find_same   = find_same_avx2;
+         break;
+#endif
+#ifdef STATE_MANAGER_RAW_NEON
+      case STATE_MANAGER_RAW_IMPL_NEON:
+         find_change = find_change_neon;
+         find_same   = find_same_neon;
+         break;
+#endif
+      default:
+         impl        = STATE_MANAGER_RAW_IMPL_SCALAR;
+         find_change = find_change_scalar;
+         find_same   = find_same_scalar;
+         break;
+   }
+
+   state_manager_raw_current = impl;
+   return true;
+}
+
+enum state_manager_raw_impl state_manager_raw_selected(void)
+{
+   return state_manager_raw_current;
+}
+
+const char *state_manager_raw_impl_name(enum state_manager_raw_impl impl)
+{
+   if (impl >= STATE_MANAGER_RAW_IMPL_LAST)
+      return "unknown";
+   return state_manager_raw_impl_names[impl];
+}
+
+/* Returns the maximum compressed size of a savestate.
+ * It is very likely to compress to far less. */
+size_t state_manager_raw_maxsize(size_t uncomp)
+{
+   /* bytes covered by a compressed block */
+   const int maxcblkcover = UINT16_MAX * sizeof(uint16_t);
+   /* uncompressed size, rounded to 16 bits */
+   size_t uncomp16        = (uncomp + sizeof(uint16_t) - 1) & -sizeof(uint16_t);
+   /* number of blocks */
+   size_t maxcblks        = (uncomp + maxcblkcover - 1) / maxcblkcover;
+   return uncomp16 + maxcblks * sizeof(uint16_t) * 2 /* two u16 overhead per block */ + sizeof(uint16_t) *
+      3; /* three u16 to end it */
+}
+
+/*
+ * See state_manager_raw_compress for information about this.
+ * When you're done with it, send it to free().
+ */
+void *state_manager_raw_alloc(size_t len, uint16_t uniq)
+{
+   size_t  _len  = (len + sizeof(uint16_t) - 1) & -sizeof(uint16_t);
+   uint16_t *ret = (uint16_t*)calloc(_len + sizeof(uint16_t) * 4 + 64, 1);
+
+   if (!ret)
+      return NULL;
+
+   /* Force in a different byte at the end, so we don't need to check
+    * bounds in the innermost loop (it's expensive).
+    *
+    * There is also a large amount of data that's the same, to stop
+    * the other scan.
+    *
+    * There is also some padding at the end. This is so we don't
+    * read outside the buffer end if we're reading in large blocks;
+    * the widest kernel reads 64 bytes at a time.
+    *
+    * It doesn't make any difference to us, but sacrificing 64 bytes to get
+    * Valgrind happy is worth it. */
+   ret[_len / sizeof(uint16_t) + 3] = uniq;
+
+   return ret;
+}
+
+/*
+ * Takes two savestates and creates a patch that turns 'src' into 'dst'.
+ * Both 'src' and 'dst' must be returned from state_manager_raw_alloc(),
+ * with the same 'len', and different 'uniq'.
+ *
+ * 'patch' must be size 'state_manager_raw_maxsize(len)' or more.
+ * Returns the number of bytes actually written to 'patch'.
+ */
+size_t state_manager_raw_compress(const void *src,
+      const void *dst, size_t len, void *patch)
+{
+   const uint16_t  *old16 = (const uint16_t*)src;
+   const uint16_t  *new16 = (const uint16_t*)dst;
+   uint16_t *compressed16 = (uint16_t*)patch;
+   size_t          num16s = (len + sizeof(uint16_t) - 1)
+      / sizeof(uint16_t);
+
+   while (num16s)
+   {
+      size_t i, changed;
+      size_t skip = find_change(old16, new16);
+
+      if (skip >= num16s)
+         break;
+
+      old16  += skip;
+      new16  += skip;
+      num16s -= skip;
+
+      if (skip > UINT16_MAX)
+      {
+         /* This will make it scan the entire thing again,
+          * but it only hits on 8GB unchanged data anyways,
+          * and if you're doing that, you've got bigger problems. */
+         if (skip > UINT32_MAX)
+            skip         = UINT32_MAX;
+
+         *compressed16++ = 0;
+         *compressed16++ = skip;
+         *compressed16++ = skip >> 16;
+         continue;
+      }
+
+      changed = find_same(old16, new16);
+      if (changed > UINT16_MAX)
+         changed = UINT16_MAX;
+
+      *compressed16++ = changed;
+      *compressed16++ = skip;
+
+      for (i = 0; i < changed; i++)
+         compressed16[i] = old16[i];
+
+      old16        += changed;
+      new16        += changed;
+      num16s       -= changed;
+      compressed16 += changed;
+   }
+
+   compressed16[0]  = 0;
+   compressed16[1]  = 0;
+   compressed16[2]  = 0;
+
+   return (uint8_t*)(compressed16 + 3) - (uint8_t*)patch;
+}
+
+/*
+ * Takes 'patch' from a previous call to 'state_manager_raw_compress'
+ * and applies it to 'data' ('src' from that call),
+ * yielding 'dst' in that call.
+ *
+ * If the given arguments do not match a previous call to
+ * state_manager_raw_compress(), anything at all can happen.
+ */
+void state_manager_raw_decompress(const void *patch, void *data)
+{
+   uint16_t         *out16 = (uint16_t*)data;
+   const uint16_t *patch16 = (const uint16_t*)patch;
+
+   for (;;)
+   {
+      uint16_t numchanged  = *(patch16++);
+
+      if (numchanged)
+      {
+         uint16_t i;
+
+         out16       += *patch16++;
+
+         /* We could do memcpy, but it seems that memcpy has a
+          * constant-per-call overhead that actually shows up.
+          *
+          * Our average size in here seems to be 8 or something.
+          * Therefore, we do something with lower overhead. */
+         for (i = 0; i < numchanged; i++)
+            out16[i]  = patch16[i];
+
+         patch16     += numchanged;
+         out16       += numchanged;
+      }
+      else
+      {
+         uint32_t numunchanged = patch16[0] | (patch16[1] << 16);
+
+         if (!numunchanged)
+            break;
+         patch16 += 2;
+         out16   += numunchanged;
+      }
+   }
+}
+
+/* Returns the number of bytes of a patch from state_manager_raw_compress. */
+size_t state_manager_raw_patch_size(const void *patch)
+{
+   const uint16_t *patch16 = (const uint16_t*)patch;
+
+   for (;;)
+   {
+      uint16_t numchanged  = *(patch16++);
+
+      if (numchanged)
+         patch16          += 1 + numchanged;
+      else
+      {
+         uint32_t numunchanged = patch16[0] | (patch16[1] << 16);
+
+         patch16          += 2;
+         if (!numunchanged)
+            break;
+      }
+   }
+
+   return (const uint8_t*)patch16 - (const uint8_t*)patch;
+}
+
+/* Changed run of a patch, in u16 units of the state */
+struct state_manager_raw_run
+{
+   const uint16_t *patch;
+   const uint16_t *data;
+   size_t start;
+   size_t end;
+   /* Where the next run's skip counts from */
+   size_t pos;
+};
+
+static void state_manager_raw_run_next(struct state_manager_raw_run *run)
+{
+   for (;;)
+   {
+      uint16_t numchanged  = *(run->patch++);
+
+      if (numchanged)
+      {
+         run->start  = run->pos + *(run->patch++);
+         run->end    = run->start + numchanged;
+         run->data   = run->patch;
+         run->patch += numchanged;
+         run->pos    = run->end;
+         return;
+      }
+      else
+      {
+         uint32_t numunchanged = run->patch[0] | (run->patch[1] << 16);
+
+         run->patch += 2;
+         if (!numunchanged)
+         {
+            /* Past every position, so the other patch goes first */
+            run->start = run->end = (size_t)-1;
+            return;
+         }
+         run->pos   += numunchanged;
+      }
+   }
+}
+
+/* Output of state_manager_raw_merge; runs that meet are joined */
+struct state_manager_raw_writer
+{
+   uint16_t *out;
+   uint16_t *end;
+   uint16_t *run;
+   size_t pos;
+};
+
+static bool state_manager_raw_put(struct state_manager_raw_writer *w,
+      size_t start, const uint16_t *data, size_t len)
+{
+   while (len)
+   {
+      size_t n;
+
+      if (w->run && start == w->pos && *w->run < UINT16_MAX)
+      {
+         n = UINT16_MAX - *w->run;
+         if (n > len)
+            n = len;
+         if ((size_t)(w->end - w->out) < n)
+            return false;
+         *w->run += n;
+      }
+      else
+      {
+         size_t skip = start - w->pos;
+
+         n = len > UINT16_MAX ? UINT16_MAX : len;
+         if ((size_t)(w->end - w->out) < n + 5)
+            return false;
+         if (skip > UINT16_MAX)
+         {
+            /* Patches come from states far below 8GB, a single long
+             * skip always covers the gap */
+            *w->out++ = 0;
+            *w->out++ = skip;
+            *w->out++ = skip >> 16;
+            skip      = 0;
+         }
+         w->run    = w->out;
+         *w->out++ = n;
+         *w->out++ = skip;
+      }
+
+      memcpy(w->out, data, n * sizeof(uint16_t));
+      w->out += n;
+      w->pos  = start + n;
+      start  += n;
+      data   += n;
+      len    -= n;
+   }
+
+   return true;
+}
+
+/*
+ * Writes a patch with the effect of applying 'newer', then 'older', to
+ * 'patch'. Where both change a word, 'older' has the final say; the
+ * states themselves are not needed. Returns the number of bytes written,
+ * or 0 if they would be more than 'len'.
+ */
+size_t state_manager_raw_merge(const void *newer, const void *older,
+      void *patch, size_t len)
+{
+   struct state_manager_raw_run a, b;
+   struct state_manager_raw_writer w;
+
+   if (len < sizeof(uint16_t) * 3)
+      return 0;
+
+   a.patch = (const uint16_t*)newer;
+   a.data  = NULL;
+   a.pos   = 0;
+   b.patch = (const uint16_t*)older;
+   b.data  = NULL;
+   b.pos   = 0;
+   w.out   = (uint16_t*)patch;
+   w.end   = w.out + len / sizeof(uint16_t) - 3;
+   w.run   = NULL;
+   w.pos   = 0;
+
+   state_manager_raw_run_next(&a);
+   state_manager_raw_run_next(&b);
+
+   while (a.start != (size_t)-1 || b.start != (size_t)-1)
+   {
+      if (b.start <= a.start)
+      {
+         /* The older patch wins over the whole run, the newer
+          * words under it would be overwritten anyway */
+         if (!state_manager_raw_put(&w, b.start, b.data, b.end - b.start))
+            return 0;
+         while (a.end <= b.end)
+            state_manager_raw_run_next(&a);
+         if (a.start < b.end)
+         {
+            a.data += b.end - a.start;
+            a.start = b.end;
+         }
+         state_manager_raw_run_next(&b);
+      }
+      else
+      {
+         size_t stop = a.end < b.start ? a.end : b.start;
+
+         if (!state_manager_raw_put(&w, a.start, a.data, stop - a.start))
+            return 0;
+         a.data += stop - a.start;
+         a.start = stop;
+         if (a.start == a.end)
+            state_manager_raw_run_next(&a);
+      }
+   }
+
+   w.out[0] = 0;
+   w.out[1] = 0;
+   w.out[2] = 0;
+
+   return (uint8_t*)(w.out + 3) - (uint8_t*)patch;
+}
@@ -0,0 +1,83 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2017 - Daniel De Matteis
+ *  Copyright (C) 2014-2017 - Alfred Agrell
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __STATE_MANAGER_RAW_H
+#define __STATE_MANAGER_RAW_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <boolean.h>
+#include <retro_common_api.h>
+
+RETRO_BEGIN_DECLS
+
+/* Delta codec of the rewind buffer. Every kernel produces the same
+ * patches; they only differ in speed. */
+
+enum state_manager_raw_impl
+{
+   STATE_MANAGER_RAW_IMPL_AUTO = 0,
+   STATE_MANAGER_RAW_IMPL_SCALAR,
+   STATE_MANAGER_RAW_IMPL_SSE2,
+   STATE_MANAGER_RAW_IMPL_AVX2,
+   STATE_MANAGER_RAW_IMPL_NEON,
+   STATE_MANAGER_RAW_IMPL_LAST
+};
+
+/**
+ * state_manager_raw_select:
+ * @impl                 : kernel to use, or the fastest one this CPU
+ *                         runs for STATE_MANAGER_RAW_IMPL_AUTO
+ *
+ * Not thread-safe; call before any compression starts.
+ * Returns false if @impl was not built or this CPU lacks it.
+ **/
+bool state_manager_raw_select(enum state_manager_raw_impl impl);
+
+bool state_manager_raw_supported(enum state_manager_raw_impl impl);
+
+enum state_manager_raw_impl state_manager_raw_selected(void);
+
+const char *state_manager_raw_impl_name(enum state_manager_raw_impl impl);
+
+/* Returns the maximum compressed size of a savestate. */
+size_t state_manager_raw_maxsize(size_t uncomp);
+
+/* Savestate buffer of @len bytes the codec can work on;
+ * send it to free(). */
+void *state_manager_raw_alloc(size_t len, uint16_t uniq);
+
+/* Writes the patch that turns @src into @dst to @patch and returns
+ * its size. */
+size_t state_manager_raw_compress(const void *src,
+      const void *dst, size_t len, void *patch);
+
+void state_manager_raw_decompress(const void *patch, void *data);
+
+/* Returns the number of bytes of a patch. */
+size_t state_manager_raw_patch_size(const void *patch);
+
+/* Writes a patch that applies @newer and then @older in one go to
+ * @patch, without the states they were made from. Returns its size,
+ * or 0 if it would not fit in @len bytes. */
+size_t state_manager_raw_merge(const void *newer, const void *older,
+      void *patch, size_t len);
+
+RETRO_END_DECLS
+
+#endif
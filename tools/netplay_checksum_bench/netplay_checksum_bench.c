@@ -0,0 +1,187 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2021 - Daniel De Matteis
+ *  Copyright (C) 2024-2025 - Jamie Meyer
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Compares the netplay state checksum modes on savestate-sized buffers.
+ *
+ * Usage: netplay_checksum_bench [-i iterations] [state files...]
+ *
+ * Without files, synthetic states of typical sizes (SNES through N64)
+ * are generated. With files, each one is hashed as-is, so dumps from
+ * real cores can be measured. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <features/features_cpu.h>
+
+#include "../../network/netplay/netplay_checksum.h"
+
+struct bench_mode
+{
+   const char *name;
+   enum netplay_checksum_mode mode;
+   size_t stride;
+};
+
+static const struct bench_mode bench_modes[] = {
+   { "crc32",          NETPLAY_CHECKSUM_CRC32,  0    },
+   { "xxh3",           NETPLAY_CHECKSUM_XXH3,   0    },
+   { "crc32c",         NETPLAY_CHECKSUM_CRC32C, 0    },
+   { "crc32/4K",       NETPLAY_CHECKSUM_CRC32,  4096 },
+   { "xxh3/4K",        NETPLAY_CHECKSUM_XXH3,   4096 },
+   { "crc32c/4K",      NETPLAY_CHECKSUM_CRC32C, 4096 },
+};
+
+static const size_t bench_sizes[] = {
+   128 * 1024,        /* 8/16-bit consoles */
+   1024 * 1024,       /* PS1 */
+   4 * 1024 * 1024,   /* N64, Saturn */
+   16 * 1024 * 1024
+};
+
+static unsigned char *bench_load_file(const char *path, size_t *len)
+{
+   long size;
+   unsigned char *buf = NULL;
+   FILE *fp           = fopen(path, "rb");
+
+   if (!fp)
+      return NULL;
+
+   if (fseek(fp, 0, SEEK_END) == 0 && (size = ftell(fp)) > 0)
+   {
+      rewind(fp);
+      if ((buf = (unsigned char*)malloc((size_t)size)))
+      {
+         if (fread(buf, 1, (size_t)size, fp) == (size_t)size)
+            *len = (size_t)size;
+         else
+         {
+            free(buf);
+            buf = NULL;
+         }
+      }
+   }
+
+   fclose(fp);
+   return buf;
+}
+
+static unsigned char *bench_make_state(size_t len)
+{
+   size_t i;
+   uint32_t seed      = 0x12345678U;
+   unsigned char *buf = (unsigned char*)malloc(len);
+
+   if (!buf)
+      return NULL;
+
+   /* Mostly-zero memory with noisy pages, roughly like a real state */
+   for (i = 0; i < len; i++)
+   {
+      seed   = seed * 1103515245U + 12345U;
+      buf[i] = ((i >> 12) & 3) ? (unsigned char)(seed >> 16) : 0;
+   }
+
+   return buf;
+}
+
+static void bench_run(const char *label, const unsigned char *data,
+      size_t len, unsigned iterations)
+{
+   size_t m;
+
+   printf("%s (%lu bytes)\n", label, (unsigned long)len);
+
+   for (m = 0; m < sizeof(bench_modes) / sizeof(bench_modes[0]); m++)
+   {
+      unsigned i;
+      netplay_checksum_t cs;
+      retro_time_t start, elapsed;
+      uint32_t result = 0;
+      double usec;
+
+      cs.mode     = bench_modes[m].mode;
+      cs.interval = 1;
+      cs.stride   = bench_modes[m].stride;
+
+      /* Warm up caches and lazy tables */
+      result ^= netplay_checksum_compute(&cs, data, len);
+
+      start = cpu_features_get_time_usec();
+      for (i = 0; i < iterations; i++)
+         result ^= netplay_checksum_compute(&cs, data, len);
+      elapsed = cpu_features_get_time_usec() - start;
+
+      usec = (double)elapsed / iterations;
+      printf("  %-10s %10.1f usec/state %10.1f MB/s   [%08x]\n",
+            bench_modes[m].name, usec,
+            usec > 0.0 ? (double)len / usec : 0.0,
+            (unsigned)result);
+   }
+}
+
+int main(int argc, char **argv)
+{
+   int i;
+   unsigned iterations = 200;
+   int first_file      = 1;
+
+   if (argc > 2 && !strcmp(argv[1], "-i"))
+   {
+      iterations = (unsigned)strtoul(argv[2], NULL, 10);
+      if (!iterations)
+         iterations = 1;
+      first_file = 3;
+   }
+
+   printf("CRC-32C implementation: %s\n\n",
+         netplay_checksum_hw_accelerated() ? "hardware" : "software");
+
+   if (first_file >= argc)
+   {
+      size_t s;
+      for (s = 0; s < sizeof(bench_sizes) / sizeof(bench_sizes[0]); s++)
+      {
+         char label[64];
+         unsigned char *buf = bench_make_state(bench_sizes[s]);
+         if (!buf)
+            return 1;
+         snprintf(label, sizeof(label), "synthetic %luK",
+               (unsigned long)(bench_sizes[s] / 1024));
+         bench_run(label, buf, bench_sizes[s], iterations);
+         free(buf);
+      }
+      return 0;
+   }
+
+   for (i = first_file; i < argc; i++)
+   {
+      size_t len         = 0;
+      unsigned char *buf = bench_load_file(argv[i], &len);
+      if (!buf)
+      {
+         fprintf(stderr, "%s: unable to read\n", argv[i]);
+         return 1;
+      }
+      bench_run(argv[i], buf, len, iterations);
+      free(buf);
+   }
+
+   return 0;
+}
@@ -0,0 +1,591 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2021 - Daniel De Matteis
+ *  Copyright (C) 2024-2025 - Jamie Meyer
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Spectator relay: takes the confirmed input stream of a netplay host
+ * and sends it on to any number of spectators, a configurable number
+ * of frames behind.
+ *
+ * Usage: netplay_relayd [options]
+ *
+ * The host points netplay_relay_server at this relay; spectators set
+ * the same address and netplay_relay_spectate. --selftest N runs a
+ * host and N spectators in the same process over the loopback
+ * interface and exits with status 1 if any spectator's stream differs
+ * from the host's. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <compat/getopt.h>
+#include <features/features_cpu.h>
+#include <net/net_compat.h>
+#include <net/net_socket.h>
+#include <retro_timers.h>
+
+#include "../../network/netplay/netplay_relay.h"
+
+#define RELAY_MAX_SPECTATORS   1024
+/* A spectator silent this long has gone away */
+#define RELAY_TIMEOUT_USEC     10000000
+/* Messages per spectator and per host link per pass */
+#define RELAY_BURST            16
+#define RELAY_WATCH_USEC       20000
+#define RELAY_SELFTEST_RECORD  24
+
+typedef struct relay_peer
+{
+   struct sockaddr_storage addr;
+   socklen_t               addr_len;
+   char                    name[64];
+   netplay_relay_link_t    link;
+   bool                    used;
+} relay_peer_t;
+
+typedef struct relay_options
+{
+   unsigned    port;
+   unsigned    delay;
+   unsigned    max_spectators;
+   unsigned    stats_interval;
+   unsigned    selftest;
+   unsigned    selftest_frames;
+   bool        verbose;
+} relay_options_t;
+
+typedef struct relay
+{
+   int                     fd;
+   netplay_relay_stream_t  stream;
+   relay_peer_t           *spectators;
+   unsigned                spectator_count;
+   uint64_t                bytes_in;
+   uint64_t                bytes_out;
+   uint64_t                packets_in;
+   uint64_t                packets_out;
+} relay_t;
+
+static relay_options_t relay_opt;
+static relay_t         *relay_active;
+
+static void relay_describe(const struct sockaddr_storage *addr,
+      socklen_t addr_len, char *s, size_t len)
+{
+   char host[48];
+   char serv[8];
+
+   if (getnameinfo_retro((const struct sockaddr*)addr, addr_len,
+            host, sizeof(host), serv, sizeof(serv),
+            NI_NUMERICHOST | NI_NUMERICSERV))
+      snprintf(s, len, "?");
+   else
+      snprintf(s, len, "%s:%s", host, serv);
+}
+
+static bool relay_same_addr(const relay_peer_t *peer,
+      const struct sockaddr_storage *addr, socklen_t addr_len)
+{
+   return peer->used
+      && peer->addr_len == addr_len
+      && !memcmp(&peer->addr, addr, addr_len);
+}
+
+static void relay_send(void *data, const uint8_t *msg, size_t len)
+{
+   relay_peer_t *peer = (relay_peer_t*)data;
+
+   if (sendto(relay_active->fd, (const char*)msg, (int)len, 0,
+            (const struct sockaddr*)&peer->addr, peer->addr_len) < 0)
+      return;
+   relay_active->bytes_out   += len;
+   relay_active->packets_out++;
+}
+
+static relay_peer_t *relay_find_spectator(relay_t *r,
+      const struct sockaddr_storage *addr, socklen_t addr_len,
+      int64_t now)
+{
+   unsigned i;
+   relay_peer_t *free_slot = NULL;
+
+   for (i = 0; i < relay_opt.max_spectators; i++)
+   {
+      if (relay_same_addr(&r->spectators[i], addr, addr_len))
+         return &r->spectators[i];
+      if (!free_slot && !r->spectators[i].used)
+         free_slot = &r->spectators[i];
+   }
+
+   if (!free_slot)
+      return NULL;
+
+   memset(free_slot, 0, sizeof(*free_slot));
+   memcpy(&free_slot->addr, addr, addr_len);
+   free_slot->addr_len = addr_len;
+   free_slot->used     = true;
+   relay_describe(addr, addr_len, free_slot->name, sizeof(free_slot->name));
+   netplay_relay_link_reset(&free_slot->link, 0, now);
+   r->spectator_count++;
+
+   if (relay_opt.verbose)
+      printf("Spectator %s joined (%u watching).\n",
+            free_slot->name, r->spectator_count);
+   return free_slot;
+}
+
+static void relay_receive(relay_t *r, int64_t now)
+{
+   for (;;)
+   {
+      uint8_t msg[NETPLAY_RELAY_PACKET_MAX];
+      struct sockaddr_storage addr;
+      socklen_t addr_len = sizeof(addr);
+      uint8_t type;
+      uint32_t session;
+      size_t record_len;
+      unsigned count;
+      int len = (int)recvfrom(r->fd, (char*)msg, sizeof(msg), 0,
+            (struct sockaddr*)&addr, &addr_len);
+
+      if (len < 0)
+         break;
+
+      r->bytes_in += (unsigned)len;
+      r->packets_in++;
+
+      if (!netplay_relay_peek(msg, (size_t)len, &type, &session,
+               &record_len))
+         continue;
+
+      if (type == NETPLAY_RELAY_MSG_FRAMES)
+      {
+         relay_peer_t host;
+         uint8_t ack[NETPLAY_RELAY_CONTROL_SIZE];
+         size_t ack_len;
+
+         /* A new session starts over; spectators of the old one
+          * stay subscribed and are served from its first frame */
+         if (     session    != r->stream.session
+               || record_len != r->stream.record_len)
+         {
+            unsigned i;
+
+            if (!netplay_relay_stream_init(&r->stream, session, record_len))
+               continue;
+            for (i = 0; i < relay_opt.max_spectators; i++)
+               if (r->spectators[i].used)
+                  netplay_relay_link_reset(&r->spectators[i].link, 0, now);
+            printf("Session %08x started, %u byte(s) per frame.\n",
+                  (unsigned)session, (unsigned)record_len);
+         }
+
+         netplay_relay_unpack(&r->stream, msg, (size_t)len);
+
+         memcpy(&host.addr, &addr, addr_len);
+         host.addr_len = addr_len;
+         if ((ack_len = netplay_relay_control(ack, sizeof(ack),
+                     NETPLAY_RELAY_MSG_ACK, r->stream.session,
+                     r->stream.count)))
+            relay_send(&host, ack, ack_len);
+      }
+      else if (netplay_relay_parse_control(msg, (size_t)len,
+               &type, &session, &count)
+            && type == NETPLAY_RELAY_MSG_WATCH)
+      {
+         relay_peer_t *peer = relay_find_spectator(r, &addr, addr_len, now);
+
+         if (!peer)
+            continue;
+         if (session == r->stream.session)
+            netplay_relay_link_ack(&peer->link, count, now);
+         else
+            peer->link.heard_at = now;
+      }
+   }
+}
+
+static void relay_pump(relay_t *r, int64_t now)
+{
+   unsigned i;
+   unsigned end = r->stream.count > relay_opt.delay
+      ? r->stream.count - relay_opt.delay : 0;
+
+   for (i = 0; i < relay_opt.max_spectators; i++)
+   {
+      relay_peer_t *peer = &r->spectators[i];
+
+      if (!peer->used)
+         continue;
+
+      if (now - peer->link.heard_at > RELAY_TIMEOUT_USEC)
+      {
+         peer->used = false;
+         r->spectator_count--;
+         if (relay_opt.verbose)
+            printf("Spectator %s left (%u watching).\n",
+                  peer->name, r->spectator_count);
+         continue;
+      }
+
+      if (r->stream.record_len)
+         netplay_relay_link_poll(&peer->link, &r->stream, end, now,
+               RELAY_BURST, relay_send, peer);
+   }
+}
+
+static int relay_open(unsigned port)
+{
+   struct addrinfo *addr = NULL;
+   int fd = socket_init((void**)&addr, (uint16_t)port, NULL,
+         SOCKET_TYPE_DATAGRAM, AF_INET);
+
+   if (fd < 0 || !addr)
+      return -1;
+
+   if (!socket_bind(fd, addr) || !socket_set_block(fd, false))
+   {
+      freeaddrinfo_retro(addr);
+      socket_close(fd);
+      return -1;
+   }
+
+   freeaddrinfo_retro(addr);
+   return fd;
+}
+
+static bool relay_init(relay_t *r)
+{
+   memset(r, 0, sizeof(*r));
+   if (!(r->spectators = (relay_peer_t*)calloc(relay_opt.max_spectators,
+               sizeof(*r->spectators))))
+      return false;
+
+   if ((r->fd = relay_open(relay_opt.port)) < 0)
+   {
+      fprintf(stderr, "Unable to bind UDP port %u.\n", relay_opt.port);
+      free(r->spectators);
+      return false;
+   }
+
+   relay_active = r;
+   return true;
+}
+
+static void relay_deinit(relay_t *r)
+{
+   socket_close(r->fd);
+   netplay_relay_stream_free(&r->stream);
+   free(r->spectators);
+}
+
+/* Self test: a host feeding the relay and spectators watching it, each
+ * with its own socket on the loopback interface */
+
+typedef struct relay_client
+{
+   int                    fd;
+   relay_peer_t           relay;
+   netplay_relay_stream_t stream;
+   netplay_relay_link_t   link;
+   int64_t                watch_at;
+} relay_client_t;
+
+static void relay_client_send(void *data, const uint8_t *msg, size_t len)
+{
+   relay_client_t *c = (relay_client_t*)data;
+   sendto(c->fd, (const char*)msg, (int)len, 0,
+         (const struct sockaddr*)&c->relay.addr, c->relay.addr_len);
+}
+
+static bool relay_client_open(relay_client_t *c, unsigned port,
+      uint32_t session, size_t record_len)
+{
+   struct addrinfo *addr = NULL;
+
+   memset(c, 0, sizeof(*c));
+   c->fd = socket_init((void**)&addr, (uint16_t)port, "127.0.0.1",
+         SOCKET_TYPE_DATAGRAM, AF_INET);
+   if (c->fd < 0 || !addr)
+      return false;
+
+   memcpy(&c->relay.addr, addr->ai_addr, addr->ai_addrlen);
+   c->relay.addr_len = (socklen_t)addr->ai_addrlen;
+   freeaddrinfo_retro(addr);
+
+   return socket_set_block(c->fd, false)
+      && netplay_relay_stream_init(&c->stream, session, record_len);
+}
+
+static void relay_client_receive(relay_client_t *c, int64_t now)
+{
+   uint8_t msg[NETPLAY_RELAY_PACKET_MAX];
+   int len;
+
+   while ((len = (int)recvfrom(c->fd, (char*)msg, sizeof(msg), 0,
+               NULL, NULL)) >= 0)
+   {
+      uint8_t type;
+      unsigned count;
+
+      if (netplay_relay_parse_control(msg, (size_t)len, &type, NULL, &count))
+         netplay_relay_link_ack(&c->link, count, now);
+      else
+         netplay_relay_unpack(&c->stream, msg, (size_t)len);
+   }
+}
+
+static void relay_selftest_record(unsigned frame, uint8_t *rec)
+{
+   unsigned i;
+
+   /* Mostly idle pads with a button held now and then and a stick
+    * that moves in bursts, roughly what a fighting game sends */
+   memset(rec, 0, RELAY_SELFTEST_RECORD);
+   if ((frame / 20) % 4 == 1)
+      rec[0] = (uint8_t)(1 << (frame / 80 % 8));
+   if ((frame / 7) % 5 == 0)
+      for (i = 4; i < 8; i++)
+         rec[i] = (uint8_t)(frame * (i + 3));
+   if (frame % 45 < 3)
+      rec[12] = 0x40;
+}
+
+static int relay_selftest(void)
+{
+   unsigned i, frame;
+   relay_t r;
+   relay_client_t host;
+   relay_client_t *spectators;
+   uint8_t rec[RELAY_SELFTEST_RECORD];
+   unsigned frames   = relay_opt.selftest_frames;
+   unsigned watchers = relay_opt.selftest;
+   unsigned expected = frames > relay_opt.delay ? frames - relay_opt.delay : 0;
+   uint32_t session  = 0x52410001;
+   unsigned failed   = 0;
+   int64_t start, deadline, feed_at;
+
+   if (!relay_init(&r))
+      return 1;
+
+   spectators = (relay_client_t*)calloc(watchers, sizeof(*spectators));
+   if (     !spectators
+         || !relay_client_open(&host, relay_opt.port, session,
+            RELAY_SELFTEST_RECORD))
+   {
+      fprintf(stderr, "Unable to open the host's socket.\n");
+      return 1;
+   }
+   for (i = 0; i < watchers; i++)
+      if (!relay_client_open(&spectators[i], relay_opt.port, session,
+               RELAY_SELFTEST_RECORD))
+      {
+         fprintf(stderr, "Unable to open spectator socket %u.\n", i);
+         return 1;
+      }
+
+   start    = cpu_features_get_time_usec();
+   deadline = start + 60000000;
+   feed_at  = start;
+   frame    = 0;
+   netplay_relay_link_reset(&host.link, 0, start);
+
+   for (;;)
+   {
+      bool done = frame >= frames;
+      int64_t now = cpu_features_get_time_usec();
+
+      /* The host confirms a frame every millisecond */
+      while (frame < frames && now >= feed_at)
+      {
+         relay_selftest_record(frame, rec);
+         netplay_relay_stream_set(&host.stream, frame++, rec, sizeof(rec));
+         feed_at += 1000;
+      }
+      netplay_relay_link_poll(&host.link, &host.stream, frame, now,
+            RELAY_BURST, relay_client_send, &host);
+      relay_client_receive(&host, now);
+      netplay_relay_stream_trim(&host.stream, host.link.acked);
+
+      relay_receive(&r, now);
+      relay_pump(&r, now);
+
+      for (i = 0; i < watchers; i++)
+      {
+         relay_client_t *c = &spectators[i];
+
+         relay_client_receive(c, now);
+         if (now - c->watch_at >= RELAY_WATCH_USEC)
+         {
+            uint8_t msg[NETPLAY_RELAY_CONTROL_SIZE];
+            size_t len = netplay_relay_control(msg, sizeof(msg),
+                  NETPLAY_RELAY_MSG_WATCH, session, c->stream.count);
+            relay_client_send(c, msg, len);
+            c->watch_at = now;
+         }
+         if (c->stream.count < expected)
+            done = false;
+      }
+
+      if (done || now > deadline)
+         break;
+      retro_sleep(1);
+   }
+
+   for (i = 0; i < watchers; i++)
+   {
+      relay_client_t *c = &spectators[i];
+
+      if (c->stream.count < expected)
+      {
+         printf("Spectator %u: %u of %u frames.\n", i,
+               c->stream.count, expected);
+         failed++;
+         continue;
+      }
+      for (frame = 0; frame < expected; frame++)
+      {
+         relay_selftest_record(frame, rec);
+         if (memcmp(netplay_relay_stream_get(&c->stream, frame),
+                  rec, sizeof(rec)))
+         {
+            printf("Spectator %u: frame %u differs.\n", i, frame);
+            failed++;
+            break;
+         }
+      }
+   }
+
+   printf("%u spectator(s), %u frame(s) in %.2f s: %llu packet(s), %.1f byte(s) per frame per spectator, %u failed.\n",
+         watchers, expected,
+         (cpu_features_get_time_usec() - start) / 1000000.0,
+         (unsigned long long)r.packets_out,
+         watchers && expected
+            ? (double)r.bytes_out / watchers / expected : 0.0,
+         failed);
+
+   for (i = 0; i < watchers; i++)
+   {
+      socket_close(spectators[i].fd);
+      netplay_relay_stream_free(&spectators[i].stream);
+   }
+   socket_close(host.fd);
+   netplay_relay_stream_free(&host.stream);
+   free(spectators);
+   relay_deinit(&r);
+   return failed ? 1 : 0;
+}
+
+static void relay_usage(void)
+{
+   fprintf(stderr,
+         "Usage: netplay_relayd [options]\n"
+         "  -p, --port N           UDP port (default %d)\n"
+         "  -d, --delay N          frames spectators are kept behind the host (default 0)\n"
+         "  -m, --max-spectators N (default 256, at most %d)\n"
+         "  -s, --stats N          print statistics every N seconds (default 10, 0 = never)\n"
+         "  -t, --selftest N       run a host and N spectators over loopback and exit\n"
+         "  -f, --frames N         frames the self test streams (default 3000)\n"
+         "  -v, --verbose\n",
+         NETPLAY_RELAY_DEFAULT_PORT, RELAY_MAX_SPECTATORS);
+}
+
+int main(int argc, char **argv)
+{
+   relay_t r;
+   int64_t stats_at;
+   const struct option opt[] = {
+      {"port",           1, NULL, 'p'},
+      {"delay",          1, NULL, 'd'},
+      {"max-spectators", 1, NULL, 'm'},
+      {"stats",          1, NULL, 's'},
+      {"selftest",       1, NULL, 't'},
+      {"frames",         1, NULL, 'f'},
+      {"verbose",        0, NULL, 'v'},
+      {"help",           0, NULL, 'h'},
+      {NULL,             0, NULL, 0}
+   };
+
+   relay_opt.port            = NETPLAY_RELAY_DEFAULT_PORT;
+   relay_opt.max_spectators  = 256;
+   relay_opt.stats_interval  = 10;
+   relay_opt.selftest_frames = 3000;
+
+   for (;;)
+   {
+      int c = getopt_long(argc, argv, "p:d:m:s:t:f:vh", opt, NULL);
+      if (c == -1)
+         break;
+
+      switch (c)
+      {
+         case 'p': relay_opt.port            = (unsigned)atoi(optarg); break;
+         case 'd': relay_opt.delay           = (unsigned)atoi(optarg); break;
+         case 'm': relay_opt.max_spectators  = (unsigned)atoi(optarg); break;
+         case 's': relay_opt.stats_interval  = (unsigned)atoi(optarg); break;
+         case 't': relay_opt.selftest        = (unsigned)atoi(optarg); break;
+         case 'f': relay_opt.selftest_frames = (unsigned)atoi(optarg); break;
+         case 'v': relay_opt.verbose         = true; break;
+         default:
+            relay_usage();
+            return 1;
+      }
+   }
+
+   if (     !relay_opt.max_spectators
+         ||  relay_opt.max_spectators > RELAY_MAX_SPECTATORS
+         ||  relay_opt.selftest > relay_opt.max_spectators)
+   {
+      relay_usage();
+      return 1;
+   }
+
+   if (relay_opt.selftest)
+      return relay_selftest();
+
+   if (!relay_init(&r))
+      return 1;
+
+   printf("Relaying on UDP port %u, %u frame(s) behind the host.\n",
+         relay_opt.port, relay_opt.delay);
+
+   stats_at = cpu_features_get_time_usec();
+   for (;;)
+   {
+      int64_t now = cpu_features_get_time_usec();
+
+      relay_receive(&r, now);
+      relay_pump(&r, now);
+
+      if (     relay_opt.stats_interval
+            && now - stats_at >= (int64_t)relay_opt.stats_interval * 1000000)
+      {
+         printf("%u spectator(s), %u frame(s), in %llu B / %llu packets, out %llu B / %llu packets.\n",
+               r.spectator_count, r.stream.count,
+               (unsigned long long)r.bytes_in,
+               (unsigned long long)r.packets_in,
+               (unsigned long long)r.bytes_out,
+               (unsigned long long)r.packets_out);
+         fflush(stdout);
+         stats_at = now;
+      }
+
+      retro_sleep(1);
+   }
+
+   relay_deinit(&r);
+   return 0;
+}
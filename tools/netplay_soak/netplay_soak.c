@@ -0,0 +1,1281 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2021 - Daniel De Matteis
+ *  Copyright (C) 2024-2025 - Jamie Meyer
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Headless rollback soak test: N GekkoNet sessions in one process,
+ * linked by a simulated network with latency, jitter, reordering and
+ * loss, each driving its own instance of a libretro core.
+ *
+ * Usage: netplay_soak [options] [-L core.so [content]]
+ *
+ * Without a core, a small built-in deterministic core is used so the
+ * netcode can be exercised on its own. Real cores are copied once per
+ * peer before loading, so every peer gets private globals.
+ *
+ * Every peer handles GekkoNet's events with the frontend's planner,
+ * netplay_events_plan(), and runs the presented frame after the update
+ * as core_run() does. --skip also runs the frames time sync skips.
+ *
+ * Exits with status 1 if any peer reported a desync, if the confirmed
+ * state checksums of the peers disagree at the end, or if a save did
+ * not hold the frame it was tagged with. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dlfcn.h>
+
+#include <libretro.h>
+#include <compat/getopt.h>
+#include <features/features_cpu.h>
+
+#include "../../gekkonet/linux/include/gekkonet.h"
+#include "../../network/netplay/netplay_input.h"
+#include "../../network/netplay/netplay_events.h"
+#include "../../network/netplay/netplay_checksum.h"
+#include "../../network/netplay/netplay_telemetry.h"
+
+#define SOAK_MAX_PEERS     4
+#define SOAK_PACKET_MAX    1472
+/* Datagrams in flight across all simulated links */
+#define SOAK_LINK_SLOTS    4096
+/* Datagrams handed to one receive_data() call */
+#define SOAK_RECV_SLOTS    256
+/* Confirmed checksums remembered per peer for the final comparison */
+#define SOAK_HASH_RING     512
+#define SOAK_BUILTIN_STATE (64 * 1024)
+
+typedef struct soak_options
+{
+   const char *core_path;
+   const char *content_path;
+   const char *csv_prefix;
+   unsigned    peers;
+   unsigned    frames;
+   unsigned    latency_ms;
+   unsigned    jitter_ms;
+   unsigned    loss_pct;
+   unsigned    reorder_pct;
+   unsigned    delay;
+   unsigned    prediction;
+   unsigned    skip;
+   int         desync_at;
+   uint64_t    seed;
+   bool        fast;
+   bool        verbose;
+} soak_options_t;
+
+typedef struct soak_packet
+{
+   int64_t  deliver_at;
+   uint64_t seq;
+   int      src;
+   int      dst;
+   unsigned len;
+   char     data[SOAK_PACKET_MAX];
+} soak_packet_t;
+
+typedef struct soak_link
+{
+   soak_packet_t *slots;
+   unsigned       count;
+   uint64_t       seq;
+   uint64_t       sent;
+   uint64_t       delivered;
+   uint64_t       lost;
+   uint64_t       reordered;
+   uint64_t       overflow;
+   uint64_t       rng;
+} soak_link_t;
+
+typedef struct soak_core
+{
+   void *handle;
+   char  path[256];
+   void     (*retro_init)(void);
+   void     (*retro_deinit)(void);
+   void     (*retro_get_system_info)(struct retro_system_info*);
+   void     (*retro_get_system_av_info)(struct retro_system_av_info*);
+   void     (*retro_set_environment)(retro_environment_t);
+   void     (*retro_set_video_refresh)(retro_video_refresh_t);
+   void     (*retro_set_audio_sample)(retro_audio_sample_t);
+   void     (*retro_set_audio_sample_batch)(retro_audio_sample_batch_t);
+   void     (*retro_set_input_poll)(retro_input_poll_t);
+   void     (*retro_set_input_state)(retro_input_state_t);
+   void     (*retro_run)(void);
+   size_t   (*retro_serialize_size)(void);
+   bool     (*retro_serialize)(void*, size_t);
+   bool     (*retro_unserialize)(const void*, size_t);
+   bool     (*retro_load_game)(const struct retro_game_info*);
+   void     (*retro_unload_game)(void);
+} soak_core_t;
+
+typedef struct soak_hash
+{
+   int      frame;
+   uint32_t checksum;
+} soak_hash_t;
+
+typedef struct soak_peer
+{
+   GekkoSession         *session;
+   soak_core_t           core;
+   uint8_t              *local_input;
+   netplay_input_port_t  ports[SOAK_MAX_PEERS];
+   uint64_t              keys;
+   netplay_telemetry_t   telemetry;
+   soak_hash_t           hashes[SOAK_HASH_RING];
+   /* Held pad, changed every few frames like a human would */
+   netplay_input_port_t  pad;
+   unsigned              pad_hold;
+   uint64_t              rng;
+   uint64_t              run_usec;
+   uint64_t              runs;
+   uint64_t              desyncs;
+   /* Frontend event handling: the plan of the latest update, whose
+    * deferred saves wait for the next one */
+   netplay_events_t      events;
+   GekkoGameEvent      **deferred;
+   uint64_t              presented;
+   uint64_t              deferred_saves;
+   uint64_t              skipped;
+   /* Built-in core: a save's tag minus the frames run before it */
+   uint64_t              bad_saves;
+   int                   save_delta;
+   bool                  save_delta_known;
+   int                   first_desync;
+   int                   handle;
+   int                   frame;
+   bool                  started;
+   /* Built-in core */
+   uint8_t               builtin_state[SOAK_BUILTIN_STATE];
+} soak_peer_t;
+
+static soak_options_t        soak_opt;
+static soak_link_t           soak_link;
+static soak_peer_t           soak_peers[SOAK_MAX_PEERS];
+static netplay_input_layout_t soak_layout;
+static netplay_checksum_t    soak_checksum;
+static int                   soak_endpoint_ids[SOAK_MAX_PEERS] = { 0, 1, 2, 3 };
+/* Peer whose session or core is being driven. GekkoNet adapters and
+ * libretro callbacks carry no context, so calls are routed by this. */
+static int                   soak_current;
+
+static soak_packet_t        *soak_recv_slots;
+static GekkoNetResult        soak_recv_results[SOAK_RECV_SLOTS];
+static GekkoNetResult       *soak_recv_ptrs[SOAK_RECV_SLOTS];
+
+static uint64_t soak_rand(uint64_t *state)
+{
+   uint64_t x = *state;
+   x ^= x << 13;
+   x ^= x >> 7;
+   x ^= x << 17;
+   *state = x;
+   return x;
+}
+
+static unsigned soak_rand_range(uint64_t *state, unsigned n)
+{
+   return n ? (unsigned)(soak_rand(state) % n) : 0;
+}
+
+/* Simulated network */
+
+static void soak_link_send(GekkoNetAddress *addr, const char *data,
+      int length)
+{
+   int64_t delay;
+   soak_packet_t *pkt;
+
+   if (!addr || !addr->data || length <= 0 || length > SOAK_PACKET_MAX)
+      return;
+
+   soak_link.sent++;
+
+   if (soak_rand_range(&soak_link.rng, 100) < soak_opt.loss_pct)
+   {
+      soak_link.lost++;
+      return;
+   }
+
+   if (soak_link.count >= SOAK_LINK_SLOTS)
+   {
+      soak_link.overflow++;
+      return;
+   }
+
+   delay = (int64_t)soak_opt.latency_ms * 1000;
+   if (soak_opt.jitter_ms)
+      delay += (int64_t)soak_rand_range(&soak_link.rng,
+            soak_opt.jitter_ms * 2000 + 1)
+         - (int64_t)soak_opt.jitter_ms * 1000;
+   /* Held back long enough to land behind later packets */
+   if (soak_rand_range(&soak_link.rng, 100) < soak_opt.reorder_pct)
+   {
+      delay += 1000 + (int64_t)soak_rand_range(&soak_link.rng,
+            (soak_opt.latency_ms + 10) * 1000);
+      soak_link.reordered++;
+   }
+   if (delay < 0)
+      delay = 0;
+
+   pkt             = &soak_link.slots[soak_link.count++];
+   pkt->deliver_at = cpu_features_get_time_usec() + delay;
+   pkt->seq        = soak_link.seq++;
+   pkt->src        = soak_current;
+   pkt->dst        = *(const int*)addr->data;
+   pkt->len        = (unsigned)length;
+   memcpy(pkt->data, data, (size_t)length);
+}
+
+static GekkoNetResult **soak_link_receive(int *length)
+{
+   unsigned i     = 0;
+   unsigned count = 0;
+   int64_t now    = cpu_features_get_time_usec();
+
+   while (i < soak_link.count && count < SOAK_RECV_SLOTS)
+   {
+      soak_packet_t *pkt = &soak_link.slots[i];
+
+      if (pkt->dst != soak_current || pkt->deliver_at > now)
+      {
+         i++;
+         continue;
+      }
+
+      soak_recv_slots[count] = *pkt;
+      *pkt = soak_link.slots[--soak_link.count];
+      count++;
+   }
+
+   /* Hand packets over in arrival order */
+   for (i = 1; i < count; i++)
+   {
+      unsigned j;
+      soak_packet_t tmp = soak_recv_slots[i];
+      for (j = i; j > 0
+            && (soak_recv_slots[j - 1].deliver_at > tmp.deliver_at
+               || (soak_recv_slots[j - 1].deliver_at == tmp.deliver_at
+                  && soak_recv_slots[j - 1].seq > tmp.seq)); j--)
+         soak_recv_slots[j] = soak_recv_slots[j - 1];
+      soak_recv_slots[j] = tmp;
+   }
+
+   for (i = 0; i < count; i++)
+   {
+      GekkoNetResult *res = &soak_recv_results[i];
+      res->addr.data      = &soak_endpoint_ids[soak_recv_slots[i].src];
+      res->addr.size      = sizeof(int);
+      res->data_len       = soak_recv_slots[i].len;
+      res->data           = soak_recv_slots[i].data;
+      soak_recv_ptrs[i]   = res;
+   }
+
+   soak_link.delivered += count;
+   *length = (int)count;
+   return soak_recv_ptrs;
+}
+
+/* Results live in soak_recv_slots until the next receive */
+static void soak_link_free(void *data_ptr)
+{
+   (void)data_ptr;
+}
+
+static GekkoNetAdapter soak_adapter = {
+   soak_link_send,
+   soak_link_receive,
+   soak_link_free
+};
+
+/* Built-in core: mixes every input into a state buffer and touches a
+ * few pages per frame, so rollbacks and desyncs show up in the hash.
+ * The last bytes count the frames run, for checking saves. */
+
+#define SOAK_BUILTIN_COUNTER (SOAK_BUILTIN_STATE - 4)
+
+static retro_input_state_t builtin_input_cb;
+
+static void builtin_run(void)
+{
+   unsigned p;
+   uint8_t *state = soak_peers[soak_current].builtin_state;
+   uint32_t acc;
+
+   uint32_t frames;
+
+   memcpy(&acc, state, sizeof(acc));
+   for (p = 0; p < soak_opt.peers; p++)
+   {
+      unsigned i;
+      acc = acc * 1664525U + 1013904223U
+         + (uint16_t)builtin_input_cb(p, RETRO_DEVICE_JOYPAD, 0,
+               RETRO_DEVICE_ID_JOYPAD_MASK);
+      for (i = 0; i < 4; i++)
+         acc = acc * 31U + (uint16_t)builtin_input_cb(p,
+               RETRO_DEVICE_ANALOG, i >> 1, i & 1);
+   }
+   for (p = 0; p < 8; p++)
+   {
+      size_t off = (acc >> (p * 3)) % (SOAK_BUILTIN_COUNTER - 4);
+      state[off] ^= (uint8_t)(acc >> (p * 4));
+   }
+   memcpy(state, &acc, sizeof(acc));
+   memcpy(&frames, state + SOAK_BUILTIN_COUNTER, sizeof(frames));
+   frames++;
+   memcpy(state + SOAK_BUILTIN_COUNTER, &frames, sizeof(frames));
+}
+
+static size_t builtin_serialize_size(void)
+{
+   return SOAK_BUILTIN_STATE;
+}
+
+static bool builtin_serialize(void *data, size_t len)
+{
+   if (len < SOAK_BUILTIN_STATE)
+      return false;
+   memcpy(data, soak_peers[soak_current].builtin_state, SOAK_BUILTIN_STATE);
+   return true;
+}
+
+static bool builtin_unserialize(const void *data, size_t len)
+{
+   if (len < SOAK_BUILTIN_STATE)
+      return false;
+   memcpy(soak_peers[soak_current].builtin_state, data, SOAK_BUILTIN_STATE);
+   return true;
+}
+
+static void builtin_set_input_state(retro_input_state_t cb)
+{
+   builtin_input_cb = cb;
+}
+
+static int16_t soak_input_state(unsigned port, unsigned device,
+      unsigned idx, unsigned id);
+
+static void soak_core_builtin(soak_core_t *core)
+{
+   memset(core, 0, sizeof(*core));
+   strcpy(core->path, "built-in");
+   core->retro_set_input_state = builtin_set_input_state;
+   core->retro_run             = builtin_run;
+   core->retro_serialize_size  = builtin_serialize_size;
+   core->retro_serialize       = builtin_serialize;
+   core->retro_unserialize     = builtin_unserialize;
+   core->retro_set_input_state(soak_input_state);
+}
+
+/* libretro callbacks shared by every core instance */
+
+static bool soak_environment(unsigned cmd, void *data)
+{
+   switch (cmd)
+   {
+      case RETRO_ENVIRONMENT_GET_CAN_DUPE:
+         *(bool*)data = true;
+         return true;
+      case RETRO_ENVIRONMENT_SET_PIXEL_FORMAT:
+         return true;
+      case RETRO_ENVIRONMENT_GET_SYSTEM_DIRECTORY:
+      case RETRO_ENVIRONMENT_GET_SAVE_DIRECTORY:
+         *(const char**)data = ".";
+         return true;
+      default:
+         break;
+   }
+   return false;
+}
+
+static void soak_video(const void *data, unsigned width, unsigned height,
+      size_t pitch)
+{
+   (void)data;
+   (void)width;
+   (void)height;
+   (void)pitch;
+}
+
+static void soak_audio(int16_t left, int16_t right)
+{
+   (void)left;
+   (void)right;
+}
+
+static size_t soak_audio_batch(const int16_t *data, size_t frames)
+{
+   (void)data;
+   return frames;
+}
+
+static void soak_poll(void) { }
+
+static int16_t soak_input_state(unsigned port, unsigned device,
+      unsigned idx, unsigned id)
+{
+   soak_peer_t *peer = &soak_peers[soak_current];
+   return netplay_input_query(&soak_layout,
+         port < soak_opt.peers ? &peer->ports[port] : NULL,
+         peer->keys, device, idx, id);
+}
+
+/* Synthetic player: what the local pad reads when input is collected */
+static int16_t soak_local_state(unsigned port, unsigned device,
+      unsigned idx, unsigned id)
+{
+   const netplay_input_port_t *pad = &soak_peers[soak_current].pad;
+
+   if (port != 0)
+      return 0;
+   if (device == RETRO_DEVICE_JOYPAD && id < 16)
+      return (pad->buttons >> id) & 1;
+   if (device == RETRO_DEVICE_ANALOG && idx < 2 && id < 2)
+      return pad->analog[idx * 2 + id];
+   return 0;
+}
+
+static void soak_update_pad(soak_peer_t *peer)
+{
+   unsigned i;
+
+   if (peer->pad_hold)
+   {
+      peer->pad_hold--;
+      return;
+   }
+
+   peer->pad_hold    = 2 + soak_rand_range(&peer->rng, 20);
+   peer->pad.buttons = (uint16_t)(soak_rand(&peer->rng)
+         & soak_rand(&peer->rng));
+   for (i = 0; i < 4; i++)
+      peer->pad.analog[i] = (int16_t)(soak_rand(&peer->rng) >> 48);
+}
+
+static bool soak_core_load(soak_core_t *core, const char *path,
+      unsigned index)
+{
+   FILE *in;
+   FILE *out;
+   char buf[65536];
+   size_t n;
+
+   memset(core, 0, sizeof(*core));
+   snprintf(core->path, sizeof(core->path), "/tmp/netplay_soak_%d_%u.so",
+         (int)getpid(), index);
+
+   /* dlopen() shares a library loaded twice; a private copy each */
+   if (!(in = fopen(path, "rb")))
+   {
+      perror(path);
+      return false;
+   }
+   if (!(out = fopen(core->path, "wb")))
+   {
+      perror(core->path);
+      fclose(in);
+      return false;
+   }
+   while ((n = fread(buf, 1, sizeof(buf), in)) > 0)
+      fwrite(buf, 1, n, out);
+   fclose(in);
+   fclose(out);
+
+   if (!(core->handle = dlopen(core->path, RTLD_NOW | RTLD_LOCAL)))
+   {
+      fprintf(stderr, "%s\n", dlerror());
+      return false;
+   }
+
+#define SOAK_SYM(x) \
+   if (!(*(void**)&core->x = dlsym(core->handle, #x))) \
+   { \
+      fprintf(stderr, "Core is missing %s.\n", #x); \
+      return false; \
+   }
+   SOAK_SYM(retro_init);
+   SOAK_SYM(retro_deinit);
+   SOAK_SYM(retro_get_system_info);
+   SOAK_SYM(retro_get_system_av_info);
+   SOAK_SYM(retro_set_environment);
+   SOAK_SYM(retro_set_video_refresh);
+   SOAK_SYM(retro_set_audio_sample);
+   SOAK_SYM(retro_set_audio_sample_batch);
+   SOAK_SYM(retro_set_input_poll);
+   SOAK_SYM(retro_set_input_state);
+   SOAK_SYM(retro_run);
+   SOAK_SYM(retro_serialize_size);
+   SOAK_SYM(retro_serialize);
+   SOAK_SYM(retro_unserialize);
+   SOAK_SYM(retro_load_game);
+   SOAK_SYM(retro_unload_game);
+#undef SOAK_SYM
+
+   return true;
+}
+
+static bool soak_core_start(soak_core_t *core, const char *content,
+      double *fps)
+{
+   struct retro_system_info    info;
+   struct retro_system_av_info av;
+   struct retro_game_info      game;
+   void *data = NULL;
+   bool ok;
+
+   core->retro_set_environment(soak_environment);
+   core->retro_init();
+   core->retro_set_video_refresh(soak_video);
+   core->retro_set_audio_sample(soak_audio);
+   core->retro_set_audio_sample_batch(soak_audio_batch);
+   core->retro_set_input_poll(soak_poll);
+   core->retro_set_input_state(soak_input_state);
+
+   memset(&info, 0, sizeof(info));
+   memset(&game, 0, sizeof(game));
+   core->retro_get_system_info(&info);
+   game.path = content;
+
+   if (content && !info.need_fullpath)
+   {
+      FILE *fp = fopen(content, "rb");
+      long size;
+      if (!fp)
+      {
+         perror(content);
+         return false;
+      }
+      fseek(fp, 0, SEEK_END);
+      size = ftell(fp);
+      rewind(fp);
+      if (size > 0 && (data = malloc((size_t)size))
+            && fread(data, 1, (size_t)size, fp) == (size_t)size)
+      {
+         game.data = data;
+         game.size = (size_t)size;
+      }
+      fclose(fp);
+   }
+
+   ok = core->retro_load_game(content ? &game : NULL);
+   free(data);
+   if (!ok)
+   {
+      fprintf(stderr, "Core failed to load content.\n");
+      return false;
+   }
+
+   core->retro_get_system_av_info(&av);
+   if (av.timing.fps > 0.0)
+      *fps = av.timing.fps;
+   return true;
+}
+
+static void soak_core_unload(soak_core_t *core)
+{
+   if (!core->handle)
+      return;
+   core->retro_unload_game();
+   core->retro_deinit();
+   dlclose(core->handle);
+   remove(core->path);
+   core->handle = NULL;
+}
+
+/* GekkoNet event handling, as netplay_handle_game_events() does it */
+
+static void soak_advance(soak_peer_t *peer, const GekkoGameEvent *ev)
+{
+   int64_t start = cpu_features_get_time_usec();
+   uint32_t elapsed;
+
+   netplay_input_decode(&soak_layout, ev->data.adv.inputs,
+         ev->data.adv.input_len, soak_opt.peers,
+         peer->ports, &peer->keys);
+   peer->core.retro_run();
+   elapsed = (uint32_t)(cpu_features_get_time_usec() - start);
+   if (ev->data.adv.rolling_back)
+      netplay_telemetry_add_resim(&peer->telemetry, elapsed);
+   else
+   {
+      peer->run_usec += elapsed;
+      peer->runs++;
+   }
+   peer->frame = ev->data.adv.frame;
+}
+
+/* Every save must hold the same number of frames relative to its tag,
+ * whether it was taken at once or deferred behind a presented frame */
+static void soak_check_save(soak_peer_t *peer, int index,
+      const uint8_t *state, int frame)
+{
+   uint32_t frames;
+   int delta;
+
+   if (soak_opt.core_path)
+      return;
+
+   memcpy(&frames, state + SOAK_BUILTIN_COUNTER, sizeof(frames));
+   delta = frame - (int)frames;
+   if (!peer->save_delta_known)
+   {
+      peer->save_delta       = delta;
+      peer->save_delta_known = true;
+   }
+   else if (delta != peer->save_delta && !peer->bad_saves++)
+      printf("peer %d: save of frame %d holds %u frames run, expected %d\n",
+            index, frame, frames, frame - peer->save_delta);
+}
+
+static void soak_save(soak_peer_t *peer, int index, GekkoGameEvent *ev,
+      unsigned state_size)
+{
+   int64_t start = cpu_features_get_time_usec();
+
+   if (peer->core.retro_serialize(ev->data.save.state, state_size))
+   {
+      soak_hash_t *h;
+      soak_check_save(peer, index, (const uint8_t*)ev->data.save.state,
+            ev->data.save.frame);
+      /* Corrupt every save of the frame, so replaying it after
+       * a rollback cannot heal the divergence */
+      if (     soak_opt.desync_at >= 0
+            && index == (int)soak_opt.peers - 1
+            && ev->data.save.frame == soak_opt.desync_at)
+      {
+         uint8_t *state = (uint8_t*)ev->data.save.state;
+         state[state_size / 2] ^= 0x5a;
+         peer->core.retro_unserialize(state, state_size);
+      }
+      *ev->data.save.state_len = state_size;
+      *ev->data.save.checksum  = netplay_checksum_frame(
+            &soak_checksum, ev->data.save.frame,
+            ev->data.save.state, state_size);
+      h           = &peer->hashes[(unsigned)ev->data.save.frame
+         % SOAK_HASH_RING];
+      h->frame    = ev->data.save.frame;
+      h->checksum = *ev->data.save.checksum;
+   }
+   else
+      *ev->data.save.state_len = 0;
+   netplay_telemetry_add_save(&peer->telemetry, (uint32_t)
+         (cpu_features_get_time_usec() - start));
+}
+
+/**
+ * soak_pump
+ * @present              : the presented frame is run after the update
+ *
+ * One GekkoNet update, handled like the frontend's netplay_pump_events().
+ * Returns the advance left for the caller to run, or NULL.
+ */
+static GekkoGameEvent *soak_pump(soak_peer_t *peer, int index,
+      unsigned state_size, bool present)
+{
+   int i;
+   int presented;
+   int count      = 0;
+   unsigned depth = 0;
+   netplay_event_plan_t *plan;
+   GekkoGameEvent **events;
+
+   /* The advance the saves follow has run by now */
+   if (peer->deferred)
+   {
+      for (i = 0; i < peer->events.count; i++)
+      {
+         if (peer->events.plan[i].action == NETPLAY_EVENT_SAVE_AFTER)
+         {
+            soak_save(peer, index, peer->deferred[i], state_size);
+            peer->deferred_saves++;
+         }
+      }
+      peer->deferred = NULL;
+   }
+
+   events = gekko_update_session(peer->session, &count);
+   if (!(plan = netplay_events_begin(&peer->events, count)))
+      return NULL;
+
+   for (i = 0; i < count; i++)
+   {
+      switch (events[i]->type)
+      {
+         case AdvanceEvent:
+            plan[i].type         = NETPLAY_EVENT_ADVANCE;
+            plan[i].rolling_back = events[i]->data.adv.rolling_back;
+            break;
+         case SaveEvent:
+            plan[i].type         = NETPLAY_EVENT_SAVE;
+            break;
+         case LoadEvent:
+            plan[i].type         = NETPLAY_EVENT_LOAD;
+            break;
+         default:
+            break;
+      }
+   }
+
+   presented = netplay_events_plan(&peer->events, present);
+
+   for (i = 0; i < count; i++)
+   {
+      GekkoGameEvent *ev = events[i];
+      int64_t start      = cpu_features_get_time_usec();
+
+      switch (plan[i].action)
+      {
+         case NETPLAY_EVENT_RESIMULATE:
+            if (ev->data.adv.rolling_back)
+               depth++;
+            else if (!present)
+               peer->skipped++;
+            soak_advance(peer, ev);
+            break;
+         case NETPLAY_EVENT_SAVE_NOW:
+            soak_save(peer, index, ev, state_size);
+            break;
+         case NETPLAY_EVENT_SAVE_AFTER:
+            peer->deferred = events;
+            break;
+         case NETPLAY_EVENT_LOAD_NOW:
+            peer->core.retro_unserialize(ev->data.load.state,
+                  ev->data.load.state_len);
+            netplay_telemetry_add_load(&peer->telemetry, (uint32_t)
+                  (cpu_features_get_time_usec() - start));
+            break;
+         default:
+            break;
+      }
+   }
+
+   if (depth)
+      netplay_telemetry_add_rollback(&peer->telemetry, depth);
+
+   return presented >= 0 ? events[presented] : NULL;
+}
+
+static void soak_handle_session_events(soak_peer_t *peer, int index)
+{
+   int i;
+   int count = 0;
+   GekkoSessionEvent **events = gekko_session_events(peer->session, &count);
+
+   for (i = 0; i < count; i++)
+   {
+      GekkoSessionEvent *ev = events[i];
+      switch (ev->type)
+      {
+         case SessionStarted:
+            peer->started = true;
+            if (soak_opt.verbose)
+               printf("peer %d: session started\n", index);
+            break;
+         case PlayerDisconnected:
+            printf("peer %d: handle %d disconnected\n",
+                  index, ev->data.disconnected.handle);
+            break;
+         case DesyncDetected:
+            if (!peer->desyncs++)
+               peer->first_desync = ev->data.desynced.frame;
+            if (soak_opt.verbose || peer->desyncs == 1)
+               printf("peer %d: desync at frame %d with handle %d"
+                     " (local %08x remote %08x)\n", index,
+                     ev->data.desynced.frame,
+                     ev->data.desynced.remote_handle,
+                     ev->data.desynced.local_checksum,
+                     ev->data.desynced.remote_checksum);
+            break;
+         default:
+            break;
+      }
+   }
+}
+
+/* Orderings GekkoNet may hand out in one update, and what the frontend
+ * must do with them. Events: A advance, R rolling back advance, S save,
+ * L load, O other. Actions: P presented by core_run(), r run at once,
+ * s save at once, d save deferred to the next update, l load, - none. */
+static const struct
+{
+   const char *events;
+   bool        present;
+   const char *actions;
+} soak_plans[] = {
+   { "AS",      true,  "Pd"      },
+   { "AS",      false, "rs"      },
+   { "ASAS",    true,  "rsPd"    },
+   { "ASAS",    false, "rsrs"    },
+   { "LRSRSAS", true,  "lrsrsPd" },
+   { "LRSRSAS", false, "lrsrsrs" },
+   { "LRS",     true,  "lrs"     },
+   { "AL",      true,  "rl"      },
+   { "SAOS",    true,  "sP-d"    },
+   { "",        true,  ""        }
+};
+
+/* Returns the number of orderings planned differently than expected */
+static unsigned soak_check_plans(void)
+{
+   unsigned i;
+   unsigned failed = 0;
+   netplay_events_t ev;
+
+   memset(&ev, 0, sizeof(ev));
+
+   for (i = 0; i < sizeof(soak_plans) / sizeof(soak_plans[0]); i++)
+   {
+      int j;
+      char got[16];
+      int count                  = (int)strlen(soak_plans[i].events);
+      netplay_event_plan_t *plan = netplay_events_begin(&ev, count);
+
+      for (j = 0; j < count; j++)
+      {
+         switch (soak_plans[i].events[j])
+         {
+            case 'R':
+               plan[j].rolling_back = true;
+               /* fall through */
+            case 'A':
+               plan[j].type = NETPLAY_EVENT_ADVANCE;
+               break;
+            case 'S':
+               plan[j].type = NETPLAY_EVENT_SAVE;
+               break;
+            case 'L':
+               plan[j].type = NETPLAY_EVENT_LOAD;
+               break;
+            default:
+               break;
+         }
+      }
+
+      netplay_events_plan(&ev, soak_plans[i].present);
+      for (j = 0; j < count; j++)
+         got[j] = "-rPsdl"[plan[j].action];
+      got[count] = '\0';
+
+      if (strcmp(got, soak_plans[i].actions))
+      {
+         printf("plan for %s%s: %s, expected %s\n", soak_plans[i].events,
+               soak_plans[i].present ? "" : " after the frame",
+               got, soak_plans[i].actions);
+         failed++;
+      }
+   }
+
+   netplay_events_free(&ev);
+   return failed;
+}
+
+/* Compare the checksums every peer saved for frames that can no
+ * longer be rolled back. Returns the number of mismatching frames. */
+static unsigned soak_compare_hashes(unsigned *compared)
+{
+   unsigned p;
+   unsigned mismatches = 0;
+   int lo, hi, f;
+   int newest          = soak_peers[0].frame;
+
+   for (p = 1; p < soak_opt.peers; p++)
+      if (soak_peers[p].frame < newest)
+         newest = soak_peers[p].frame;
+
+   hi        = newest - (int)soak_opt.prediction - 2;
+   lo        = hi - SOAK_HASH_RING + 1;
+   *compared = 0;
+   if (lo < 0)
+      lo = 0;
+
+   for (f = lo; f <= hi; f++)
+   {
+      const soak_hash_t *ref = &soak_peers[0].hashes[(unsigned)f
+         % SOAK_HASH_RING];
+      if (ref->frame != f)
+         continue;
+      for (p = 1; p < soak_opt.peers; p++)
+      {
+         const soak_hash_t *h = &soak_peers[p].hashes[(unsigned)f
+            % SOAK_HASH_RING];
+         if (h->frame != f)
+            continue;
+         (*compared)++;
+         if (h->checksum != ref->checksum)
+         {
+            if (!mismatches)
+               printf("checksum mismatch at frame %d: peer 0 %08x, peer %u %08x\n",
+                     f, ref->checksum, p, h->checksum);
+            mismatches++;
+         }
+      }
+   }
+
+   return mismatches;
+}
+
+static void soak_usage(void)
+{
+   fprintf(stderr,
+         "Usage: netplay_soak [options] [content]\n"
+         "  -L, --core PATH        libretro core (default: built-in test core)\n"
+         "  -n, --peers N          sessions to run, 2-%d (default 2)\n"
+         "  -f, --frames N         frames every peer must reach (default 3600)\n"
+         "  -l, --latency MS       one-way latency (default 40)\n"
+         "  -j, --jitter MS        latency jitter, +/- (default 8)\n"
+         "  -x, --loss PCT         packet loss (default 2)\n"
+         "  -r, --reorder PCT      packets held back behind later ones (default 1)\n"
+         "  -d, --delay N          local input delay (default 1)\n"
+         "  -w, --window N         input prediction window (default 8)\n"
+         "  -k, --skip N           skip one frame in N, as time sync does\n"
+         "  -s, --seed N           random seed (default 1)\n"
+         "  -D, --desync-at N      corrupt the last peer's state at frame N\n"
+         "  -c, --csv PREFIX       write PREFIX-<peer>.csv telemetry\n"
+         "  -F, --fast             do not pace frames to the core's rate\n"
+         "  -v, --verbose\n",
+         SOAK_MAX_PEERS);
+}
+
+int main(int argc, char **argv)
+{
+   unsigned p;
+   unsigned state_size = 0;
+   unsigned compared   = 0;
+   unsigned mismatches;
+   uint64_t desyncs    = 0;
+   double fps          = 60.0;
+   int64_t frame_usec, next_tick, start, deadline;
+   GekkoConfig cfg;
+
+   const struct option opt[] = {
+      {"core",      1, NULL, 'L'},
+      {"peers",     1, NULL, 'n'},
+      {"frames",    1, NULL, 'f'},
+      {"latency",   1, NULL, 'l'},
+      {"jitter",    1, NULL, 'j'},
+      {"loss",      1, NULL, 'x'},
+      {"reorder",   1, NULL, 'r'},
+      {"delay",     1, NULL, 'd'},
+      {"window",    1, NULL, 'w'},
+      {"skip",      1, NULL, 'k'},
+      {"seed",      1, NULL, 's'},
+      {"desync-at", 1, NULL, 'D'},
+      {"csv",       1, NULL, 'c'},
+      {"fast",      0, NULL, 'F'},
+      {"verbose",   0, NULL, 'v'},
+      {"help",      0, NULL, 'h'},
+      {NULL,        0, NULL, 0}
+   };
+
+   soak_opt.peers       = 2;
+   soak_opt.frames      = 3600;
+   soak_opt.latency_ms  = 40;
+   soak_opt.jitter_ms   = 8;
+   soak_opt.loss_pct    = 2;
+   soak_opt.reorder_pct = 1;
+   soak_opt.delay       = 1;
+   soak_opt.prediction  = 8;
+   soak_opt.desync_at   = -1;
+   soak_opt.seed        = 1;
+
+   for (;;)
+   {
+      int c = getopt_long(argc, argv, "L:n:f:l:j:x:r:d:w:k:s:D:c:Fvh",
+            opt, NULL);
+      if (c == -1)
+         break;
+
+      switch (c)
+      {
+         case 'L': soak_opt.core_path   = optarg; break;
+         case 'n': soak_opt.peers       = (unsigned)atoi(optarg); break;
+         case 'f': soak_opt.frames      = (unsigned)atoi(optarg); break;
+         case 'l': soak_opt.latency_ms  = (unsigned)atoi(optarg); break;
+         case 'j': soak_opt.jitter_ms   = (unsigned)atoi(optarg); break;
+         case 'x': soak_opt.loss_pct    = (unsigned)atoi(optarg); break;
+         case 'r': soak_opt.reorder_pct = (unsigned)atoi(optarg); break;
+         case 'd': soak_opt.delay       = (unsigned)atoi(optarg); break;
+         case 'w': soak_opt.prediction  = (unsigned)atoi(optarg); break;
+         case 'k': soak_opt.skip        = (unsigned)atoi(optarg); break;
+         case 's': soak_opt.seed        = strtoull(optarg, NULL, 0); break;
+         case 'D': soak_opt.desync_at   = atoi(optarg); break;
+         case 'c': soak_opt.csv_prefix  = optarg; break;
+         case 'F': soak_opt.fast        = true; break;
+         case 'v': soak_opt.verbose     = true; break;
+         default:
+            soak_usage();
+            return 2;
+      }
+   }
+
+   if (optind < argc)
+      soak_opt.content_path = argv[optind];
+
+   if (soak_opt.peers < 2 || soak_opt.peers > SOAK_MAX_PEERS)
+   {
+      soak_usage();
+      return 2;
+   }
+
+   if (soak_check_plans())
+   {
+      printf("FAIL (event plans)\n");
+      return 1;
+   }
+
+   soak_link.slots = (soak_packet_t*)calloc(SOAK_LINK_SLOTS,
+         sizeof(*soak_link.slots));
+   soak_recv_slots = (soak_packet_t*)calloc(SOAK_RECV_SLOTS,
+         sizeof(*soak_recv_slots));
+   if (!soak_link.slots || !soak_recv_slots)
+      return 1;
+   soak_link.rng = soak_opt.seed * 0x9E3779B97F4A7C15ULL + 1;
+
+   soak_checksum.mode     = NETPLAY_CHECKSUM_CRC32;
+   soak_checksum.interval = 1;
+   soak_checksum.stride   = 0;
+   netplay_input_layout_init(&soak_layout, NETPLAY_INPUT_ANALOG, 1);
+
+   for (p = 0; p < soak_opt.peers; p++)
+   {
+      soak_peer_t *peer = &soak_peers[p];
+
+      soak_current       = (int)p;
+      peer->rng          = (soak_opt.seed + p + 1) * 0x2545F4914F6CDD1DULL;
+      peer->first_desync = -1;
+      peer->local_input  = (uint8_t*)calloc(1, soak_layout.record_size);
+      netplay_telemetry_init(&peer->telemetry, soak_opt.csv_prefix != NULL);
+
+      if (soak_opt.core_path)
+      {
+         if (     !soak_core_load(&peer->core, soak_opt.core_path, p)
+               || !soak_core_start(&peer->core, soak_opt.content_path, &fps))
+            return 1;
+      }
+      else
+         soak_core_builtin(&peer->core);
+
+      if (peer->core.retro_serialize_size() > state_size)
+         state_size = (unsigned)peer->core.retro_serialize_size();
+   }
+
+   if (!state_size)
+   {
+      fprintf(stderr, "Core does not support save states.\n");
+      return 1;
+   }
+
+   memset(&cfg, 0, sizeof(cfg));
+   cfg.num_players             = (unsigned char)soak_opt.peers;
+   cfg.input_prediction_window = (unsigned char)soak_opt.prediction;
+   cfg.input_size              = soak_layout.record_size;
+   cfg.state_size              = state_size;
+   cfg.desync_detection        = true;
+
+   for (p = 0; p < soak_opt.peers; p++)
+   {
+      unsigned q;
+      soak_peer_t *peer = &soak_peers[p];
+
+      if (!gekko_create(&peer->session))
+      {
+         fprintf(stderr, "gekko_create failed.\n");
+         return 1;
+      }
+      gekko_start(peer->session, &cfg);
+      gekko_net_adapter_set(peer->session, &soak_adapter);
+
+      /* Every peer registers the players in the same order */
+      for (q = 0; q < soak_opt.peers; q++)
+      {
+         if (q == p)
+            peer->handle = gekko_add_actor(peer->session, LocalPlayer, NULL);
+         else
+         {
+            GekkoNetAddress addr;
+            addr.data = &soak_endpoint_ids[q];
+            addr.size = sizeof(int);
+            gekko_add_actor(peer->session, RemotePlayer, &addr);
+         }
+      }
+      gekko_set_local_delay(peer->session, peer->handle,
+            (unsigned char)soak_opt.delay);
+   }
+
+   printf("%u peers, core %s, state %u bytes, input %u bytes, %.2f fps\n",
+         soak_opt.peers, soak_peers[0].core.path, state_size,
+         soak_layout.record_size, fps);
+   printf("link: %u ms +/- %u ms, %u%% loss, %u%% reorder, delay %u\n",
+         soak_opt.latency_ms, soak_opt.jitter_ms, soak_opt.loss_pct,
+         soak_opt.reorder_pct, soak_opt.delay);
+
+   frame_usec = (int64_t)(1000000.0 / fps);
+   start      = cpu_features_get_time_usec();
+   next_tick  = start;
+   /* Generous limit so a stalled session fails instead of hanging */
+   deadline   = start + (int64_t)soak_opt.frames * frame_usec * 4
+      + 30 * 1000000LL;
+
+   for (;;)
+   {
+      int slowest = soak_peers[0].frame;
+      int64_t now;
+
+      for (p = 0; p < soak_opt.peers; p++)
+      {
+         soak_peer_t *peer = &soak_peers[p];
+         int before        = peer->frame;
+         GekkoGameEvent *advance;
+
+         soak_current = (int)p;
+         gekko_network_poll(peer->session);
+
+         soak_update_pad(peer);
+         netplay_input_collect(&soak_layout, soak_local_state, 0,
+               peer->local_input);
+         gekko_add_local_input(peer->session, peer->handle,
+               peer->local_input);
+
+         /* A frame time sync skips: input and an update of its own,
+          * every advance run at once */
+         if (     soak_opt.skip
+               && peer->started
+               && !soak_rand_range(&peer->rng, soak_opt.skip))
+         {
+            soak_pump(peer, (int)p, state_size, false);
+            soak_update_pad(peer);
+            netplay_input_collect(&soak_layout, soak_local_state, 0,
+                  peer->local_input);
+            gekko_add_local_input(peer->session, peer->handle,
+                  peer->local_input);
+         }
+
+         /* netplay_pre_frame(), then core_run() */
+         if ((advance = soak_pump(peer, (int)p, state_size, true)))
+         {
+            soak_advance(peer, advance);
+            peer->presented++;
+         }
+         soak_handle_session_events(peer, (int)p);
+
+         if (peer->started && peer->frame != before)
+            netplay_telemetry_end_frame(&peer->telemetry,
+                  gekko_frames_ahead(peer->session),
+                  cpu_features_get_time_usec());
+
+         if (peer->frame < slowest)
+            slowest = peer->frame;
+      }
+
+      if (slowest >= (int)soak_opt.frames)
+         break;
+
+      now = cpu_features_get_time_usec();
+      if (now > deadline)
+      {
+         printf("timed out at frame %d\n", slowest);
+         break;
+      }
+
+      if (soak_opt.fast)
+         usleep(100);
+      else
+      {
+         next_tick += frame_usec;
+         if (next_tick > now)
+            usleep((useconds_t)(next_tick - now));
+         else if (now - next_tick > frame_usec * 8)
+            next_tick = now;
+      }
+   }
+
+   mismatches = soak_compare_hashes(&compared);
+
+   printf("\n%.1f s, link: %llu sent, %llu delivered, %llu lost, %llu reordered, %llu overflow\n",
+         (double)(cpu_features_get_time_usec() - start) / 1000000.0,
+         (unsigned long long)soak_link.sent,
+         (unsigned long long)soak_link.delivered,
+         (unsigned long long)soak_link.lost,
+         (unsigned long long)soak_link.reordered,
+         (unsigned long long)soak_link.overflow);
+
+   for (p = 0; p < soak_opt.peers; p++)
+   {
+      char desc[2048];
+      soak_peer_t *peer = &soak_peers[p];
+      const netplay_telemetry_t *t = &peer->telemetry;
+
+      netplay_telemetry_describe(t, desc, sizeof(desc));
+      printf("peer %u: frame %d, %llu desync(s), %llu rollbacks"
+            " (%llu frames), run %.0f us, save %.0f us, load %.0f us"
+            " per call\n", p, peer->frame,
+            (unsigned long long)peer->desyncs,
+            (unsigned long long)t->rollbacks,
+            (unsigned long long)t->rollback_frames,
+            peer->runs  ? (double)peer->run_usec / peer->runs : 0.0,
+            t->saves    ? (double)t->save_usec_total / t->saves : 0.0,
+            t->loads    ? (double)t->load_usec_total / t->loads : 0.0);
+      if (soak_opt.verbose)
+         printf("  %s\n", desc);
+
+      if (soak_opt.csv_prefix)
+      {
+         char path[512];
+         snprintf(path, sizeof(path), "%s-%u.csv", soak_opt.csv_prefix, p);
+         if (!netplay_telemetry_write_csv(t, path))
+            fprintf(stderr, "Unable to write %s.\n", path);
+      }
+
+      printf("  %llu presented, %llu deferred saves, %llu skipped, %llu bad saves\n",
+            (unsigned long long)peer->presented,
+            (unsigned long long)peer->deferred_saves,
+            (unsigned long long)peer->skipped,
+            (unsigned long long)peer->bad_saves);
+
+      desyncs += peer->desyncs + peer->bad_saves;
+   }
+
+   printf("confirmed checksums: %u compared, %u mismatched\n",
+         compared, mismatches);
+
+   for (p = 0; p < soak_opt.peers; p++)
+   {
+      soak_current = (int)p;
+      gekko_destroy(soak_peers[p].session);
+      soak_core_unload(&soak_peers[p].core);
+      netplay_telemetry_free(&soak_peers[p].telemetry);
+      netplay_events_free(&soak_peers[p].events);
+      free(soak_peers[p].local_input);
+   }
+   free(soak_link.slots);
+   free(soak_recv_slots);
+
+   if (desyncs || mismatches)
+   {
+      printf("FAIL\n");
+      return 1;
+   }
+   if (soak_peers[0].frame < (int)soak_opt.frames)
+   {
+      printf("FAIL (stalled)\n");
+      return 1;
+   }
+   printf("OK\n");
+   return 0;
+}
@@ -0,0 +1,532 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2017 - Daniel De Matteis
+ *  Copyright (C) 2014-2017 - Alfred Agrell
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Replays a recording of savestates through every rewind backend,
+ * without a core or the frontend.
+ *
+ * Usage: rewind_bench [options] [directory]
+ *
+ *   -b MB        rewind buffer size (20)
+ *   -t seconds   history the thinning backends aim for (300)
+ *   -g frames    push every this many states (1)
+ *   -f fps       frame rate of the recording (60)
+ *   -n frames    length of the synthetic recording (3600)
+ *   -s bytes     state size of the synthetic recording (262144)
+ *   -B name      only run this backend
+ *
+ * The files of the directory, sorted by name, are taken as the states
+ * of consecutive frames; dump them from a core with the same size.
+ * Without a directory, a synthetic recording is generated.
+ *
+ * Each backend gets every state pushed, then everything it kept popped
+ * back and checked against the recording. Pushes run on this thread,
+ * so their times are the whole cost the compression worker would
+ * otherwise hide. Peak memory is what the state manager holds. */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <compat/getopt.h>
+#include <retro_dirent.h>
+#include <file/file_path.h>
+#include <streams/file_stream.h>
+
+/* The state manager keeps its backends to itself; build it in, the
+ * way griffin does */
+#include "../../state_manager.c"
+
+struct bench_backend
+{
+   const char *name;
+   bool dedup;
+   bool compress;
+   bool thin;
+};
+
+static const struct bench_backend bench_backends[] = {
+   { "ring",            false, false, false },
+#ifdef HAVE_ZSTD
+   { "ring+zstd",       false, true,  false },
+#endif
+   { "ring+thin",       false, false, true  },
+#ifdef HAVE_ZSTD
+   { "ring+zstd+thin",  false, true,  true  },
+#endif
+#ifdef HAVE_STATESTREAM
+   { "dedup",           true,  false, false },
+#endif
+};
+
+static size_t   bench_buffer_size = 20 << 20;
+static unsigned bench_seconds     = 300;
+static unsigned bench_granularity = 1;
+static double   bench_fps         = 60.0;
+static bool     bench_verbose     = false;
+
+/* What the frontend would otherwise provide */
+
+static video_driver_state_t bench_video_st;
+
+video_driver_state_t *video_state_get_ptr(void) { return &bench_video_st; }
+const char *msg_hash_to_str(enum msg_hash_enums msg) { return ""; }
+bool core_info_get_current_core(core_info_t **core) { return false; }
+bool core_info_current_supports_rewind(void) { return true; }
+size_t content_get_serialized_size_rewind(void) { return 0; }
+bool content_serialize_state_rewind(void *buffer, size_t len) { return false; }
+bool content_deserialize_state(const void *data, size_t len) { return false; }
+bool audio_driver_has_callback(void) { return false; }
+void audio_driver_setup_rewind(void) { }
+void audio_driver_frame_is_reverse(void) { }
+void audio_driver_sample(int16_t left, int16_t right) { }
+void audio_driver_sample_rewind(int16_t left, int16_t right) { }
+size_t audio_driver_sample_batch(const int16_t *data, size_t frames) { return frames; }
+size_t audio_driver_sample_batch_rewind(const int16_t *data, size_t frames) { return frames; }
+bool retroarch_ctl(enum rarch_ctl_state state, void *data) { return false; }
+void runloop_msg_queue_push(const char *msg, size_t len,
+      unsigned prio, unsigned duration, bool flush, char *title,
+      enum message_queue_icon icon, enum message_queue_category category) { }
+
+static void bench_vlog(const char *fmt, va_list ap)
+{
+   if (bench_verbose)
+      vfprintf(stderr, fmt, ap);
+}
+
+void RARCH_LOG(const char *fmt, ...)
+{
+   va_list ap;
+   va_start(ap, fmt);
+   bench_vlog(fmt, ap);
+   va_end(ap);
+}
+
+void RARCH_WARN(const char *fmt, ...)
+{
+   va_list ap;
+   va_start(ap, fmt);
+   bench_vlog(fmt, ap);
+   va_end(ap);
+}
+
+void RARCH_ERR(const char *fmt, ...)
+{
+   va_list ap;
+   va_start(ap, fmt);
+   vfprintf(stderr, fmt, ap);
+   va_end(ap);
+}
+
+static int bench_compare_names(const void *a, const void *b)
+{
+   return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static int bench_compare_times(const void *a, const void *b)
+{
+   retro_time_t x = *(const retro_time_t*)a;
+   retro_time_t y = *(const retro_time_t*)b;
+   return (x > y) - (x < y);
+}
+
+/* Loads the files of dir in name order; they must all be one size. */
+static uint8_t **bench_load_dir(const char *dir, size_t *count, size_t *len)
+{
+   size_t i;
+   char **names       = NULL;
+   uint8_t **states   = NULL;
+   size_t num         = 0;
+   size_t cap         = 0;
+   struct RDIR *rdir  = retro_opendir(dir);
+
+   if (!rdir)
+   {
+      fprintf(stderr, "Cannot open \"%s\".\n", dir);
+      return NULL;
+   }
+
+   while (retro_readdir(rdir))
+   {
+      const char *name = retro_dirent_get_name(rdir);
+
+      if (retro_dirent_is_dir(rdir, NULL) || name[0] == '.')
+         continue;
+      if (num == cap)
+      {
+         cap   = cap ? cap * 2 : 256;
+         names = (char**)realloc(names, cap * sizeof(*names));
+      }
+      names[num++] = strdup(name);
+   }
+   retro_closedir(rdir);
+
+   if (!num)
+   {
+      fprintf(stderr, "No states in \"%s\".\n", dir);
+      free(names);
+      return NULL;
+   }
+
+   qsort(names, num, sizeof(*names), bench_compare_names);
+   states = (uint8_t**)calloc(num, sizeof(*states));
+   *len   = 0;
+
+   for (i = 0; i < num; i++)
+   {
+      char path[PATH_MAX_LENGTH];
+      void *buf      = NULL;
+      int64_t size   = 0;
+
+      fill_pathname_join_special(path, dir, names[i], sizeof(path));
+      if (!filestream_read_file(path, &buf, &size) || size <= 0)
+      {
+         fprintf(stderr, "Cannot read \"%s\".\n", path);
+         goto error;
+      }
+      if (!*len)
+         *len = (size_t)size;
+      else if ((size_t)size != *len)
+      {
+         fprintf(stderr, "\"%s\" is %u bytes, the states before it %u.\n",
+               path, (unsigned)size, (unsigned)*len);
+         free(buf);
+         goto error;
+      }
+      states[i] = (uint8_t*)buf;
+   }
+
+   for (i = 0; i < num; i++)
+      free(names[i]);
+   free(names);
+   *count = num;
+   return states;
+
+error:
+   for (i = 0; i < num; i++)
+   {
+      free(names[i]);
+      free(states[i]);
+   }
+   free(names);
+   free(states);
+   return NULL;
+}
+
+/* A recording that looks like a game: a bit of RAM changes every
+ * frame, some of it the same bytes over and over, and now and then a
+ * larger region is rewritten, as on a scene change. */
+static uint8_t **bench_synthetic(size_t count, size_t len)
+{
+   size_t i, j;
+   uint32_t seed    = 0x12345678U;
+   uint8_t **states = (uint8_t**)calloc(count, sizeof(*states));
+
+   for (i = 0; i < count; i++)
+   {
+      uint8_t *state = (uint8_t*)malloc(len);
+
+      states[i] = state;
+      if (!i)
+      {
+         for (j = 0; j < len; j++)
+         {
+            seed     = seed * 1103515245U + 12345U;
+            state[j] = ((j >> 12) & 3) ? (uint8_t)(seed >> 16) : 0;
+         }
+         continue;
+      }
+
+      memcpy(state, states[i - 1], len);
+      /* Counters and the player's position */
+      for (j = 0; j < 64; j++)
+         state[(j * 97) % len] = (uint8_t)(i + j);
+      /* Scattered writes */
+      for (j = 0; j < 32; j++)
+      {
+         seed = seed * 1103515245U + 12345U;
+         state[(seed >> 8) % len] = (uint8_t)(seed >> 24);
+      }
+      /* A region rewritten every few seconds */
+      if (i % 300 == 0)
+      {
+         size_t at = (i * 4099) % len;
+         for (j = 0; j < 8192 && at + j < len; j++)
+         {
+            seed          = seed * 1103515245U + 12345U;
+            state[at + j] = (uint8_t)(seed >> 16);
+         }
+      }
+   }
+
+   return states;
+}
+
+static size_t bench_ring_used(const uint8_t *head, const uint8_t *tail,
+      size_t capacity)
+{
+   return (size_t)(head - tail + (ptrdiff_t)capacity) % capacity;
+}
+
+/* Bytes the stored history takes up */
+static size_t bench_used(state_manager_t *state)
+{
+   unsigned t;
+   size_t used = state->blocksize;
+
+#ifdef HAVE_STATESTREAM
+   if (state->blocks)
+      return used + state->dedup_used;
+#endif
+
+   used += bench_ring_used(state->head, state->tail, state->capacity);
+   for (t = 0; t < state->tier_count; t++)
+   {
+      struct state_manager_tier *tier = &state->tiers[t];
+      used += bench_ring_used(tier->head, tier->tail, tier->capacity);
+      if (tier->pending_count)
+         used += state_manager_raw_patch_size(tier->pending);
+   }
+   return used;
+}
+
+/* Bytes the state manager holds */
+static size_t bench_footprint(state_manager_t *state)
+{
+   unsigned t;
+   size_t patch = state_manager_raw_maxsize(state->blocksize);
+   size_t bytes = 2 * (state->blocksize + 72);
+
+#ifdef HAVE_STATESTREAM
+   if (state->blocks)
+      bytes += state->dedup_used + state->dedup_block_size
+         + DEDUP_SUPERBLOCK_SIZE * sizeof(uint32_t);
+   else
+#endif
+      bytes += state->capacity;
+
+#ifdef HAVE_ZSTD
+   if (state->zstd_cctx)
+      bytes += patch
+         + ZSTD_sizeof_CCtx((ZSTD_CCtx*)state->zstd_cctx)
+         + ZSTD_sizeof_DCtx((ZSTD_DCtx*)state->zstd_dctx);
+#endif
+
+   if (state->tier_patch[0])
+      bytes += 2 * patch;
+   for (t = 0; t < state->tier_count; t++)
+   {
+      if (!state->tiers[t].mapped)
+         bytes += state->tiers[t].capacity;
+      if (state->tiers[t].pending)
+         bytes += patch;
+   }
+   return bytes;
+}
+
+/* Returns false if a popped state is not one that was pushed. */
+static bool bench_run(const struct bench_backend *backend,
+      uint8_t **states, size_t count, size_t len)
+{
+   size_t i, used;
+   unsigned captures, entries;
+   retro_time_t start, push_usec, pop_usec;
+   size_t pushes        = 0;
+   size_t pops          = 0;
+   size_t peak          = 0;
+   size_t last          = count;
+   unsigned target      = 0;
+   bool ok              = true;
+   retro_time_t *times  = (retro_time_t*)malloc(
+         (count / bench_granularity + 1) * sizeof(*times));
+   state_manager_t *st  = state_manager_new(len, bench_buffer_size,
+         backend->dedup, backend->compress, 0, NULL,
+         backend->thin ? bench_seconds : 0);
+
+   if (!st || !times)
+   {
+      printf("%-16s failed to start\n", backend->name);
+      free(times);
+      if (st)
+      {
+         state_manager_free(st);
+         free(st);
+      }
+      return true;
+   }
+
+   if (st->seconds)
+      target = (unsigned)(bench_seconds * bench_fps / bench_granularity);
+#ifdef HAVE_ZSTD
+   st->zstd_budget = (int64_t)(1000000.0 / bench_fps / 4);
+#endif
+
+   push_usec = 0;
+   for (i = 0; i < count; i += bench_granularity)
+   {
+      void *slot;
+      retro_time_t usec;
+      size_t footprint;
+
+      start = cpu_features_get_time_usec();
+      state_manager_push_where(st, &slot);
+      usec  = cpu_features_get_time_usec() - start;
+
+      /* Stands in for the core serializing into the slot */
+      memcpy(slot, states[i], len);
+
+      start = cpu_features_get_time_usec();
+      state_manager_push_do(st, target);
+      usec += cpu_features_get_time_usec() - start;
+
+      times[pushes++] = usec;
+      push_usec      += usec;
+      if ((footprint = bench_footprint(st)) > peak)
+         peak = footprint;
+   }
+
+   used     = bench_used(st);
+   captures = st->captures;
+   entries  = st->entries;
+
+   start    = cpu_features_get_time_usec();
+   for (;;)
+   {
+      const void *data;
+
+      if (!state_manager_pop(st, &data))
+         break;
+      pops++;
+
+      /* Thinned history skips states, but never goes forward */
+      while (last > 0 && memcmp(data, states[--last], len))
+         ;
+      if (last == 0 && memcmp(data, states[0], len))
+      {
+         ok = false;
+         break;
+      }
+   }
+   pop_usec = cpu_features_get_time_usec() - start;
+
+   qsort(times, pushes, sizeof(*times), bench_compare_times);
+
+   printf("%-16s %9.1f %7.2f %7u %7u %9.1f %8.1f %8.1f %7u%s\n",
+         backend->name,
+         push_usec ? (double)pushes * len / push_usec : 0.0,
+         used ? (double)entries * len / used : 0.0,
+         (unsigned)times[pushes / 2],
+         (unsigned)times[pushes * 99 / 100],
+         pop_usec ? (double)pops * len / pop_usec : 0.0,
+         peak / 1048576.0,
+         (double)captures * bench_granularity / bench_fps,
+         entries,
+         ok ? "" : "  MISMATCH");
+
+   free(times);
+   state_manager_free(st);
+   free(st);
+   return ok;
+}
+
+int main(int argc, char **argv)
+{
+   int c;
+   size_t i, count;
+   uint8_t **states    = NULL;
+   const char *only    = NULL;
+   size_t frames       = 3600;
+   size_t len          = 256 * 1024;
+   bool ok             = true;
+
+   while ((c = getopt(argc, argv, "b:t:g:f:n:s:B:v")) != -1)
+   {
+      switch (c)
+      {
+         case 'b':
+            bench_buffer_size = (size_t)strtoul(optarg, NULL, 0) << 20;
+            break;
+         case 't':
+            bench_seconds     = (unsigned)strtoul(optarg, NULL, 0);
+            break;
+         case 'g':
+            bench_granularity = (unsigned)strtoul(optarg, NULL, 0);
+            break;
+         case 'f':
+            bench_fps         = atof(optarg);
+            break;
+         case 'n':
+            frames            = (size_t)strtoul(optarg, NULL, 0);
+            break;
+         case 's':
+            len               = (size_t)strtoul(optarg, NULL, 0);
+            break;
+         case 'B':
+            only              = optarg;
+            break;
+         case 'v':
+            bench_verbose     = true;
+            break;
+         default:
+            fprintf(stderr, "Usage: %s [-b MB] [-t seconds] [-g frames] "
+                  "[-f fps] [-n frames] [-s bytes] [-B backend] [-v] "
+                  "[directory]\n", argv[0]);
+            return 1;
+      }
+   }
+
+   if (!bench_granularity)
+      bench_granularity = 1;
+   if (bench_fps <= 0.0)
+      bench_fps = 60.0;
+   bench_video_st.av_info.timing.fps = bench_fps;
+
+   if (optind < argc)
+   {
+      if (!(states = bench_load_dir(argv[optind], &count, &len)))
+         return 1;
+   }
+   else if (frames && len)
+   {
+      count  = frames;
+      states = bench_synthetic(count, len);
+   }
+   else
+      return 1;
+
+   state_manager_raw_select(STATE_MANAGER_RAW_IMPL_AUTO);
+   printf("%u states of %u bytes, %u MB buffer, %s delta kernels\n\n",
+         (unsigned)count, (unsigned)len,
+         (unsigned)(bench_buffer_size >> 20),
+         state_manager_raw_impl_name(state_manager_raw_selected()));
+   printf("%-16s %9s %7s %7s %7s %9s %8s %8s %7s\n", "backend",
+         "push MB/s", "ratio", "p50 us", "p99 us", "pop MB/s",
+         "peak MB", "depth s", "states");
+
+   for (i = 0; i < sizeof(bench_backends) / sizeof(bench_backends[0]); i++)
+   {
+      if (only && strcmp(only, bench_backends[i].name))
+         continue;
+      if (!bench_run(&bench_backends[i], states, count, len))
+         ok = false;
+   }
+
+   for (i = 0; i < count; i++)
+      free(states[i]);
+   free(states);
+   return ok ? 0 : 1;
+}
@@ -0,0 +1,246 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2017 - Daniel De Matteis
+ *  Copyright (C) 2014-2017 - Alfred Agrell
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Compares the rewind delta kernels on pairs of consecutive states.
+ *
+ * Usage: rewind_diff_bench [-i iterations] [state files...]
+ *
+ * Files are taken in order as a recording, each one diffed against
+ * the one before, so dumps of consecutive frames from a real core
+ * can be measured. Without files, synthetic pairs of typical sizes
+ * (SNES through N64) with sparse changes are generated. Every kernel's
+ * patches are checked against the scalar ones. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <features/features_cpu.h>
+
+#include "../../state_manager_raw.h"
+
+static const size_t bench_sizes[] = {
+   128 * 1024,        /* 8/16-bit consoles */
+   1024 * 1024,       /* PS1 */
+   4 * 1024 * 1024,   /* N64, Saturn */
+   16 * 1024 * 1024
+};
+
+static unsigned char *bench_load_file(const char *path, size_t *len)
+{
+   long size;
+   unsigned char *buf = NULL;
+   FILE *fp           = fopen(path, "rb");
+
+   if (!fp)
+      return NULL;
+
+   if (fseek(fp, 0, SEEK_END) == 0 && (size = ftell(fp)) > 0)
+   {
+      rewind(fp);
+      if ((buf = (unsigned char*)malloc((size_t)size)))
+      {
+         if (fread(buf, 1, (size_t)size, fp) == (size_t)size)
+            *len = (size_t)size;
+         else
+         {
+            free(buf);
+            buf = NULL;
+         }
+      }
+   }
+
+   fclose(fp);
+   return buf;
+}
+
+/* A state and the next frame's, which changes a few bytes here and
+ * there and rewrites one 2K region, roughly like a real frame */
+static void bench_make_pair(unsigned char *a, unsigned char *b, size_t len)
+{
+   size_t i;
+   uint32_t seed = 0x12345678U;
+
+   for (i = 0; i < len; i++)
+   {
+      seed = seed * 1103515245U + 12345U;
+      a[i] = ((i >> 12) & 3) ? (unsigned char)(seed >> 16) : 0;
+   }
+
+   memcpy(b, a, len);
+   for (i = 0; i < len / 512; i++)
+   {
+      seed = seed * 1103515245U + 12345U;
+      b[(seed >> 8) % len] ^= 0x5a;
+   }
+   for (i = len / 3; i < len / 3 + 2048 && i < len; i++)
+      b[i] ^= (unsigned char)i;
+}
+
+/* Runs every kernel over the pairs (states[i - 1], states[i]). */
+static int bench_run(const char *label, unsigned char **states,
+      unsigned count, size_t len, unsigned iterations)
+{
+   int impl;
+   unsigned i;
+   size_t total         = 0;
+   size_t maxsize       = state_manager_raw_maxsize(len);
+   unsigned char *ref   = (unsigned char*)malloc(maxsize * count);
+   unsigned char *patch = (unsigned char*)malloc(maxsize);
+   unsigned char *out   = (unsigned char*)state_manager_raw_alloc(len, 2);
+   int ret              = 0;
+
+   if (!ref || !patch || !out)
+      return 1;
+
+   printf("%s (%lu bytes, %u pairs)\n", label, (unsigned long)len, count - 1);
+
+   /* Reference patches, which must also undo each frame */
+   state_manager_raw_select(STATE_MANAGER_RAW_IMPL_SCALAR);
+   for (i = 1; i < count; i++)
+   {
+      size_t size = state_manager_raw_compress(states[i - 1], states[i],
+            len, ref + maxsize * i);
+      memcpy(out, states[i], len);
+      state_manager_raw_decompress(ref + maxsize * i, out);
+      if (memcmp(out, states[i - 1], len))
+      {
+         printf("  scalar patch %u does not restore its state\n", i);
+         ret = 1;
+      }
+      total += size;
+   }
+   printf("  patches    %10.1f bytes/pair (%.2f%% of a state)\n",
+         (double)total / (count - 1), 100.0 * total / (count - 1) / len);
+
+   for (impl = STATE_MANAGER_RAW_IMPL_SCALAR;
+         impl < STATE_MANAGER_RAW_IMPL_LAST; impl++)
+   {
+      unsigned n;
+      retro_time_t start, elapsed;
+      double usec;
+      bool same = true;
+
+      if (!state_manager_raw_select((enum state_manager_raw_impl)impl))
+         continue;
+
+      for (i = 1; i < count; i++)
+      {
+         size_t size = state_manager_raw_compress(states[i - 1], states[i],
+               len, patch);
+         if (     size != state_manager_raw_patch_size(ref + maxsize * i)
+               || memcmp(patch, ref + maxsize * i, size))
+            same = false;
+      }
+
+      start = cpu_features_get_time_usec();
+      for (n = 0; n < iterations; n++)
+         for (i = 1; i < count; i++)
+            state_manager_raw_compress(states[i - 1], states[i], len, patch);
+      elapsed = cpu_features_get_time_usec() - start;
+
+      usec = (double)elapsed / iterations / (count - 1);
+      printf("  %-10s %10.1f usec/pair %10.1f MB/s   %s\n",
+            state_manager_raw_impl_name((enum state_manager_raw_impl)impl),
+            usec, usec > 0.0 ? (double)len / usec : 0.0,
+            same ? "ok" : "MISMATCH");
+      if (!same)
+         ret = 1;
+   }
+
+   free(ref);
+   free(patch);
+   free(out);
+   return ret;
+}
+
+int main(int argc, char **argv)
+{
+   int i;
+   unsigned count;
+   unsigned char **states;
+   size_t len          = 0;
+   unsigned iterations = 50;
+   int first_file      = 1;
+   int ret             = 0;
+
+   if (argc > 2 && !strcmp(argv[1], "-i"))
+   {
+      iterations = (unsigned)strtoul(argv[2], NULL, 10);
+      if (!iterations)
+         iterations = 1;
+      first_file = 3;
+   }
+
+   if (first_file >= argc)
+   {
+      size_t s;
+      for (s = 0; s < sizeof(bench_sizes) / sizeof(bench_sizes[0]); s++)
+      {
+         char label[64];
+         unsigned char *pair[2];
+         pair[0] = (unsigned char*)state_manager_raw_alloc(bench_sizes[s], 0);
+         pair[1] = (unsigned char*)state_manager_raw_alloc(bench_sizes[s], 1);
+         if (!pair[0] || !pair[1])
+            return 1;
+         bench_make_pair(pair[0], pair[1], bench_sizes[s]);
+         snprintf(label, sizeof(label), "synthetic %luK",
+               (unsigned long)(bench_sizes[s] / 1024));
+         ret |= bench_run(label, pair, 2, bench_sizes[s], iterations);
+         free(pair[0]);
+         free(pair[1]);
+      }
+      return ret;
+   }
+
+   count  = (unsigned)(argc - first_file);
+   if (count < 2)
+   {
+      fprintf(stderr, "need at least two consecutive states\n");
+      return 1;
+   }
+   states = (unsigned char**)calloc(count, sizeof(*states));
+   if (!states)
+      return 1;
+
+   for (i = 0; i < (int)count; i++)
+   {
+      size_t size        = 0;
+      unsigned char *buf = bench_load_file(argv[first_file + i], &size);
+      if (!buf || (len && size != len))
+      {
+         fprintf(stderr, "%s: unable to read, or not the size of the first state\n",
+               argv[first_file + i]);
+         return 1;
+      }
+      len = size;
+      /* Alternate the end markers, as the rewind buffer does */
+      if ((states[i] = (unsigned char*)state_manager_raw_alloc(len, i & 1)))
+         memcpy(states[i], buf, len);
+      free(buf);
+      if (!states[i])
+         return 1;
+   }
+
+   ret = bench_run(argc - first_file > 2 ? "recording" : argv[first_file],
+         states, count, len, iterations);
+
+   for (i = 0; i < (int)count; i++)
+      free(states[i]);
+   free(states);
+   return ret;
+}
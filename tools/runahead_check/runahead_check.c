@@ -0,0 +1,300 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2023 - Daniel De Matteis
+ *  Copyright (C) 2018-2023 - Dan Weiss
+ *  Copyright (C) 2022-2023 - Neil Fore
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Runs single instance run-ahead against a small deterministic core
+ * and checks after every frame that the core holds the state of the
+ * real frame, the way it would without run-ahead.
+ *
+ * Usage: runahead_check
+ *
+ * Besides plain play with changing and unchanging input, the core's
+ * state is changed behind run-ahead's back - a state load and a reset,
+ * once through the core callbacks run-ahead hooks and once past them -
+ * and the next frame runs with unchanged input. The exit status is
+ * non-zero if any frame ends on another state. */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../runahead.h"
+#include "../../runloop.h"
+#include "../../audio/audio_driver.h"
+#include "../../gfx/video_driver.h"
+#include "../../configuration.h"
+#include "../../core_info.h"
+#include "../../msg_hash.h"
+
+struct check_core_state
+{
+   uint32_t frame;
+   uint32_t acc;
+};
+
+static runloop_state_t         check_runloop;
+static video_driver_state_t    check_video;
+static audio_driver_state_t    check_audio;
+static settings_t              check_settings;
+
+static struct check_core_state check_core;
+static retro_input_poll_t      check_poll_cb;
+static retro_input_state_t     check_state_cb;
+static int16_t                 check_input;
+static unsigned                check_failures;
+
+/* The core */
+
+static void check_core_step(struct check_core_state *s, int16_t input)
+{
+   s->frame++;
+   s->acc = s->acc * 31 + (uint32_t)input + s->frame;
+}
+
+static void check_core_run(void)
+{
+   int16_t input;
+   check_poll_cb();
+   input = check_state_cb(0, RETRO_DEVICE_JOYPAD, 0,
+         RETRO_DEVICE_ID_JOYPAD_B);
+   check_core_step(&check_core, input);
+}
+
+static void check_core_reset(void)
+{
+   memset(&check_core, 0, sizeof(check_core));
+}
+
+static size_t check_core_serialize_size(void)
+{
+   return sizeof(check_core);
+}
+
+static bool check_core_serialize(void *data, size_t len)
+{
+   if (len < sizeof(check_core))
+      return false;
+   memcpy(data, &check_core, sizeof(check_core));
+   return true;
+}
+
+static bool check_core_unserialize(const void *data, size_t len)
+{
+   if (len < sizeof(check_core))
+      return false;
+   memcpy(&check_core, data, sizeof(check_core));
+   return true;
+}
+
+static void check_core_set_input_poll(retro_input_poll_t cb)
+{
+   check_poll_cb = cb;
+}
+
+static void check_core_set_input_state(retro_input_state_t cb)
+{
+   check_state_cb = cb;
+}
+
+static void check_input_poll(void) { }
+
+static int16_t check_input_state(unsigned port, unsigned device,
+      unsigned idx, unsigned id)
+{
+   return check_input;
+}
+
+/* What the frontend would otherwise provide */
+
+runloop_state_t *runloop_state_get_ptr(void) { return &check_runloop; }
+video_driver_state_t *video_state_get_ptr(void) { return &check_video; }
+audio_driver_state_t *audio_state_get_ptr(void) { return &check_audio; }
+settings_t *config_get_ptr(void) { return &check_settings; }
+bool core_info_current_supports_runahead(void) { return true; }
+const char *msg_hash_to_str(enum msg_hash_enums msg) { return ""; }
+void retro_input_poll_null(void) { }
+void input_driver_poll(void) { }
+
+int16_t input_driver_state_wrapper(unsigned port, unsigned device,
+      unsigned idx, unsigned id)
+{
+   return check_input;
+}
+
+void runloop_msg_queue_push(const char *msg, size_t len,
+      unsigned prio, unsigned duration, bool flush,
+      char *title, enum message_queue_icon icon,
+      enum message_queue_category category) { }
+
+void RARCH_LOG(const char *fmt, ...) { }
+void RARCH_WARN(const char *fmt, ...) { }
+
+void RARCH_ERR(const char *fmt, ...)
+{
+   va_list ap;
+   va_start(ap, fmt);
+   vfprintf(stderr, fmt, ap);
+   va_end(ap);
+}
+
+void core_run(void)
+{
+   check_runloop.current_core.retro_run();
+}
+
+bool core_serialize_special(retro_ctx_serialize_info_t *info)
+{
+   return check_runloop.current_core.retro_serialize(info->data, info->size);
+}
+
+bool core_unserialize_special(retro_ctx_serialize_info_t *info)
+{
+   return check_runloop.current_core.retro_unserialize(
+         info->data_const, info->size);
+}
+
+size_t core_serialize_size_special(void)
+{
+   return check_runloop.current_core.retro_serialize_size();
+}
+
+/* The checks */
+
+static void check_init(void)
+{
+   struct retro_core_t *core = &check_runloop.current_core;
+
+   core->retro_run              = check_core_run;
+   core->retro_reset            = check_core_reset;
+   core->retro_serialize_size   = check_core_serialize_size;
+   core->retro_serialize        = check_core_serialize;
+   core->retro_unserialize      = check_core_unserialize;
+   core->retro_set_input_poll   = check_core_set_input_poll;
+   core->retro_set_input_state  = check_core_set_input_state;
+
+   check_runloop.retro_ctx.poll_cb  = check_input_poll;
+   check_runloop.retro_ctx.state_cb = check_input_state;
+   core->retro_set_input_poll(check_input_poll);
+   core->retro_set_input_state(check_input_state);
+
+   check_video.flags |= VIDEO_FLAG_ACTIVE;
+   runahead_clear_variables(&check_runloop);
+}
+
+/* Runs a frame and compares the core with @ref run without run-ahead */
+static void check_frame(const char *what, int frames,
+      struct check_core_state *ref)
+{
+   check_video.frame_count++;
+   runahead_run(&check_runloop, frames, true, false);
+   check_core_step(ref, check_input);
+
+   if (     check_core.frame != ref->frame
+         || check_core.acc   != ref->acc)
+   {
+      fprintf(stderr, "%s, %d frames: at frame %u, expected frame %u\n",
+            what, frames, (unsigned)check_core.frame,
+            (unsigned)ref->frame);
+      check_failures++;
+      *ref = check_core;
+   }
+}
+
+/* Plays, then changes the core's state with @change and runs a frame
+ * with the input of the frame before */
+static void check_change(const char *what, int frames,
+      void (*change)(struct check_core_state *ref, bool hooked),
+      bool hooked)
+{
+   int i;
+   char name[64];
+   struct check_core_state ref;
+
+   check_core_reset();
+   ref = check_core;
+   check_input = 0;
+
+   for (i = 0; i < 20; i++)
+   {
+      /* Changing input, then a run of the same one */
+      if (i < 8)
+         check_input = (int16_t)(i & 1);
+      check_frame("play", frames, &ref);
+   }
+
+   snprintf(name, sizeof(name), "%s%s", what,
+         hooked ? "" : " past the hooks");
+   change(&ref, hooked);
+   check_frame(name, frames, &ref);
+
+   for (i = 0; i < 4; i++)
+      check_frame(name, frames, &ref);
+}
+
+static void check_load(struct check_core_state *ref, bool hooked)
+{
+   struct check_core_state state;
+
+   memset(&state, 0, sizeof(state));
+   state.frame = 5;
+   state.acc   = 12345;
+
+   /* What core_unserialize() does */
+   if (hooked)
+      check_runloop.current_core.retro_unserialize(&state, sizeof(state));
+   else
+      check_core = state;
+   runahead_reset_buffer(&check_runloop);
+   *ref = state;
+}
+
+static void check_reset(struct check_core_state *ref, bool hooked)
+{
+   /* What CMD_EVENT_RESET does */
+   if (hooked)
+      check_runloop.current_core.retro_reset();
+   else
+      check_core_reset();
+   runahead_reset_buffer(&check_runloop);
+   memset(ref, 0, sizeof(*ref));
+}
+
+int main(void)
+{
+   int frames;
+
+   check_init();
+
+   for (frames = 1; frames <= 4; frames++)
+   {
+      check_change("load state", frames, check_load, true);
+      check_change("load state", frames, check_load, false);
+      check_change("reset", frames, check_reset, true);
+      check_change("reset", frames, check_reset, false);
+   }
+
+   if (check_failures)
+   {
+      fprintf(stderr, "%u frame(s) ended on the wrong state\n",
+            check_failures);
+      return 1;
+   }
+
+   printf("All frames ended on the real frame's state.\n");
+   return 0;
+}